@@ -1,3 +1,85 @@
+// Precision of the kernels run by TomoGANSession, picked at build time. By default tensors
+// and weights are float. -DTOMOGAN_FP16 stores them as half, read with vload_half and
+// written with vstore_half (core OpenCL, no extension needed) and computed in float;
+// -DTOMOGAN_FP16_ACC on top of it also multiplies and accumulates the convolutions in half,
+// which needs cl_khr_fp16. data_t is the element type of tensors in global memory, acc_t
+// (acc8_t, acc16_t) the type the convolutions accumulate in; LOAD(p, i) reads element i of
+// p as acc_t, LOAD8 and LOAD16 read the i-th 8 or 16 elements, STORE writes an acc_t and
+// STORE8 the i-th 8 elements.
+// LOADF and STOREF always read and write a float, for the Winograd, pooling, upsampling
+// and concatenation kernels which compute in float whatever the storage.
+#if defined(TOMOGAN_FP16_ACC)
+#pragma OPENCL EXTENSION cl_khr_fp16 : enable
+typedef half    data_t;
+typedef half    acc_t;
+typedef half8   acc8_t;
+typedef half16  acc16_t;
+#define LOAD(p, i)      ((p)[i])
+#define LOAD8(p, i)     vload8((i), (p))
+#define LOAD16(p, i)    vload16((i), (p))
+#define STORE(p, i, v)  ((p)[i] = (v))
+#define STORE8(p, i, v) vstore8((v), (i), (p))
+#define LOADF(p, i)     vload_half((i), (p))
+#define STOREF(p, i, v) vstore_half((v), (i), (p))
+#elif defined(TOMOGAN_FP16)
+typedef half    data_t;
+typedef float   acc_t;
+typedef float8  acc8_t;
+typedef float16 acc16_t;
+#define LOAD(p, i)      vload_half((i), (p))
+#define LOAD8(p, i)     vload_half8((i), (p))
+#define LOAD16(p, i)    vload_half16((i), (p))
+#define STORE(p, i, v)  vstore_half((v), (i), (p))
+#define STORE8(p, i, v) vstore_half8((v), (i), (p))
+#define LOADF(p, i)     vload_half((i), (p))
+#define STOREF(p, i, v) vstore_half((v), (i), (p))
+#else
+typedef float   data_t;
+typedef float   acc_t;
+typedef float8  acc8_t;
+typedef float16 acc16_t;
+#define LOAD(p, i)      ((p)[i])
+#define LOAD8(p, i)     vload8((i), (p))
+#define LOAD16(p, i)    vload16((i), (p))
+#define STORE(p, i, v)  ((p)[i] = (v))
+#define STORE8(p, i, v) vstore8((v), (i), (p))
+#define LOADF(p, i)     ((p)[i])
+#define STOREF(p, i, v) ((p)[i] = (v))
+#endif
+
+// Layer specialization: a program built with -DSPEC_C_IN=<channels> -DSPEC_C_OUT=<filters>
+// -DSPEC_K=<filter size> -DSPEC_RELU=<0|1> serves one conv shape. The conv kernels starting
+// with SPEC_CONV_ARGS still take channel, filter_size, num_filter and relu as arguments, so
+// the host sets them the same way, but read the constants instead; the compiler can then
+// unroll the tap and channel loops, fold the index arithmetic and the padding checks of the
+// taps, and drop the dead ReLU branch. TomoGANSession builds one such program per conv
+// shape (TOMOGAN_SPECIALIZE=0 keeps the generic kernels only).
+#ifdef SPEC_C_IN
+#define SPEC_CHANNEL SPEC_C_IN
+#else
+#define SPEC_CHANNEL channel_arg
+#endif
+#ifdef SPEC_C_OUT
+#define SPEC_NUM_FILTER SPEC_C_OUT
+#else
+#define SPEC_NUM_FILTER num_filter_arg
+#endif
+#ifdef SPEC_K
+#define SPEC_FILTER_SIZE SPEC_K
+#else
+#define SPEC_FILTER_SIZE filter_size_arg
+#endif
+#ifdef SPEC_RELU
+#define SPEC_RELU_FLAG SPEC_RELU
+#else
+#define SPEC_RELU_FLAG relu_arg
+#endif
+#define SPEC_CONV_ARGS \
+    const unsigned int channel     = SPEC_CHANNEL; \
+    const unsigned int filter_size = SPEC_FILTER_SIZE; \
+    const unsigned int num_filter  = SPEC_NUM_FILTER; \
+    const char relu                = SPEC_RELU_FLAG;
+
 // HWC; stride = 1; padding = same; square filter
 // naive implementation using global memory
 __kernel void conv2d_naive(__global float *input,
@@ -75,147 +157,648 @@ __kernel void conv2d_vec16(__global float16 *input,
 }
 
 // this can achive at least linear scale time to the number of kernels
-__kernel void conv2d_vec16_mk(__global float16 *input,
-                     const unsigned int height,
+// the *_mk kernels and the pooling/upsample/concat kernels below take a batch of NHWC
+// slices along the 3rd dimension of the NDRange, 2D launches process a single slice.
+// conv2d_vec16_mk, conv2d_vec8_mk and conv2d_mk compute kf_block filters per work item,
+// the 3rd dimension is n_slices * ceil(num_filter / kf_block) with the filter block fastest;
+// kf_block = num_filter is one work item per pixel
+// Zero padding is not tested tap by tap: a pixel's window is clipped to the taps
+// [kr_st, kr_ed) x [kc_st, kc_ed) inside the image, which is the whole window for interior
+// pixels, and the conv2d_*_taps helpers sum those taps without any test. Interior pixels
+// call them with the full window, constant bounds under SPEC_K, border pixels with the
+// clipped one; the skipped taps added zeros, so the sums are unchanged.
+// conv2d_*_taps: one filter (filter points to its weights) at the pixel whose window starts
+// at row0, col0
+acc16_t conv2d_vec16_taps(__global const data_t *input,
+                          const unsigned int width,
+                          const unsigned int channls_to_16,
+                          __global const data_t *filter,
+                          const unsigned int filter_size,
+                          const int row0, const int col0,
+                          const int kr_st, const int kr_ed, const int kc_st, const int kc_ed){
+    acc16_t conv_res = (acc16_t)(0.0);
+    for(int krow = kr_st; krow < kr_ed; krow++)
+        for(int kcol = kc_st; kcol < kc_ed; kcol++)
+            for(unsigned int batch = 0; batch < channls_to_16; batch++){
+                conv_res += LOAD16(input, width * channls_to_16 * (row0 + krow) + channls_to_16 * (col0 + kcol) + batch) * \
+                            LOAD16(filter, filter_size * channls_to_16 * krow + channls_to_16 * kcol + batch);
+    }
+    return conv_res;
+}
+
+acc8_t conv2d_vec8_taps(__global const data_t *input,
+                        const unsigned int width,
+                        const unsigned int channls_to_8,
+                        __constant data_t *filter,
+                        const unsigned int filter_size,
+                        const int row0, const int col0,
+                        const int kr_st, const int kr_ed, const int kc_st, const int kc_ed){
+    acc8_t conv_res = (acc8_t)(0.0);
+    for(int krow = kr_st; krow < kr_ed; krow++)
+        for(int kcol = kc_st; kcol < kc_ed; kcol++)
+            for(unsigned int batch = 0; batch < channls_to_8; batch++){
+                conv_res += LOAD8(input, width * channls_to_8 * (row0 + krow) + channls_to_8 * (col0 + kcol) + batch) * \
+                            LOAD8(filter, filter_size * channls_to_8 * krow + channls_to_8 * kcol + batch);
+    }
+    return conv_res;
+}
+
+acc_t conv2d_mk_taps(__global const data_t *input,
                      const unsigned int width,
                      const unsigned int channel,
-                     __global float16 *filter_values,
+                     __constant data_t *filter,
                      const unsigned int filter_size,
-                     const unsigned int num_filter,
-                     __global float *output_buf,
-                     const char relu){
+                     const int row0, const int col0,
+                     const int kr_st, const int kr_ed, const int kc_st, const int kc_ed){
+    acc_t conv_res = 0.0;
+    for(int krow = kr_st; krow < kr_ed; krow++)
+        for(int kcol = kc_st; kcol < kc_ed; kcol++)
+            for(unsigned int batch = 0; batch < channel; batch++){
+                conv_res += LOAD(input, width * channel * (row0 + krow) + channel * (col0 + kcol) + batch) * \
+                            LOAD(filter, filter_size * channel * krow + channel * kcol + batch);
+    }
+    return conv_res;
+}
+
+__kernel void conv2d_vec16_mk(__global const data_t *input,
+                     const unsigned int height,
+                     const unsigned int width,
+                     const unsigned int channel_arg,
+                     __global const data_t *filter_values,
+                     const unsigned int filter_size_arg,
+                     const unsigned int num_filter_arg,
+                     __global data_t *output_buf,
+                     const char relu_arg,
+                     const unsigned int kf_block){
+    SPEC_CONV_ARGS
     int row = get_global_id(0);
     int col = get_global_id(1);
+    const unsigned int kf_blocks = (num_filter + kf_block - 1) / kf_block;
+    const int n = get_global_id(2) / kf_blocks; // slice index in the batch
+    const unsigned int kf0 = get_global_id(2) % kf_blocks * kf_block;
+    const unsigned int kf_end = min(num_filter, kf0 + kf_block);
     if(row >= height || col >= width){
         return;
     }
-    const unsigned int half_filter_size = filter_size/2;
-    const unsigned int gr2l_off = row - half_filter_size;
-    const unsigned int gc2l_off = col - half_filter_size;
+    input      += (size_t)n * height * width * channel;
+    output_buf += (size_t)n * height * width * num_filter;
+    const int row0 = row - (int)filter_size / 2;
+    const int col0 = col - (int)filter_size / 2;
+    // taps inside the image, see conv2d_vec16_taps
+    const int kr_st = max(0, -row0), kr_ed = min((int)filter_size, (int)height - row0);
+    const int kc_st = max(0, -col0), kc_ed = min((int)filter_size, (int)width - col0);
+    const bool interior = kr_st == 0 && kc_st == 0 && kr_ed == (int)filter_size && kc_ed == (int)filter_size;
     const unsigned int channls_to_16 = channel / 16;
 
-    int in_g_row, in_g_col;
-    const unsigned int filter_value_size_to_16 = filter_size * filter_size * channls_to_16;
-    for(unsigned int kf = 0; kf < num_filter; kf++){
-        float16 conv_res = (float16)(0.0);
-        for(unsigned int krow = 0; krow < filter_size; krow++)
-            for(unsigned int kcol = 0; kcol < filter_size; kcol++){
-                in_g_row = gr2l_off + krow;
-                in_g_col = gc2l_off + kcol;
-                if(in_g_row >= height || in_g_col >= width || in_g_row < 0 || in_g_col < 0){
-                    continue;
-                }
-                for(unsigned int batch = 0; batch < channls_to_16; batch++){
-                    conv_res += input[width * channls_to_16 * in_g_row + channls_to_16 * in_g_col + batch] * \
-                                filter_values[kf * filter_value_size_to_16 + \
-                                                filter_size * channls_to_16 * krow + \
-                                                channls_to_16 * kcol + batch];
-                }
-        }
-        float pixel_conv = \
+    const unsigned int filter_value_size = filter_size * filter_size * channel;
+    for(unsigned int kf = kf0; kf < kf_end; kf++){
+        __global const data_t *filter = filter_values + (size_t)kf * filter_value_size;
+        acc16_t conv_res = interior ? \
+            conv2d_vec16_taps(input, width, channls_to_16, filter, filter_size, row0, col0, 0, filter_size, 0, filter_size) : \
+            conv2d_vec16_taps(input, width, channls_to_16, filter, filter_size, row0, col0, kr_st, kr_ed, kc_st, kc_ed);
+        acc_t pixel_conv = \
             conv_res.s0 + conv_res.s1 + conv_res.s2 + conv_res.s3 + \
             conv_res.s4 + conv_res.s5 + conv_res.s6 + conv_res.s7 +\
             conv_res.s8 + conv_res.s9 + conv_res.sa + conv_res.sb +\
             conv_res.sc + conv_res.sd + conv_res.se + conv_res.sf;
         if(relu != 0){
-            output_buf[num_filter * width * row + num_filter * col + kf] = fmax((float)0.0, pixel_conv);
+            STORE(output_buf, num_filter * width * row + num_filter * col + kf, fmax((acc_t)0.0, pixel_conv));
         } 
         else{
-            output_buf[num_filter * width * row + num_filter * col + kf] = pixel_conv;
+            STORE(output_buf, num_filter * width * row + num_filter * col + kf, pixel_conv);
         }
     }
 }
 
-__kernel void conv2d_vec8_mk(__global float8 *input,
+__kernel void conv2d_vec8_mk(__global const data_t *input,
                      const unsigned int height,
                      const unsigned int width,
-                     const unsigned int channel,
-                     __constant float8 *filter_values,
-                     const unsigned int filter_size,
-                     const unsigned int num_filter,
-                     __global float *output_buf,
-                     const char relu){
+                     const unsigned int channel_arg,
+                     __constant data_t *filter_values,
+                     const unsigned int filter_size_arg,
+                     const unsigned int num_filter_arg,
+                     __global data_t *output_buf,
+                     const char relu_arg,
+                     const unsigned int kf_block){
+    SPEC_CONV_ARGS
     int row = get_global_id(0);
     int col = get_global_id(1);
+    const unsigned int kf_blocks = (num_filter + kf_block - 1) / kf_block;
+    const int n = get_global_id(2) / kf_blocks; // slice index in the batch
+    const unsigned int kf0 = get_global_id(2) % kf_blocks * kf_block;
+    const unsigned int kf_end = min(num_filter, kf0 + kf_block);
     if(row >= height || col >= width){
         return;
     }
-    const unsigned int half_filter_size = filter_size/2;
-    const unsigned int gr2l_off = row - half_filter_size;
-    const unsigned int gc2l_off = col - half_filter_size;
+    input      += (size_t)n * height * width * channel;
+    output_buf += (size_t)n * height * width * num_filter;
+    const int row0 = row - (int)filter_size / 2;
+    const int col0 = col - (int)filter_size / 2;
+    // taps inside the image, see conv2d_vec16_taps
+    const int kr_st = max(0, -row0), kr_ed = min((int)filter_size, (int)height - row0);
+    const int kc_st = max(0, -col0), kc_ed = min((int)filter_size, (int)width - col0);
+    const bool interior = kr_st == 0 && kc_st == 0 && kr_ed == (int)filter_size && kc_ed == (int)filter_size;
     const unsigned int channls_to_8 = channel / 8;
 
-    int in_g_row, in_g_col;
-    const unsigned int filter_value_size_to_8 = filter_size * filter_size * channls_to_8;
-    for(unsigned int kf = 0; kf < num_filter; kf++){
-        float8 conv_res = (float8)(0.0);
-        for(unsigned int krow = 0; krow < filter_size; krow++)
-            for(unsigned int kcol = 0; kcol < filter_size; kcol++){
-                in_g_row = gr2l_off + krow;
-                in_g_col = gc2l_off + kcol;
-                if(in_g_row >= height || in_g_col >= width || in_g_row < 0 || in_g_col < 0){
-                    continue;
-                }
-                for(unsigned int batch = 0; batch < channls_to_8; batch++){
-                    conv_res += input[width * channls_to_8 * in_g_row + channls_to_8 * in_g_col + batch] * \
-                                filter_values[kf * filter_value_size_to_8 + \
-                                                filter_size * channls_to_8 * krow + \
-                                                channls_to_8 * kcol + batch];
-                }
-        }
-        float pixel_conv = \
+    const unsigned int filter_value_size = filter_size * filter_size * channel;
+    for(unsigned int kf = kf0; kf < kf_end; kf++){
+        __constant data_t *filter = filter_values + (size_t)kf * filter_value_size;
+        acc8_t conv_res = interior ? \
+            conv2d_vec8_taps(input, width, channls_to_8, filter, filter_size, row0, col0, 0, filter_size, 0, filter_size) : \
+            conv2d_vec8_taps(input, width, channls_to_8, filter, filter_size, row0, col0, kr_st, kr_ed, kc_st, kc_ed);
+        acc_t pixel_conv = \
             conv_res.s0 + conv_res.s1 + conv_res.s2 + conv_res.s3 + \
             conv_res.s4 + conv_res.s5 + conv_res.s6 + conv_res.s7;
         if(relu != 0){
-            output_buf[num_filter * width * row + num_filter * col + kf] = fmax((float)0.0, pixel_conv);
+            STORE(output_buf, num_filter * width * row + num_filter * col + kf, fmax((acc_t)0.0, pixel_conv));
         } 
         else{
-            output_buf[num_filter * width * row + num_filter * col + kf] = pixel_conv;
+            STORE(output_buf, num_filter * width * row + num_filter * col + kf, pixel_conv);
         }
     }
 }
 
-__kernel void conv2d_mk(__global float *input,
+__kernel void conv2d_mk(__global const data_t *input,
+                     const unsigned int height,
+                     const unsigned int width,
+                     const unsigned int channel_arg,
+                     __constant data_t *filter_values,
+                     const unsigned int filter_size_arg,
+                     const unsigned int num_filter_arg,
+                     __global data_t *output_buf,
+                     const char relu_arg,
+                     const unsigned int kf_block){
+    SPEC_CONV_ARGS
+    int row = get_global_id(0);
+    int col = get_global_id(1);
+    const unsigned int kf_blocks = (num_filter + kf_block - 1) / kf_block;
+    const int n = get_global_id(2) / kf_blocks; // slice index in the batch
+    const unsigned int kf0 = get_global_id(2) % kf_blocks * kf_block;
+    const unsigned int kf_end = min(num_filter, kf0 + kf_block);
+    if(row >= height || col >= width){
+        return;
+    }
+    input      += (size_t)n * height * width * channel;
+    output_buf += (size_t)n * height * width * num_filter;
+    const int row0 = row - (int)filter_size / 2;
+    const int col0 = col - (int)filter_size / 2;
+    // taps inside the image, see conv2d_vec16_taps
+    const int kr_st = max(0, -row0), kr_ed = min((int)filter_size, (int)height - row0);
+    const int kc_st = max(0, -col0), kc_ed = min((int)filter_size, (int)width - col0);
+    const bool interior = kr_st == 0 && kc_st == 0 && kr_ed == (int)filter_size && kc_ed == (int)filter_size;
+
+    const unsigned int filter_value_size = filter_size * filter_size * channel;
+    for(unsigned int kf = kf0; kf < kf_end; kf++){
+        __constant data_t *filter = filter_values + (size_t)kf * filter_value_size;
+        acc_t conv_res = interior ? \
+            conv2d_mk_taps(input, width, channel, filter, filter_size, row0, col0, 0, filter_size, 0, filter_size) : \
+            conv2d_mk_taps(input, width, channel, filter, filter_size, row0, col0, kr_st, kr_ed, kc_st, kc_ed);
+        if(relu != 0){
+            STORE(output_buf, num_filter * width * row + num_filter * col + kf, fmax((acc_t)0.0, conv_res));
+        } 
+        else{
+            STORE(output_buf, num_filter * width * row + num_filter * col + kf, conv_res);
+        }
+    }
+}
+
+// HWC; stride = 1; padding = same; square filter of size 1 or 3; any channel/filter count
+// A LCONV_TILE x LCONV_TILE work group stages its input tile plus a 1 pixel halo in local
+// memory, LCONV_CH_CHUNK channels at a time, together with the matching weights of
+// LCONV_KF_BLOCK filters. Each work item keeps those LCONV_KF_BLOCK outputs in registers,
+// so every input pixel is read from global memory once per block of filters instead of
+// once per filter. The 3rd NDRange dimension is n_slices * ceil(num_filter / LCONV_KF_BLOCK),
+// filter block fastest. The defaults can be overridden with -D at build time.
+#ifndef LCONV_TILE
+#define LCONV_TILE 16
+#endif
+#ifndef LCONV_CH_CHUNK
+#define LCONV_CH_CHUNK 8
+#endif
+#ifndef LCONV_KF_BLOCK
+#define LCONV_KF_BLOCK 8
+#endif
+#define LCONV_HALO_TILE (LCONV_TILE + 2)
+#if LCONV_TILE % 2 != 0
+#error "LCONV_TILE must be even so that 2x2 pooling windows do not straddle work groups"
+#endif
+// conv_res[k] = conv of filter kf0 + k at this work item's pixel, shared by the conv2d_local_*
+// kernels which own the local buffers. The channel input channels are the skip_channel of
+// input followed by those of low_input, (height / 2) x (width / 2) and read with nearest
+// neighbour indexing, i.e. the concatenation of input and upsampled low_input; plain
+// convolutions pass skip_channel = channel and low_input is never read.
+void conv2d_local_accumulate(__global const data_t *input,
+                             __global const data_t *low_input,
+                             const unsigned int height,
+                             const unsigned int width,
+                             const unsigned int channel,
+                             const unsigned int skip_channel,
+                             __global const data_t *filter_values,
+                             const unsigned int filter_size,
+                             const unsigned int num_filter,
+                             const unsigned int kf0,
+                             __local acc_t *input_local,
+                             __local acc_t *filter_local,
+                             acc_t *conv_res){
+    const int lrow = get_local_id(0);
+    const int lcol = get_local_id(1);
+    const int lid = lrow * LCONV_TILE + lcol;
+    const int half_filter_size = filter_size / 2;
+    const int taps = filter_size * filter_size;
+    const int tile_row0 = get_group_id(0) * LCONV_TILE - 1;
+    const int tile_col0 = get_group_id(1) * LCONV_TILE - 1;
+    const unsigned int low_channel = channel - skip_channel;
+    const unsigned int low_width = width / 2;
+
+    for(int k = 0; k < LCONV_KF_BLOCK; k++){
+        conv_res[k] = 0.0f;
+    }
+    for(unsigned int ch0 = 0; ch0 < channel; ch0 += LCONV_CH_CHUNK){
+        // input tile with halo, zero outside the image and past the last channel
+        for(int i = lid; i < LCONV_HALO_TILE * LCONV_HALO_TILE * LCONV_CH_CHUNK; i += LCONV_TILE * LCONV_TILE){
+            int c  = i % LCONV_CH_CHUNK;
+            int px = i / LCONV_CH_CHUNK;
+            int in_g_row = tile_row0 + px / LCONV_HALO_TILE;
+            int in_g_col = tile_col0 + px % LCONV_HALO_TILE;
+            acc_t value = 0.0f;
+            if(in_g_row >= 0 && in_g_row < height && in_g_col >= 0 && in_g_col < width && ch0 + c < channel){
+                if(ch0 + c < skip_channel){
+                    value = LOAD(input, ((size_t)width * in_g_row + in_g_col) * skip_channel + ch0 + c);
+                }else{
+                    value = LOAD(low_input, ((size_t)low_width * (in_g_row / 2) + in_g_col / 2) * low_channel + ch0 + c - skip_channel);
+                }
+            }
+            input_local[i] = value;
+        }
+        // weights of this chunk for the filter block, [filter][tap][channel]
+        for(int i = lid; i < LCONV_KF_BLOCK * 9 * LCONV_CH_CHUNK; i += LCONV_TILE * LCONV_TILE){
+            int c   = i % LCONV_CH_CHUNK;
+            int tap = i / LCONV_CH_CHUNK % 9;
+            int k   = i / (LCONV_CH_CHUNK * 9);
+            acc_t value = 0.0f;
+            if(kf0 + k < num_filter && ch0 + c < channel && tap < taps){
+                value = LOAD(filter_values, (size_t)(kf0 + k) * taps * channel + tap * channel + ch0 + c);
+            }
+            filter_local[i] = value;
+        }
+        barrier(CLK_LOCAL_MEM_FENCE);
+
+        for(int tap = 0; tap < taps; tap++){
+            int lrow_in = lrow + 1 - half_filter_size + tap / filter_size;
+            int lcol_in = lcol + 1 - half_filter_size + tap % filter_size;
+            __local const acc_t *in_px = input_local + (LCONV_HALO_TILE * lrow_in + lcol_in) * LCONV_CH_CHUNK;
+            __local const acc_t *f_tap = filter_local + tap * LCONV_CH_CHUNK;
+            for(int c = 0; c < LCONV_CH_CHUNK; c++){
+                acc_t value = in_px[c];
+                for(int k = 0; k < LCONV_KF_BLOCK; k++){
+                    conv_res[k] += value * f_tap[k * 9 * LCONV_CH_CHUNK + c];
+                }
+            }
+        }
+        barrier(CLK_LOCAL_MEM_FENCE);
+    }
+}
+
+__kernel __attribute__((reqd_work_group_size(LCONV_TILE, LCONV_TILE, 1)))
+void conv2d_local_mk(__global const data_t *input,
+                     const unsigned int height,
+                     const unsigned int width,
+                     const unsigned int channel_arg,
+                     __global const data_t *filter_values,
+                     const unsigned int filter_size_arg,
+                     const unsigned int num_filter_arg,
+                     __global data_t *output_buf,
+                     const char relu_arg){
+    SPEC_CONV_ARGS
+    __local acc_t input_local[LCONV_HALO_TILE * LCONV_HALO_TILE * LCONV_CH_CHUNK];
+    __local acc_t filter_local[LCONV_KF_BLOCK * 9 * LCONV_CH_CHUNK];
+    const int row  = get_global_id(0);
+    const int col  = get_global_id(1);
+    const unsigned int kf_blocks = (num_filter + LCONV_KF_BLOCK - 1) / LCONV_KF_BLOCK;
+    const unsigned int n   = get_global_id(2) / kf_blocks; // slice index in the batch
+    const unsigned int kf0 = get_global_id(2) % kf_blocks * LCONV_KF_BLOCK;
+    input      += (size_t)n * height * width * channel;
+    output_buf += (size_t)n * height * width * num_filter;
+
+    acc_t conv_res[LCONV_KF_BLOCK];
+    conv2d_local_accumulate(input, input, height, width, channel, channel, filter_values, filter_size, num_filter, kf0, \
+                            input_local, filter_local, conv_res);
+
+    // every work item had to take part in the barriers, the ones past the image stop here
+    if(row >= height || col >= width){
+        return;
+    }
+    __global data_t *out_px = output_buf + ((size_t)width * row + col) * num_filter + kf0;
+    for(int k = 0; k < LCONV_KF_BLOCK && kf0 + k < num_filter; k++){
+        STORE(out_px, k, (relu != 0) ? fmax((acc_t)0.0f, conv_res[k]) : conv_res[k]);
+    }
+}
+
+// conv2d_local_mk that also writes the 2x2 max pooling of its (ReLU) output to pool_buf,
+// (height / 2) x (width / 2) x num_filter, for the encoder blocks whose output feeds both the
+// skip connection and the next level; height and width must be even. The work group's
+// outputs go through input_local, which is free after the last barrier of the convolution,
+// so the full resolution tensor is not read back by a separate maxpooling2d launch.
+__kernel __attribute__((reqd_work_group_size(LCONV_TILE, LCONV_TILE, 1)))
+void conv2d_local_pool_mk(__global const data_t *input,
+                          const unsigned int height,
+                          const unsigned int width,
+                          const unsigned int channel_arg,
+                          __global const data_t *filter_values,
+                          const unsigned int filter_size_arg,
+                          const unsigned int num_filter_arg,
+                          __global data_t *output_buf,
+                          const char relu_arg,
+                          __global data_t *pool_buf){
+    SPEC_CONV_ARGS
+    __local acc_t input_local[LCONV_HALO_TILE * LCONV_HALO_TILE * LCONV_CH_CHUNK];
+    __local acc_t filter_local[LCONV_KF_BLOCK * 9 * LCONV_CH_CHUNK];
+    const int lrow = get_local_id(0);
+    const int lcol = get_local_id(1);
+    const int row  = get_global_id(0);
+    const int col  = get_global_id(1);
+    const unsigned int kf_blocks = (num_filter + LCONV_KF_BLOCK - 1) / LCONV_KF_BLOCK;
+    const unsigned int n   = get_global_id(2) / kf_blocks; // slice index in the batch
+    const unsigned int kf0 = get_global_id(2) % kf_blocks * LCONV_KF_BLOCK;
+    const unsigned int pool_height = height / 2;
+    const unsigned int pool_width  = width / 2;
+    input      += (size_t)n * height * width * channel;
+    output_buf += (size_t)n * height * width * num_filter;
+    pool_buf   += (size_t)n * pool_height * pool_width * num_filter;
+
+    acc_t conv_res[LCONV_KF_BLOCK];
+    conv2d_local_accumulate(input, input, height, width, channel, channel, filter_values, filter_size, num_filter, kf0, \
+                            input_local, filter_local, conv_res);
+
+    // [LCONV_TILE][LCONV_TILE][LCONV_KF_BLOCK] outputs of the work group
+    __local acc_t *out_local = input_local + (lrow * LCONV_TILE + lcol) * LCONV_KF_BLOCK;
+    for(int k = 0; k < LCONV_KF_BLOCK; k++){
+        out_local[k] = (relu != 0) ? fmax((acc_t)0.0f, conv_res[k]) : conv_res[k];
+    }
+    if(row < height && col < width){
+        __global data_t *out_px = output_buf + ((size_t)width * row + col) * num_filter + kf0;
+        for(int k = 0; k < LCONV_KF_BLOCK && kf0 + k < num_filter; k++){
+            STORE(out_px, k, out_local[k]);
+        }
+    }
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    // all work items share the (LCONV_TILE / 2)^2 x LCONV_KF_BLOCK pooled values
+    const int lid = lrow * LCONV_TILE + lcol;
+    for(int i = lid; i < LCONV_TILE * LCONV_TILE / 4 * LCONV_KF_BLOCK; i += LCONV_TILE * LCONV_TILE){
+        int k    = i % LCONV_KF_BLOCK;
+        int prow = i / LCONV_KF_BLOCK / (LCONV_TILE / 2);
+        int pcol = i / LCONV_KF_BLOCK % (LCONV_TILE / 2);
+        unsigned int pool_row = get_group_id(0) * (LCONV_TILE / 2) + prow;
+        unsigned int pool_col = get_group_id(1) * (LCONV_TILE / 2) + pcol;
+        if(pool_row >= pool_height || pool_col >= pool_width || kf0 + k >= num_filter){
+            continue;
+        }
+        __local const acc_t *win = input_local + (2 * prow * LCONV_TILE + 2 * pcol) * LCONV_KF_BLOCK + k;
+        acc_t pixel = fmax(fmax(win[0], win[LCONV_KF_BLOCK]), \
+                           fmax(win[LCONV_TILE * LCONV_KF_BLOCK], win[(LCONV_TILE + 1) * LCONV_KF_BLOCK]));
+        STORE(pool_buf, ((size_t)pool_width * pool_row + pool_col) * num_filter + kf0 + k, pixel);
+    }
+}
+
+// conv2d_local_mk on the concatenation of input (height x width x skip_channel) and the 2x
+// nearest neighbour upsampling of low_input ((height / 2) x (width / 2) x (channel - skip_channel)),
+// for the decoder blocks: neither the upsampled nor the concatenated tensor is materialized.
+// The first 9 arguments are those of conv2d_local_mk with channel the concatenated count.
+__kernel __attribute__((reqd_work_group_size(LCONV_TILE, LCONV_TILE, 1)))
+void conv2d_local_upcat_mk(__global const data_t *input,
+                           const unsigned int height,
+                           const unsigned int width,
+                           const unsigned int channel_arg,
+                           __global const data_t *filter_values,
+                           const unsigned int filter_size_arg,
+                           const unsigned int num_filter_arg,
+                           __global data_t *output_buf,
+                           const char relu_arg,
+                           __global const data_t *low_input,
+                           const unsigned int skip_channel){
+    SPEC_CONV_ARGS
+    __local acc_t input_local[LCONV_HALO_TILE * LCONV_HALO_TILE * LCONV_CH_CHUNK];
+    __local acc_t filter_local[LCONV_KF_BLOCK * 9 * LCONV_CH_CHUNK];
+    const int row  = get_global_id(0);
+    const int col  = get_global_id(1);
+    const unsigned int kf_blocks = (num_filter + LCONV_KF_BLOCK - 1) / LCONV_KF_BLOCK;
+    const unsigned int n   = get_global_id(2) / kf_blocks; // slice index in the batch
+    const unsigned int kf0 = get_global_id(2) % kf_blocks * LCONV_KF_BLOCK;
+    input      += (size_t)n * height * width * skip_channel;
+    low_input  += (size_t)n * (height / 2) * (width / 2) * (channel - skip_channel);
+    output_buf += (size_t)n * height * width * num_filter;
+
+    acc_t conv_res[LCONV_KF_BLOCK];
+    conv2d_local_accumulate(input, low_input, height, width, channel, skip_channel, filter_values, filter_size, num_filter, \
+                            kf0, input_local, filter_local, conv_res);
+
+    if(row >= height || col >= width){
+        return;
+    }
+    __global data_t *out_px = output_buf + ((size_t)width * row + col) * num_filter + kf0;
+    for(int k = 0; k < LCONV_KF_BLOCK && kf0 + k < num_filter; k++){
+        STORE(out_px, k, (relu != 0) ? fmax((acc_t)0.0f, conv_res[k]) : conv_res[k]);
+    }
+}
+
+// HWC; stride = 1; padding = same; 3x3 filter; Winograd F(2x2, 3x3)
+// Each work item computes a 2x2 output tile for WINO_KF_BLOCK filters: per channel the 4x4
+// input tile d is transformed to V = B^T d B, multiplied elementwise with the filters
+// transformed on the host, U = G g G^T stored as [16][channel][num_filter], and the 16
+// products are summed over channels before Y = A^T M A. That is 16 instead of 36
+// multiplies per output pixel and channel. Rows and columns of the NDRange are tiles,
+// the 3rd dimension is n_slices * ceil(num_filter / WINO_KF_BLOCK), filter block fastest.
+// filter_size is always 3, it keeps the arguments of the other conv2d kernels.
+#ifndef WINO_KF_BLOCK
+#define WINO_KF_BLOCK 4
+#endif
+__kernel void conv2d_winograd_f2(__global const data_t *input,
                      const unsigned int height,
                      const unsigned int width,
                      const unsigned int channel,
-                     __constant float *filter_values,
+                     __global const data_t *filter_values,
                      const unsigned int filter_size,
                      const unsigned int num_filter,
-                     __global float *output_buf,
+                     __global data_t *output_buf,
                      const char relu){
-    int row = get_global_id(0);
-    int col = get_global_id(1);
+    const int row = get_global_id(0) * 2;
+    const int col = get_global_id(1) * 2;
+    const unsigned int kf_blocks = (num_filter + WINO_KF_BLOCK - 1) / WINO_KF_BLOCK;
+    const unsigned int n   = get_global_id(2) / kf_blocks; // slice index in the batch
+    const unsigned int kf0 = get_global_id(2) % kf_blocks * WINO_KF_BLOCK;
     if(row >= height || col >= width){
         return;
     }
-    const unsigned int half_filter_size = filter_size/2;
-    const unsigned int gr2l_off = row - half_filter_size;
-    const unsigned int gc2l_off = col - half_filter_size;
+    input      += (size_t)n * height * width * channel;
+    output_buf += (size_t)n * height * width * num_filter;
 
-    int in_g_row, in_g_col;
+    // offsets of the 4x4 input tile, -1 marks a row/column outside the image; tiles with no
+    // such row or column read it without testing every element
+    const bool interior = row >= 1 && row + 3 <= height && col >= 1 && col + 3 <= width;
+    int in_off_row[4], in_off_col[4];
+    for(int i = 0; i < 4; i++){
+        int in_g_row = row - 1 + i;
+        int in_g_col = col - 1 + i;
+        in_off_row[i] = (in_g_row >= 0 && in_g_row < height) ? in_g_row * width : -1;
+        in_off_col[i] = (in_g_col >= 0 && in_g_col < width)  ? in_g_col : -1;
+    }
+
+    float M[WINO_KF_BLOCK][16];
+    for(int k = 0; k < WINO_KF_BLOCK; k++)
+        for(int e = 0; e < 16; e++){
+            M[k][e] = 0.0f;
+    }
+    for(unsigned int c = 0; c < channel; c++){
+        float d[4][4];
+        if(interior){
+            for(int i = 0; i < 4; i++)
+                for(int j = 0; j < 4; j++){
+                    d[i][j] = LOADF(input, (size_t)(in_off_row[i] + in_off_col[j]) * channel + c);
+            }
+        }else{
+            for(int i = 0; i < 4; i++)
+                for(int j = 0; j < 4; j++){
+                    d[i][j] = (in_off_row[i] >= 0 && in_off_col[j] >= 0) ? \
+                              LOADF(input, (size_t)(in_off_row[i] + in_off_col[j]) * channel + c) : 0.0f;
+            }
+        }
+        // B^T d
+        float t[4][4];
+        for(int j = 0; j < 4; j++){
+            t[0][j] = d[0][j] - d[2][j];
+            t[1][j] = d[1][j] + d[2][j];
+            t[2][j] = d[2][j] - d[1][j];
+            t[3][j] = d[1][j] - d[3][j];
+        }
+        // (B^T d) B
+        float V[16];
+        for(int i = 0; i < 4; i++){
+            V[i * 4 + 0] = t[i][0] - t[i][2];
+            V[i * 4 + 1] = t[i][1] + t[i][2];
+            V[i * 4 + 2] = t[i][2] - t[i][1];
+            V[i * 4 + 3] = t[i][1] - t[i][3];
+        }
+        __global const data_t *U = filter_values + (size_t)c * num_filter + kf0;
+        for(int e = 0; e < 16; e++){
+            __global const data_t *U_e = U + (size_t)e * channel * num_filter;
+            for(int k = 0; k < WINO_KF_BLOCK; k++){
+                M[k][e] += V[e] * ((kf0 + k < num_filter) ? LOADF(U_e, k) : 0.0f);
+            }
+        }
+    }
+
+    for(int k = 0; k < WINO_KF_BLOCK && kf0 + k < num_filter; k++){
+        // A^T M A
+        float s[2][4];
+        for(int j = 0; j < 4; j++){
+            s[0][j] = M[k][j] + M[k][4 + j] + M[k][8 + j];
+            s[1][j] = M[k][4 + j] - M[k][8 + j] - M[k][12 + j];
+        }
+        for(int i = 0; i < 2 && row + i < height; i++){
+            float y[2];
+            y[0] = s[i][0] + s[i][1] + s[i][2];
+            y[1] = s[i][1] - s[i][2] - s[i][3];
+            for(int j = 0; j < 2 && col + j < width; j++){
+                STOREF(output_buf, ((size_t)width * (row + i) + col + j) * num_filter + kf0 + k, (relu != 0) ? fmax(0.0f, y[j]) : y[j]);
+            }
+        }
+    }
+}
+
+// HWC; stride = 1; padding = same; square filter
+// INT8 convolution on tensors quantized by quantize.hpp: uint8 input with zero point in_zero,
+// int8 weights [filters][rows][cols][channels]. The sums are exact int32 and requantized as in
+// conv_int8.hpp, so the output matches conv2d_int8_cpu bit for bit: taps outside the image
+// read in_zero, zero_comp[kf] removes in_zero times the sum of the weights of filter kf, and
+// out_mult[kf] scales to the output, uint8 clamped to [relu ? out_zero : 0, 255] with zero
+// point out_zero, or float when float_out != 0 (output_buf then holds floats). With channel a
+// multiple of 4, 4 channels are read as one uint and multiplied with dot4_us, the packed dot
+// product of cl_khr_integer_dot_product / OpenCL 3.0 when the device has it. A work item
+// computes INT8_KF_BLOCK filters of one pixel, the 3rd NDRange dimension is
+// n_slices * ceil(num_filter / INT8_KF_BLOCK), filter block fastest.
+#ifndef INT8_KF_BLOCK
+#define INT8_KF_BLOCK 8
+#endif
+#if defined(__opencl_c_integer_dot_product_input_4x8bit_packed)
+#define dot4_us(a, b) dot_4x8packed_us_int((a), (b))
+#else
+// 4 uint8 of a times 4 int8 of b, byte by byte
+int dot4_us(uint a, uint b){
+    return (int)(a & 0xffu) * (int)(char)(b & 0xffu) + (int)((a >> 8) & 0xffu) * (int)(char)((b >> 8) & 0xffu) + \
+           (int)((a >> 16) & 0xffu) * (int)(char)((b >> 16) & 0xffu) + (int)(a >> 24) * (int)(char)(b >> 24);
+}
+#endif
+__kernel void conv2d_int8_mk(__global const uchar *input,
+                     const unsigned int height,
+                     const unsigned int width,
+                     const unsigned int channel,
+                     __global const char *filter_values,
+                     const unsigned int filter_size,
+                     const unsigned int num_filter,
+                     __global uchar *output_buf,
+                     const char relu,
+                     __global const int *zero_comp,
+                     __global const float *out_mult,
+                     const int in_zero,
+                     const int out_zero,
+                     const char float_out){
+    const int row = get_global_id(0);
+    const int col = get_global_id(1);
+    const unsigned int kf_blocks = (num_filter + INT8_KF_BLOCK - 1) / INT8_KF_BLOCK;
+    const unsigned int n   = get_global_id(2) / kf_blocks; // slice index in the batch
+    const unsigned int kf0 = get_global_id(2) % kf_blocks * INT8_KF_BLOCK;
+    if(row >= height || col >= width){
+        return;
+    }
+    input += (size_t)n * height * width * channel;
+    const int half_filter_size = filter_size / 2;
     const unsigned int filter_value_size = filter_size * filter_size * channel;
-    for(unsigned int kf = 0; kf < num_filter; kf++){
-        float conv_res = 0.0;
-        for(unsigned int krow = 0; krow < filter_size; krow++)
-            for(unsigned int kcol = 0; kcol < filter_size; kcol++){
-                in_g_row = gr2l_off + krow;
-                in_g_col = gc2l_off + kcol;
-                if(in_g_row >= height || in_g_col >= width || in_g_row < 0 || in_g_col < 0){
-                    continue;
+    // the zero point 4 times, for taps outside the image
+    const uint zero4 = (uint)in_zero * 0x01010101u;
+
+    int acc[INT8_KF_BLOCK];
+    for(int k = 0; k < INT8_KF_BLOCK; k++){
+        acc[k] = 0;
+    }
+    for(unsigned int krow = 0; krow < filter_size; krow++)
+        for(unsigned int kcol = 0; kcol < filter_size; kcol++){
+            const int in_g_row = row - half_filter_size + (int)krow;
+            const int in_g_col = col - half_filter_size + (int)kcol;
+            const bool inside = in_g_row >= 0 && in_g_col >= 0 && in_g_row < height && in_g_col < width;
+            const size_t in_off = inside ? ((size_t)width * in_g_row + in_g_col) * channel : 0;
+            const unsigned int w_off = (krow * filter_size + kcol) * channel;
+            if(channel % 4 == 0){
+                for(unsigned int c = 0; c < channel; c += 4){
+                    const uint a = inside ? ((__global const uint *)(input + in_off))[c / 4] : zero4;
+                    for(int k = 0; k < INT8_KF_BLOCK; k++){
+                        if(kf0 + k < num_filter){
+                            acc[k] += dot4_us(a, ((__global const uint *)(filter_values + \
+                                              (size_t)(kf0 + k) * filter_value_size + w_off))[c / 4]);
+                        }
+                    }
                 }
-                for(unsigned int batch = 0; batch < channel; batch++){
-                    conv_res += input[width * channel * in_g_row + channel * in_g_col + batch] * \
-                                filter_values[kf * filter_value_size + \
-                                                filter_size * channel * krow + \
-                                                channel * kcol + batch];
+            }else{
+                for(unsigned int c = 0; c < channel; c++){
+                    const int a = inside ? input[in_off + c] : in_zero;
+                    for(int k = 0; k < INT8_KF_BLOCK; k++){
+                        if(kf0 + k < num_filter){
+                            acc[k] += a * filter_values[(size_t)(kf0 + k) * filter_value_size + w_off + c];
+                        }
+                    }
                 }
-        }
-        if(relu != 0){
-            output_buf[num_filter * width * row + num_filter * col + kf] = fmax((float)0.0, conv_res);
-        } 
-        else{
-            output_buf[num_filter * width * row + num_filter * col + kf] = conv_res;
+            }
+    }
+
+    const size_t out_px = ((size_t)n * height * width + (size_t)width * row + col) * num_filter;
+    // clamp then round to nearest even, as int8_requantize
+    const float lo = (float)((relu != 0 ? out_zero : 0) - out_zero), hi = (float)(255 - out_zero);
+    for(int k = 0; k < INT8_KF_BLOCK && kf0 + k < num_filter; k++){
+        const float value = (float)(acc[k] - zero_comp[kf0 + k]) * out_mult[kf0 + k];
+        if(float_out != 0){
+            ((__global float *)output_buf)[out_px + kf0 + k] = value;
+        }else{
+            output_buf[out_px + kf0 + k] = (uchar)(convert_int_rte(clamp(value, lo, hi)) + out_zero);
         }
     }
 }
@@ -336,79 +919,89 @@ __kernel void conv2d_vec16_local(__global float16 *input,
 }
 
 
-__kernel void upsample2d(__global float   *input,
+__kernel void upsample2d(__global data_t  *input,
                         const unsigned int height,
                         const unsigned int width,
                         const unsigned int channel,
-                        __global float    *output){
+                        __global data_t   *output){
 
     int row = get_global_id(0);
     int col = get_global_id(1);   
+    int n   = get_global_id(2); // slice index in the batch
     if(row >= height || col >= width){
         return;
     }
+    input  += (size_t)n * height * width * channel;
+    output += (size_t)n * 4 * height * width * channel;
     unsigned int urow = 2 * row;
     unsigned int ucol = 2 * col;
     unsigned int uwidth = 2 * width;
     unsigned int uheight= 2 * height;
     for(unsigned int ch = 0; ch < channel; ch++){
-        float pixel = input[width * row * channel + col * channel + ch];
-        output[uwidth * urow      * channel + ucol      * channel + ch] = pixel;  // [urow][ucol][ch] 
-        output[uwidth * (urow+1)  * channel + ucol      * channel + ch] = pixel;  // [urow+1][ucol][ch] 
-        output[uwidth * urow      * channel + (ucol+1)  * channel + ch] = pixel;  // [urow][ucol+1][ch]
-        output[uwidth * (urow+1)  * channel + (ucol+1)  * channel + ch] = pixel;  // [urow+1][ucol+1][ch]
+        float pixel = LOADF(input, width * row * channel + col * channel + ch);
+        STOREF(output, uwidth * urow      * channel + ucol      * channel + ch, pixel);  // [urow][ucol][ch] 
+        STOREF(output, uwidth * (urow+1)  * channel + ucol      * channel + ch, pixel);  // [urow+1][ucol][ch] 
+        STOREF(output, uwidth * urow      * channel + (ucol+1)  * channel + ch, pixel);  // [urow][ucol+1][ch]
+        STOREF(output, uwidth * (urow+1)  * channel + (ucol+1)  * channel + ch, pixel);  // [urow+1][ucol+1][ch]
     }
 }
 
-__kernel void maxpooling2d(__global float   *input,
+__kernel void maxpooling2d(__global data_t  *input,
                            const unsigned int height,
                            const unsigned int width,
                            const unsigned int channel,
-                           __global float    *output){
+                           __global data_t   *output){
 
     int row = get_global_id(0);
     int col = get_global_id(1);
+    int n   = get_global_id(2); // slice index in the batch
     if(row >= height || col >= width){
         return;
     }
+    input  += (size_t)n * 4 * height * width * channel;
+    output += (size_t)n * height * width * channel;
     unsigned int urow = 2 * row;
     unsigned int ucol = 2 * col;
     unsigned int uwidth = 2 * width;
     unsigned int uheight= 2 * height;
     for(unsigned int ch = 0; ch < channel; ch++){
-        float pixel =       input[uwidth * urow     * channel + ucol     * channel + ch];  // [urow][ucol][ch] 
-        pixel = fmax(pixel, input[uwidth * (urow+1) * channel + ucol     * channel + ch]); // [urow+1][ucol][ch] 
-        pixel = fmax(pixel, input[uwidth * urow     * channel + (ucol+1) * channel + ch]); // [urow][ucol+1][ch] 
-        pixel = fmax(pixel, input[uwidth * (urow+1) * channel + (ucol+1) * channel + ch]); // [urow+1][ucol+1][ch]
-        output[width * row * channel + col * channel + ch] = pixel;
+        float pixel =       LOADF(input, uwidth * urow     * channel + ucol     * channel + ch);  // [urow][ucol][ch] 
+        pixel = fmax(pixel, LOADF(input, uwidth * (urow+1) * channel + ucol     * channel + ch)); // [urow+1][ucol][ch] 
+        pixel = fmax(pixel, LOADF(input, uwidth * urow     * channel + (ucol+1) * channel + ch)); // [urow][ucol+1][ch] 
+        pixel = fmax(pixel, LOADF(input, uwidth * (urow+1) * channel + (ucol+1) * channel + ch)); // [urow+1][ucol+1][ch]
+        STOREF(output, width * row * channel + col * channel + ch, pixel);
     }
 }
 
 // only support last axis cat
-__kernel void concatenate(__global float   *input1,
-                          __global float   *input2,
+__kernel void concatenate(__global data_t  *input1,
+                          __global data_t  *input2,
                            const unsigned int height,
                            const unsigned int width,
                            const unsigned int channel1,
                            const unsigned int channel2,
-                           __global float    *output){
+                           __global data_t   *output){
 
     int row = get_global_id(0);
     int col = get_global_id(1);
+    int n   = get_global_id(2); // slice index in the batch
     if(row >= height || col >= width){
         return;
     }
+    input1 += (size_t)n * height * width * channel1;
+    input2 += (size_t)n * height * width * channel2;
+    output += (size_t)n * height * width * (channel1 + channel2);
 
     size_t output_channel = channel1 + channel2;
     unsigned out_base_idx = width * output_channel * row + output_channel * col;
     unsigned in_base_idx  = width * channel1 * row + channel1 * col;
     for(unsigned int ch = 0; ch < channel1; ch++){
-        output[out_base_idx + ch] = input1[in_base_idx + ch];
+        STOREF(output, out_base_idx + ch, LOADF(input1, in_base_idx + ch));
     }
 
     in_base_idx = width * channel2 * row + channel2 * col;
     for(unsigned int ch = 0; ch < channel2; ch++){
-        output[out_base_idx + channel1 + ch] = input2[in_base_idx + ch];
+        STOREF(output, out_base_idx + channel1 + ch, LOADF(input2, in_base_idx + ch));
     }
 }
 
@@ -423,9 +1016,13 @@ __kernel void concatenate_vec16(__global float16   *input1,
 
     int row = get_global_id(0);
     int col = get_global_id(1);
+    int n   = get_global_id(2); // slice index in the batch
     if(row >= height || col >= width){
         return;
     }
+    input1 += (size_t)n * height * width * (channel1 / 16);
+    input2 += (size_t)n * height * width * (channel2 / 16);
+    output += (size_t)n * height * width * ((channel1 + channel2) / 16);
     size_t ch1_vec = channel1 / 16;
     size_t ch2_vec = channel2 / 16;
     size_t cho_vec = ch1_vec + ch2_vec;
@@ -439,4 +1036,208 @@ __kernel void concatenate_vec16(__global float16   *input1,
     for(unsigned int ch = 0; ch < ch2_vec; ch++){
         output[out_base_idx + ch1_vec + ch] = input2[in_base_idx + ch];
     }
-}
\ No newline at end of file
+}
+// NCHWc8: channel-blocked tensors [n][ceil(channel / 8)][height][width][8], the channels of the
+// last block past `channel` are zero. The 8 channels of a pixel are one LOAD8/STORE8 and the
+// column is the 1st NDRange dimension, so neighbouring work items read and write neighbouring
+// 32 (or 16 in half) byte vectors: stores coalesce on GPUs, and CPU devices vectorize over the
+// block, whatever the channel count. The 3rd NDRange dimension is n_slices * blocks, block
+// fastest. hwc_to_nchwc8 and nchwc8_to_hwc convert at the boundary of the network, conv
+// weights are prepacked on the host (layout.hpp).
+#define NCHWC_BLOCK 8
+
+// index of the 8-vector of pixel (row, col) in block b of slice n
+size_t nchwc8_index(unsigned int n, unsigned int blocks, unsigned int b, unsigned int height, unsigned int width, \
+                    int row, int col){
+    return (((size_t)n * blocks + b) * height + row) * width + col;
+}
+
+__kernel void hwc_to_nchwc8(__global const data_t *input,
+                            const unsigned int height,
+                            const unsigned int width,
+                            const unsigned int channel,
+                            __global data_t *output){
+    const int col = get_global_id(0);
+    const int row = get_global_id(1);
+    const unsigned int blocks = (channel + NCHWC_BLOCK - 1) / NCHWC_BLOCK;
+    const unsigned int n = get_global_id(2) / blocks; // slice index in the batch
+    const unsigned int b = get_global_id(2) % blocks;
+    if(row >= height || col >= width){
+        return;
+    }
+    __global const data_t *in_px = input + (((size_t)n * height + row) * width + col) * channel + b * NCHWC_BLOCK;
+    acc_t lane[NCHWC_BLOCK];
+    for(unsigned int k = 0; k < NCHWC_BLOCK; k++){
+        lane[k] = (b * NCHWC_BLOCK + k < channel) ? LOAD(in_px, k) : (acc_t)0.0;
+    }
+    STORE8(output, nchwc8_index(n, blocks, b, height, width, row, col), \
+           (acc8_t)(lane[0], lane[1], lane[2], lane[3], lane[4], lane[5], lane[6], lane[7]));
+}
+
+__kernel void nchwc8_to_hwc(__global const data_t *input,
+                            const unsigned int height,
+                            const unsigned int width,
+                            const unsigned int channel,
+                            __global data_t *output){
+    const int col = get_global_id(0);
+    const int row = get_global_id(1);
+    const unsigned int blocks = (channel + NCHWC_BLOCK - 1) / NCHWC_BLOCK;
+    const unsigned int n = get_global_id(2) / blocks; // slice index in the batch
+    const unsigned int b = get_global_id(2) % blocks;
+    if(row >= height || col >= width){
+        return;
+    }
+    __global data_t *out_px = output + (((size_t)n * height + row) * width + col) * channel + b * NCHWC_BLOCK;
+    acc_t lane[NCHWC_BLOCK];
+    vstore8(LOAD8(input, nchwc8_index(n, blocks, b, height, width, row, col)), 0, lane);
+    for(unsigned int k = 0; k < NCHWC_BLOCK && b * NCHWC_BLOCK + k < channel; k++){
+        STORE(out_px, k, lane[k]);
+    }
+}
+
+// HWC convolution semantics (stride = 1; padding = same; square filter) on NCHWc8 tensors,
+// any channel and filter count. A work item computes the 8 filters of one output block for
+// one pixel; filter_values are [filter block][channel block][rows][cols][8 channels][8 filters]
+// so the 8 filters of one input channel are one LOAD8. Zero padding is handled as in
+// conv2d_vec16_mk, conv2d_nchwc8_taps adds the taps [kr_st, kr_ed) x [kc_st, kc_ed) of
+// one channel block to acc without testing them.
+acc8_t conv2d_nchwc8_taps(acc8_t acc,
+                          __global const data_t *input,
+                          const unsigned int width,
+                          __global const data_t *filter_values,
+                          const unsigned int filter_size,
+                          const int row0, const int col0,
+                          const int kr_st, const int kr_ed, const int kc_st, const int kc_ed){
+    for(int krow = kr_st; krow < kr_ed; krow++)
+        for(int kcol = kc_st; kcol < kc_ed; kcol++){
+            const acc8_t x = LOAD8(input, (size_t)(row0 + krow) * width + col0 + kcol);
+            // in units of 8 filters
+            const size_t w = (krow * filter_size + kcol) * NCHWC_BLOCK;
+            acc += x.s0 * LOAD8(filter_values, w)     + x.s1 * LOAD8(filter_values, w + 1) + \
+                   x.s2 * LOAD8(filter_values, w + 2) + x.s3 * LOAD8(filter_values, w + 3) + \
+                   x.s4 * LOAD8(filter_values, w + 4) + x.s5 * LOAD8(filter_values, w + 5) + \
+                   x.s6 * LOAD8(filter_values, w + 6) + x.s7 * LOAD8(filter_values, w + 7);
+    }
+    return acc;
+}
+
+__kernel void conv2d_nchwc8(__global const data_t *input,
+                            const unsigned int height,
+                            const unsigned int width,
+                            const unsigned int channel_arg,
+                            __global const data_t *filter_values,
+                            const unsigned int filter_size_arg,
+                            const unsigned int num_filter_arg,
+                            __global data_t *output_buf,
+                            const char relu_arg){
+    SPEC_CONV_ARGS
+    const int col = get_global_id(0);
+    const int row = get_global_id(1);
+    const unsigned int in_blocks  = (channel + NCHWC_BLOCK - 1) / NCHWC_BLOCK;
+    const unsigned int out_blocks = (num_filter + NCHWC_BLOCK - 1) / NCHWC_BLOCK;
+    const unsigned int n  = get_global_id(2) / out_blocks; // slice index in the batch
+    const unsigned int fb = get_global_id(2) % out_blocks;
+    if(row >= height || col >= width){
+        return;
+    }
+    const int row0 = row - (int)filter_size / 2;
+    const int col0 = col - (int)filter_size / 2;
+    const int kr_st = max(0, -row0), kr_ed = min((int)filter_size, (int)height - row0);
+    const int kc_st = max(0, -col0), kc_ed = min((int)filter_size, (int)width - col0);
+    const bool interior = kr_st == 0 && kc_st == 0 && kr_ed == (int)filter_size && kc_ed == (int)filter_size;
+    input         += (size_t)n * in_blocks * height * width * NCHWC_BLOCK;
+    filter_values += (size_t)fb * in_blocks * filter_size * filter_size * NCHWC_BLOCK * NCHWC_BLOCK;
+
+    acc8_t acc = (acc8_t)(0.0);
+    for(unsigned int cb = 0; cb < in_blocks; cb++){
+        __global const data_t *in_block = input + (size_t)cb * height * width * NCHWC_BLOCK;
+        __global const data_t *w_block  = filter_values + (size_t)cb * filter_size * filter_size * NCHWC_BLOCK * NCHWC_BLOCK;
+        acc = interior ? \
+            conv2d_nchwc8_taps(acc, in_block, width, w_block, filter_size, row0, col0, 0, filter_size, 0, filter_size) : \
+            conv2d_nchwc8_taps(acc, in_block, width, w_block, filter_size, row0, col0, kr_st, kr_ed, kc_st, kc_ed);
+    }
+    if(relu != 0){
+        acc = fmax(acc, (acc8_t)(0.0));
+    }
+    STORE8(output_buf, nchwc8_index(n, out_blocks, fb, height, width, row, col), acc);
+}
+
+// height x width is the output, as maxpooling2d
+__kernel void maxpooling2d_nchwc8(__global const data_t *input,
+                                  const unsigned int height,
+                                  const unsigned int width,
+                                  const unsigned int channel,
+                                  __global data_t *output){
+    const int col = get_global_id(0);
+    const int row = get_global_id(1);
+    const unsigned int blocks = (channel + NCHWC_BLOCK - 1) / NCHWC_BLOCK;
+    const unsigned int n = get_global_id(2) / blocks; // slice index in the batch
+    const unsigned int b = get_global_id(2) % blocks;
+    if(row >= height || col >= width){
+        return;
+    }
+    const size_t in_idx = nchwc8_index(n, blocks, b, 2 * height, 2 * width, 2 * row, 2 * col);
+    acc8_t pixel = fmax(LOAD8(input, in_idx),             LOAD8(input, in_idx + 1));
+    pixel = fmax(pixel, fmax(LOAD8(input, in_idx + 2 * width), LOAD8(input, in_idx + 2 * width + 1)));
+    STORE8(output, nchwc8_index(n, blocks, b, height, width, row, col), pixel);
+}
+
+// height x width is the input, as upsample2d
+__kernel void upsample2d_nchwc8(__global const data_t *input,
+                                const unsigned int height,
+                                const unsigned int width,
+                                const unsigned int channel,
+                                __global data_t *output){
+    const int col = get_global_id(0);
+    const int row = get_global_id(1);
+    const unsigned int blocks = (channel + NCHWC_BLOCK - 1) / NCHWC_BLOCK;
+    const unsigned int n = get_global_id(2) / blocks; // slice index in the batch
+    const unsigned int b = get_global_id(2) % blocks;
+    if(row >= height || col >= width){
+        return;
+    }
+    const acc8_t pixel = LOAD8(input, nchwc8_index(n, blocks, b, height, width, row, col));
+    const size_t out_idx = nchwc8_index(n, blocks, b, 2 * height, 2 * width, 2 * row, 2 * col);
+    STORE8(output, out_idx,                 pixel);
+    STORE8(output, out_idx + 1,             pixel);
+    STORE8(output, out_idx + 2 * width,     pixel);
+    STORE8(output, out_idx + 2 * width + 1, pixel);
+}
+
+// channel concatenation; with channel1 a multiple of 8 every output block is a block of one
+// input, else the blocks of input2 are shifted lane by lane
+__kernel void concatenate_nchwc8(__global const data_t *input1,
+                                 __global const data_t *input2,
+                                 const unsigned int height,
+                                 const unsigned int width,
+                                 const unsigned int channel1,
+                                 const unsigned int channel2,
+                                 __global data_t *output){
+    const int col = get_global_id(0);
+    const int row = get_global_id(1);
+    const unsigned int blocks1 = (channel1 + NCHWC_BLOCK - 1) / NCHWC_BLOCK;
+    const unsigned int blocks2 = (channel2 + NCHWC_BLOCK - 1) / NCHWC_BLOCK;
+    const unsigned int blocks  = (channel1 + channel2 + NCHWC_BLOCK - 1) / NCHWC_BLOCK;
+    const unsigned int n = get_global_id(2) / blocks; // slice index in the batch
+    const unsigned int b = get_global_id(2) % blocks;
+    if(row >= height || col >= width){
+        return;
+    }
+    acc8_t pixel;
+    if(channel1 % NCHWC_BLOCK == 0){
+        pixel = (b < blocks1) ? LOAD8(input1, nchwc8_index(n, blocks1, b, height, width, row, col)) : \
+                                LOAD8(input2, nchwc8_index(n, blocks2, b - blocks1, height, width, row, col));
+    }else{
+        acc_t lane[NCHWC_BLOCK];
+        for(unsigned int k = 0; k < NCHWC_BLOCK; k++){
+            const unsigned int c = b * NCHWC_BLOCK + k, c2 = c - channel1;
+            lane[k] = (c < channel1) ? \
+                LOAD(input1, nchwc8_index(n, blocks1, c / NCHWC_BLOCK, height, width, row, col) * NCHWC_BLOCK + c % NCHWC_BLOCK) : \
+                (c2 < channel2) ? \
+                LOAD(input2, nchwc8_index(n, blocks2, c2 / NCHWC_BLOCK, height, width, row, col) * NCHWC_BLOCK + c2 % NCHWC_BLOCK) : \
+                (acc_t)0.0;
+        }
+        pixel = (acc8_t)(lane[0], lane[1], lane[2], lane[3], lane[4], lane[5], lane[6], lane[7]);
+    }
+    STORE8(output, nchwc8_index(n, blocks, b, height, width, row, col), pixel);
+}
@@ -0,0 +1,194 @@
+#ifndef TOMOGAN_CONV_GEMM_HPP
+#define TOMOGAN_CONV_GEMM_HPP
+
+#include <vector>
+#include <cstring>
+#include <algorithm>
+
+#if defined(__AVX512F__) || defined(__AVX2__)
+    #include <immintrin.h>
+#endif
+
+#include "utils.hpp"
+
+// Convolution as GEMM for the CPU engine: with HWC tensors and filters stored as
+// [num_filter][fs][fs][channel] = [C_out][K], the output [H*W][C_out] is the product of the
+// im2col matrix [H*W][K] with the transposed filters [K][C_out]. The filters are packed once
+// into GEMM_NR wide column panels; blocks of GEMM_MC pixels are unrolled into GEMM_MR row
+// strips, GEMM_KC taps x channels at a time so the strip stays in L1/L2, and multiplied by
+// a register-blocked micro-kernel. The instruction set is chosen at compile time
+// (-march=native picks AVX-512 or AVX2+FMA), a scalar kernel covers the rest.
+#if defined(__AVX512F__)
+    #define GEMM_MR 12
+    #define GEMM_ISA "AVX-512"
+#elif defined(__AVX2__) && defined(__FMA__)
+    #define GEMM_MR 6
+    #define GEMM_ISA "AVX2"
+#else
+    #define GEMM_MR 4
+    #define GEMM_ISA "scalar"
+#endif
+#define GEMM_NR 16
+#define GEMM_KC 256
+#define GEMM_MC (GEMM_MR * 16)
+
+// filters [num_filter][K] repacked as ceil(num_filter / GEMM_NR) panels of [K][GEMM_NR],
+// columns past num_filter are zero
+struct gemm_packed_filters{
+    unsigned int k_size;
+    unsigned int num_filter;
+    unsigned int n_panels;
+    std::vector<float> values;
+};
+
+gemm_packed_filters gemm_pack_filters(const float *filter_values, unsigned int k_size, unsigned int num_filter){
+    gemm_packed_filters packed;
+    packed.k_size = k_size;
+    packed.num_filter = num_filter;
+    packed.n_panels = (num_filter + GEMM_NR - 1) / GEMM_NR;
+    packed.values.assign((size_t)packed.n_panels * k_size * GEMM_NR, 0.0f);
+    for(unsigned int kf = 0; kf < num_filter; kf++){
+        float *panel = packed.values.data() + (size_t)(kf / GEMM_NR) * k_size * GEMM_NR + kf % GEMM_NR;
+        for(unsigned int k = 0; k < k_size; k++){
+            panel[(size_t)k * GEMM_NR] = filter_values[(size_t)kf * k_size + k];
+        }
+    }
+    return packed;
+}
+
+// c[GEMM_MR][GEMM_NR] (row stride ldc) += a[kc][GEMM_MR] * b[kc][GEMM_NR]
+void gemm_micro_kernel(unsigned int kc, const float *a, const float *b, float *c, unsigned int ldc){
+#if defined(__AVX512F__)
+    __m512 acc[GEMM_MR];
+    for(int i = 0; i < GEMM_MR; i++){
+        acc[i] = _mm512_loadu_ps(c + (size_t)ldc * i);
+    }
+    for(unsigned int k = 0; k < kc; k++){
+        __m512 b_row = _mm512_loadu_ps(b + (size_t)GEMM_NR * k);
+        const float *a_col = a + (size_t)GEMM_MR * k;
+        for(int i = 0; i < GEMM_MR; i++){
+            acc[i] = _mm512_fmadd_ps(_mm512_set1_ps(a_col[i]), b_row, acc[i]);
+        }
+    }
+    for(int i = 0; i < GEMM_MR; i++){
+        _mm512_storeu_ps(c + (size_t)ldc * i, acc[i]);
+    }
+#elif defined(__AVX2__) && defined(__FMA__)
+    __m256 acc_lo[GEMM_MR], acc_hi[GEMM_MR];
+    for(int i = 0; i < GEMM_MR; i++){
+        acc_lo[i] = _mm256_loadu_ps(c + (size_t)ldc * i);
+        acc_hi[i] = _mm256_loadu_ps(c + (size_t)ldc * i + 8);
+    }
+    for(unsigned int k = 0; k < kc; k++){
+        __m256 b_lo = _mm256_loadu_ps(b + (size_t)GEMM_NR * k);
+        __m256 b_hi = _mm256_loadu_ps(b + (size_t)GEMM_NR * k + 8);
+        const float *a_col = a + (size_t)GEMM_MR * k;
+        for(int i = 0; i < GEMM_MR; i++){
+            __m256 a_i = _mm256_broadcast_ss(a_col + i);
+            acc_lo[i] = _mm256_fmadd_ps(a_i, b_lo, acc_lo[i]);
+            acc_hi[i] = _mm256_fmadd_ps(a_i, b_hi, acc_hi[i]);
+        }
+    }
+    for(int i = 0; i < GEMM_MR; i++){
+        _mm256_storeu_ps(c + (size_t)ldc * i,     acc_lo[i]);
+        _mm256_storeu_ps(c + (size_t)ldc * i + 8, acc_hi[i]);
+    }
+#else
+    float acc[GEMM_MR][GEMM_NR];
+    for(int i = 0; i < GEMM_MR; i++)
+        for(int j = 0; j < GEMM_NR; j++){
+            acc[i][j] = c[(size_t)ldc * i + j];
+    }
+    for(unsigned int k = 0; k < kc; k++)
+        for(int i = 0; i < GEMM_MR; i++)
+            for(int j = 0; j < GEMM_NR; j++){
+                acc[i][j] += a[(size_t)GEMM_MR * k + i] * b[(size_t)GEMM_NR * k + j];
+    }
+    for(int i = 0; i < GEMM_MR; i++)
+        for(int j = 0; j < GEMM_NR; j++){
+            c[(size_t)ldc * i + j] = acc[i][j];
+    }
+#endif
+}
+
+// im2col of GEMM_MR pixels starting at flat pixel index px0 for K indexes [k0, k0 + kc),
+// written k-major as a[kc][GEMM_MR]; pixels past the image and taps outside it are zero
+void gemm_pack_patches(const float *input, unsigned int height, unsigned int width, unsigned int channel,
+                       unsigned int filter_size, size_t px0, unsigned int k0, unsigned int kc, float *a){
+    const int half_filter_size = filter_size / 2;
+    const size_t n_pixels = (size_t)height * width;
+    for(int i = 0; i < GEMM_MR; i++){
+        size_t px = px0 + i;
+        int row = px / width, col = px % width;
+        unsigned int k = k0;
+        while(k < k0 + kc){
+            // one tap at a time, its channels are contiguous in both input and filters
+            unsigned int tap = k / channel, ch0 = k % channel;
+            unsigned int ch_ed = std::min(channel, ch0 + (k0 + kc - k));
+            int in_g_row = row - half_filter_size + (int)(tap / filter_size);
+            int in_g_col = col - half_filter_size + (int)(tap % filter_size);
+            float *a_k = a + (size_t)GEMM_MR * (k - k0) + i;
+            if(px >= n_pixels || in_g_row < 0 || in_g_col < 0 || in_g_row >= (int)height || in_g_col >= (int)width){
+                for(unsigned int ch = ch0; ch < ch_ed; ch++){
+                    a_k[(size_t)GEMM_MR * (ch - ch0)] = 0.0f;
+                }
+            }else{
+                const float *in_px = input + ((size_t)width * in_g_row + in_g_col) * channel;
+                for(unsigned int ch = ch0; ch < ch_ed; ch++){
+                    a_k[(size_t)GEMM_MR * (ch - ch0)] = in_px[ch];
+                }
+            }
+            k += ch_ed - ch0;
+        }
+    }
+}
+
+// HWC; stride = 1; padding = same; square filter, same interface as conv2d_cpu but with
+// filters prepacked by gemm_pack_filters
+void conv2d_gemm_cpu(const float *input,
+                     const unsigned int height,
+                     const unsigned int width,
+                     const unsigned int channel,
+                     const gemm_packed_filters &filters,
+                     const unsigned int filter_size,
+                     float *output,
+                     const unsigned char relu){
+    const unsigned int k_size = filters.k_size;
+    const unsigned int num_filter = filters.num_filter;
+    const unsigned int ldc = filters.n_panels * GEMM_NR;
+    const size_t n_pixels = (size_t)height * width;
+    const unsigned int n_blocks = (n_pixels + GEMM_MC - 1) / GEMM_MC;
+    parallel_rows(n_blocks, [&](unsigned int blk_st, unsigned int blk_ed){
+        std::vector<float> a_buf((size_t)GEMM_MC * GEMM_KC);
+        std::vector<float> c_buf((size_t)GEMM_MC * ldc);
+        for(unsigned int blk = blk_st; blk < blk_ed; blk++){
+            size_t px0 = (size_t)blk * GEMM_MC;
+            unsigned int n_strips = (std::min((size_t)GEMM_MC, n_pixels - px0) + GEMM_MR - 1) / GEMM_MR;
+            std::fill(c_buf.begin(), c_buf.end(), 0.0f);
+            for(unsigned int k0 = 0; k0 < k_size; k0 += GEMM_KC){
+                unsigned int kc = std::min(GEMM_KC, (int)(k_size - k0));
+                for(unsigned int s = 0; s < n_strips; s++){
+                    gemm_pack_patches(input, height, width, channel, filter_size, px0 + s * GEMM_MR, k0, kc, \
+                                      a_buf.data() + (size_t)s * GEMM_MR * GEMM_KC);
+                }
+                for(unsigned int p = 0; p < filters.n_panels; p++){
+                    const float *b = filters.values.data() + ((size_t)p * k_size + k0) * GEMM_NR;
+                    for(unsigned int s = 0; s < n_strips; s++){
+                        gemm_micro_kernel(kc, a_buf.data() + (size_t)s * GEMM_MR * GEMM_KC, b, \
+                                          c_buf.data() + (size_t)s * GEMM_MR * ldc + p * GEMM_NR, ldc);
+                    }
+                }
+            }
+            unsigned int n_px = std::min((size_t)GEMM_MC, n_pixels - px0);
+            for(unsigned int i = 0; i < n_px; i++){
+                const float *c_px = c_buf.data() + (size_t)i * ldc;
+                float *out_px = output + (px0 + i) * num_filter;
+                for(unsigned int kf = 0; kf < num_filter; kf++){
+                    out_px[kf] = (relu != 0) ? std::max(0.0f, c_px[kf]) : c_px[kf];
+                }
+            }
+        }
+    });
+}
+
+#endif
@@ -0,0 +1,315 @@
+#ifndef TOMOGAN_CONV_INT8_HPP
+#define TOMOGAN_CONV_INT8_HPP
+
+#include <vector>
+#include <cmath>
+#include <cstring>
+#include <cstdint>
+#include <algorithm>
+
+#if defined(__AVX512F__) || defined(__AVX2__)
+    #include <immintrin.h>
+#endif
+
+#include "utils.hpp"
+
+// INT8 convolution for the CPU engine, on tensors quantized by quantize.hpp: activations
+// are uint8 with real = scale * (q - zero), weights are int8 with one scale per filter and
+// no zero point. It is the GEMM of conv_gemm.hpp with 4 consecutive K indexes packed into
+// 32 bits: filters in INT8_NR wide panels of [K / 4][INT8_NR][4] bytes, times INT8_MR pixels
+// whose 4 channels at a time are broadcast, into exact int32 sums by
+//   AVX-512 VNNI   vpdpbusd, 4 uint8 x int8 products added to each int32 lane
+//   AVX2           vpmaddubsw + vpmaddwd, pairs added in saturating int16 first
+// or a scalar kernel. To keep the int16 pairs of vpmaddubsw from saturating, weights use
+// 7 bits (INT8_WEIGHT_MAX, 255 * 63 * 2 < 32767); every kernel, and conv2d_int8_mk of
+// conv2d.cl, then computes the same int32 sums and so the same output bits.
+// The output is requantized with the ReLU fused in: q = clamp(round((acc - comp) * mult) +
+// zero, relu ? zero : 0, 255), comp removing the input zero point, or written as float for
+// a linear output layer.
+#if defined(__AVX512VNNI__) && defined(__AVX512BW__)
+    #define INT8_MR 12
+    #define INT8_ISA "AVX-512 VNNI"
+#elif defined(__AVX2__)
+    #define INT8_MR 6
+    #define INT8_ISA "AVX2"
+#else
+    #define INT8_MR 4
+    #define INT8_ISA "scalar"
+#endif
+#define INT8_NR 16
+#define INT8_MC (INT8_MR * 16)
+#define INT8_WEIGHT_MAX 63
+
+// quantization of one conv, read from a quantized model (quantize.hpp)
+struct int8_conv_params{
+    float in_scale;
+    int in_zero;
+    // out_scale 0: the output is float, for a linear conv that is the network output
+    float out_scale;
+    int out_zero;
+    bool relu;
+    // real weight = weight_scale[kf] * q
+    std::vector<float> weight_scale;
+};
+
+struct int8_packed_filters{
+    unsigned int k_size;
+    // k_size rounded up to a multiple of 4, the padding weights are 0
+    unsigned int k_padded;
+    unsigned int num_filter;
+    unsigned int n_panels;
+    std::vector<int8_t> values;
+    // requantization per filter: in_zero * sum of the weights, and the multiplier of the
+    // int32 sum to the output scale (to real values for float output)
+    std::vector<int32_t> zero_comp;
+    std::vector<float> out_mult;
+    int in_zero;
+    int out_zero;
+    int out_min;
+    bool float_out;
+};
+
+int8_packed_filters int8_pack_filters(const int8_t *filter_values, unsigned int k_size, unsigned int num_filter, \
+                                      const int8_conv_params &params){
+    int8_packed_filters packed;
+    packed.k_size = k_size;
+    packed.k_padded = (k_size + 3) / 4 * 4;
+    packed.num_filter = num_filter;
+    packed.n_panels = (num_filter + INT8_NR - 1) / INT8_NR;
+    packed.values.assign((size_t)packed.n_panels * packed.k_padded * INT8_NR, 0);
+    packed.zero_comp.assign(num_filter, 0);
+    packed.out_mult.assign(num_filter, 0.0f);
+    packed.in_zero   = params.in_zero;
+    packed.out_zero  = params.out_zero;
+    packed.out_min   = params.relu ? params.out_zero : 0;
+    packed.float_out = params.out_scale == 0;
+    for(unsigned int kf = 0; kf < num_filter; kf++){
+        int8_t *panel = packed.values.data() + (size_t)(kf / INT8_NR) * packed.k_padded * INT8_NR;
+        int32_t sum = 0;
+        for(unsigned int k = 0; k < k_size; k++){
+            int8_t w = filter_values[(size_t)kf * k_size + k];
+            panel[((size_t)(k / 4) * INT8_NR + kf % INT8_NR) * 4 + k % 4] = w;
+            sum += w;
+        }
+        packed.zero_comp[kf] = params.in_zero * sum;
+        float mult = params.in_scale * params.weight_scale[kf];
+        packed.out_mult[kf] = packed.float_out ? mult : mult / params.out_scale;
+    }
+    return packed;
+}
+
+// c[INT8_MR][INT8_NR] (row stride ldc) += a * b[taps * k4][INT8_NR][4], where row i of a is
+// the bytes at rows[tap * INT8_MR + i] for every tap, k4 groups of 4 each. rows point either
+// straight into the input pixels of the tap (indirect convolution, no copies), or into
+// packed patches with taps = 1.
+void int8_micro_kernel(unsigned int taps, unsigned int k4, const uint8_t *const *rows, const int8_t *b,
+                       int32_t *c, unsigned int ldc){
+#if defined(__AVX512VNNI__) && defined(__AVX512BW__)
+    __m512i acc[INT8_MR];
+    for(int i = 0; i < INT8_MR; i++){
+        acc[i] = _mm512_loadu_si512(c + (size_t)ldc * i);
+    }
+    for(unsigned int tap = 0; tap < taps; tap++){
+        const uint8_t *row[INT8_MR];
+        for(int i = 0; i < INT8_MR; i++){
+            row[i] = rows[tap * INT8_MR + i];
+        }
+        const int8_t *b_tap = b + (size_t)INT8_NR * 4 * k4 * tap;
+        for(unsigned int k = 0; k < k4; k++){
+            __m512i b_row = _mm512_loadu_si512(b_tap + (size_t)INT8_NR * 4 * k);
+            for(int i = 0; i < INT8_MR; i++){
+                int32_t a_i;
+                memcpy(&a_i, row[i] + 4 * k, 4);
+                acc[i] = _mm512_dpbusd_epi32(acc[i], _mm512_set1_epi32(a_i), b_row);
+            }
+        }
+    }
+    for(int i = 0; i < INT8_MR; i++){
+        _mm512_storeu_si512(c + (size_t)ldc * i, acc[i]);
+    }
+#elif defined(__AVX2__)
+    const __m256i ones = _mm256_set1_epi16(1);
+    __m256i acc_lo[INT8_MR], acc_hi[INT8_MR];
+    for(int i = 0; i < INT8_MR; i++){
+        acc_lo[i] = _mm256_loadu_si256((const __m256i *)(c + (size_t)ldc * i));
+        acc_hi[i] = _mm256_loadu_si256((const __m256i *)(c + (size_t)ldc * i + 8));
+    }
+    for(unsigned int tap = 0; tap < taps; tap++){
+        const uint8_t *row[INT8_MR];
+        for(int i = 0; i < INT8_MR; i++){
+            row[i] = rows[tap * INT8_MR + i];
+        }
+        const int8_t *b_tap = b + (size_t)INT8_NR * 4 * k4 * tap;
+        for(unsigned int k = 0; k < k4; k++){
+            __m256i b_lo = _mm256_loadu_si256((const __m256i *)(b_tap + (size_t)INT8_NR * 4 * k));
+            __m256i b_hi = _mm256_loadu_si256((const __m256i *)(b_tap + (size_t)INT8_NR * 4 * k + 32));
+            for(int i = 0; i < INT8_MR; i++){
+                int32_t a_i;
+                memcpy(&a_i, row[i] + 4 * k, 4);
+                __m256i a_bc = _mm256_set1_epi32(a_i);
+                acc_lo[i] = _mm256_add_epi32(acc_lo[i], _mm256_madd_epi16(_mm256_maddubs_epi16(a_bc, b_lo), ones));
+                acc_hi[i] = _mm256_add_epi32(acc_hi[i], _mm256_madd_epi16(_mm256_maddubs_epi16(a_bc, b_hi), ones));
+            }
+        }
+    }
+    for(int i = 0; i < INT8_MR; i++){
+        _mm256_storeu_si256((__m256i *)(c + (size_t)ldc * i),     acc_lo[i]);
+        _mm256_storeu_si256((__m256i *)(c + (size_t)ldc * i + 8), acc_hi[i]);
+    }
+#else
+    int32_t acc[INT8_MR][INT8_NR];
+    for(int i = 0; i < INT8_MR; i++)
+        for(int j = 0; j < INT8_NR; j++){
+            acc[i][j] = c[(size_t)ldc * i + j];
+    }
+    for(unsigned int tap = 0; tap < taps; tap++)
+        for(unsigned int k = 0; k < k4; k++)
+            for(int i = 0; i < INT8_MR; i++)
+                for(int j = 0; j < INT8_NR; j++){
+                    const uint8_t *a = rows[tap * INT8_MR + i] + 4 * k;
+                    const int8_t *b_k = b + ((size_t)INT8_NR * (k4 * tap + k) + j) * 4;
+                    for(int l = 0; l < 4; l++){
+                        acc[i][j] += (int32_t)a[l] * b_k[l];
+                    }
+    }
+    for(int i = 0; i < INT8_MR; i++)
+        for(int j = 0; j < INT8_NR; j++){
+            c[(size_t)ldc * i + j] = acc[i][j];
+    }
+#endif
+}
+
+// im2col of pixel px, k_size bytes then the input zero point up to k_padded; taps outside the
+// image are the zero point too, i.e. a real 0
+void int8_pack_patch(const uint8_t *input, unsigned int height, unsigned int width, unsigned int channel,
+                     unsigned int filter_size, unsigned int k_padded, uint8_t zero, size_t px, uint8_t *patch){
+    const int half_filter_size = filter_size / 2;
+    const int row = px / width, col = px - (size_t)row * width;
+    memset(patch, zero, k_padded);
+    for(unsigned int krow = 0; krow < filter_size; krow++)
+        for(unsigned int kcol = 0; kcol < filter_size; kcol++){
+            int in_g_row = row - half_filter_size + (int)krow;
+            int in_g_col = col - half_filter_size + (int)kcol;
+            if(in_g_row >= 0 && in_g_col >= 0 && in_g_row < (int)height && in_g_col < (int)width){
+                memcpy(patch + (krow * filter_size + kcol) * channel, input + ((size_t)width * in_g_row + in_g_col) * channel, \
+                       channel);
+            }
+    }
+}
+
+// Requantize the int32 sums of one pixel, see the top of the file, 16 or 8 filters at a time
+// with the rounding mode (nearest even, as convert_int_rte in conv2d.cl). The scalar tail adds
+// and subtracts 1.5 * 2^23, which rounds the same way; it is exact since the value is clamped
+// to [-255, 255] first.
+void int8_requantize(const int32_t *acc, const int8_packed_filters &filters, uint8_t *out_px){
+    const int32_t *zero_comp = filters.zero_comp.data();
+    const float *out_mult = filters.out_mult.data();
+    const int zero = filters.out_zero, num_filter = filters.num_filter;
+    const float lo = (float)(filters.out_min - zero), hi = (float)(255 - zero);
+    int kf = 0;
+#if defined(__AVX512F__)
+    for(; kf + 16 <= num_filter; kf += 16){
+        __m512i sum = _mm512_sub_epi32(_mm512_loadu_si512(acc + kf), _mm512_loadu_si512(zero_comp + kf));
+        __m512 value = _mm512_mul_ps(_mm512_cvtepi32_ps(sum), _mm512_loadu_ps(out_mult + kf));
+        value = _mm512_min_ps(_mm512_max_ps(value, _mm512_set1_ps(lo)), _mm512_set1_ps(hi));
+        __m512i q = _mm512_add_epi32(_mm512_cvtps_epi32(value), _mm512_set1_epi32(zero));
+        _mm_storeu_si128((__m128i *)(out_px + kf), _mm512_cvtepi32_epi8(q));
+    }
+#elif defined(__AVX2__)
+    for(; kf + 8 <= num_filter; kf += 8){
+        __m256i sum = _mm256_sub_epi32(_mm256_loadu_si256((const __m256i *)(acc + kf)), \
+                                       _mm256_loadu_si256((const __m256i *)(zero_comp + kf)));
+        __m256 value = _mm256_mul_ps(_mm256_cvtepi32_ps(sum), _mm256_loadu_ps(out_mult + kf));
+        value = _mm256_min_ps(_mm256_max_ps(value, _mm256_set1_ps(lo)), _mm256_set1_ps(hi));
+        __m256i q = _mm256_add_epi32(_mm256_cvtps_epi32(value), _mm256_set1_epi32(zero));
+        __m128i q16 = _mm_packus_epi32(_mm256_castsi256_si128(q), _mm256_extracti128_si256(q, 1));
+        _mm_storel_epi64((__m128i *)(out_px + kf), _mm_packus_epi16(q16, q16));
+    }
+#endif
+    for(; kf < num_filter; kf++){
+        float value = (float)(acc[kf] - zero_comp[kf]) * out_mult[kf];
+        value = std::min(std::max(value, lo), hi);
+        value = (value + 12582912.0f) - 12582912.0f;
+        out_px[kf] = (uint8_t)((int)value + zero);
+    }
+}
+
+// HWC; stride = 1; padding = same; square filter, filters prepacked by int8_pack_filters;
+// writes uint8 output, or float to output_float when the filters were packed for it.
+// With channel a multiple of 4 the micro-kernel reads the input pixels in place, else
+// (the 3 channel input layer) it reads packed patches.
+void conv2d_int8_cpu(const uint8_t *input,
+                     const unsigned int height,
+                     const unsigned int width,
+                     const unsigned int channel,
+                     const int8_packed_filters &filters,
+                     const unsigned int filter_size,
+                     uint8_t *output,
+                     float *output_float){
+    const unsigned int k_padded = filters.k_padded;
+    const unsigned int num_filter = filters.num_filter;
+    const unsigned int ldc = filters.n_panels * INT8_NR;
+    const bool indirect = channel % 4 == 0;
+    const unsigned int taps = indirect ? filter_size * filter_size : 1;
+    const unsigned int k4 = indirect ? channel / 4 : k_padded / 4;
+    const int half_filter_size = filter_size / 2;
+    const size_t n_pixels = (size_t)height * width;
+    const unsigned int n_blocks = (n_pixels + INT8_MC - 1) / INT8_MC;
+    // taps outside the image and rows past the last pixel read the zero point
+    const std::vector<uint8_t> zero_px(std::max(channel, k_padded), filters.in_zero);
+    parallel_rows(n_blocks, [&](unsigned int blk_st, unsigned int blk_ed){
+        std::vector<int32_t> c_buf((size_t)INT8_MC * ldc);
+        std::vector<const uint8_t *> rows((size_t)INT8_MC * taps);
+        std::vector<uint8_t> patches(indirect ? 0 : (size_t)INT8_MC * k_padded);
+        for(unsigned int blk = blk_st; blk < blk_ed; blk++){
+            size_t px0 = (size_t)blk * INT8_MC;
+            unsigned int n_px = std::min((size_t)INT8_MC, n_pixels - px0);
+            unsigned int n_strips = (n_px + INT8_MR - 1) / INT8_MR;
+            std::fill(c_buf.begin(), c_buf.end(), 0);
+            for(unsigned int s = 0; s < n_strips; s++)
+                for(unsigned int i = 0; i < INT8_MR; i++){
+                    size_t px = px0 + s * INT8_MR + i;
+                    const uint8_t **px_rows = rows.data() + (size_t)s * taps * INT8_MR + i;
+                    if(px >= n_pixels){
+                        for(unsigned int tap = 0; tap < taps; tap++){
+                            px_rows[tap * INT8_MR] = zero_px.data();
+                        }
+                    }else if(!indirect){
+                        uint8_t *patch = patches.data() + (size_t)(s * INT8_MR + i) * k_padded;
+                        int8_pack_patch(input, height, width, channel, filter_size, k_padded, filters.in_zero, px, patch);
+                        px_rows[0] = patch;
+                    }else{
+                        int row = px / width, col = px - (size_t)row * width;
+                        for(unsigned int krow = 0; krow < filter_size; krow++)
+                            for(unsigned int kcol = 0; kcol < filter_size; kcol++){
+                                int in_g_row = row - half_filter_size + (int)krow;
+                                int in_g_col = col - half_filter_size + (int)kcol;
+                                bool inside = in_g_row >= 0 && in_g_col >= 0 && in_g_row < (int)height && in_g_col < (int)width;
+                                px_rows[(krow * filter_size + kcol) * INT8_MR] = \
+                                    inside ? input + ((size_t)width * in_g_row + in_g_col) * channel : zero_px.data();
+                        }
+                    }
+            }
+            for(unsigned int p = 0; p < filters.n_panels; p++){
+                const int8_t *b = filters.values.data() + (size_t)p * k_padded * INT8_NR;
+                for(unsigned int s = 0; s < n_strips; s++){
+                    int8_micro_kernel(taps, k4, rows.data() + (size_t)s * taps * INT8_MR, b, \
+                                      c_buf.data() + (size_t)s * INT8_MR * ldc + p * INT8_NR, ldc);
+                }
+            }
+            for(unsigned int i = 0; i < n_px; i++){
+                const int32_t *c_px = c_buf.data() + (size_t)i * ldc;
+                if(filters.float_out){
+                    float *out_px = output_float + (px0 + i) * num_filter;
+                    for(unsigned int kf = 0; kf < num_filter; kf++){
+                        out_px[kf] = (float)(c_px[kf] - filters.zero_comp[kf]) * filters.out_mult[kf];
+                    }
+                }else{
+                    int8_requantize(c_px, filters, output + (px0 + i) * num_filter);
+                }
+            }
+        }
+    });
+}
+
+#endif
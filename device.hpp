@@ -0,0 +1,218 @@
+#ifndef TOMOGAN_DEVICE_HPP
+#define TOMOGAN_DEVICE_HPP
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cstring>
+#include <cstdlib>
+#include <algorithm>
+
+#ifdef __APPLE__
+    #define CL_SILENCE_DEPRECATION
+    #include <OpenCL/opencl.h>
+#else
+    #define CL_TARGET_OPENCL_VERSION 210
+    #include <CL/cl.h>
+#endif
+
+// properties of the selected device that matter for launching our kernels
+struct ocl_device_info{
+    cl_platform_id platform;
+    cl_device_id   device;
+    cl_device_type type;
+    std::string    platform_name;
+    std::string    name;
+    std::string    vendor;
+    std::string    version;
+    std::string    driver_version;
+    cl_ulong       local_mem_size;
+    cl_ulong       global_mem_size;
+    cl_ulong       max_alloc_size;
+    cl_ulong       max_constant_size;      // bytes of a __constant argument
+    cl_uint        mem_base_addr_align;    // bits, sub-buffer origins must be multiples of it
+    cl_uint        compute_units;
+    size_t         max_work_group_size;
+    size_t         max_work_item_sizes[3];
+    cl_uint        pref_vec_width_float;
+    cl_uint        pref_vec_width_half;
+    cl_uint        native_vec_width_float;
+    std::string    extensions;
+};
+
+std::string ocl_platform_str(cl_platform_id platform, cl_platform_info param){
+    size_t size = 0;
+    clGetPlatformInfo(platform, param, 0, NULL, &size);
+    std::vector<char> buf(size + 1, 0);
+    clGetPlatformInfo(platform, param, size, buf.data(), NULL);
+    return std::string(buf.data());
+}
+
+std::string ocl_device_str(cl_device_id device, cl_device_info param){
+    size_t size = 0;
+    clGetDeviceInfo(device, param, 0, NULL, &size);
+    std::vector<char> buf(size + 1, 0);
+    clGetDeviceInfo(device, param, size, buf.data(), NULL);
+    return std::string(buf.data());
+}
+
+const char* ocl_device_type_str(cl_device_type type){
+    if(type & CL_DEVICE_TYPE_GPU)         return "GPU";
+    if(type & CL_DEVICE_TYPE_ACCELERATOR) return "ACC";
+    if(type & CL_DEVICE_TYPE_CPU)         return "CPU";
+    return "OTHER";
+}
+
+ocl_device_info query_device(cl_platform_id platform, cl_device_id device){
+    ocl_device_info info;
+    info.platform = platform;
+    info.device   = device;
+    info.platform_name  = ocl_platform_str(platform, CL_PLATFORM_NAME);
+    info.name           = ocl_device_str(device, CL_DEVICE_NAME);
+    info.vendor         = ocl_device_str(device, CL_DEVICE_VENDOR);
+    info.version        = ocl_device_str(device, CL_DEVICE_VERSION);
+    info.driver_version = ocl_device_str(device, CL_DRIVER_VERSION);
+    clGetDeviceInfo(device, CL_DEVICE_TYPE, sizeof(cl_device_type), &info.type, NULL);
+    clGetDeviceInfo(device, CL_DEVICE_LOCAL_MEM_SIZE, sizeof(cl_ulong), &info.local_mem_size, NULL);
+    clGetDeviceInfo(device, CL_DEVICE_GLOBAL_MEM_SIZE, sizeof(cl_ulong), &info.global_mem_size, NULL);
+    clGetDeviceInfo(device, CL_DEVICE_MAX_MEM_ALLOC_SIZE, sizeof(cl_ulong), &info.max_alloc_size, NULL);
+    clGetDeviceInfo(device, CL_DEVICE_MAX_CONSTANT_BUFFER_SIZE, sizeof(cl_ulong), &info.max_constant_size, NULL);
+    clGetDeviceInfo(device, CL_DEVICE_MEM_BASE_ADDR_ALIGN, sizeof(cl_uint), &info.mem_base_addr_align, NULL);
+    clGetDeviceInfo(device, CL_DEVICE_MAX_COMPUTE_UNITS, sizeof(cl_uint), &info.compute_units, NULL);
+    clGetDeviceInfo(device, CL_DEVICE_MAX_WORK_GROUP_SIZE, sizeof(size_t), &info.max_work_group_size, NULL);
+    clGetDeviceInfo(device, CL_DEVICE_MAX_WORK_ITEM_SIZES, sizeof(size_t) * 3, info.max_work_item_sizes, NULL);
+    clGetDeviceInfo(device, CL_DEVICE_PREFERRED_VECTOR_WIDTH_FLOAT, sizeof(cl_uint), &info.pref_vec_width_float, NULL);
+    clGetDeviceInfo(device, CL_DEVICE_PREFERRED_VECTOR_WIDTH_HALF, sizeof(cl_uint), &info.pref_vec_width_half, NULL);
+    clGetDeviceInfo(device, CL_DEVICE_NATIVE_VECTOR_WIDTH_FLOAT, sizeof(cl_uint), &info.native_vec_width_float, NULL);
+    info.extensions     = ocl_device_str(device, CL_DEVICE_EXTENSIONS);
+    return info;
+}
+
+bool ocl_has_extension(const ocl_device_info &info, const char *extension){
+    return (" " + info.extensions + " ").find(" " + std::string(extension) + " ") != std::string::npos;
+}
+
+void print_device_report(const ocl_device_info &info){
+    printf("Device: %s (%s) on platform %s, %s, driver %s\n", info.name.c_str(), ocl_device_type_str(info.type), \
+           info.platform_name.c_str(), info.version.c_str(), info.driver_version.c_str());
+    printf("  %d compute units, %lluKB local mem, %lluMB global mem, %lluMB max alloc, %lluKB max constant\n", \
+           info.compute_units, (unsigned long long)info.local_mem_size/1024, (unsigned long long)info.global_mem_size/1024/1024, \
+           (unsigned long long)info.max_alloc_size/1024/1024, (unsigned long long)info.max_constant_size/1024);
+    printf("  max work group size %ld (%ld, %ld, %ld), preferred vector width float %d half %d, native float %d\n", \
+           info.max_work_group_size, info.max_work_item_sizes[0], info.max_work_item_sizes[1], info.max_work_item_sizes[2], \
+           info.pref_vec_width_float, info.pref_vec_width_half, info.native_vec_width_float);
+    printf("  half arithmetic (cl_khr_fp16): %s\n", ocl_has_extension(info, "cl_khr_fp16") ? "yes" : "no");
+    printf("  packed int8 dot product (cl_khr_integer_dot_product): %s\n", \
+           ocl_has_extension(info, "cl_khr_integer_dot_product") ? "yes" : "no");
+}
+
+// rank used by the default policy: GPU, then accelerator, then CPU
+int device_type_rank(cl_device_type type){
+    if(type & CL_DEVICE_TYPE_GPU)         return 3;
+    if(type & CL_DEVICE_TYPE_ACCELERATOR) return 2;
+    if(type & CL_DEVICE_TYPE_CPU)         return 1;
+    return 0;
+}
+
+// Enumerate every device of every platform and pick one. The choice can be forced with
+// `--device <platform>:<device>` or `--device cpu|gpu|acc` on the command line, or with
+// the TOMOGAN_DEVICE environment variable using the same syntax. Without override, the
+// highest ranked device type wins, ties go to the device with more global memory.
+ocl_device_info select_device(int argc, char** argv){
+    const char *choice = getenv("TOMOGAN_DEVICE");
+    for(int i = 1; i < argc - 1; i++){
+        if(strcmp(argv[i], "--device") == 0){
+            choice = argv[i+1];
+        }
+    }
+
+    cl_uint num_platforms = 0;
+    cl_int err = clGetPlatformIDs(0, NULL, &num_platforms);
+    if (err != CL_SUCCESS || num_platforms == 0){
+        printf("Exit because there is no platform support OpenCL, error: %d\n", err);
+        exit(EXIT_FAILURE);
+    }
+    std::vector<cl_platform_id> platform_ids(num_platforms);
+    clGetPlatformIDs(num_platforms, platform_ids.data(), NULL);
+
+    std::vector<ocl_device_info> devices;
+    std::vector<std::pair<unsigned int, unsigned int> > device_idx;
+    printf("There are %d platform(s).\n", num_platforms);
+    for(unsigned int p = 0; p < num_platforms; p++){
+        cl_uint num_devices = 0;
+        if(clGetDeviceIDs(platform_ids[p], CL_DEVICE_TYPE_ALL, 0, NULL, &num_devices) != CL_SUCCESS){
+            continue;
+        }
+        std::vector<cl_device_id> device_ids(num_devices);
+        clGetDeviceIDs(platform_ids[p], CL_DEVICE_TYPE_ALL, num_devices, device_ids.data(), NULL);
+        for(unsigned int d = 0; d < num_devices; d++){
+            devices.push_back(query_device(platform_ids[p], device_ids[d]));
+            device_idx.push_back(std::make_pair(p, d));
+            printf("  [%d:%d] %-3s %s\n", p, d, ocl_device_type_str(devices.back().type), devices.back().name.c_str());
+        }
+    }
+    if(devices.empty()){
+        printf("Exit because there is no device support OpenCL\n");
+        exit(EXIT_FAILURE);
+    }
+
+    int selected = -1;
+    unsigned int want_p, want_d;
+    cl_device_type want_type = 0;
+    if(choice != NULL){
+        if(sscanf(choice, "%u:%u", &want_p, &want_d) == 2){
+            for(size_t i = 0; i < devices.size(); i++){
+                if(device_idx[i].first == want_p && device_idx[i].second == want_d){
+                    selected = i;
+                }
+            }
+        }
+        else if(strcmp(choice, "cpu") == 0) want_type = CL_DEVICE_TYPE_CPU;
+        else if(strcmp(choice, "gpu") == 0) want_type = CL_DEVICE_TYPE_GPU;
+        else if(strcmp(choice, "acc") == 0) want_type = CL_DEVICE_TYPE_ACCELERATOR;
+        if(selected < 0 && want_type == 0){
+            printf("Error: no device matches '%s'\n", choice);
+            exit(EXIT_FAILURE);
+        }
+    }
+    for(size_t i = 0; i < devices.size() && (choice == NULL || want_type != 0); i++){
+        if(want_type != 0 && !(devices[i].type & want_type)){
+            continue;
+        }
+        if(selected < 0 || \
+           device_type_rank(devices[i].type) > device_type_rank(devices[selected].type) || \
+           (device_type_rank(devices[i].type) == device_type_rank(devices[selected].type) && \
+            devices[i].global_mem_size > devices[selected].global_mem_size)){
+            selected = i;
+        }
+    }
+    if(selected < 0){
+        printf("Error: no device matches '%s'\n", choice);
+        exit(EXIT_FAILURE);
+    }
+    print_device_report(devices[selected]);
+    return devices[selected];
+}
+
+// shrink a 2D local size (keeping it a power-of-two divisor of the original) until it fits
+// the device, and the kernel if one is given
+void fit_local_size(const ocl_device_info &info, size_t *local, cl_kernel kernel = NULL){
+    size_t max_size = info.max_work_group_size;
+    if(kernel != NULL){
+        size_t kernel_wg_size = 0;
+        if(clGetKernelWorkGroupInfo(kernel, info.device, CL_KERNEL_WORK_GROUP_SIZE, sizeof(size_t), &kernel_wg_size, NULL) == CL_SUCCESS){
+            max_size = std::min(max_size, kernel_wg_size);
+        }
+    }
+    for(int dim = 0; dim < 2; dim++){
+        while(local[dim] > 1 && local[dim] > info.max_work_item_sizes[dim]){
+            local[dim] /= 2;
+        }
+    }
+    while(local[0] * local[1] > max_size){
+        if(local[0] >= local[1]) local[0] /= 2;
+        else local[1] /= 2;
+    }
+}
+
+#endif
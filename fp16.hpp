@@ -0,0 +1,123 @@
+#ifndef TOMOGAN_FP16_HPP
+#define TOMOGAN_FP16_HPP
+
+#include <cstdint>
+#include <cstring>
+#include <cstddef>
+#ifdef __F16C__
+#include <immintrin.h>
+#endif
+
+// IEEE 754 half precision for the fp16 modes: host side conversion of the tensors and
+// weights of TomoGANSession, and storage rounding in tomogan_cpu.cpp. Conversions round
+// to nearest even, as vstore_half does on the device. With F16C (-march=native on x86
+// since Ivy Bridge) 8 values are converted per instruction, else with the scalar version
+// below, which gives the same bits.
+#ifdef __F16C__
+#define FP16_ISA "f16c"
+#else
+#define FP16_ISA "scalar"
+#endif
+
+uint16_t float_to_half(float value){
+    uint32_t f;
+    memcpy(&f, &value, sizeof(f));
+    const uint32_t sign = (f >> 16) & 0x8000;
+    const uint32_t abs = f & 0x7fffffff;
+    if(abs >= 0x7f800000){
+        // inf, or a quiet NaN keeping the top of the payload
+        return sign | 0x7c00 | (abs > 0x7f800000 ? 0x200 | ((abs >> 13) & 0x3ff) : 0);
+    }
+    if(abs >= 0x477ff000){
+        // 65520 and above round to inf
+        return sign | 0x7c00;
+    }
+    uint32_t h, rem, halfway;
+    if(abs < 0x38800000){
+        // below 2^-14, a subnormal half in units of 2^-24
+        const int shift = 126 - (int)(abs >> 23);
+        if(shift > 24){
+            return sign;
+        }
+        const uint32_t mant = (abs & 0x7fffff) | 0x800000;
+        h = mant >> shift;
+        rem = mant & ((1u << shift) - 1);
+        halfway = 1u << (shift - 1);
+    }else{
+        h = (((abs >> 23) - 112) << 10) | ((abs >> 13) & 0x3ff);
+        rem = abs & 0x1fff;
+        halfway = 0x1000;
+    }
+    // a carry out of the mantissa correctly moves to the next exponent
+    if(rem > halfway || (rem == halfway && (h & 1))){
+        h++;
+    }
+    return sign | h;
+}
+
+float half_to_float(uint16_t h){
+    const uint32_t sign = (uint32_t)(h & 0x8000) << 16;
+    uint32_t exponent = (h >> 10) & 0x1f;
+    uint32_t mant = h & 0x3ff;
+    uint32_t f;
+    if(exponent == 0x1f){
+        f = sign | 0x7f800000 | (mant << 13);
+    }else if(exponent != 0){
+        f = sign | ((exponent + 112) << 23) | (mant << 13);
+    }else if(mant == 0){
+        f = sign;
+    }else{
+        // subnormal, normalized as a float
+        exponent = 113;
+        while(!(mant & 0x400)){
+            mant <<= 1;
+            exponent--;
+        }
+        f = sign | (exponent << 23) | ((mant & 0x3ff) << 13);
+    }
+    float value;
+    memcpy(&value, &f, sizeof(value));
+    return value;
+}
+
+void floats_to_halves(const float *src, uint16_t *dst, size_t n){
+    size_t i = 0;
+#ifdef __F16C__
+    for(; i + 8 <= n; i += 8){
+        __m128i h = _mm256_cvtps_ph(_mm256_loadu_ps(src + i), _MM_FROUND_TO_NEAREST_INT);
+        _mm_storeu_si128((__m128i *)(dst + i), h);
+    }
+#endif
+    for(; i < n; i++){
+        dst[i] = float_to_half(src[i]);
+    }
+}
+
+void halves_to_floats(const uint16_t *src, float *dst, size_t n){
+    size_t i = 0;
+#ifdef __F16C__
+    for(; i + 8 <= n; i += 8){
+        _mm256_storeu_ps(dst + i, _mm256_cvtph_ps(_mm_loadu_si128((const __m128i *)(src + i))));
+    }
+#endif
+    for(; i < n; i++){
+        dst[i] = half_to_float(src[i]);
+    }
+}
+
+// round float values to the nearest half in place, i.e. what storing them as half and
+// reading them back gives
+void round_to_half(float *data, size_t n){
+    size_t i = 0;
+#ifdef __F16C__
+    for(; i + 8 <= n; i += 8){
+        __m128i h = _mm256_cvtps_ph(_mm256_loadu_ps(data + i), _MM_FROUND_TO_NEAREST_INT);
+        _mm256_storeu_ps(data + i, _mm256_cvtph_ps(h));
+    }
+#endif
+    for(; i < n; i++){
+        data[i] = half_to_float(float_to_half(data[i]));
+    }
+}
+
+#endif
@@ -0,0 +1,67 @@
+#ifndef TOMOGAN_LAYOUT_HPP
+#define TOMOGAN_LAYOUT_HPP
+
+#include <vector>
+#include <cstddef>
+
+// Channel-blocked NCHWc8 layout of the *_nchwc8 kernels of conv2d.cl: a tensor is
+// [n][ceil(channel / 8)][height][width][8], the channels of the last block past `channel`
+// are zero. Host side helpers: the conv weights packed for conv2d_nchwc8, and conversions
+// from and to HWC for the tests (the session converts on the device).
+#define NCHWC_BLOCK (8)
+
+inline unsigned int nchwc8_blocks(unsigned int channel){
+    return (channel + NCHWC_BLOCK - 1) / NCHWC_BLOCK;
+}
+
+// elements of a height x width x channel slice in NCHWc8, with the padding channels
+inline size_t nchwc8_size(unsigned int height, unsigned int width, unsigned int channel){
+    return (size_t)nchwc8_blocks(channel) * NCHWC_BLOCK * height * width;
+}
+
+// filters [num_filter][filter_size][filter_size][channel] -> [filter block][channel block]
+// [filter_size][filter_size][8 channels][8 filters], zero for the padding channels and filters
+std::vector<float> nchwc8_transform_filters(const float *filter_values, unsigned int filter_size, unsigned int channel, \
+                                            unsigned int num_filter){
+    const unsigned int in_blocks = nchwc8_blocks(channel), out_blocks = nchwc8_blocks(num_filter);
+    const unsigned int taps = filter_size * filter_size;
+    std::vector<float> packed((size_t)out_blocks * in_blocks * taps * NCHWC_BLOCK * NCHWC_BLOCK, 0.0f);
+    for(unsigned int kf = 0; kf < num_filter; kf++)
+        for(unsigned int tap = 0; tap < taps; tap++)
+            for(unsigned int c = 0; c < channel; c++){
+                size_t dst = ((((size_t)(kf / NCHWC_BLOCK) * in_blocks + c / NCHWC_BLOCK) * taps + tap) * NCHWC_BLOCK + \
+                              c % NCHWC_BLOCK) * NCHWC_BLOCK + kf % NCHWC_BLOCK;
+                packed[dst] = filter_values[((size_t)kf * taps + tap) * channel + c];
+    }
+    return packed;
+}
+
+// n_slices of height x width x channel, HWC -> NCHWc8
+void hwc_to_nchwc8_cpu(const float *input, unsigned int n_slices, unsigned int height, unsigned int width, \
+                       unsigned int channel, float *output){
+    const unsigned int blocks = nchwc8_blocks(channel);
+    const size_t hw = (size_t)height * width;
+    for(unsigned int n = 0; n < n_slices; n++)
+        for(unsigned int b = 0; b < blocks; b++)
+            for(size_t px = 0; px < hw; px++)
+                for(unsigned int k = 0; k < NCHWC_BLOCK; k++){
+                    unsigned int c = b * NCHWC_BLOCK + k;
+                    output[(((size_t)n * blocks + b) * hw + px) * NCHWC_BLOCK + k] = \
+                        c < channel ? input[((size_t)n * hw + px) * channel + c] : 0.0f;
+    }
+}
+
+// NCHWc8 -> HWC, the padding channels are dropped
+void nchwc8_to_hwc_cpu(const float *input, unsigned int n_slices, unsigned int height, unsigned int width, \
+                       unsigned int channel, float *output){
+    const unsigned int blocks = nchwc8_blocks(channel);
+    const size_t hw = (size_t)height * width;
+    for(unsigned int n = 0; n < n_slices; n++)
+        for(size_t px = 0; px < hw; px++)
+            for(unsigned int c = 0; c < channel; c++){
+                output[((size_t)n * hw + px) * channel + c] = \
+                    input[(((size_t)n * blocks + c / NCHWC_BLOCK) * hw + px) * NCHWC_BLOCK + c % NCHWC_BLOCK];
+    }
+}
+
+#endif
@@ -3,6 +3,7 @@
 #include <string>
 #include <math.h>
 #include <chrono>
+#include "program.hpp"
 
 #ifdef __APPLE__
     #define CL_SILENCE_DEPRECATION 
@@ -23,7 +24,6 @@ using namespace std;
 #define FILTER_DATA_SIZE (FILTER_SIZE * FILTER_SIZE * IMG_CH)
 #define INPUT_DATA_SIZE  (IMG_SIZE * IMG_SIZE * IMG_CH)
 #define OUTPUT_DATA_SIZE (IMG_SIZE * IMG_SIZE)
-#define MAX_SOURCE_SIZE (0x10000)
 
 int main(int argc, char** argv)
 {
@@ -48,56 +48,12 @@ int main(int argc, char** argv)
                 input_img_h[gidx] = c;
     }
     
-    // Set up platform 
-    cl_platform_id platform_ids[2];
-    cl_uint num_platforms = 0;
-    err = clGetPlatformIDs(2, platform_ids, &num_platforms);
-    if (err != CL_SUCCESS){ 
-        printf("Failed to query platforms. Error:%i\n", err);
-    }else{
-        printf("There are %d platform(s).\n", num_platforms);
-    }
-    if(num_platforms == 0){
-        printf("Exit because there is no platform support OpenCL\n");
-        return EXIT_FAILURE;
-    }
-
-    unsigned int platform_idx = 0;
-    char *profile = NULL;
-    size_t size;
-    clGetPlatformInfo(platform_ids[platform_idx], CL_PLATFORM_VERSION, 0, profile, &size); // get size of profile char array
-    profile = new char[size]();
-    clGetPlatformInfo(platform_ids[platform_idx], CL_PLATFORM_VERSION,size, profile, NULL); // get profile char array
-    cout << profile << " is used to support computing." << endl;
-    delete[] profile;
-
-    unsigned int num_devices = 0;
-    cl_device_id device_ids[2];
-    err = clGetDeviceIDs(platform_ids[platform_idx], CL_DEVICE_TYPE_GPU, 2, device_ids, &num_devices);
-    if (err != CL_SUCCESS){
-        printf("Error: Failed to create a device group: %d\n", err);
-        return EXIT_FAILURE;
-    }else{
-        printf("There is(are) %d GPU device(s) support OCL.\n", num_devices);
-    }
-    if(num_devices == 0){
-        printf("Exit because there is no device support OpenCL\n");
-        return EXIT_FAILURE;
-    }
-
-    unsigned int dev_idx = 0;
-
-    cl_ulong local_mem_size;
-    clGetDeviceInfo(device_ids[dev_idx], CL_DEVICE_LOCAL_MEM_SIZE, sizeof(cl_ulong), &local_mem_size, 0);
-    char *vendor = NULL;
-    clGetDeviceInfo(device_ids[dev_idx], CL_DEVICE_VENDOR, 0, NULL, &size);
-    vendor = new char[size]();
-    clGetDeviceInfo(device_ids[dev_idx], CL_DEVICE_VENDOR, size, vendor, NULL);
-    printf("Device produced by %s with %lldKB local mem will be used.\n", vendor, local_mem_size/1024);
-    delete[] vendor;
+    // Pick a device, see device.hpp for the selection policy and overrides
+    ocl_device_info dev_info = select_device(argc, argv);
+    cl_device_id device_id = dev_info.device;
 
     // Create a compute context 
-    cl_context context = clCreateContext(0, 1, &(device_ids[dev_idx]), NULL, NULL, &err);
+    cl_context context = clCreateContext(0, 1, &device_id, NULL, NULL, &err);
     if (!context){
         printf("Error: Failed to create a compute context! %d\n", err);
         return EXIT_FAILURE;
@@ -105,9 +61,9 @@ int main(int argc, char** argv)
 
     // Create a command commands
     #ifdef __APPLE__
-        cl_command_queue commands = clCreateCommandQueue(context, device_ids[dev_idx], 0, &err);
+        cl_command_queue commands = clCreateCommandQueue(context, device_id, 0, &err);
     #else
-        cl_command_queue commands = clCreateCommandQueueWithProperties(context, device_ids[dev_idx], 0, &err);
+        cl_command_queue commands = clCreateCommandQueueWithProperties(context, device_id, 0, &err);
     #endif
     if (!commands){
         printf("Error: Failed to create a command commands! %d\n", err);
@@ -115,38 +71,8 @@ int main(int argc, char** argv)
     }
 
     auto compile_st = chrono::steady_clock::now();
-    // Load the kernel source code into the array source_str
-    FILE *fp;
-    char *source_str;
-    size_t source_size;
- 
-    fp = fopen("conv2d.cl", "r");
-    if (!fp){
-        fprintf(stderr, "Failed to load kernel.\n");
-        exit(1);
-    }
-    source_str = new char[MAX_SOURCE_SIZE]();
-    source_size = fread( source_str, 1, MAX_SOURCE_SIZE, fp);
-    fclose( fp );
-    
-    // Create the compute program from the source buffer
-    cl_program program = clCreateProgramWithSource(context, 1, (const char **) &source_str, NULL, &err);
-    if (!program){
-        printf("Error: Failed to create compute program! %d\n", err);
-        return EXIT_FAILURE;
-    }
-    delete[] source_str;
-
-    // Build the program executable
-    err = clBuildProgram(program, 0, NULL, NULL, NULL, NULL);
-    if (err != CL_SUCCESS){
-        size_t len;
-        char buffer[2048];
-        printf("Error: Failed to build program executable!: %d\n", err);
-        clGetProgramBuildInfo(program, device_ids[dev_idx], CL_PROGRAM_BUILD_LOG, sizeof(buffer), buffer, &len);
-        printf("build error: %s\n", buffer);
-        exit(1);
-    }
+    // Build the program executable, or load it from the program cache
+    cl_program program = build_program(context, dev_info, "conv2d.cl");
 
     // Create the compute kernel in the program we wish to run
     cl_kernel kernel = clCreateKernel(program, "conv2d", &err);
@@ -157,7 +83,7 @@ int main(int argc, char** argv)
 
     size_t max_group_size;
     // Get the maximum work group size for executing the kernel on the device
-    err = clGetKernelWorkGroupInfo(kernel, device_ids[dev_idx], CL_KERNEL_WORK_GROUP_SIZE, sizeof(max_group_size), &max_group_size, NULL);
+    err = clGetKernelWorkGroupInfo(kernel, device_id, CL_KERNEL_WORK_GROUP_SIZE, sizeof(max_group_size), &max_group_size, NULL);
     if (err != CL_SUCCESS)
     {
         printf("Error: Failed to retrieve kernel work group info! %d\n", err);
@@ -210,6 +136,7 @@ int main(int argc, char** argv)
         }
 
         size_t local[2] = {16, 16};
+        fit_local_size(dev_info, local, kernel);
         size_t global[2] = {IMG_SIZE, IMG_SIZE};
         err = clEnqueueNDRangeKernel(commands, kernel, 2, NULL, global, local, 0, NULL, NULL);
         if (err){
@@ -42,9 +42,56 @@ void conv2d_set_arg(cl_kernel *kernel,
         printf("Error: Failed to set kernel arguments for conv2d! %d\n", err);
         exit(1);
     }
-    else{
-        printf("Conv2d H:%4d, W:%4d, C:%3d, FS:%3d, NF:%3d, Relu:%1d\n", \
-               img_height, img_width, img_channel, filter_size, num_filter, apply_relu);
+}
+
+// conv2d_vec16_mk, conv2d_vec8_mk and conv2d_mk: the conv2d arguments and the filters per
+// work item, num_filter for one work item per pixel
+void conv2d_mk_set_arg(cl_kernel *kernel,
+                    cl_mem *input_d,
+                    unsigned int img_height,
+                    unsigned int img_width,
+                    unsigned int img_channel,
+                    cl_mem *filter_d,
+                    unsigned int filter_size,
+                    unsigned int num_filter,
+                    cl_mem *output_d,
+                    unsigned char apply_relu,
+                    unsigned int kf_block){
+    conv2d_set_arg(kernel, input_d, img_height, img_width, img_channel, filter_d, filter_size, num_filter, output_d, apply_relu);
+    int err = clSetKernelArg(*kernel, 9, sizeof(unsigned int), &kf_block);
+    if (err != CL_SUCCESS){
+        printf("Error: Failed to set kernel arguments for conv2d_mk! %d\n", err);
+        exit(1);
+    }
+}
+
+// conv2d_int8_mk: the conv2d arguments, then the requantization of int8_packed_filters
+// (conv_int8.hpp) with zero_comp_d and out_mult_d holding num_filter ints and floats
+void conv2d_int8_set_arg(cl_kernel *kernel,
+                    cl_mem *input_d,
+                    unsigned int img_height,
+                    unsigned int img_width,
+                    unsigned int img_channel,
+                    cl_mem *filter_d,
+                    unsigned int filter_size,
+                    unsigned int num_filter,
+                    cl_mem *output_d,
+                    unsigned char apply_relu,
+                    cl_mem *zero_comp_d,
+                    cl_mem *out_mult_d,
+                    int in_zero,
+                    int out_zero,
+                    unsigned char float_out){
+    conv2d_set_arg(kernel, input_d, img_height, img_width, img_channel, filter_d, filter_size, num_filter, output_d, apply_relu);
+    int err;
+    err  = clSetKernelArg(*kernel, 9,  sizeof(cl_mem), zero_comp_d);
+    err |= clSetKernelArg(*kernel, 10, sizeof(cl_mem), out_mult_d);
+    err |= clSetKernelArg(*kernel, 11, sizeof(int), &in_zero);
+    err |= clSetKernelArg(*kernel, 12, sizeof(int), &out_zero);
+    err |= clSetKernelArg(*kernel, 13, sizeof(unsigned char), &float_out);
+    if (err != CL_SUCCESS){
+        printf("Error: Failed to set kernel arguments for conv2d_int8! %d\n", err);
+        exit(1);
     }
 }
 
@@ -86,6 +133,26 @@ void upsample_set_arg(cl_kernel *kernel,
     }
 }
 
+// hwc_to_nchwc8 and nchwc8_to_hwc
+void layout_set_arg(cl_kernel *kernel,
+                    cl_mem *input_d,
+                    unsigned int img_height,
+                    unsigned int img_width,
+                    unsigned int img_channel,
+                    cl_mem *output_d){
+    int err;
+    err  = 0;
+    err  = clSetKernelArg(*kernel, 0, sizeof(cl_mem), input_d);
+    err |= clSetKernelArg(*kernel, 1, sizeof(unsigned int), &img_height);
+    err |= clSetKernelArg(*kernel, 2, sizeof(unsigned int), &img_width);
+    err |= clSetKernelArg(*kernel, 3, sizeof(unsigned int), &img_channel);
+    err |= clSetKernelArg(*kernel, 4, sizeof(cl_mem), output_d);
+    if (err != CL_SUCCESS){
+        printf("Error: Failed to set kernel arguments for layout conversion! %d\n", err);
+        exit(1);
+    }
+}
+
 void concat_set_arg(cl_kernel *kernel,
                     cl_mem *input_d1,
                     cl_mem *input_d2,
@@ -94,8 +161,6 @@ void concat_set_arg(cl_kernel *kernel,
                     unsigned int img_channel1,
                     unsigned int img_channel2,
                     cl_mem *output_d){
-    printf("Concat H:%4d, W:%4d, C1:%3d, C2:%3d\n", \
-            img_height, img_width, img_channel1, img_channel2);
     int err;
     err  = 0;
     err  = clSetKernelArg(*kernel, 0, sizeof(cl_mem), input_d1);
@@ -0,0 +1,138 @@
+#ifndef TOMOGAN_MEMORY_PLAN_HPP
+#define TOMOGAN_MEMORY_PLAN_HPP
+
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cstdio>
+
+// Static memory planner: every tensor of the network is written at one step and read up to
+// its last use, two tensors whose [def, last_use] intervals overlap must not share bytes.
+// solve() packs all tensors into a single arena, largest first, each at the lowest aligned
+// offset that does not collide with an already placed tensor it is live with (greedy by
+// size, which is close to optimal on chain-like graphs with a few long-lived skips).
+// Devices cap the size of one allocation, so the arena is made of chunk_bytes chunks that
+// no tensor straddles; with a large enough chunk it is a single buffer.
+struct plan_tensor{
+    std::string name;
+    size_t bytes;
+    int def;
+    int last_use;
+    size_t offset;
+};
+
+class memory_plan{
+public:
+    // a tensor of `bytes` written at step `def`, returns its id
+    unsigned int add(const char *name, size_t bytes, int def){
+        plan_tensor t = {name, bytes, def, def, 0};
+        tensors_.push_back(t);
+        return tensors_.size() - 1;
+    }
+    // tensor `id` is read at `step`
+    void use(unsigned int id, int step){
+        tensors_[id].last_use = std::max(tensors_[id].last_use, step);
+    }
+
+    // assign offsets aligned to `alignment` bytes, returns the arena size
+    size_t solve(size_t alignment, size_t chunk_bytes = (size_t)-1){
+        chunk_bytes_ = chunk_bytes;
+        std::vector<unsigned int> order(tensors_.size());
+        for(unsigned int i = 0; i < order.size(); i++){
+            order[i] = i;
+        }
+        std::stable_sort(order.begin(), order.end(), [&](unsigned int a, unsigned int b){
+            return tensors_[a].bytes > tensors_[b].bytes;
+        });
+        std::vector<unsigned int> placed;
+        arena_bytes_ = 0;
+        for(unsigned int id : order){
+            plan_tensor &t = tensors_[id];
+            // placed tensors live at the same time as t, by offset
+            std::vector<unsigned int> live;
+            for(unsigned int p : placed){
+                if(tensors_[p].def <= t.last_use && t.def <= tensors_[p].last_use){
+                    live.push_back(p);
+                }
+            }
+            std::sort(live.begin(), live.end(), [&](unsigned int a, unsigned int b){
+                return tensors_[a].offset < tensors_[b].offset;
+            });
+            // the next chunk boundary when [offset, offset + t.bytes) would straddle one
+            auto in_chunk = [&](size_t offset){
+                bool straddles = t.bytes > 0 && offset / chunk_bytes != (offset + t.bytes - 1) / chunk_bytes;
+                return straddles ? (offset / chunk_bytes + 1) * chunk_bytes : offset;
+            };
+            size_t offset = 0;
+            for(unsigned int p : live){
+                offset = in_chunk(offset);
+                if(offset + t.bytes <= tensors_[p].offset){
+                    break;
+                }
+                offset = std::max(offset, align(tensors_[p].offset + tensors_[p].bytes, alignment));
+            }
+            offset = in_chunk(offset);
+            t.offset = offset;
+            arena_bytes_ = std::max(arena_bytes_, offset + t.bytes);
+            placed.push_back(id);
+        }
+        return arena_bytes_;
+    }
+
+    unsigned int size() const { return tensors_.size(); }
+    const plan_tensor& tensor(unsigned int id) const { return tensors_[id]; }
+    size_t arena_bytes() const { return arena_bytes_; }
+    // chunks of the arena and the chunk of tensor id, its offset in there is offset % chunk
+    unsigned int n_chunks() const { return arena_bytes_ == 0 ? 0 : (arena_bytes_ - 1) / chunk_bytes_ + 1; }
+    unsigned int chunk_of(unsigned int id) const { return tensors_[id].offset / chunk_bytes_; }
+    size_t chunk_bytes(unsigned int chunk) const{
+        return std::min(chunk_bytes_, arena_bytes_ - (size_t)chunk * chunk_bytes_);
+    }
+    size_t chunk_offset(unsigned int id) const { return tensors_[id].offset % chunk_bytes_; }
+    // footprint without any reuse
+    size_t total_bytes() const{
+        size_t total = 0;
+        for(const plan_tensor &t : tensors_){
+            total += t.bytes;
+        }
+        return total;
+    }
+    // largest sum of simultaneously live tensors, a lower bound for any arena
+    size_t live_peak_bytes() const{
+        int last_step = 0;
+        for(const plan_tensor &t : tensors_){
+            last_step = std::max(last_step, t.last_use);
+        }
+        size_t peak = 0;
+        for(int step = 0; step <= last_step; step++){
+            size_t live = 0;
+            for(const plan_tensor &t : tensors_){
+                if(t.def <= step && step <= t.last_use){
+                    live += t.bytes;
+                }
+            }
+            peak = std::max(peak, live);
+        }
+        return peak;
+    }
+
+    void print() const{
+        printf("%-10s %12s %6s %12s\n", "tensor", "MB", "steps", "offset MB");
+        for(const plan_tensor &t : tensors_){
+            printf("%-10s %12.2f %2d-%-3d %12.2f\n", t.name.c_str(), t.bytes / 1048576., t.def, t.last_use, t.offset / 1048576.);
+        }
+        printf("arena %.2f MB in %d chunk(s), live peak %.2f MB, without reuse %.2f MB\n", arena_bytes_ / 1048576., \
+               n_chunks(), live_peak_bytes() / 1048576., total_bytes() / 1048576.);
+    }
+
+private:
+    static size_t align(size_t value, size_t alignment){
+        return (value + alignment - 1) / alignment * alignment;
+    }
+
+    std::vector<plan_tensor> tensors_;
+    size_t arena_bytes_ = 0;
+    size_t chunk_bytes_ = (size_t)-1;
+};
+
+#endif
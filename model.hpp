@@ -0,0 +1,278 @@
+#ifndef TOMOGAN_MODEL_HPP
+#define TOMOGAN_MODEL_HPP
+
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// Model container: a header, a table with the name, dtype, layout, shape, offset, size and
+// CRC-32 of every tensor, then the tensors at 64 byte aligned offsets. Files are mapped
+// with mmap, so tensors are read (or uploaded) straight from the page cache without heap
+// copies. Files without the magic are the legacy headerless format, float32 weights back
+// to back in network order, whose sizes can only be checked against the total file size.
+// tomogan_convert.cpp turns a legacy file into a container, tomogan_quantize.cpp writes
+// quantized ones: int8 weights plus float vectors of scales per conv (quantize.hpp).
+#define MODEL_MAGIC     "TOMOGAN"
+#define MODEL_VERSION   (1)
+#define MODEL_ALIGNMENT (64)
+
+enum model_dtype{
+    MODEL_F32 = 0,
+    MODEL_I8  = 1
+};
+
+enum model_layout{
+    // conv weights [filters][rows][cols][channels]
+    MODEL_KRSC   = 0,
+    // shape[0] values, the other dimensions are 1
+    MODEL_VECTOR = 1
+};
+
+inline size_t model_dtype_size(uint32_t dtype){
+    return dtype == MODEL_I8 ? 1 : 4;
+}
+
+struct model_header{
+    char magic[8];
+    uint32_t version;
+    uint32_t n_tensors;
+    uint64_t file_bytes;
+};
+
+struct model_tensor{
+    char name[48];
+    uint32_t dtype;
+    uint32_t layout;
+    // filters, rows, cols, channels
+    uint32_t shape[4];
+    uint64_t offset;
+    uint64_t bytes;
+    uint32_t crc32;
+    uint32_t reserved;
+};
+
+uint32_t model_crc32(const void *data, size_t bytes){
+    static uint32_t table[256];
+    static bool table_ready = false;
+    if(!table_ready){
+        for(uint32_t i = 0; i < 256; i++){
+            uint32_t c = i;
+            for(int k = 0; k < 8; k++){
+                c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            }
+            table[i] = c;
+        }
+        table_ready = true;
+    }
+    const unsigned char *p = (const unsigned char *)data;
+    uint32_t crc = 0xFFFFFFFFu;
+    for(size_t i = 0; i < bytes; i++){
+        crc = table[(crc ^ p[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return crc ^ 0xFFFFFFFFu;
+}
+
+class model_file{
+public:
+    // map a container or a legacy file, any error is fatal
+    explicit model_file(const char *path) : path_(path), cursor_(0){
+        int fd = open(path, O_RDONLY);
+        struct stat st;
+        if(fd < 0 || fstat(fd, &st) != 0){
+            printf("Error: failed to open model file %s\n", path);
+            exit(1);
+        }
+        bytes_ = st.st_size;
+        base_ = bytes_ > 0 ? (const char *)mmap(NULL, bytes_, PROT_READ, MAP_PRIVATE, fd, 0) : NULL;
+        close(fd);
+        if(base_ == MAP_FAILED || base_ == NULL){
+            printf("Error: failed to map model file %s\n", path);
+            exit(1);
+        }
+        legacy_ = bytes_ < sizeof(model_header) || memcmp(base_, MODEL_MAGIC, sizeof(MODEL_MAGIC)) != 0;
+        if(legacy_){
+            return;
+        }
+        const model_header *header = (const model_header *)base_;
+        if(header->version > MODEL_VERSION){
+            printf("Error: %s is model format version %d, this build reads up to %d\n", path, header->version, MODEL_VERSION);
+            exit(1);
+        }
+        if(header->file_bytes != bytes_ || sizeof(model_header) + (size_t)header->n_tensors * sizeof(model_tensor) > bytes_){
+            printf("Error: %s is truncated, %ld bytes instead of %ld\n", path, bytes_, (size_t)header->file_bytes);
+            exit(1);
+        }
+        const model_tensor *table = (const model_tensor *)(base_ + sizeof(model_header));
+        tensors_.assign(table, table + header->n_tensors);
+        for(const model_tensor &t : tensors_){
+            if(t.offset % MODEL_ALIGNMENT != 0 || t.offset + t.bytes > bytes_ || t.name[sizeof(t.name) - 1] != '\0'){
+                printf("Error: %s has a corrupt tensor table\n", path);
+                exit(1);
+            }
+        }
+    }
+    ~model_file(){
+        munmap((void *)base_, bytes_);
+    }
+    model_file(const model_file &) = delete;
+    model_file& operator=(const model_file &) = delete;
+
+    bool legacy() const { return legacy_; }
+    const std::vector<model_tensor>& tensors() const { return tensors_; }
+    const float* data(const model_tensor &t) const { return (const float *)(base_ + t.offset); }
+
+    // the table entry of tensor `name` of a container, NULL when there is none
+    const model_tensor* find(const char *name) const{
+        for(const model_tensor &t : tensors_){
+            if(strcmp(t.name, name) == 0){
+                return &t;
+            }
+        }
+        return NULL;
+    }
+
+    // tensor `name` of a container, checked for dtype, layout, shape and checksum
+    const void* tensor(const char *name, model_dtype dtype, model_layout layout, const uint32_t shape[4]){
+        const model_tensor *t = find(name);
+        if(t == NULL){
+            printf("Error: %s has no tensor %s\n", path_.c_str(), name);
+            exit(1);
+        }
+        size_t bytes = model_dtype_size(dtype) * shape[0] * shape[1] * shape[2] * shape[3];
+        if(t->dtype != dtype || t->layout != layout || t->bytes != bytes || t->shape[0] != shape[0] || \
+           t->shape[1] != shape[1] || t->shape[2] != shape[2] || t->shape[3] != shape[3]){
+            printf("Error: %s in %s is %dx%dx%dx%d (dtype %d, layout %d), expected %dx%dx%dx%d (dtype %d, layout %d)\n", \
+                   name, path_.c_str(), t->shape[0], t->shape[1], t->shape[2], t->shape[3], t->dtype, t->layout, \
+                   shape[0], shape[1], shape[2], shape[3], dtype, layout);
+            exit(1);
+        }
+        if(model_crc32(base_ + t->offset, t->bytes) != t->crc32){
+            printf("Error: checksum mismatch for %s in %s\n", name, path_.c_str());
+            exit(1);
+        }
+        cursor_ += bytes;
+        return base_ + t->offset;
+    }
+
+    // float32 weights of conv `name`, [num_filter][filter_size][filter_size][channel], checked
+    // against the file: shape, dtype, layout and checksum of a container, the remaining size
+    // of a legacy file, which is read back to back in call order
+    const float* conv_weights(const char *name, unsigned int num_filter, unsigned int filter_size, unsigned int channel){
+        size_t bytes = sizeof(float) * num_filter * filter_size * filter_size * channel;
+        if(legacy_){
+            if(cursor_ + bytes > bytes_){
+                printf("Error while load weights for %s, EoF reached, only %ld bytes could be read\n", name, bytes_ - cursor_);
+                exit(1);
+            }
+            const float *weights = (const float *)(base_ + cursor_);
+            cursor_ += bytes;
+            return weights;
+        }
+        for(const model_tensor &t : tensors_){
+            if(strcmp(t.name, name) != 0){
+                continue;
+            }
+            if(t.dtype != MODEL_F32 || t.layout != MODEL_KRSC || t.bytes != bytes || t.shape[0] != num_filter || \
+               t.shape[1] != filter_size || t.shape[2] != filter_size || t.shape[3] != channel){
+                printf("Error: %s in %s is %dx%dx%dx%d (dtype %d, layout %d), the network needs %dx%dx%dx%d float32\n", \
+                       name, path_.c_str(), t.shape[0], t.shape[1], t.shape[2], t.shape[3], t.dtype, t.layout, \
+                       num_filter, filter_size, filter_size, channel);
+                exit(1);
+            }
+            if(model_crc32(base_ + t.offset, t.bytes) != t.crc32){
+                printf("Error: checksum mismatch for %s in %s\n", name, path_.c_str());
+                exit(1);
+            }
+            cursor_ += bytes;
+            return data(t);
+        }
+        printf("Error: %s has no weights for %s\n", path_.c_str(), name);
+        exit(1);
+    }
+
+    // after all conv_weights() calls: a legacy file must have been used up exactly,
+    // tensors of a container that were not asked for are reported
+    void finish() const{
+        size_t total = legacy_ ? bytes_ : 0;
+        for(const model_tensor &t : tensors_){
+            total += t.bytes;
+        }
+        if(legacy_ && cursor_ != total){
+            printf("Error: %s has %ld bytes of weights, the network uses %ld\n", path_.c_str(), total, cursor_);
+            exit(1);
+        }
+        if(!legacy_ && cursor_ != total){
+            printf("Warning: %s has %ld bytes of weights the network does not use\n", path_.c_str(), total - cursor_);
+        }
+    }
+
+    void print() const{
+        if(legacy_){
+            printf("%s: legacy weights file, %ld bytes\n", path_.c_str(), bytes_);
+            return;
+        }
+        printf("%s: model format version %d, %ld tensors, %ld bytes\n", path_.c_str(), \
+               ((const model_header *)base_)->version, tensors_.size(), bytes_);
+        printf("%-12s %5s %6s %18s %10s %10s %10s\n", "tensor", "dtype", "layout", "shape", "offset", "bytes", "crc32");
+        for(const model_tensor &t : tensors_){
+            char shape[32];
+            snprintf(shape, sizeof(shape), "%dx%dx%dx%d", t.shape[0], t.shape[1], t.shape[2], t.shape[3]);
+            printf("%-12s %5d %6d %18s %10ld %10ld %10x\n", t.name, t.dtype, t.layout, shape, (size_t)t.offset, \
+                   (size_t)t.bytes, t.crc32);
+        }
+    }
+
+private:
+    std::string path_;
+    const char *base_;
+    size_t bytes_;
+    bool legacy_;
+    std::vector<model_tensor> tensors_;
+    // bytes handed out by conv_weights()
+    size_t cursor_;
+};
+
+// Write a container: t.name, dtype, layout, shape and bytes are taken from tensors, offsets
+// and checksums are filled in here.
+void write_model(const char *path, std::vector<model_tensor> tensors, const std::vector<const void *> &data){
+    size_t offset = sizeof(model_header) + tensors.size() * sizeof(model_tensor);
+    for(unsigned int i = 0; i < tensors.size(); i++){
+        offset = (offset + MODEL_ALIGNMENT - 1) / MODEL_ALIGNMENT * MODEL_ALIGNMENT;
+        tensors[i].offset = offset;
+        tensors[i].crc32 = model_crc32(data[i], tensors[i].bytes);
+        offset += tensors[i].bytes;
+    }
+    model_header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, MODEL_MAGIC, sizeof(MODEL_MAGIC));
+    header.version = MODEL_VERSION;
+    header.n_tensors = tensors.size();
+    header.file_bytes = offset;
+
+    FILE *fout = fopen(path, "wb");
+    if(!fout){
+        printf("Error: failed to create %s\n", path);
+        exit(1);
+    }
+    bool ok = fwrite(&header, sizeof(header), 1, fout) == 1;
+    ok = ok && fwrite(tensors.data(), sizeof(model_tensor), tensors.size(), fout) == tensors.size();
+    const char zeros[MODEL_ALIGNMENT] = {0};
+    for(unsigned int i = 0; i < tensors.size() && ok; i++){
+        size_t pad = tensors[i].offset - ftell(fout);
+        ok = fwrite(zeros, 1, pad, fout) == pad && fwrite(data[i], 1, tensors[i].bytes, fout) == tensors[i].bytes;
+    }
+    if(fclose(fout) != 0 || !ok){
+        printf("Error: failed to write %s\n", path);
+        exit(1);
+    }
+}
+
+#endif
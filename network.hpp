@@ -0,0 +1,207 @@
+#ifndef TOMOGAN_NETWORK_HPP
+#define TOMOGAN_NETWORK_HPP
+
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+
+// Declarative description of a U-Net style generator, see tomogan.net for the file format.
+// Nodes are kept in file order, which is a valid execution order since every input is
+// defined before it is used. Shapes are inferred while loading: channels from the convs
+// and concatenations, the U-Net level (pixels are 2^level input pixels wide) from the
+// poolings and upsamplings.
+enum net_op{
+    NET_INPUT,
+    NET_CONV,
+    NET_POOL,
+    NET_UPSAMPLE,
+    NET_CONCAT
+};
+
+struct net_node{
+    net_op op;
+    std::string name;
+    // producing nodes, -1 when unused
+    int input[2];
+    unsigned int channel;
+    unsigned int level;
+    // nodes that read this one
+    unsigned int n_consumers;
+    // convs only: input channels, filters are filter_size x filter_size, ReLU or linear,
+    // and the index of the conv in weights order
+    unsigned int in_channel;
+    unsigned int filter_size;
+    bool relu;
+    int conv;
+};
+
+class network{
+public:
+    // parse and check a network file, any error is fatal
+    static network load(const char *path){
+        std::ifstream fin(path);
+        if(!fin){
+            printf("Error: failed to open network file %s\n", path);
+            exit(1);
+        }
+        network net;
+        std::string line;
+        int line_no = 0;
+        while(std::getline(fin, line)){
+            line_no++;
+            line = line.substr(0, line.find('#'));
+            std::istringstream tokens(line);
+            std::string op;
+            if(!(tokens >> op)){
+                continue;
+            }
+            net.parse_node(op, tokens, path, line_no);
+        }
+        if(net.nodes_.empty() || net.nodes_[0].op != NET_INPUT){
+            printf("Error: %s must start with an input node\n", path);
+            exit(1);
+        }
+        if(net.output_ < 0){
+            printf("Error: %s has no output node\n", path);
+            exit(1);
+        }
+        if(net.nodes_[net.output_].level != 0){
+            printf("Error: %s: output %s is not at the input resolution\n", path, net.nodes_[net.output_].name.c_str());
+            exit(1);
+        }
+        return net;
+    }
+
+    unsigned int size() const { return nodes_.size(); }
+    const net_node& node(unsigned int id) const { return nodes_[id]; }
+    int input() const { return 0; }
+    int output() const { return output_; }
+    unsigned int channel() const { return nodes_[0].channel; }
+    unsigned int n_convs() const { return convs_.size(); }
+    // node id of the i-th conv in weights order
+    int conv_node(unsigned int i) const { return convs_[i]; }
+    // deepest level, inputs are padded to a multiple of 2^max_level so all poolings are exact
+    unsigned int max_level() const { return max_level_; }
+
+    // Input pixels on each side of an output pixel that can influence it, the longest path
+    // from the input: every conv adds its radius and every 2x2 pooling its extra pixel, both
+    // scaled to the input resolution. Rounded up to a multiple of 2^max_level so tiles keep
+    // the pooling grid of the whole image.
+    unsigned int halo() const{
+        std::vector<unsigned int> reach(nodes_.size(), 0);
+        for(unsigned int i = 1; i < nodes_.size(); i++){
+            const net_node &n = nodes_[i];
+            for(int k = 0; k < 2; k++){
+                if(n.input[k] >= 0){
+                    reach[i] = std::max(reach[i], reach[n.input[k]]);
+                }
+            }
+            if(n.op == NET_CONV){
+                reach[i] += (n.filter_size / 2) << n.level;
+            }else if(n.op == NET_POOL){
+                reach[i] += 1 << nodes_[n.input[0]].level;
+            }
+        }
+        unsigned int multiple = 1 << max_level_;
+        return (reach[output_] + multiple - 1) / multiple * multiple;
+    }
+
+    void print() const{
+        printf("%-12s %-9s %-24s %5s %5s\n", "node", "op", "inputs", "ch", "level");
+        const char *op_names[] = {"input", "conv", "pool", "upsample", "concat"};
+        for(const net_node &n : nodes_){
+            std::string inputs;
+            for(int k = 0; k < 2 && n.input[k] >= 0; k++){
+                inputs += (k ? " " : "") + nodes_[n.input[k]].name;
+            }
+            printf("%-12s %-9s %-24s %5d %5d\n", n.name.c_str(), op_names[n.op], inputs.c_str(), n.channel, n.level);
+        }
+    }
+
+private:
+    int find(const std::string &name) const{
+        for(unsigned int i = 0; i < nodes_.size(); i++){
+            if(nodes_[i].name == name){
+                return i;
+            }
+        }
+        return -1;
+    }
+
+    // the id of an input node named in the file, which must already be defined
+    int parse_input(std::istringstream &tokens, const char *path, int line_no){
+        std::string name;
+        int id = (tokens >> name) ? find(name) : -1;
+        if(id < 0){
+            printf("Error: %s:%d: input %s is not defined before\n", path, line_no, name.c_str());
+            exit(1);
+        }
+        nodes_[id].n_consumers++;
+        return id;
+    }
+
+    void parse_node(const std::string &op, std::istringstream &tokens, const char *path, int line_no){
+        if(op == "output"){
+            output_ = parse_input(tokens, path, line_no);
+            return;
+        }
+        net_node n = {NET_INPUT, "", {-1, -1}, 0, 0, 0, 0, 0, false, -1};
+        if(!(tokens >> n.name) || find(n.name) >= 0){
+            printf("Error: %s:%d: missing or duplicate node name %s\n", path, line_no, n.name.c_str());
+            exit(1);
+        }
+        bool ok = true;
+        if(op == "input"){
+            ok = (tokens >> n.channel) && n.channel > 0 && nodes_.empty();
+        }else if(op == "conv"){
+            n.op = NET_CONV;
+            n.input[0] = parse_input(tokens, path, line_no);
+            std::string activation;
+            ok = (tokens >> n.channel >> n.filter_size >> activation) && n.channel > 0 && n.filter_size % 2 == 1 && \
+                 (activation == "relu" || activation == "linear");
+            n.in_channel = nodes_[n.input[0]].channel;
+            n.level = nodes_[n.input[0]].level;
+            n.relu = activation == "relu";
+            n.conv = convs_.size();
+            convs_.push_back(nodes_.size());
+        }else if(op == "pool"){
+            n.op = NET_POOL;
+            n.input[0] = parse_input(tokens, path, line_no);
+            n.channel = nodes_[n.input[0]].channel;
+            n.level = nodes_[n.input[0]].level + 1;
+        }else if(op == "upsample"){
+            n.op = NET_UPSAMPLE;
+            n.input[0] = parse_input(tokens, path, line_no);
+            n.channel = nodes_[n.input[0]].channel;
+            ok = nodes_[n.input[0]].level > 0;
+            n.level = nodes_[n.input[0]].level - 1;
+        }else if(op == "concat"){
+            n.op = NET_CONCAT;
+            n.input[0] = parse_input(tokens, path, line_no);
+            n.input[1] = parse_input(tokens, path, line_no);
+            n.channel = nodes_[n.input[0]].channel + nodes_[n.input[1]].channel;
+            ok = nodes_[n.input[0]].level == nodes_[n.input[1]].level;
+            n.level = nodes_[n.input[0]].level;
+        }else{
+            printf("Error: %s:%d: unknown op %s\n", path, line_no, op.c_str());
+            exit(1);
+        }
+        if(!ok){
+            printf("Error: %s:%d: invalid %s node %s\n", path, line_no, op.c_str(), n.name.c_str());
+            exit(1);
+        }
+        max_level_ = std::max(max_level_, n.level);
+        nodes_.push_back(n);
+    }
+
+    std::vector<net_node> nodes_;
+    std::vector<int> convs_;
+    int output_ = -1;
+    unsigned int max_level_ = 0;
+};
+
+#endif
@@ -0,0 +1,137 @@
+#ifndef TOMOGAN_PROFILER_HPP
+#define TOMOGAN_PROFILER_HPP
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "device.hpp"
+
+// device time of one named step, summed over all the enqueues that used the name
+struct ocl_profile_entry{
+    std::string name;
+    unsigned int calls;
+    double ms;
+    double flops;
+    double bytes;
+};
+
+// Collects OpenCL events of a queue created with CL_QUEUE_PROFILING_ENABLE. Every enqueue
+// asks event() for the pointer to pass as its `event` argument; NULL is returned while
+// profiling is off so the hot path does not create events. The pointer is only valid until
+// the next call, which is fine since clEnqueue* fills it before returning. collect() must
+// run once the commands have completed, e.g. after a blocking read.
+class ocl_profiler{
+public:
+    ocl_profiler() : enabled_(false) {}
+    ~ocl_profiler(){ reset(); }
+
+    void set_enabled(bool enabled){ enabled_ = enabled; }
+    bool enabled() const { return enabled_; }
+
+    // flops and bytes are the useful work and the minimal traffic of the command
+    cl_event* event(const char *name, double flops = 0, double bytes = 0);
+    // read start/end of all pending events into the entries and release them
+    void collect();
+    // drop the entries (and any pending event)
+    void reset();
+
+    const std::vector<ocl_profile_entry>& entries() const { return entries_; }
+    double total_ms() const;
+
+    void print_report() const;
+    void write_json(const char *path) const;
+
+private:
+    bool enabled_;
+    std::vector<ocl_profile_entry> entries_;
+    std::vector<std::pair<size_t, cl_event> > pending_;
+};
+
+cl_event* ocl_profiler::event(const char *name, double flops, double bytes){
+    if(!enabled_){
+        return NULL;
+    }
+    size_t idx = 0;
+    while(idx < entries_.size() && entries_[idx].name != name){
+        idx++;
+    }
+    if(idx == entries_.size()){
+        ocl_profile_entry entry = {name, 0, 0, 0, 0};
+        entries_.push_back(entry);
+    }
+    entries_[idx].calls += 1;
+    entries_[idx].flops += flops;
+    entries_[idx].bytes += bytes;
+    pending_.push_back(std::make_pair(idx, (cl_event)NULL));
+    return &pending_.back().second;
+}
+
+void ocl_profiler::collect(){
+    for(size_t i = 0; i < pending_.size(); i++){
+        cl_event ev = pending_[i].second;
+        if(ev == NULL){
+            continue;
+        }
+        cl_ulong st = 0, ed = 0;
+        int err  = clGetEventProfilingInfo(ev, CL_PROFILING_COMMAND_START, sizeof(cl_ulong), &st, NULL);
+        err     |= clGetEventProfilingInfo(ev, CL_PROFILING_COMMAND_END,   sizeof(cl_ulong), &ed, NULL);
+        if(err == CL_SUCCESS){
+            entries_[pending_[i].first].ms += (ed - st) / 1e6;
+        }
+        clReleaseEvent(ev);
+    }
+    pending_.clear();
+}
+
+void ocl_profiler::reset(){
+    for(size_t i = 0; i < pending_.size(); i++){
+        if(pending_[i].second != NULL){
+            clReleaseEvent(pending_[i].second);
+        }
+    }
+    pending_.clear();
+    entries_.clear();
+}
+
+double ocl_profiler::total_ms() const{
+    double total = 0;
+    for(size_t i = 0; i < entries_.size(); i++){
+        total += entries_[i].ms;
+    }
+    return total;
+}
+
+void ocl_profiler::print_report() const{
+    double total = total_ms();
+    printf("%-12s %6s %10s %7s %10s %10s\n", "step", "calls", "ms", "%", "GFLOP/s", "GB/s");
+    for(size_t i = 0; i < entries_.size(); i++){
+        const ocl_profile_entry &e = entries_[i];
+        printf("%-12s %6d %10.3f %6.1f%% %10.2f %10.2f\n", e.name.c_str(), e.calls, e.ms, \
+               total > 0 ? 100. * e.ms / total : 0., e.ms > 0 ? e.flops / e.ms / 1e6 : 0., e.ms > 0 ? e.bytes / e.ms / 1e6 : 0.);
+    }
+    printf("%-12s %6s %10.3f\n", "total", "", total);
+}
+
+void ocl_profiler::write_json(const char *path) const{
+    std::ofstream fout(path);
+    if(!fout){
+        printf("Error: failed to open %s for the profile\n", path);
+        return;
+    }
+    char line[512];
+    fout << "{\n  \"total_ms\": " << total_ms() << ",\n  \"steps\": [\n";
+    for(size_t i = 0; i < entries_.size(); i++){
+        const ocl_profile_entry &e = entries_[i];
+        snprintf(line, sizeof(line), "    {\"name\": \"%s\", \"calls\": %d, \"ms\": %.6f, \"flops\": %.0f, \"bytes\": %.0f, " \
+                 "\"gflops\": %.3f, \"gbps\": %.3f}%s\n", e.name.c_str(), e.calls, e.ms, e.flops, e.bytes, \
+                 e.ms > 0 ? e.flops / e.ms / 1e6 : 0., e.ms > 0 ? e.bytes / e.ms / 1e6 : 0., \
+                 i + 1 < entries_.size() ? "," : "");
+        fout << line;
+    }
+    fout << "  ]\n}\n";
+    printf("Profile written to %s\n", path);
+}
+
+#endif
@@ -0,0 +1,122 @@
+#ifndef TOMOGAN_PROGRAM_HPP
+#define TOMOGAN_PROGRAM_HPP
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstdio>
+#include <cstdint>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "device.hpp"
+
+// 64-bit FNV-1a, good enough to key the program cache
+uint64_t fnv1a_hash(const std::string &data, uint64_t hash = 14695981039346656037ULL){
+    for(size_t i = 0; i < data.size(); i++){
+        hash ^= (unsigned char)data[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+std::string read_text_file(const char *path){
+    std::ifstream fin(path);
+    if(!fin){
+        fprintf(stderr, "Failed to load %s.\n", path);
+        exit(1);
+    }
+    std::stringstream ss;
+    ss << fin.rdbuf();
+    return ss.str();
+}
+
+void print_build_log(cl_program program, const ocl_device_info &dev_info){
+    size_t len = 0;
+    clGetProgramBuildInfo(program, dev_info.device, CL_PROGRAM_BUILD_LOG, 0, NULL, &len);
+    std::vector<char> buffer(len + 1, 0);
+    clGetProgramBuildInfo(program, dev_info.device, CL_PROGRAM_BUILD_LOG, len, buffer.data(), NULL);
+    printf("build error: %s\n", buffer.data());
+}
+
+// Build the program in `source_path` with `options`. Built binaries are kept in the
+// directory given by TOMOGAN_CACHE_DIR (default .tomogan_cache), keyed by device name,
+// driver version, build options and the kernel source, so later runs skip the compiler.
+// A stale or rejected binary is simply rebuilt from source and overwritten.
+cl_program build_program(cl_context context, const ocl_device_info &dev_info, const char *source_path, const char *options = ""){
+    auto build_st = std::chrono::steady_clock::now();
+    std::string source = read_text_file(source_path);
+    uint64_t key = fnv1a_hash(dev_info.name + '\0' + dev_info.driver_version + '\0' + options + '\0' + source);
+
+    const char *cache_dir = getenv("TOMOGAN_CACHE_DIR");
+    if(cache_dir == NULL){
+        cache_dir = ".tomogan_cache";
+    }
+    char cache_path[512];
+    snprintf(cache_path, sizeof(cache_path), "%s/%016llx.bin", cache_dir, (unsigned long long)key);
+
+    cl_int err;
+    cl_program program = NULL;
+    std::ifstream cache_fin(cache_path, std::ios::binary);
+    if(cache_fin){
+        std::vector<unsigned char> binary((std::istreambuf_iterator<char>(cache_fin)), std::istreambuf_iterator<char>());
+        const unsigned char *binary_ptr = binary.data();
+        size_t binary_size = binary.size();
+        cl_int binary_status;
+        program = clCreateProgramWithBinary(context, 1, &dev_info.device, &binary_size, &binary_ptr, &binary_status, &err);
+        if(program && (err != CL_SUCCESS || binary_status != CL_SUCCESS || \
+                       clBuildProgram(program, 1, &dev_info.device, options, NULL, NULL) != CL_SUCCESS)){
+            clReleaseProgram(program);
+            program = NULL;
+        }
+        if(!program){
+            printf("Cached program %s is not usable, rebuilding from source\n", cache_path);
+        }
+    }
+
+    bool from_cache = (program != NULL);
+    if(!from_cache){
+        const char *source_str = source.c_str();
+        program = clCreateProgramWithSource(context, 1, &source_str, NULL, &err);
+        if (!program){
+            printf("Error: Failed to create compute program! %d\n", err);
+            exit(1);
+        }
+        err = clBuildProgram(program, 1, &dev_info.device, options, NULL, NULL);
+        if (err != CL_SUCCESS){
+            printf("Error: Failed to build program executable!: %d\n", err);
+            print_build_log(program, dev_info);
+            exit(1);
+        }
+
+        // save the binary for next runs, a failure here only costs the next run a rebuild; it is
+        // written to a file of this process and renamed into place, so a killed or concurrent
+        // run never leaves a truncated binary at cache_path
+        size_t binary_size = 0;
+        clGetProgramInfo(program, CL_PROGRAM_BINARY_SIZES, sizeof(size_t), &binary_size, NULL);
+        std::vector<unsigned char> binary(binary_size);
+        unsigned char *binary_ptr = binary.data();
+        if(binary_size > 0 && clGetProgramInfo(program, CL_PROGRAM_BINARIES, sizeof(unsigned char*), &binary_ptr, NULL) == CL_SUCCESS){
+            mkdir(cache_dir, 0755);
+            char tmp_path[540];
+            snprintf(tmp_path, sizeof(tmp_path), "%s.%d.tmp", cache_path, (int)getpid());
+            std::ofstream cache_fout(tmp_path, std::ios::binary);
+            cache_fout.write((char *) binary.data(), binary_size);
+            cache_fout.close();
+            if(!cache_fout || rename(tmp_path, cache_path) != 0){
+                remove(tmp_path);
+            }
+        }
+    }
+
+    auto build_ed = std::chrono::steady_clock::now();
+    printf("It takes %.3f ms to %s OCL program %s\n", \
+           std::chrono::duration_cast<std::chrono::microseconds>(build_ed - build_st).count()/1000., \
+           from_cache ? "load cached" : "compile", source_path);
+    return program;
+}
+
+#endif
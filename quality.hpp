@@ -0,0 +1,88 @@
+#ifndef TOMOGAN_QUALITY_HPP
+#define TOMOGAN_QUALITY_HPP
+
+#include <cstdio>
+#include <cmath>
+#include <vector>
+#include <algorithm>
+
+// Accuracy of an output against a reference one, e.g. a reduced precision run against the
+// fp32 output_img.bin. Both are height x width x channel (HWC). PSNR and SSIM use the
+// value range of the reference as the data range; SSIM is the mean over all 7x7 windows
+// (uniform weights, K1 = 0.01, K2 = 0.03) and channels, the default of scikit-image's
+// structural_similarity, so the numbers can be checked against it.
+struct image_quality{
+    double max_abs_diff;
+    double rmse;
+    double psnr;
+    double ssim;
+};
+
+#define SSIM_WINDOW (7)
+
+image_quality compare_images(const float *test, const float *ref, unsigned int height, unsigned int width, \
+                             unsigned int channel){
+    image_quality q = {0, 0, 0, 0};
+    const size_t n = (size_t)height * width * channel;
+    float ref_min = ref[0], ref_max = ref[0];
+    double sq_err = 0;
+    for(size_t i = 0; i < n; i++){
+        double diff = (double)test[i] - ref[i];
+        q.max_abs_diff = std::max(q.max_abs_diff, std::fabs(diff));
+        sq_err += diff * diff;
+        ref_min = std::min(ref_min, ref[i]);
+        ref_max = std::max(ref_max, ref[i]);
+    }
+    const double range = (double)ref_max - ref_min;
+    q.rmse = std::sqrt(sq_err / n);
+    q.psnr = (q.rmse > 0) ? 20 * std::log10(range / q.rmse) : INFINITY;
+
+    if(height < SSIM_WINDOW || width < SSIM_WINDOW){
+        q.ssim = NAN;
+        return q;
+    }
+    // sums over each window from integral images of x, y, x^2, y^2 and xy
+    const double c1 = (0.01 * range) * (0.01 * range), c2 = (0.03 * range) * (0.03 * range);
+    const double np = SSIM_WINDOW * SSIM_WINDOW, cov_norm = np / (np - 1);
+    const size_t iw = width + 1;
+    std::vector<double> sums[5];
+    for(int k = 0; k < 5; k++){
+        sums[k].assign((size_t)(height + 1) * iw, 0.0);
+    }
+    double ssim_total = 0;
+    for(unsigned int ch = 0; ch < channel; ch++){
+        for(unsigned int r = 0; r < height; r++)
+            for(unsigned int c = 0; c < width; c++){
+                double x = test[((size_t)width * r + c) * channel + ch];
+                double y = ref[((size_t)width * r + c) * channel + ch];
+                double v[5] = {x, y, x * x, y * y, x * y};
+                size_t at = (r + 1) * iw + c + 1;
+                for(int k = 0; k < 5; k++){
+                    sums[k][at] = v[k] + sums[k][at - 1] + sums[k][at - iw] - sums[k][at - iw - 1];
+                }
+        }
+        for(unsigned int r = 0; r + SSIM_WINDOW <= height; r++)
+            for(unsigned int c = 0; c + SSIM_WINDOW <= width; c++){
+                double m[5];
+                for(int k = 0; k < 5; k++){
+                    const std::vector<double> &s = sums[k];
+                    m[k] = (s[(r + SSIM_WINDOW) * iw + c + SSIM_WINDOW] - s[r * iw + c + SSIM_WINDOW] - \
+                            s[(r + SSIM_WINDOW) * iw + c] + s[r * iw + c]) / np;
+                }
+                double vx  = cov_norm * (m[2] - m[0] * m[0]);
+                double vy  = cov_norm * (m[3] - m[1] * m[1]);
+                double vxy = cov_norm * (m[4] - m[0] * m[1]);
+                ssim_total += ((2 * m[0] * m[1] + c1) * (2 * vxy + c2)) / \
+                              ((m[0] * m[0] + m[1] * m[1] + c1) * (vx + vy + c2));
+        }
+    }
+    q.ssim = ssim_total / ((double)(height - SSIM_WINDOW + 1) * (width - SSIM_WINDOW + 1) * channel);
+    return q;
+}
+
+void print_quality(const char *name, const char *ref_name, const image_quality &q){
+    printf("Accuracy of %s against %s: max abs diff %g, RMSE %g, PSNR %.2f dB, SSIM %.6f\n", \
+           name, ref_name, q.max_abs_diff, q.rmse, q.psnr, q.ssim);
+}
+
+#endif
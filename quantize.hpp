@@ -0,0 +1,352 @@
+#ifndef TOMOGAN_QUANTIZE_HPP
+#define TOMOGAN_QUANTIZE_HPP
+
+#include <cstdio>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <functional>
+#include <algorithm>
+
+#include "utils.hpp"
+#include "network.hpp"
+#include "model.hpp"
+#include "conv_gemm.hpp"
+#include "conv_int8.hpp"
+
+// Post-training INT8 quantization of a network for the CPU engine (conv_int8.hpp) and
+// conv2d_int8_mk of conv2d.cl. tomogan_quantize.cpp runs the fp32 network on sample slices,
+// records the value range of every node, and writes a quantized model container with, per
+// conv <name>:
+//   <name>        int8 weights [filters][rows][cols][channels], symmetric per filter
+//   <name>.scale  float [filters], real weight = scale * q
+//   <name>.quant  float [4], input scale and zero point, output scale and zero point
+// and <input>.quant for the network input. Activations are uint8 with one scale and zero
+// point per tensor, real = scale * (q - zero). Pooling, upsampling and concatenation only
+// move values, so their inputs and output share one quantization; the convs producing them
+// requantize straight to it. The output conv writes float (output scale 0).
+
+// range of the values of a node over the calibration slices
+struct act_range{
+    float min;
+    float max;
+};
+
+struct act_quant{
+    float scale;
+    int zero;
+};
+
+// uint8 quantization covering [min, max] and 0, so that 0 (ReLU, padding) is exact
+act_quant act_quant_from_range(act_range range){
+    float lo = std::min(range.min, 0.0f), hi = std::max(range.max, 0.0f);
+    act_quant q;
+    q.scale = hi > lo ? (hi - lo) / 255 : 1.0f;
+    q.zero = std::min(255, std::max(0, (int)lrintf(-lo / q.scale)));
+    return q;
+}
+
+void quantize_activations(const float *input, size_t n, act_quant q, uint8_t *output){
+    const float inv_scale = 1.0f / q.scale;
+    parallel_rows((n + 4095) / 4096, [&](unsigned int blk_st, unsigned int blk_ed){
+        for(size_t i = (size_t)blk_st * 4096; i < std::min(n, (size_t)blk_ed * 4096); i++){
+            float value = std::min(std::max(input[i] * inv_scale + q.zero, 0.0f), 255.0f);
+            output[i] = (uint8_t)lrintf(value);
+        }
+    });
+}
+
+// range of data, or its [100 - percentile, percentile] percentiles estimated on at most
+// 2^20 evenly strided values, which keeps rare outliers from stretching the scale
+act_range measure_range(const float *data, size_t n, float percentile){
+    act_range range = {data[0], data[0]};
+    if(percentile >= 100){
+        for(size_t i = 1; i < n; i++){
+            range.min = std::min(range.min, data[i]);
+            range.max = std::max(range.max, data[i]);
+        }
+        return range;
+    }
+    size_t stride = std::max((size_t)1, n >> 20);
+    std::vector<float> sample;
+    for(size_t i = 0; i < n; i += stride){
+        sample.push_back(data[i]);
+    }
+    size_t hi = std::min(sample.size() - 1, (size_t)(percentile / 100 * (sample.size() - 1)));
+    size_t lo = sample.size() - 1 - hi;
+    std::nth_element(sample.begin(), sample.begin() + hi, sample.end());
+    range.max = sample[hi];
+    std::nth_element(sample.begin(), sample.begin() + lo, sample.end());
+    range.min = sample[lo];
+    return range;
+}
+
+// quantization of every node: nodes tied by pooling, upsampling or concatenation are merged
+// (union-find) and get one quantization covering all of their ranges
+std::vector<act_quant> plan_activation_quant(const network &net, const std::vector<act_range> &ranges){
+    std::vector<int> group(net.size());
+    for(unsigned int i = 0; i < net.size(); i++){
+        group[i] = i;
+    }
+    std::function<int(int)> root = [&](int i){
+        return group[i] == i ? i : (group[i] = root(group[i]));
+    };
+    for(unsigned int i = 0; i < net.size(); i++){
+        const net_node &n = net.node(i);
+        if(n.op == NET_POOL || n.op == NET_UPSAMPLE || n.op == NET_CONCAT){
+            for(int k = 0; k < 2 && n.input[k] >= 0; k++){
+                group[root(n.input[k])] = root(i);
+            }
+        }
+    }
+    std::vector<act_range> merged(net.size(), act_range{0, 0});
+    for(unsigned int i = 0; i < net.size(); i++){
+        act_range &m = merged[root(i)];
+        m.min = std::min(m.min, ranges[i].min);
+        m.max = std::max(m.max, ranges[i].max);
+    }
+    std::vector<act_quant> quant(net.size());
+    for(unsigned int i = 0; i < net.size(); i++){
+        quant[i] = act_quant_from_range(merged[root(i)]);
+    }
+    return quant;
+}
+
+// symmetric per filter quantization to [-INT8_WEIGHT_MAX, INT8_WEIGHT_MAX]
+void quantize_filters(const float *filter_values, unsigned int k_size, unsigned int num_filter, int8_t *q, float *scale){
+    for(unsigned int kf = 0; kf < num_filter; kf++){
+        const float *w = filter_values + (size_t)kf * k_size;
+        float max_abs = 0;
+        for(unsigned int k = 0; k < k_size; k++){
+            max_abs = std::max(max_abs, fabsf(w[k]));
+        }
+        scale[kf] = max_abs > 0 ? max_abs / INT8_WEIGHT_MAX : 1.0f;
+        for(unsigned int k = 0; k < k_size; k++){
+            long v = lrintf(w[k] / scale[kf]);
+            q[(size_t)kf * k_size + k] = (int8_t)std::min(std::max(v, (long)-INT8_WEIGHT_MAX), (long)INT8_WEIGHT_MAX);
+        }
+    }
+}
+
+// wraps every op of run_network_cpu, e.g. to time it: step(name, bytes, flops, op)
+typedef std::function<void(const char *, double, double, const std::function<void()> &)> cpu_step_fn;
+
+void run_step_untimed(const char *, double, double, const std::function<void()> &op){
+    op();
+}
+
+// Runs net on CPU tensors of T in node order, each tensor freed after its last consumer.
+// conv(id, input, height, width, output) computes conv node id at the given resolution,
+// visit(id, tensor, size) sees every node's output once it is computed. height and width
+// must be multiples of 2^max_level.
+template <typename T>
+void run_network_cpu(const network &net, const T *input, unsigned int height, unsigned int width,
+                     const std::function<void(int, const T *, unsigned int, unsigned int, T *)> &conv,
+                     const std::function<void(int, const T *, size_t)> &visit,
+                     const cpu_step_fn &step = run_step_untimed){
+    const unsigned int multiple = 1 << net.max_level();
+    if(height % multiple != 0 || width % multiple != 0){
+        printf("Error: %dx%d is not a multiple of %d, the poolings of the network would not be exact\n", height, width, multiple);
+        exit(1);
+    }
+    std::vector<std::vector<T>> tensors(net.size());
+    std::vector<unsigned int> remaining(net.size());
+    for(unsigned int id = 0; id < net.size(); id++){
+        remaining[id] = net.node(id).n_consumers;
+    }
+    for(unsigned int id = 0; id < net.size(); id++){
+        const net_node &n = net.node(id);
+        unsigned int h = height >> n.level, w = width >> n.level;
+        tensors[id].resize((size_t)h * w * n.channel);
+        T *out = tensors[id].data();
+        const int in0 = n.input[0], in1 = n.input[1];
+        if(n.op == NET_INPUT){
+            std::copy(input, input + tensors[id].size(), out);
+        }else if(n.op == NET_CONV){
+            // weights are T too, float or int8
+            double bytes = sizeof(T) * ((double)h * w * (n.in_channel + n.channel) + \
+                                        (double)n.filter_size * n.filter_size * n.in_channel * n.channel);
+            double flops = 2. * h * w * n.filter_size * n.filter_size * n.in_channel * n.channel;
+            step(n.name.c_str(), bytes, flops, [&](){
+                conv(id, tensors[in0].data(), h, w, out);
+            });
+        }else if(n.op == NET_POOL){
+            step(n.name.c_str(), sizeof(T) * (double)h * w * n.channel * 5, 0, [&](){
+                maxpooling_cpu(tensors[in0].data(), h, w, n.channel, out);
+            });
+        }else if(n.op == NET_UPSAMPLE){
+            step(n.name.c_str(), sizeof(T) * (double)h * w * n.channel * 1.25, 0, [&](){
+                upsample_cpu_mt(tensors[in0].data(), h / 2, w / 2, n.channel, out);
+            });
+        }else{
+            step(n.name.c_str(), sizeof(T) * (double)h * w * n.channel * 2, 0, [&](){
+                concatenate_mt(tensors[in0].data(), tensors[in1].data(), h, w, net.node(in0).channel, \
+                               net.node(in1).channel, out);
+            });
+        }
+        visit(id, out, tensors[id].size());
+        for(int k = 0; k < 2; k++){
+            if(n.input[k] >= 0 && --remaining[n.input[k]] == 0){
+                std::vector<T>().swap(tensors[n.input[k]]);
+            }
+        }
+    }
+}
+
+// fp32 weights of the convs of net in weights order, mapped from the file
+std::vector<const float *> load_network_fp32(const network &net, model_file &weights){
+    std::vector<const float *> conv_weights;
+    for(unsigned int i = 0; i < net.n_convs(); i++){
+        const net_node &c = net.node(net.conv_node(i));
+        conv_weights.push_back(weights.conv_weights(c.name.c_str(), c.channel, c.filter_size, c.in_channel));
+    }
+    weights.finish();
+    return conv_weights;
+}
+
+// the same packed for conv2d_gemm_cpu
+std::vector<gemm_packed_filters> pack_network_fp32(const network &net, const std::vector<const float *> &conv_weights){
+    std::vector<gemm_packed_filters> packed;
+    for(unsigned int i = 0; i < net.n_convs(); i++){
+        const net_node &c = net.node(net.conv_node(i));
+        packed.push_back(gemm_pack_filters(conv_weights[i], c.filter_size * c.filter_size * c.in_channel, c.channel));
+    }
+    return packed;
+}
+
+// fp32 inference of net, visit(id, tensor, size) sees every node, output is height x width x
+// the output channels
+void run_network_fp32(const network &net, const std::vector<gemm_packed_filters> &filters, const float *input,
+                      unsigned int height, unsigned int width, float *output,
+                      const std::function<void(int, const float *, size_t)> &visit = nullptr){
+    run_network_cpu<float>(net, input, height, width,
+        [&](int id, const float *in, unsigned int h, unsigned int w, float *out){
+            const net_node &c = net.node(id);
+            conv2d_gemm_cpu(in, h, w, c.in_channel, filters[c.conv], c.filter_size, out, c.relu);
+        },
+        [&](int id, const float *tensor, size_t size){
+            if(visit){
+                visit(id, tensor, size);
+            }
+            if(id == net.output()){
+                std::copy(tensor, tensor + size, output);
+            }
+        });
+}
+
+// Write the quantized model of net: conv_weights are the fp32 ones (load_network_fp32),
+// quant the activation quantization of every node (plan_activation_quant).
+void write_quantized_model(const char *path, const network &net, const std::vector<const float *> &conv_weights,
+                           const std::vector<act_quant> &quant){
+    std::vector<model_tensor> tensors;
+    std::vector<const void *> data;
+    // owned here until the file is written
+    std::vector<std::vector<int8_t>> q_weights(net.n_convs());
+    std::vector<std::vector<float>> vectors;
+    vectors.reserve(2 * net.n_convs() + 1);
+    auto add = [&](const std::string &name, model_dtype dtype, model_layout layout, const uint32_t shape[4], const void *values){
+        model_tensor t;
+        memset(&t, 0, sizeof(t));
+        if(name.size() >= sizeof(t.name)){
+            printf("Error: tensor name %s is longer than %ld characters\n", name.c_str(), sizeof(t.name) - 1);
+            exit(1);
+        }
+        strcpy(t.name, name.c_str());
+        t.dtype = dtype;
+        t.layout = layout;
+        memcpy(t.shape, shape, sizeof(t.shape));
+        t.bytes = model_dtype_size(dtype) * shape[0] * shape[1] * shape[2] * shape[3];
+        tensors.push_back(t);
+        data.push_back(values);
+    };
+    const net_node &in = net.node(net.input());
+    const uint32_t quant_shape[4] = {4, 1, 1, 1};
+    vectors.push_back({quant[net.input()].scale, (float)quant[net.input()].zero, 0, 0});
+    add(in.name + ".quant", MODEL_F32, MODEL_VECTOR, quant_shape, vectors.back().data());
+    for(unsigned int i = 0; i < net.n_convs(); i++){
+        const int id = net.conv_node(i);
+        const net_node &c = net.node(id);
+        const unsigned int k_size = c.filter_size * c.filter_size * c.in_channel;
+        const float *w = conv_weights[i];
+        q_weights[i].resize((size_t)k_size * c.channel);
+        vectors.push_back(std::vector<float>(c.channel));
+        quantize_filters(w, k_size, c.channel, q_weights[i].data(), vectors.back().data());
+        const uint32_t w_shape[4] = {c.channel, c.filter_size, c.filter_size, c.in_channel};
+        const uint32_t s_shape[4] = {c.channel, 1, 1, 1};
+        add(c.name, MODEL_I8, MODEL_KRSC, w_shape, q_weights[i].data());
+        add(c.name + ".scale", MODEL_F32, MODEL_VECTOR, s_shape, vectors.back().data());
+        const act_quant qi = quant[c.input[0]], qo = quant[id];
+        if(id == net.output()){
+            vectors.push_back({qi.scale, (float)qi.zero, 0, 0});
+        }else{
+            vectors.push_back({qi.scale, (float)qi.zero, qo.scale, (float)qo.zero});
+        }
+        add(c.name + ".quant", MODEL_F32, MODEL_VECTOR, quant_shape, vectors.back().data());
+    }
+    write_model(path, tensors, data);
+}
+
+// INT8 inference of a network with a quantized model (write_quantized_model) on the CPU
+class int8_network{
+public:
+    int8_network(const network &net, model_file &model) : net_(net){
+        if(net.node(net.output()).op != NET_CONV){
+            printf("Error: INT8 inference needs a conv as the network output\n");
+            exit(1);
+        }
+        const uint32_t quant_shape[4] = {4, 1, 1, 1};
+        const float *in_q = (const float *)model.tensor((net.node(net.input()).name + ".quant").c_str(), MODEL_F32, \
+                                                        MODEL_VECTOR, quant_shape);
+        input_quant_.scale = in_q[0];
+        input_quant_.zero  = (int)in_q[1];
+        for(unsigned int i = 0; i < net.n_convs(); i++){
+            const int id = net.conv_node(i);
+            const net_node &c = net.node(id);
+            const uint32_t w_shape[4] = {c.channel, c.filter_size, c.filter_size, c.in_channel};
+            const uint32_t s_shape[4] = {c.channel, 1, 1, 1};
+            const int8_t *w = (const int8_t *)model.tensor(c.name.c_str(), MODEL_I8, MODEL_KRSC, w_shape);
+            const float *scale = (const float *)model.tensor((c.name + ".scale").c_str(), MODEL_F32, MODEL_VECTOR, s_shape);
+            const float *q = (const float *)model.tensor((c.name + ".quant").c_str(), MODEL_F32, MODEL_VECTOR, quant_shape);
+            int8_conv_params params;
+            params.in_scale  = q[0];
+            params.in_zero   = (int)q[1];
+            params.out_scale = q[2];
+            params.out_zero  = (int)q[3];
+            params.relu      = c.relu;
+            params.weight_scale.assign(scale, scale + c.channel);
+            if((params.out_scale == 0) != (id == net.output())){
+                printf("Error: %s of the model does not match the network, only the output conv writes float\n", c.name.c_str());
+                exit(1);
+            }
+            params_.push_back(params);
+            filters_.push_back(int8_pack_filters(w, c.filter_size * c.filter_size * c.in_channel, c.channel, params));
+        }
+        model.finish();
+    }
+
+    act_quant input_quant() const { return input_quant_; }
+    const int8_conv_params& conv_params(unsigned int conv) const { return params_[conv]; }
+
+    void run(const float *input, unsigned int height, unsigned int width, float *output,
+             const cpu_step_fn &step = run_step_untimed) const{
+        std::vector<uint8_t> input_q((size_t)height * width * net_.channel());
+        step("quantize", (1. + sizeof(float)) * input_q.size(), 0, [&](){
+            quantize_activations(input, input_q.size(), input_quant_, input_q.data());
+        });
+        run_network_cpu<uint8_t>(net_, input_q.data(), height, width,
+            [&](int id, const uint8_t *in, unsigned int h, unsigned int w, uint8_t *out){
+                const net_node &c = net_.node(id);
+                conv2d_int8_cpu(in, h, w, c.in_channel, filters_[c.conv], c.filter_size, out, \
+                                id == net_.output() ? output : NULL);
+            },
+            [](int, const uint8_t *, size_t){}, step);
+    }
+
+private:
+    const network &net_;
+    act_quant input_quant_;
+    std::vector<int8_conv_params> params_;
+    std::vector<int8_packed_filters> filters_;
+};
+
+#endif
@@ -0,0 +1,304 @@
+#ifndef TOMOGAN_SIMD_OPS_HPP
+#define TOMOGAN_SIMD_OPS_HPP
+
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <string>
+#include <strings.h>
+#include <algorithm>
+
+#include "utils.hpp"
+
+#if defined(__x86_64__) || defined(__i386__)
+    #define SIMD_OPS_X86
+    #include <immintrin.h>
+#endif
+
+// 2x2 max pooling, 2x nearest upsampling and channel concatenation of HWC float tensors for
+// the CPU engine and as the reference of the test drivers. Unlike conv_gemm.hpp the
+// instruction set is picked at run time: every variant is compiled with a target attribute
+// and cpu_simd_level() selects the widest one the CPU supports, so one binary runs
+// AVX-512, AVX2 or SSE, and the templates of utils.hpp are the scalar fallback. Rows are
+// split over the threads of parallel_rows. The ops only move or compare values, every
+// level gives the same bits: like std::max the max keeps its first operand on ties.
+enum simd_level{
+    SIMD_SCALAR = 0,
+    SIMD_SSE,
+    SIMD_AVX2,
+    SIMD_AVX512
+};
+
+inline const char* simd_level_name(simd_level level){
+    static const char *names[] = {"scalar", "SSE", "AVX2", "AVX-512"};
+    return names[level];
+}
+
+// the widest level of the CPU
+inline simd_level simd_detect(){
+#ifdef SIMD_OPS_X86
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx512f")) return SIMD_AVX512;
+    if(__builtin_cpu_supports("avx2"))    return SIMD_AVX2;
+    if(__builtin_cpu_supports("sse2"))    return SIMD_SSE;
+#endif
+    return SIMD_SCALAR;
+}
+
+// level used by the ops, TOMOGAN_SIMD (scalar, sse, avx2 or avx512) lowers the detected
+// one; set >= 0 sets it for the rest of the run, capped to what the CPU supports
+inline simd_level cpu_simd_level(int set = -1){
+    static int level = -1;
+    if(level < 0){
+        level = simd_detect();
+        const char *env = getenv("TOMOGAN_SIMD");
+        if(env != NULL){
+            for(int l = SIMD_SCALAR; l <= SIMD_AVX512; l++){
+                std::string name = simd_level_name((simd_level)l);
+                name.erase(std::remove(name.begin(), name.end(), '-'), name.end());
+                if(strcasecmp(env, name.c_str()) == 0){
+                    level = std::min(level, l);
+                }
+            }
+        }
+    }
+    if(set >= 0){
+        level = std::min(set, (int)simd_detect());
+    }
+    return (simd_level)level;
+}
+
+#ifdef SIMD_OPS_X86
+// the same three row loops per level, out[i] = max(in00, in01, in10, in11) per channel with
+// in01 and in11 one pixel to the right, out = in repeated per pixel and row, out = in1 | in2
+__attribute__((target("avx512f")))
+inline void maxpool_rows_avx512(const float *input, size_t width, size_t channel, size_t row_st, size_t row_ed, float *output){
+    for(size_t r = row_st; r < row_ed; r++)
+        for(size_t c = 0; c < width; c++){
+            const float *in00 = input + (4 * width * r + 2 * c) * channel;
+            const float *in10 = in00 + 2 * width * channel;
+            float *out_px = output + (width * r + c) * channel;
+            size_t ch = 0;
+            for(; ch + 16 <= channel; ch += 16){
+                __m512 pixel = _mm512_loadu_ps(in00 + ch);
+                pixel = _mm512_max_ps(_mm512_loadu_ps(in10 + ch), pixel);
+                pixel = _mm512_max_ps(_mm512_loadu_ps(in00 + channel + ch), pixel);
+                pixel = _mm512_max_ps(_mm512_loadu_ps(in10 + channel + ch), pixel);
+                _mm512_storeu_ps(out_px + ch, pixel);
+            }
+            for(; ch < channel; ch++){
+                out_px[ch] = std::max(std::max(std::max(in00[ch], in10[ch]), in00[channel + ch]), in10[channel + ch]);
+            }
+        }
+}
+
+__attribute__((target("avx512f")))
+inline void copy_avx512(const float *src, size_t n, float *dst){
+    size_t i = 0;
+    for(; i + 16 <= n; i += 16){
+        _mm512_storeu_ps(dst + i, _mm512_loadu_ps(src + i));
+    }
+    for(; i < n; i++){
+        dst[i] = src[i];
+    }
+}
+
+__attribute__((target("avx512f")))
+inline void upsample_rows_avx512(const float *input, size_t width, size_t channel, size_t row_st, size_t row_ed, float *output){
+    const size_t urow = 2 * width * channel;
+    for(size_t r = row_st; r < row_ed; r++){
+        float *out_row = output + 2 * r * urow;
+        for(size_t c = 0; c < width; c++){
+            const float *in_px = input + (width * r + c) * channel;
+            copy_avx512(in_px, channel, out_row + 2 * c * channel);
+            copy_avx512(in_px, channel, out_row + (2 * c + 1) * channel);
+        }
+        copy_avx512(out_row, urow, out_row + urow);
+    }
+}
+
+__attribute__((target("avx512f")))
+inline void concat_rows_avx512(const float *input1, const float *input2, size_t width, size_t channel1, size_t channel2,
+                               size_t row_st, size_t row_ed, float *output){
+    for(size_t px = row_st * width; px < row_ed * width; px++){
+        float *out_px = output + px * (channel1 + channel2);
+        copy_avx512(input1 + px * channel1, channel1, out_px);
+        copy_avx512(input2 + px * channel2, channel2, out_px + channel1);
+    }
+}
+
+__attribute__((target("avx2")))
+inline void maxpool_rows_avx2(const float *input, size_t width, size_t channel, size_t row_st, size_t row_ed, float *output){
+    for(size_t r = row_st; r < row_ed; r++)
+        for(size_t c = 0; c < width; c++){
+            const float *in00 = input + (4 * width * r + 2 * c) * channel;
+            const float *in10 = in00 + 2 * width * channel;
+            float *out_px = output + (width * r + c) * channel;
+            size_t ch = 0;
+            for(; ch + 8 <= channel; ch += 8){
+                __m256 pixel = _mm256_loadu_ps(in00 + ch);
+                pixel = _mm256_max_ps(_mm256_loadu_ps(in10 + ch), pixel);
+                pixel = _mm256_max_ps(_mm256_loadu_ps(in00 + channel + ch), pixel);
+                pixel = _mm256_max_ps(_mm256_loadu_ps(in10 + channel + ch), pixel);
+                _mm256_storeu_ps(out_px + ch, pixel);
+            }
+            for(; ch < channel; ch++){
+                out_px[ch] = std::max(std::max(std::max(in00[ch], in10[ch]), in00[channel + ch]), in10[channel + ch]);
+            }
+        }
+}
+
+__attribute__((target("avx2")))
+inline void copy_avx2(const float *src, size_t n, float *dst){
+    size_t i = 0;
+    for(; i + 8 <= n; i += 8){
+        _mm256_storeu_ps(dst + i, _mm256_loadu_ps(src + i));
+    }
+    for(; i < n; i++){
+        dst[i] = src[i];
+    }
+}
+
+__attribute__((target("avx2")))
+inline void upsample_rows_avx2(const float *input, size_t width, size_t channel, size_t row_st, size_t row_ed, float *output){
+    const size_t urow = 2 * width * channel;
+    for(size_t r = row_st; r < row_ed; r++){
+        float *out_row = output + 2 * r * urow;
+        for(size_t c = 0; c < width; c++){
+            const float *in_px = input + (width * r + c) * channel;
+            copy_avx2(in_px, channel, out_row + 2 * c * channel);
+            copy_avx2(in_px, channel, out_row + (2 * c + 1) * channel);
+        }
+        copy_avx2(out_row, urow, out_row + urow);
+    }
+}
+
+__attribute__((target("avx2")))
+inline void concat_rows_avx2(const float *input1, const float *input2, size_t width, size_t channel1, size_t channel2,
+                             size_t row_st, size_t row_ed, float *output){
+    for(size_t px = row_st * width; px < row_ed * width; px++){
+        float *out_px = output + px * (channel1 + channel2);
+        copy_avx2(input1 + px * channel1, channel1, out_px);
+        copy_avx2(input2 + px * channel2, channel2, out_px + channel1);
+    }
+}
+
+__attribute__((target("sse2")))
+inline void maxpool_rows_sse(const float *input, size_t width, size_t channel, size_t row_st, size_t row_ed, float *output){
+    for(size_t r = row_st; r < row_ed; r++)
+        for(size_t c = 0; c < width; c++){
+            const float *in00 = input + (4 * width * r + 2 * c) * channel;
+            const float *in10 = in00 + 2 * width * channel;
+            float *out_px = output + (width * r + c) * channel;
+            size_t ch = 0;
+            for(; ch + 4 <= channel; ch += 4){
+                __m128 pixel = _mm_loadu_ps(in00 + ch);
+                pixel = _mm_max_ps(_mm_loadu_ps(in10 + ch), pixel);
+                pixel = _mm_max_ps(_mm_loadu_ps(in00 + channel + ch), pixel);
+                pixel = _mm_max_ps(_mm_loadu_ps(in10 + channel + ch), pixel);
+                _mm_storeu_ps(out_px + ch, pixel);
+            }
+            for(; ch < channel; ch++){
+                out_px[ch] = std::max(std::max(std::max(in00[ch], in10[ch]), in00[channel + ch]), in10[channel + ch]);
+            }
+        }
+}
+
+__attribute__((target("sse2")))
+inline void copy_sse(const float *src, size_t n, float *dst){
+    size_t i = 0;
+    for(; i + 4 <= n; i += 4){
+        _mm_storeu_ps(dst + i, _mm_loadu_ps(src + i));
+    }
+    for(; i < n; i++){
+        dst[i] = src[i];
+    }
+}
+
+__attribute__((target("sse2")))
+inline void upsample_rows_sse(const float *input, size_t width, size_t channel, size_t row_st, size_t row_ed, float *output){
+    const size_t urow = 2 * width * channel;
+    for(size_t r = row_st; r < row_ed; r++){
+        float *out_row = output + 2 * r * urow;
+        for(size_t c = 0; c < width; c++){
+            const float *in_px = input + (width * r + c) * channel;
+            copy_sse(in_px, channel, out_row + 2 * c * channel);
+            copy_sse(in_px, channel, out_row + (2 * c + 1) * channel);
+        }
+        copy_sse(out_row, urow, out_row + urow);
+    }
+}
+
+__attribute__((target("sse2")))
+inline void concat_rows_sse(const float *input1, const float *input2, size_t width, size_t channel1, size_t channel2,
+                            size_t row_st, size_t row_ed, float *output){
+    for(size_t px = row_st * width; px < row_ed * width; px++){
+        float *out_px = output + px * (channel1 + channel2);
+        copy_sse(input1 + px * channel1, channel1, out_px);
+        copy_sse(input2 + px * channel2, channel2, out_px + channel1);
+    }
+}
+#endif
+
+// height and width are the output size, as maxpooling_cpu
+inline void maxpooling_simd(const float *input,
+                            const unsigned int height,
+                            const unsigned int width,
+                            const unsigned int channel,
+                            float *output){
+    const simd_level level = cpu_simd_level();
+    if(level == SIMD_SCALAR){
+        maxpooling_cpu(input, height, width, channel, output);
+        return;
+    }
+#ifdef SIMD_OPS_X86
+    parallel_rows(height, [&](unsigned int row_st, unsigned int row_ed){
+        if(level == SIMD_AVX512)    maxpool_rows_avx512(input, width, channel, row_st, row_ed, output);
+        else if(level == SIMD_AVX2) maxpool_rows_avx2(input, width, channel, row_st, row_ed, output);
+        else                        maxpool_rows_sse(input, width, channel, row_st, row_ed, output);
+    });
+#endif
+}
+
+// height and width are the input size, as upsample_cpu
+inline void upsample_simd(const float *input,
+                          const unsigned int height,
+                          const unsigned int width,
+                          const unsigned int channel,
+                          float *output){
+    const simd_level level = cpu_simd_level();
+    if(level == SIMD_SCALAR){
+        upsample_cpu_mt(const_cast<float *>(input), height, width, channel, output);
+        return;
+    }
+#ifdef SIMD_OPS_X86
+    parallel_rows(height, [&](unsigned int row_st, unsigned int row_ed){
+        if(level == SIMD_AVX512)    upsample_rows_avx512(input, width, channel, row_st, row_ed, output);
+        else if(level == SIMD_AVX2) upsample_rows_avx2(input, width, channel, row_st, row_ed, output);
+        else                        upsample_rows_sse(input, width, channel, row_st, row_ed, output);
+    });
+#endif
+}
+
+inline void concatenate_simd(const float *input1,
+                             const float *input2,
+                             unsigned int height,
+                             unsigned int width,
+                             unsigned int channel1,
+                             unsigned int channel2,
+                             float *output){
+    const simd_level level = cpu_simd_level();
+    if(level == SIMD_SCALAR){
+        concatenate_mt(const_cast<float *>(input1), const_cast<float *>(input2), height, width, channel1, channel2, output);
+        return;
+    }
+#ifdef SIMD_OPS_X86
+    parallel_rows(height, [&](unsigned int row_st, unsigned int row_ed){
+        if(level == SIMD_AVX512)    concat_rows_avx512(input1, input2, width, channel1, channel2, row_st, row_ed, output);
+        else if(level == SIMD_AVX2) concat_rows_avx2(input1, input2, width, channel1, channel2, row_st, row_ed, output);
+        else                        concat_rows_sse(input1, input2, width, channel1, channel2, row_st, row_ed, output);
+    });
+#endif
+}
+
+#endif
@@ -0,0 +1,157 @@
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <math.h>
+#include <chrono>
+#include <vector>
+
+#include "../main.hpp"
+#include "../device.hpp"
+#include "../program.hpp"
+#include "../fp16.hpp"
+
+using namespace std;
+
+// compare conv2d_local_mk built for half storage (-DTOMOGAN_FP16) and half accumulation
+// (-DTOMOGAN_FP16_ACC, when the device has cl_khr_fp16) against the float build on the
+// 3x3 layers of TomoGAN, each layer at the resolution it runs at for an IMG_SIZE x IMG_SIZE slice
+#define IMG_SIZE    (1024)
+#define N_REPS      (15)
+
+//                                0  1   2   3   4   5    6    7    8    9   10   11  12  13  14  15
+const unsigned int conv_ch[16] = {3, 8,  32, 32, 64,  64, 128, 128, 256, 64, 128, 32, 64, 32, 32, 16};
+const unsigned int  n_conv[16] = {8, 32, 32, 64, 64, 128, 128, 128,  64, 64, 32,  32, 32, 32, 16, 1};
+const unsigned int conv_lv[16] = {0, 0, 0, 1, 1, 2, 2, 3, 2, 2, 1, 1, 0, 0, 0, 0};
+
+// average device time of a launch over N_REPS - 5 runs, the first 5 are warmup
+double time_kernel(cl_command_queue commands, cl_kernel kernel, size_t *global, size_t *local){
+    double total_ms = 0;
+    for(int rep = 0; rep < N_REPS; rep++){
+        cl_event ev;
+        oclErrchk(clEnqueueNDRangeKernel(commands, kernel, 3, NULL, global, local, 0, NULL, &ev));
+        oclErrchk(clWaitForEvents(1, &ev));
+        cl_ulong st, ed;
+        clGetEventProfilingInfo(ev, CL_PROFILING_COMMAND_START, sizeof(cl_ulong), &st, NULL);
+        clGetEventProfilingInfo(ev, CL_PROFILING_COMMAND_END,   sizeof(cl_ulong), &ed, NULL);
+        clReleaseEvent(ev);
+        if(rep >= 5){
+            total_ms += (ed - st) / 1e6;
+        }
+    }
+    return total_ms / (N_REPS - 5);
+}
+
+int main(int argc, char** argv)
+{
+    int err;
+    // Pick a device, see device.hpp for the selection policy and overrides
+    ocl_device_info dev_info = select_device(argc, argv);
+    cl_device_id device_id = dev_info.device;
+
+    cl_context context = clCreateContext(0, 1, &device_id, NULL, NULL, &err);
+    if (!context){
+        printf("Error: Failed to create a compute context! %d\n", err);
+        return EXIT_FAILURE;
+    }
+    #ifdef __APPLE__
+        cl_command_queue commands = clCreateCommandQueue(context, device_id, CL_QUEUE_PROFILING_ENABLE, &err);
+    #else
+        cl_queue_properties queue_props[] = {CL_QUEUE_PROPERTIES, CL_QUEUE_PROFILING_ENABLE, 0};
+        cl_command_queue commands = clCreateCommandQueueWithProperties(context, device_id, queue_props, &err);
+    #endif
+    if (!commands){
+        printf("Error: Failed to create a command commands! %d\n", err);
+        return EXIT_FAILURE;
+    }
+
+    // float, half storage, half storage and accumulation
+    const char *options[3] = {"", "-DTOMOGAN_FP16", "-DTOMOGAN_FP16 -DTOMOGAN_FP16_ACC"};
+    const int n_modes = ocl_has_extension(dev_info, "cl_khr_fp16") ? 3 : 2;
+    if(n_modes < 3){
+        printf("The device has no cl_khr_fp16, only half storage is tested\n");
+    }
+    cl_program programs[3];
+    cl_kernel kernels[3];
+    for(int m = 0; m < n_modes; m++){
+        programs[m] = build_program(context, dev_info, "../conv2d.cl", options[m]);
+        kernels[m] = clCreateKernel(programs[m], "conv2d_local_mk", &err);
+        if (!kernels[m]){
+            printf("Error: Failed to create compute kernel! %d\n", err);
+            exit(1);
+        }
+    }
+
+    printf("%-6s %10s %4s %4s %12s %12s %8s %10s %12s %8s %10s\n", "layer", "HxW", "C", "NF", "fp32 ms", "fp16 ms", "speedup", \
+           "max diff", "fp16acc ms", "speedup", "max diff");
+    for(int layer = 1; layer <= 13; layer++){
+        unsigned int size = IMG_SIZE >> conv_lv[layer];
+        unsigned int channel = conv_ch[layer], num_filter = n_conv[layer], filter_size = 3;
+        size_t in_size  = (size_t)size * size * channel;
+        size_t out_size = (size_t)size * size * num_filter;
+        size_t w_size   = (size_t)filter_size * filter_size * channel * num_filter;
+
+        vector<float> input_h(in_size), filter_h(w_size);
+        srand(layer);
+        for(size_t i = 0; i < in_size; i++) input_h[i]  = rand() / (float)RAND_MAX;
+        for(size_t i = 0; i < w_size; i++)  filter_h[i] = rand() / (float)RAND_MAX - 0.5f;
+        vector<uint16_t> input_half_h(in_size), filter_half_h(w_size), out_half_h(out_size);
+        floats_to_halves(input_h.data(), input_half_h.data(), in_size);
+        floats_to_halves(filter_h.data(), filter_half_h.data(), w_size);
+
+        // sized for float, the half modes use the first half of each buffer
+        cl_mem input_d  = clCreateBuffer(context, CL_MEM_READ_ONLY,  sizeof(float) * in_size,  NULL, NULL);
+        cl_mem filter_d = clCreateBuffer(context, CL_MEM_READ_ONLY,  sizeof(float) * w_size,   NULL, NULL);
+        cl_mem output_d = clCreateBuffer(context, CL_MEM_WRITE_ONLY, sizeof(float) * out_size, NULL, NULL);
+        if (!input_d || !filter_d || !output_d){
+            printf("Error: Failed to allocate device memory!\n");
+            exit(1);
+        }
+
+        // default LCONV_TILE and LCONV_KF_BLOCK of conv2d.cl
+        size_t local_tile[3]  = {16, 16, 1};
+        size_t global_tile[3] = {(size + 15) / 16 * 16, (size + 15) / 16 * 16, (num_filter + 7) / 8};
+        double ms[3] = {0, 0, 0}, max_diff[3] = {0, 0, 0}, max_out = 0;
+        vector<float> out_h[3];
+        for(int m = 0; m < n_modes; m++){
+            size_t elem = (m == 0) ? sizeof(float) : sizeof(uint16_t);
+            oclErrchk(clEnqueueWriteBuffer(commands, input_d, CL_TRUE, 0, elem * in_size, \
+                                           m == 0 ? (void *)input_h.data() : (void *)input_half_h.data(), 0, NULL, NULL));
+            oclErrchk(clEnqueueWriteBuffer(commands, filter_d, CL_TRUE, 0, elem * w_size, \
+                                           m == 0 ? (void *)filter_h.data() : (void *)filter_half_h.data(), 0, NULL, NULL));
+            conv2d_set_arg(&kernels[m], &input_d, size, size, channel, &filter_d, filter_size, num_filter, &output_d, 1);
+            ms[m] = time_kernel(commands, kernels[m], global_tile, local_tile);
+            out_h[m].resize(out_size);
+            if(m == 0){
+                oclErrchk(clEnqueueReadBuffer(commands, output_d, CL_TRUE, 0, elem * out_size, out_h[m].data(), 0, NULL, NULL));
+            }else{
+                oclErrchk(clEnqueueReadBuffer(commands, output_d, CL_TRUE, 0, elem * out_size, out_half_h.data(), 0, NULL, NULL));
+                halves_to_floats(out_half_h.data(), out_h[m].data(), out_size);
+            }
+        }
+
+        // relative to the magnitude of the float output
+        for(size_t i = 0; i < out_size; i++){
+            max_out = max(max_out, (double)fabs(out_h[0][i]));
+            for(int m = 1; m < n_modes; m++){
+                max_diff[m] = max(max_diff[m], (double)fabs(out_h[0][i] - out_h[m][i]));
+            }
+        }
+        printf("%-6d %4dx%-5d %4d %4d %12.3f %12.3f %7.2fx %10.2e", layer, size, size, channel, num_filter, \
+               ms[0], ms[1], ms[0] / ms[1], max_diff[1] / max(max_out, 1e-30));
+        if(n_modes == 3){
+            printf(" %12.3f %7.2fx %10.2e", ms[2], ms[0] / ms[2], max_diff[2] / max(max_out, 1e-30));
+        }
+        printf("\n");
+
+        clReleaseMemObject(input_d);
+        clReleaseMemObject(filter_d);
+        clReleaseMemObject(output_d);
+    }
+
+    for(int m = 0; m < n_modes; m++){
+        clReleaseKernel(kernels[m]);
+        clReleaseProgram(programs[m]);
+    }
+    clReleaseCommandQueue(commands);
+    clReleaseContext(context);
+}
@@ -0,0 +1,83 @@
+#include <iostream>
+#include <string>
+#include <math.h>
+#include <chrono>
+#include <vector>
+
+#include "../utils.hpp"
+#include "../conv_gemm.hpp"
+
+using namespace std;
+
+// compare conv2d_gemm_cpu with the direct conv2d_cpu on every TomoGAN layer, each layer at
+// the resolution it runs at for an img_size x img_size slice
+// usage: ./conv2d_gemm_test [img_size] [threads]
+#define N_REPS (4)
+
+//                                0  1   2   3   4   5    6    7    8    9   10   11  12  13  14  15
+const unsigned int conv_ch[16] = {3, 8,  32, 32, 64,  64, 128, 128, 256, 64, 128, 32, 64, 32, 32, 16};
+const unsigned int  n_conv[16] = {8, 32, 32, 64, 64, 128, 128, 128,  64, 64, 32,  32, 32, 32, 16, 1};
+const unsigned int conv_sz[16] = {1, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 1, 1};
+const unsigned int conv_lv[16] = {0, 0, 0, 1, 1, 2, 2, 3, 2, 2, 1, 1, 0, 0, 0, 0};
+const unsigned int conv_lanes[16] = {1, 8, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16};
+
+// best of N_REPS runs, the first one warms up caches and page tables
+double time_ms(const function<void()> &fn){
+    double best = 1e30;
+    for(int rep = 0; rep < N_REPS; rep++){
+        auto st = chrono::steady_clock::now();
+        fn();
+        auto ed = chrono::steady_clock::now();
+        if(rep > 0){
+            best = min(best, chrono::duration_cast<chrono::microseconds>(ed - st).count() / 1000.);
+        }
+    }
+    return best;
+}
+
+int main(int argc, char** argv)
+{
+    unsigned int img_size = argc > 1 ? atoi(argv[1]) : 1024;
+    if(argc > 2){
+        cpu_num_threads(atoi(argv[2]));
+    }
+    printf("GEMM micro-kernel: %s %dx%d, %d threads, %dx%d slice\n", GEMM_ISA, GEMM_MR, GEMM_NR, cpu_num_threads(), img_size, img_size);
+    printf("%-6s %10s %4s %4s %3s %11s %11s %9s %9s %8s %10s\n", "layer", "HxW", "C", "NF", "FS", \
+           "direct ms", "gemm ms", "direct GF", "gemm GF", "speedup", "max diff");
+    double total_direct = 0, total_gemm = 0;
+    for(int layer = 0; layer < 16; layer++){
+        unsigned int size = img_size >> conv_lv[layer];
+        unsigned int channel = conv_ch[layer], num_filter = n_conv[layer], filter_size = conv_sz[layer];
+        size_t in_size  = (size_t)size * size * channel;
+        size_t out_size = (size_t)size * size * num_filter;
+        size_t w_size   = (size_t)filter_size * filter_size * channel * num_filter;
+
+        vector<float> input_h(in_size), filter_h(w_size), out_direct_h(out_size), out_gemm_h(out_size);
+        srand(layer);
+        for(size_t i = 0; i < in_size; i++) input_h[i]  = rand() / (float)RAND_MAX;
+        for(size_t i = 0; i < w_size; i++)  filter_h[i] = rand() / (float)RAND_MAX - 0.5f;
+
+        double direct_ms = time_ms([&](){
+            conv2d_cpu(input_h.data(), size, size, channel, filter_h.data(), filter_size, num_filter, \
+                       out_direct_h.data(), 1, conv_lanes[layer]);
+        });
+        gemm_packed_filters packed = gemm_pack_filters(filter_h.data(), filter_size * filter_size * channel, num_filter);
+        double gemm_ms = time_ms([&](){
+            conv2d_gemm_cpu(input_h.data(), size, size, channel, packed, filter_size, out_gemm_h.data(), 1);
+        });
+
+        // summation orders differ, compare relative to the magnitude of the output
+        double max_diff = 0, max_out = 0;
+        for(size_t i = 0; i < out_size; i++){
+            max_diff = max(max_diff, (double)fabs(out_direct_h[i] - out_gemm_h[i]));
+            max_out  = max(max_out, (double)fabs(out_direct_h[i]));
+        }
+        double gflop = 2. * size * size * w_size / 1e9;
+        printf("%-6d %4dx%-5d %4d %4d %3d %11.3f %11.3f %9.2f %9.2f %7.2fx %10.2e\n", layer, size, size, channel, num_filter, \
+               filter_size, direct_ms, gemm_ms, gflop / direct_ms * 1e3, gflop / gemm_ms * 1e3, direct_ms / gemm_ms, \
+               max_diff / max(max_out, 1e-30));
+        total_direct += direct_ms;
+        total_gemm   += gemm_ms;
+    }
+    printf("all layers: direct %.3f ms, gemm %.3f ms, %.2fx\n", total_direct, total_gemm, total_direct / total_gemm);
+}
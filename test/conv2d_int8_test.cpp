@@ -0,0 +1,152 @@
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <math.h>
+#include <chrono>
+#include <vector>
+
+#include "../main.hpp"
+#include "../device.hpp"
+#include "../program.hpp"
+#include "../conv_int8.hpp"
+
+using namespace std;
+
+// compare conv2d_int8_mk with conv2d_int8_cpu (conv_int8.hpp) on every layer shape of TomoGAN,
+// each layer at the resolution it runs at for an IMG_SIZE x IMG_SIZE slice; both compute the
+// same int32 sums and requantization, so the outputs must be identical
+#define IMG_SIZE    (1024)
+#define N_REPS      (15)
+
+//                                0  1   2   3   4   5    6    7    8    9   10   11  12  13  14  15
+const unsigned int conv_ch[16] = {3, 8,  32, 32, 64,  64, 128, 128, 256, 64, 128, 32, 64, 32, 32, 16};
+const unsigned int  n_conv[16] = {8, 32, 32, 64, 64, 128, 128, 128,  64, 64, 32,  32, 32, 32, 16, 1};
+const unsigned int conv_sz[16] = {1, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 1, 1};
+const unsigned int conv_lv[16] = {0, 0, 0, 1, 1, 2, 2, 3, 2, 2, 1, 1, 0, 0, 0, 0};
+
+// average device time of a launch over N_REPS - 5 runs, the first 5 are warmup
+double time_kernel(cl_command_queue commands, cl_kernel kernel, size_t *global, size_t *local){
+    double total_ms = 0;
+    for(int rep = 0; rep < N_REPS; rep++){
+        cl_event ev;
+        oclErrchk(clEnqueueNDRangeKernel(commands, kernel, 3, NULL, global, local, 0, NULL, &ev));
+        oclErrchk(clWaitForEvents(1, &ev));
+        cl_ulong st, ed;
+        clGetEventProfilingInfo(ev, CL_PROFILING_COMMAND_START, sizeof(cl_ulong), &st, NULL);
+        clGetEventProfilingInfo(ev, CL_PROFILING_COMMAND_END,   sizeof(cl_ulong), &ed, NULL);
+        clReleaseEvent(ev);
+        if(rep >= 5){
+            total_ms += (ed - st) / 1e6;
+        }
+    }
+    return total_ms / (N_REPS - 5);
+}
+
+int main(int argc, char** argv)
+{
+    int err;
+    // Pick a device, see device.hpp for the selection policy and overrides
+    ocl_device_info dev_info = select_device(argc, argv);
+    cl_device_id device_id = dev_info.device;
+
+    cl_context context = clCreateContext(0, 1, &device_id, NULL, NULL, &err);
+    if (!context){
+        printf("Error: Failed to create a compute context! %d\n", err);
+        return EXIT_FAILURE;
+    }
+    #ifdef __APPLE__
+        cl_command_queue commands = clCreateCommandQueue(context, device_id, CL_QUEUE_PROFILING_ENABLE, &err);
+    #else
+        cl_queue_properties queue_props[] = {CL_QUEUE_PROPERTIES, CL_QUEUE_PROFILING_ENABLE, 0};
+        cl_command_queue commands = clCreateCommandQueueWithProperties(context, device_id, queue_props, &err);
+    #endif
+    if (!commands){
+        printf("Error: Failed to create a command commands! %d\n", err);
+        return EXIT_FAILURE;
+    }
+
+    cl_program program = build_program(context, dev_info, "../conv2d.cl", "");
+    cl_kernel kernel = clCreateKernel(program, "conv2d_int8_mk", &err);
+    if (!kernel){
+        printf("Error: Failed to create compute kernel! %d\n", err);
+        exit(1);
+    }
+    printf("Packed dot product: %s, CPU reference: %s\n", \
+           ocl_has_extension(dev_info, "cl_khr_integer_dot_product") ? "cl_khr_integer_dot_product" : "byte by byte", INT8_ISA);
+
+    printf("%-6s %10s %4s %4s %3s %12s %10s %12s %10s %10s\n", "layer", "HxW", "C", "NF", "FS", "device ms", "GOP/s", \
+           "CPU ms", "GOP/s", "mismatch");
+    unsigned int n_failed = 0;
+    for(int layer = 0; layer < 16; layer++){
+        unsigned int size = IMG_SIZE >> conv_lv[layer];
+        unsigned int channel = conv_ch[layer], num_filter = n_conv[layer], filter_size = conv_sz[layer];
+        size_t in_size  = (size_t)size * size * channel;
+        size_t out_size = (size_t)size * size * num_filter;
+        size_t k_size   = (size_t)filter_size * filter_size * channel;
+
+        // random tensors and quantization; the last layer writes float as the output of the network
+        srand(layer);
+        vector<uint8_t> input_h(in_size);
+        vector<int8_t> filter_h(k_size * num_filter);
+        for(size_t i = 0; i < in_size; i++) input_h[i] = rand() % 256;
+        for(size_t i = 0; i < filter_h.size(); i++) filter_h[i] = rand() % (2 * INT8_WEIGHT_MAX + 1) - INT8_WEIGHT_MAX;
+        int8_conv_params params;
+        params.in_scale  = 0.01f + rand() / (float)RAND_MAX * 0.05f;
+        params.in_zero   = rand() % 64;
+        params.out_scale = layer == 15 ? 0.0f : 0.5f + rand() / (float)RAND_MAX;
+        params.out_zero  = layer == 15 ? 0 : rand() % 128;
+        params.relu      = layer < 15;
+        for(unsigned int kf = 0; kf < num_filter; kf++){
+            params.weight_scale.push_back(0.001f + rand() / (float)RAND_MAX * 0.01f);
+        }
+        int8_packed_filters packed = int8_pack_filters(filter_h.data(), k_size, num_filter, params);
+        const size_t out_elem = packed.float_out ? sizeof(float) : sizeof(uint8_t);
+
+        vector<uint8_t> out_cpu(out_size * out_elem), out_dev(out_size * out_elem);
+        auto st = chrono::steady_clock::now();
+        conv2d_int8_cpu(input_h.data(), size, size, channel, packed, filter_size, out_cpu.data(), (float *)out_cpu.data());
+        auto ed = chrono::steady_clock::now();
+        double cpu_ms = chrono::duration_cast<chrono::microseconds>(ed - st).count() / 1000.;
+
+        cl_mem input_d     = clCreateBuffer(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, in_size, input_h.data(), NULL);
+        cl_mem filter_d    = clCreateBuffer(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, filter_h.size(), filter_h.data(), NULL);
+        cl_mem zero_comp_d = clCreateBuffer(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, sizeof(int32_t) * num_filter, \
+                                            packed.zero_comp.data(), NULL);
+        cl_mem out_mult_d  = clCreateBuffer(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, sizeof(float) * num_filter, \
+                                            packed.out_mult.data(), NULL);
+        cl_mem output_d    = clCreateBuffer(context, CL_MEM_WRITE_ONLY, out_size * out_elem, NULL, NULL);
+        if (!input_d || !filter_d || !zero_comp_d || !out_mult_d || !output_d){
+            printf("Error: Failed to allocate device memory!\n");
+            exit(1);
+        }
+        conv2d_int8_set_arg(&kernel, &input_d, size, size, channel, &filter_d, filter_size, num_filter, &output_d, \
+                            params.relu, &zero_comp_d, &out_mult_d, packed.in_zero, packed.out_zero, packed.float_out);
+        // default INT8_KF_BLOCK of conv2d.cl
+        size_t local[3]  = {16, 16, 1};
+        size_t global[3] = {(size + 15) / 16 * 16, (size + 15) / 16 * 16, (num_filter + 7) / 8};
+        double dev_ms = time_kernel(commands, kernel, global, local);
+        oclErrchk(clEnqueueReadBuffer(commands, output_d, CL_TRUE, 0, out_size * out_elem, out_dev.data(), 0, NULL, NULL));
+
+        size_t n_mismatch = 0;
+        for(size_t i = 0; i < out_size * out_elem; i += out_elem){
+            n_mismatch += memcmp(out_cpu.data() + i, out_dev.data() + i, out_elem) != 0;
+        }
+        n_failed += n_mismatch != 0;
+        double ops = 2. * size * size * k_size * num_filter;
+        printf("%-6d %4dx%-5d %4d %4d %3d %12.3f %10.2f %12.3f %10.2f %10ld\n", layer, size, size, channel, num_filter, \
+               filter_size, dev_ms, ops / dev_ms / 1e6, cpu_ms, ops / cpu_ms / 1e6, n_mismatch);
+
+        clReleaseMemObject(input_d);
+        clReleaseMemObject(filter_d);
+        clReleaseMemObject(zero_comp_d);
+        clReleaseMemObject(out_mult_d);
+        clReleaseMemObject(output_d);
+    }
+    printf("%s\n", n_failed == 0 ? "All layers match" : "Mismatch, see above");
+
+    clReleaseKernel(kernel);
+    clReleaseProgram(program);
+    clReleaseCommandQueue(commands);
+    clReleaseContext(context);
+    return n_failed == 0 ? 0 : 1;
+}
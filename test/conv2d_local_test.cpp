@@ -0,0 +1,151 @@
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <math.h>
+#include <chrono>
+#include <vector>
+
+#include "../main.hpp"
+#include "../device.hpp"
+#include "../program.hpp"
+#include "../winograd.hpp"
+
+using namespace std;
+
+// compare conv2d_local_mk and conv2d_winograd_f2 against the global memory kernels on the
+// 3x3 layers of TomoGAN, each layer at the resolution it runs at for an IMG_SIZE x IMG_SIZE slice
+#define IMG_SIZE    (1024)
+#define N_REPS      (15)
+
+//                                0  1   2   3   4   5    6    7    8    9   10   11  12  13  14  15
+const unsigned int conv_ch[16] = {3, 8,  32, 32, 64,  64, 128, 128, 256, 64, 128, 32, 64, 32, 32, 16};
+const unsigned int  n_conv[16] = {8, 32, 32, 64, 64, 128, 128, 128,  64, 64, 32,  32, 32, 32, 16, 1};
+const unsigned int conv_lv[16] = {0, 0, 0, 1, 1, 2, 2, 3, 2, 2, 1, 1, 0, 0, 0, 0};
+
+// average device time of a launch over N_REPS - 5 runs, the first 5 are warmup
+double time_kernel(cl_command_queue commands, cl_kernel kernel, size_t *global, size_t *local){
+    double total_ms = 0;
+    for(int rep = 0; rep < N_REPS; rep++){
+        cl_event ev;
+        oclErrchk(clEnqueueNDRangeKernel(commands, kernel, 3, NULL, global, local, 0, NULL, &ev));
+        oclErrchk(clWaitForEvents(1, &ev));
+        cl_ulong st, ed;
+        clGetEventProfilingInfo(ev, CL_PROFILING_COMMAND_START, sizeof(cl_ulong), &st, NULL);
+        clGetEventProfilingInfo(ev, CL_PROFILING_COMMAND_END,   sizeof(cl_ulong), &ed, NULL);
+        clReleaseEvent(ev);
+        if(rep >= 5){
+            total_ms += (ed - st) / 1e6;
+        }
+    }
+    return total_ms / (N_REPS - 5);
+}
+
+int main(int argc, char** argv)
+{
+    int err;
+    // Pick a device, see device.hpp for the selection policy and overrides
+    ocl_device_info dev_info = select_device(argc, argv);
+    cl_device_id device_id = dev_info.device;
+
+    cl_context context = clCreateContext(0, 1, &device_id, NULL, NULL, &err);
+    if (!context){
+        printf("Error: Failed to create a compute context! %d\n", err);
+        return EXIT_FAILURE;
+    }
+    #ifdef __APPLE__
+        cl_command_queue commands = clCreateCommandQueue(context, device_id, CL_QUEUE_PROFILING_ENABLE, &err);
+    #else
+        cl_queue_properties queue_props[] = {CL_QUEUE_PROPERTIES, CL_QUEUE_PROFILING_ENABLE, 0};
+        cl_command_queue commands = clCreateCommandQueueWithProperties(context, device_id, queue_props, &err);
+    #endif
+    if (!commands){
+        printf("Error: Failed to create a command commands! %d\n", err);
+        return EXIT_FAILURE;
+    }
+
+    cl_program program = build_program(context, dev_info, "../conv2d.cl");
+    cl_kernel kernel_v16   = clCreateKernel(program, "conv2d_vec16_mk", &err);
+    cl_kernel kernel_v8    = clCreateKernel(program, "conv2d_vec8_mk", &err);
+    cl_kernel kernel_local = clCreateKernel(program, "conv2d_local_mk", &err);
+    cl_kernel kernel_wino  = clCreateKernel(program, "conv2d_winograd_f2", &err);
+    if (!kernel_v16 || !kernel_v8 || !kernel_local || !kernel_wino){
+        printf("Error: Failed to create compute kernel! %d\n", err);
+        exit(1);
+    }
+
+    printf("%-6s %10s %4s %4s %12s %12s %8s %10s %12s %8s %10s\n", "layer", "HxW", "C", "NF", "global ms", "local ms", "speedup", \
+           "max diff", "wino ms", "speedup", "max diff");
+    for(int layer = 1; layer <= 13; layer++){
+        unsigned int size = IMG_SIZE >> conv_lv[layer];
+        unsigned int channel = conv_ch[layer], num_filter = n_conv[layer], filter_size = 3;
+        size_t in_size  = (size_t)size * size * channel;
+        size_t out_size = (size_t)size * size * num_filter;
+        size_t w_size   = (size_t)filter_size * filter_size * channel * num_filter;
+
+        vector<float> input_h(in_size), filter_h(w_size), out_global_h(out_size), out_local_h(out_size), out_wino_h(out_size);
+        srand(layer);
+        for(size_t i = 0; i < in_size; i++) input_h[i]  = rand() / (float)RAND_MAX;
+        for(size_t i = 0; i < w_size; i++)  filter_h[i] = rand() / (float)RAND_MAX - 0.5f;
+
+        cl_mem input_d  = clCreateBuffer(context, CL_MEM_READ_ONLY,  sizeof(float) * in_size,  NULL, NULL);
+        cl_mem filter_d = clCreateBuffer(context, CL_MEM_READ_ONLY,  sizeof(float) * w_size,   NULL, NULL);
+        cl_mem output_d = clCreateBuffer(context, CL_MEM_WRITE_ONLY, sizeof(float) * out_size, NULL, NULL);
+        vector<float> wino_h = winograd_transform_filters(filter_h.data(), channel, num_filter, winograd_f2());
+        cl_mem wino_d   = clCreateBuffer(context, CL_MEM_READ_ONLY,  sizeof(float) * wino_h.size(), NULL, NULL);
+        if (!input_d || !filter_d || !output_d || !wino_d){
+            printf("Error: Failed to allocate device memory!\n");
+            exit(1);
+        }
+        oclErrchk(clEnqueueWriteBuffer(commands, input_d,  CL_TRUE, 0, sizeof(float) * in_size, input_h.data(), 0, NULL, NULL));
+        oclErrchk(clEnqueueWriteBuffer(commands, filter_d, CL_TRUE, 0, sizeof(float) * w_size, filter_h.data(), 0, NULL, NULL));
+        oclErrchk(clEnqueueWriteBuffer(commands, wino_d, CL_TRUE, 0, sizeof(float) * wino_h.size(), wino_h.data(), 0, NULL, NULL));
+
+        // the kernel tomogan_session.hpp used before, vec8 for the 8 channel input of layer 1
+        cl_kernel kernel_global = (channel % 16 == 0) ? kernel_v16 : kernel_v8;
+        conv2d_mk_set_arg(&kernel_global, &input_d, size, size, channel, &filter_d, filter_size, num_filter, &output_d, 1, num_filter);
+        size_t local[3] = {16, 16, 1};
+        fit_local_size(dev_info, local, kernel_global);
+        size_t global[3] = {(size + local[0] - 1) / local[0] * local[0], (size + local[1] - 1) / local[1] * local[1], 1};
+        double global_ms = time_kernel(commands, kernel_global, global, local);
+        oclErrchk(clEnqueueReadBuffer(commands, output_d, CL_TRUE, 0, sizeof(float) * out_size, out_global_h.data(), 0, NULL, NULL));
+
+        conv2d_set_arg(&kernel_local, &input_d, size, size, channel, &filter_d, filter_size, num_filter, &output_d, 1);
+        size_t local_tile[3]  = {16, 16, 1};
+        // default LCONV_TILE and LCONV_KF_BLOCK of conv2d.cl
+        size_t global_tile[3] = {(size + 15) / 16 * 16, (size + 15) / 16 * 16, (num_filter + 7) / 8};
+        double local_ms = time_kernel(commands, kernel_local, global_tile, local_tile);
+        oclErrchk(clEnqueueReadBuffer(commands, output_d, CL_TRUE, 0, sizeof(float) * out_size, out_local_h.data(), 0, NULL, NULL));
+
+        // one work item per 2x2 output tile, default WINO_KF_BLOCK of conv2d.cl
+        conv2d_set_arg(&kernel_wino, &input_d, size, size, channel, &wino_d, filter_size, num_filter, &output_d, 1);
+        size_t tiles = (size + 1) / 2;
+        size_t global_wino[3] = {(tiles + local[0] - 1) / local[0] * local[0], (tiles + local[1] - 1) / local[1] * local[1], \
+                                 (num_filter + 3) / 4};
+        double wino_ms = time_kernel(commands, kernel_wino, global_wino, local);
+        oclErrchk(clEnqueueReadBuffer(commands, output_d, CL_TRUE, 0, sizeof(float) * out_size, out_wino_h.data(), 0, NULL, NULL));
+
+        // summation orders differ, compare relative to the magnitude of the output
+        double max_diff = 0, max_diff_wino = 0, max_out = 0;
+        for(size_t i = 0; i < out_size; i++){
+            max_diff = max(max_diff, (double)fabs(out_global_h[i] - out_local_h[i]));
+            max_diff_wino = max(max_diff_wino, (double)fabs(out_global_h[i] - out_wino_h[i]));
+            max_out  = max(max_out, (double)fabs(out_global_h[i]));
+        }
+        printf("%-6d %4dx%-5d %4d %4d %12.3f %12.3f %7.2fx %10.2e %12.3f %7.2fx %10.2e\n", layer, size, size, channel, num_filter, \
+               global_ms, local_ms, global_ms / local_ms, max_diff / max(max_out, 1e-30), \
+               wino_ms, global_ms / wino_ms, max_diff_wino / max(max_out, 1e-30));
+
+        clReleaseMemObject(input_d);
+        clReleaseMemObject(filter_d);
+        clReleaseMemObject(output_d);
+        clReleaseMemObject(wino_d);
+    }
+
+    clReleaseKernel(kernel_v16);
+    clReleaseKernel(kernel_v8);
+    clReleaseKernel(kernel_local);
+    clReleaseKernel(kernel_wino);
+    clReleaseProgram(program);
+    clReleaseCommandQueue(commands);
+    clReleaseContext(context);
+}
@@ -0,0 +1,276 @@
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <math.h>
+#include <chrono>
+#include <vector>
+
+#include "../main.hpp"
+#include "../device.hpp"
+#include "../program.hpp"
+#include "../layout.hpp"
+
+using namespace std;
+
+// compare the NCHWc8 kernels (layout.hpp) with the HWC ones the session runs otherwise:
+// conv2d_nchwc8 against conv2d_local_mk (3x3) or conv2d_mk (1x1) on every layer shape of
+// TomoGAN, then the pooling, upsampling and concatenation of each level, each at the
+// resolution it runs at for an IMG_SIZE x IMG_SIZE slice
+#define IMG_SIZE    (1024)
+#define N_REPS      (15)
+
+//                                0  1   2   3   4   5    6    7    8    9   10   11  12  13  14  15
+const unsigned int conv_ch[16] = {3, 8,  32, 32, 64,  64, 128, 128, 256, 64, 128, 32, 64, 32, 32, 16};
+const unsigned int  n_conv[16] = {8, 32, 32, 64, 64, 128, 128, 128,  64, 64, 32,  32, 32, 32, 16, 1};
+const unsigned int conv_sz[16] = {1, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 1, 1};
+const unsigned int conv_lv[16] = {0, 0, 0, 1, 1, 2, 2, 3, 2, 2, 1, 1, 0, 0, 0, 0};
+
+// average device time of a launch over N_REPS - 5 runs, the first 5 are warmup
+double time_kernel(cl_command_queue commands, cl_kernel kernel, size_t *global, size_t *local){
+    double total_ms = 0;
+    for(int rep = 0; rep < N_REPS; rep++){
+        cl_event ev;
+        oclErrchk(clEnqueueNDRangeKernel(commands, kernel, 3, NULL, global, local, 0, NULL, &ev));
+        oclErrchk(clWaitForEvents(1, &ev));
+        cl_ulong st, ed;
+        clGetEventProfilingInfo(ev, CL_PROFILING_COMMAND_START, sizeof(cl_ulong), &st, NULL);
+        clGetEventProfilingInfo(ev, CL_PROFILING_COMMAND_END,   sizeof(cl_ulong), &ed, NULL);
+        clReleaseEvent(ev);
+        if(rep >= 5){
+            total_ms += (ed - st) / 1e6;
+        }
+    }
+    return total_ms / (N_REPS - 5);
+}
+
+cl_kernel create_kernel(cl_program program, const char *name){
+    int err;
+    cl_kernel kernel = clCreateKernel(program, name, &err);
+    if (!kernel){
+        printf("Error: Failed to create compute kernel %s! %d\n", name, err);
+        exit(1);
+    }
+    return kernel;
+}
+
+cl_mem create_buffer(cl_context context, size_t n_floats, const float *host){
+    cl_mem buf = clCreateBuffer(context, host ? CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR : CL_MEM_READ_WRITE, \
+                                sizeof(float) * n_floats, (void *)host, NULL);
+    if (!buf){
+        printf("Error: Failed to allocate device memory!\n");
+        exit(1);
+    }
+    return buf;
+}
+
+vector<float> read_buffer(cl_command_queue commands, cl_mem buf, size_t n_floats){
+    vector<float> host(n_floats);
+    oclErrchk(clEnqueueReadBuffer(commands, buf, CL_TRUE, 0, sizeof(float) * n_floats, host.data(), 0, NULL, NULL));
+    return host;
+}
+
+double max_abs(const vector<float> &a){
+    double m = 0;
+    for(size_t i = 0; i < a.size(); i++) m = max(m, (double)fabs(a[i]));
+    return m;
+}
+
+double max_diff(const vector<float> &a, const vector<float> &b){
+    double m = 0;
+    for(size_t i = 0; i < a.size(); i++) m = max(m, (double)fabs(a[i] - b[i]));
+    return m;
+}
+
+int main(int argc, char** argv)
+{
+    int err;
+    // Pick a device, see device.hpp for the selection policy and overrides
+    ocl_device_info dev_info = select_device(argc, argv);
+    cl_device_id device_id = dev_info.device;
+
+    cl_context context = clCreateContext(0, 1, &device_id, NULL, NULL, &err);
+    if (!context){
+        printf("Error: Failed to create a compute context! %d\n", err);
+        return EXIT_FAILURE;
+    }
+    #ifdef __APPLE__
+        cl_command_queue commands = clCreateCommandQueue(context, device_id, CL_QUEUE_PROFILING_ENABLE, &err);
+    #else
+        cl_queue_properties queue_props[] = {CL_QUEUE_PROPERTIES, CL_QUEUE_PROFILING_ENABLE, 0};
+        cl_command_queue commands = clCreateCommandQueueWithProperties(context, device_id, queue_props, &err);
+    #endif
+    if (!commands){
+        printf("Error: Failed to create a command commands! %d\n", err);
+        return EXIT_FAILURE;
+    }
+
+    cl_program program = build_program(context, dev_info, "../conv2d.cl", "");
+    cl_kernel local_kernel   = create_kernel(program, "conv2d_local_mk");
+    cl_kernel mk_kernel      = create_kernel(program, "conv2d_mk");
+    cl_kernel nchwc8_kernel  = create_kernel(program, "conv2d_nchwc8");
+    cl_kernel pool_kernel    = create_kernel(program, "maxpooling2d");
+    cl_kernel pool8_kernel   = create_kernel(program, "maxpooling2d_nchwc8");
+    cl_kernel up_kernel      = create_kernel(program, "upsample2d");
+    cl_kernel up8_kernel     = create_kernel(program, "upsample2d_nchwc8");
+    cl_kernel concat_kernel  = create_kernel(program, "concatenate");
+    cl_kernel concat8_kernel = create_kernel(program, "concatenate_nchwc8");
+    cl_kernel to8_kernel     = create_kernel(program, "hwc_to_nchwc8");
+    cl_kernel from8_kernel   = create_kernel(program, "nchwc8_to_hwc");
+
+    size_t local[3] = {16, 16, 1};
+    unsigned int n_failed = 0;
+    printf("%-6s %10s %4s %4s %3s %16s %12s %12s %8s %10s\n", "layer", "HxW", "C", "NF", "FS", "HWC kernel", "HWC ms", \
+           "nchwc8 ms", "speedup", "max diff");
+    for(int layer = 0; layer < 16; layer++){
+        unsigned int size = IMG_SIZE >> conv_lv[layer];
+        unsigned int channel = conv_ch[layer], num_filter = n_conv[layer], filter_size = conv_sz[layer];
+        size_t in_size  = (size_t)size * size * channel;
+        size_t out_size = (size_t)size * size * num_filter;
+        size_t w_size   = (size_t)filter_size * filter_size * channel * num_filter;
+
+        vector<float> input_h(in_size), filter_h(w_size);
+        srand(layer);
+        for(size_t i = 0; i < in_size; i++) input_h[i]  = rand() / (float)RAND_MAX;
+        for(size_t i = 0; i < w_size; i++)  filter_h[i] = rand() / (float)RAND_MAX - 0.5f;
+        vector<float> input8_h(nchwc8_size(size, size, channel));
+        hwc_to_nchwc8_cpu(input_h.data(), 1, size, size, channel, input8_h.data());
+        vector<float> filter8_h = nchwc8_transform_filters(filter_h.data(), filter_size, channel, num_filter);
+
+        cl_mem input_d   = create_buffer(context, in_size, input_h.data());
+        cl_mem filter_d  = create_buffer(context, w_size, filter_h.data());
+        cl_mem output_d  = create_buffer(context, out_size, NULL);
+        cl_mem input8_d  = create_buffer(context, input8_h.size(), input8_h.data());
+        cl_mem filter8_d = create_buffer(context, filter8_h.size(), filter8_h.data());
+        cl_mem output8_d = create_buffer(context, nchwc8_size(size, size, num_filter), NULL);
+
+        // the HWC kernel of the session: conv2d_local_mk for 3x3 with its default LCONV_KF_BLOCK,
+        // conv2d_mk for 1x1
+        const bool local_conv = filter_size == 3;
+        cl_kernel hwc_kernel = local_conv ? local_kernel : mk_kernel;
+        size_t hwc_global[3] = {(size + 15) / 16 * 16, (size + 15) / 16 * 16, local_conv ? (num_filter + 7) / 8 : 1};
+        if(local_conv){
+            conv2d_set_arg(&hwc_kernel, &input_d, size, size, channel, &filter_d, filter_size, num_filter, &output_d, 1);
+        }else{
+            conv2d_mk_set_arg(&hwc_kernel, &input_d, size, size, channel, &filter_d, filter_size, num_filter, &output_d, 1, num_filter);
+        }
+        double hwc_ms = time_kernel(commands, hwc_kernel, hwc_global, local);
+
+        size_t global8[3] = {(size + 15) / 16 * 16, (size + 15) / 16 * 16, nchwc8_blocks(num_filter)};
+        conv2d_set_arg(&nchwc8_kernel, &input8_d, size, size, channel, &filter8_d, filter_size, num_filter, &output8_d, 1);
+        double nchwc8_ms = time_kernel(commands, nchwc8_kernel, global8, local);
+
+        vector<float> out_h = read_buffer(commands, output_d, out_size);
+        vector<float> out8_h = read_buffer(commands, output8_d, nchwc8_size(size, size, num_filter)), out8_hwc_h(out_size);
+        nchwc8_to_hwc_cpu(out8_h.data(), 1, size, size, num_filter, out8_hwc_h.data());
+        // relative to the magnitude of the HWC output, both sum in float in different orders
+        double rel_diff = max_diff(out_h, out8_hwc_h) / max(max_abs(out_h), 1e-30);
+        n_failed += rel_diff > 1e-5;
+        printf("%-6d %4dx%-5d %4d %4d %3d %16s %12.3f %12.3f %7.2fx %10.2e\n", layer, size, size, channel, num_filter, \
+               filter_size, local_conv ? "conv2d_local_mk" : "conv2d_mk", hwc_ms, nchwc8_ms, hwc_ms / nchwc8_ms, rel_diff);
+
+        clReleaseMemObject(input_d);
+        clReleaseMemObject(filter_d);
+        clReleaseMemObject(output_d);
+        clReleaseMemObject(input8_d);
+        clReleaseMemObject(filter8_d);
+        clReleaseMemObject(output8_d);
+    }
+
+    // pooling, upsampling and concatenation move values without arithmetic, they must match exactly;
+    // the conversions are timed on the input and output of the network
+    printf("\n%-22s %10s %8s %12s %12s %8s %10s\n", "op", "HxW", "C", "HWC ms", "nchwc8 ms", "speedup", "mismatch");
+    for(int lv = 0; lv < 3; lv++){
+        unsigned int size = IMG_SIZE >> lv, low = size / 2, channel = 32 << lv;
+        vector<float> skip_h((size_t)size * size * channel), low_h((size_t)low * low * channel);
+        srand(100 + lv);
+        for(size_t i = 0; i < skip_h.size(); i++) skip_h[i] = rand() / (float)RAND_MAX;
+        for(size_t i = 0; i < low_h.size(); i++)  low_h[i]  = rand() / (float)RAND_MAX;
+        vector<float> skip8_h(nchwc8_size(size, size, channel)), low8_h(nchwc8_size(low, low, channel));
+        hwc_to_nchwc8_cpu(skip_h.data(), 1, size, size, channel, skip8_h.data());
+        hwc_to_nchwc8_cpu(low_h.data(), 1, low, low, channel, low8_h.data());
+
+        cl_mem skip_d  = create_buffer(context, skip_h.size(), skip_h.data());
+        cl_mem low_d   = create_buffer(context, low_h.size(), low_h.data());
+        cl_mem skip8_d = create_buffer(context, skip8_h.size(), skip8_h.data());
+        cl_mem low8_d  = create_buffer(context, low8_h.size(), low8_h.data());
+        cl_mem out_d   = create_buffer(context, (size_t)size * size * 2 * channel, NULL);
+        cl_mem out8_d  = create_buffer(context, nchwc8_size(size, size, 2 * channel), NULL);
+
+        for(int op = 0; op < 3; op++){
+            // pooling of the skip tensor, upsampling of the low one, concatenation of the skip
+            // tensor and the upsampling as in the decoder
+            cl_kernel kernel = op == 0 ? pool_kernel : op == 1 ? up_kernel : concat_kernel;
+            cl_kernel kernel8 = op == 0 ? pool8_kernel : op == 1 ? up8_kernel : concat8_kernel;
+            // work items per side: the output of the pooling, the input of the upsampling
+            unsigned int grid = op == 2 ? size : low;
+            unsigned int out_ch = op == 2 ? 2 * channel : channel;
+            unsigned int out_px = op == 0 ? low : size;
+            if(op == 2){
+                concat_set_arg(&kernel, &skip_d, &skip_d, size, size, channel, channel, &out_d);
+                concat_set_arg(&kernel8, &skip8_d, &skip8_d, size, size, channel, channel, &out8_d);
+            }else if(op == 0){
+                maxpool_set_arg(&kernel, &skip_d, grid, grid, channel, &out_d);
+                maxpool_set_arg(&kernel8, &skip8_d, grid, grid, channel, &out8_d);
+            }else{
+                upsample_set_arg(&kernel, &low_d, grid, grid, channel, &out_d);
+                upsample_set_arg(&kernel8, &low8_d, grid, grid, channel, &out8_d);
+            }
+            size_t global[3]  = {(grid + 15) / 16 * 16, (grid + 15) / 16 * 16, 1};
+            size_t global8[3] = {(grid + 15) / 16 * 16, (grid + 15) / 16 * 16, nchwc8_blocks(out_ch)};
+            double ms = time_kernel(commands, kernel, global, local);
+            double ms8 = time_kernel(commands, kernel8, global8, local);
+
+            size_t n_out = (size_t)out_px * out_px * out_ch;
+            vector<float> out_h = read_buffer(commands, out_d, n_out), out8_hwc_h(n_out);
+            vector<float> out8_h = read_buffer(commands, out8_d, nchwc8_size(out_px, out_px, out_ch));
+            nchwc8_to_hwc_cpu(out8_h.data(), 1, out_px, out_px, out_ch, out8_hwc_h.data());
+            size_t n_mismatch = 0;
+            for(size_t i = 0; i < n_out; i++) n_mismatch += out_h[i] != out8_hwc_h[i];
+            n_failed += n_mismatch != 0;
+            const char *names[3] = {"maxpooling2d", "upsample2d", "concatenate"};
+            printf("%-22s %4dx%-5d %8d %12.3f %12.3f %7.2fx %10ld\n", names[op], out_px, out_px, out_ch, ms, ms8, ms / ms8, n_mismatch);
+        }
+
+        clReleaseMemObject(skip_d);
+        clReleaseMemObject(low_d);
+        clReleaseMemObject(skip8_d);
+        clReleaseMemObject(low8_d);
+        clReleaseMemObject(out_d);
+        clReleaseMemObject(out8_d);
+    }
+
+    // the conversions of the session, of the input (3 channels) and of the output (1 channel)
+    for(int dir = 0; dir < 2; dir++){
+        unsigned int channel = dir == 0 ? 3 : 1;
+        vector<float> hwc_h((size_t)IMG_SIZE * IMG_SIZE * channel), blocked_h(nchwc8_size(IMG_SIZE, IMG_SIZE, channel));
+        srand(200 + dir);
+        for(size_t i = 0; i < hwc_h.size(); i++) hwc_h[i] = rand() / (float)RAND_MAX;
+        hwc_to_nchwc8_cpu(hwc_h.data(), 1, IMG_SIZE, IMG_SIZE, channel, blocked_h.data());
+        cl_mem hwc_d     = create_buffer(context, hwc_h.size(), dir == 0 ? hwc_h.data() : NULL);
+        cl_mem blocked_d = create_buffer(context, blocked_h.size(), dir == 1 ? blocked_h.data() : NULL);
+        cl_kernel kernel = dir == 0 ? to8_kernel : from8_kernel;
+        layout_set_arg(&kernel, dir == 0 ? &hwc_d : &blocked_d, IMG_SIZE, IMG_SIZE, channel, dir == 0 ? &blocked_d : &hwc_d);
+        size_t global8[3] = {IMG_SIZE, IMG_SIZE, nchwc8_blocks(channel)};
+        double ms = time_kernel(commands, kernel, global8, local);
+        vector<float> ref_h = dir == 0 ? blocked_h : hwc_h;
+        vector<float> out_h = read_buffer(commands, dir == 0 ? blocked_d : hwc_d, ref_h.size());
+        size_t n_mismatch = 0;
+        for(size_t i = 0; i < ref_h.size(); i++) n_mismatch += out_h[i] != ref_h[i];
+        n_failed += n_mismatch != 0;
+        printf("%-22s %4dx%-5d %8d %12s %12.3f %8s %10ld\n", dir == 0 ? "hwc_to_nchwc8" : "nchwc8_to_hwc", IMG_SIZE, IMG_SIZE, \
+               channel, "-", ms, "-", n_mismatch);
+        clReleaseMemObject(hwc_d);
+        clReleaseMemObject(blocked_d);
+    }
+    printf("%s\n", n_failed == 0 ? "All kernels match" : "Mismatch, see above");
+
+    cl_kernel kernels[11] = {local_kernel, mk_kernel, nchwc8_kernel, pool_kernel, pool8_kernel, up_kernel, up8_kernel, \
+                             concat_kernel, concat8_kernel, to8_kernel, from8_kernel};
+    for(int k = 0; k < 11; k++){
+        clReleaseKernel(kernels[k]);
+    }
+    clReleaseProgram(program);
+    clReleaseCommandQueue(commands);
+    clReleaseContext(context);
+    return n_failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,162 @@
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <math.h>
+#include <chrono>
+#include <vector>
+
+#include "../main.hpp"
+#include "../device.hpp"
+#include "../program.hpp"
+
+using namespace std;
+
+// compare conv2d_local_pool_mk against conv2d_local_mk followed by maxpooling2d on the
+// encoder block outputs of TomoGAN (layers 2, 4 and 6), each layer at the resolution it
+// runs at for an IMG_SIZE x IMG_SIZE slice
+#define IMG_SIZE    (1024)
+#define N_REPS      (15)
+
+//                                0  1   2   3   4   5    6    7    8    9   10   11  12  13  14  15
+const unsigned int conv_ch[16] = {3, 8,  32, 32, 64,  64, 128, 128, 256, 64, 128, 32, 64, 32, 32, 16};
+const unsigned int  n_conv[16] = {8, 32, 32, 64, 64, 128, 128, 128,  64, 64, 32,  32, 32, 32, 16, 1};
+const unsigned int conv_lv[16] = {0, 0, 0, 1, 1, 2, 2, 3, 2, 2, 1, 1, 0, 0, 0, 0};
+
+// device time of one run of the given launches, ns
+cl_ulong run_once(cl_command_queue commands, cl_kernel *kernels, size_t **globals, size_t **locals, int n_kernels){
+    cl_ulong total_ns = 0;
+    for(int i = 0; i < n_kernels; i++){
+        cl_event ev;
+        oclErrchk(clEnqueueNDRangeKernel(commands, kernels[i], 3, NULL, globals[i], locals[i], 0, NULL, &ev));
+        oclErrchk(clWaitForEvents(1, &ev));
+        cl_ulong st, ed;
+        clGetEventProfilingInfo(ev, CL_PROFILING_COMMAND_START, sizeof(cl_ulong), &st, NULL);
+        clGetEventProfilingInfo(ev, CL_PROFILING_COMMAND_END,   sizeof(cl_ulong), &ed, NULL);
+        clReleaseEvent(ev);
+        total_ns += ed - st;
+    }
+    return total_ns;
+}
+
+// average device time over N_REPS - 5 runs, the first 5 are warmup
+double time_kernels(cl_command_queue commands, cl_kernel *kernels, size_t **globals, size_t **locals, int n_kernels){
+    double total_ms = 0;
+    for(int rep = 0; rep < N_REPS; rep++){
+        cl_ulong ns = run_once(commands, kernels, globals, locals, n_kernels);
+        if(rep >= 5){
+            total_ms += ns / 1e6;
+        }
+    }
+    return total_ms / (N_REPS - 5);
+}
+
+int main(int argc, char** argv)
+{
+    int err;
+    // Pick a device, see device.hpp for the selection policy and overrides
+    ocl_device_info dev_info = select_device(argc, argv);
+    cl_device_id device_id = dev_info.device;
+
+    cl_context context = clCreateContext(0, 1, &device_id, NULL, NULL, &err);
+    if (!context){
+        printf("Error: Failed to create a compute context! %d\n", err);
+        return EXIT_FAILURE;
+    }
+    #ifdef __APPLE__
+        cl_command_queue commands = clCreateCommandQueue(context, device_id, CL_QUEUE_PROFILING_ENABLE, &err);
+    #else
+        cl_queue_properties queue_props[] = {CL_QUEUE_PROPERTIES, CL_QUEUE_PROFILING_ENABLE, 0};
+        cl_command_queue commands = clCreateCommandQueueWithProperties(context, device_id, queue_props, &err);
+    #endif
+    if (!commands){
+        printf("Error: Failed to create a command commands! %d\n", err);
+        return EXIT_FAILURE;
+    }
+
+    cl_program program = build_program(context, dev_info, "../conv2d.cl");
+    cl_kernel kernel_local = clCreateKernel(program, "conv2d_local_mk", &err);
+    cl_kernel kernel_fused = clCreateKernel(program, "conv2d_local_pool_mk", &err);
+    cl_kernel kernel_pool  = clCreateKernel(program, "maxpooling2d", &err);
+    if (!kernel_local || !kernel_fused || !kernel_pool){
+        printf("Error: Failed to create compute kernel! %d\n", err);
+        exit(1);
+    }
+
+    printf("%-6s %10s %4s %4s %14s %12s %8s %10s %10s\n", "layer", "HxW", "C", "NF", "conv+pool ms", "fused ms", \
+           "speedup", "skip diff", "pool diff");
+    const int layers[3] = {2, 4, 6};
+    for(int l = 0; l < 3; l++){
+        int layer = layers[l];
+        unsigned int size = IMG_SIZE >> conv_lv[layer];
+        unsigned int channel = conv_ch[layer], num_filter = n_conv[layer], filter_size = 3;
+        size_t in_size   = (size_t)size * size * channel;
+        size_t out_size  = (size_t)size * size * num_filter;
+        size_t pool_size = out_size / 4;
+        size_t w_size    = (size_t)filter_size * filter_size * channel * num_filter;
+
+        vector<float> input_h(in_size), filter_h(w_size);
+        vector<float> skip_ref_h(out_size), pool_ref_h(pool_size), skip_fused_h(out_size), pool_fused_h(pool_size);
+        srand(layer);
+        for(size_t i = 0; i < in_size; i++) input_h[i]  = rand() / (float)RAND_MAX;
+        for(size_t i = 0; i < w_size; i++)  filter_h[i] = rand() / (float)RAND_MAX - 0.5f;
+
+        cl_mem input_d  = clCreateBuffer(context, CL_MEM_READ_ONLY,  sizeof(float) * in_size,   NULL, NULL);
+        cl_mem filter_d = clCreateBuffer(context, CL_MEM_READ_ONLY,  sizeof(float) * w_size,    NULL, NULL);
+        cl_mem skip_d   = clCreateBuffer(context, CL_MEM_READ_WRITE, sizeof(float) * out_size,  NULL, NULL);
+        cl_mem pool_d   = clCreateBuffer(context, CL_MEM_WRITE_ONLY, sizeof(float) * pool_size, NULL, NULL);
+        if (!input_d || !filter_d || !skip_d || !pool_d){
+            printf("Error: Failed to allocate device memory!\n");
+            exit(1);
+        }
+        oclErrchk(clEnqueueWriteBuffer(commands, input_d,  CL_TRUE, 0, sizeof(float) * in_size, input_h.data(), 0, NULL, NULL));
+        oclErrchk(clEnqueueWriteBuffer(commands, filter_d, CL_TRUE, 0, sizeof(float) * w_size, filter_h.data(), 0, NULL, NULL));
+
+        // default LCONV_TILE and LCONV_KF_BLOCK of conv2d.cl
+        size_t local_tile[3]  = {16, 16, 1};
+        size_t global_tile[3] = {(size + 15) / 16 * 16, (size + 15) / 16 * 16, (num_filter + 7) / 8};
+        size_t local_pool[3]  = {16, 16, 1};
+        fit_local_size(dev_info, local_pool, kernel_pool);
+        size_t global_pool[3] = {(size / 2 + local_pool[0] - 1) / local_pool[0] * local_pool[0], \
+                                 (size / 2 + local_pool[1] - 1) / local_pool[1] * local_pool[1], 1};
+
+        conv2d_set_arg(&kernel_local, &input_d, size, size, channel, &filter_d, filter_size, num_filter, &skip_d, 1);
+        maxpool_set_arg(&kernel_pool, &skip_d, size / 2, size / 2, num_filter, &pool_d);
+        cl_kernel sep_kernels[2] = {kernel_local, kernel_pool};
+        size_t *sep_globals[2] = {global_tile, global_pool};
+        size_t *sep_locals[2]  = {local_tile, local_pool};
+        double sep_ms = time_kernels(commands, sep_kernels, sep_globals, sep_locals, 2);
+        oclErrchk(clEnqueueReadBuffer(commands, skip_d, CL_TRUE, 0, sizeof(float) * out_size,  skip_ref_h.data(), 0, NULL, NULL));
+        oclErrchk(clEnqueueReadBuffer(commands, pool_d, CL_TRUE, 0, sizeof(float) * pool_size, pool_ref_h.data(), 0, NULL, NULL));
+
+        conv2d_set_arg(&kernel_fused, &input_d, size, size, channel, &filter_d, filter_size, num_filter, &skip_d, 1);
+        oclErrchk(clSetKernelArg(kernel_fused, 9, sizeof(cl_mem), &pool_d));
+        size_t *fused_globals[1] = {global_tile};
+        size_t *fused_locals[1]  = {local_tile};
+        double fused_ms = time_kernels(commands, &kernel_fused, fused_globals, fused_locals, 1);
+        oclErrchk(clEnqueueReadBuffer(commands, skip_d, CL_TRUE, 0, sizeof(float) * out_size,  skip_fused_h.data(), 0, NULL, NULL));
+        oclErrchk(clEnqueueReadBuffer(commands, pool_d, CL_TRUE, 0, sizeof(float) * pool_size, pool_fused_h.data(), 0, NULL, NULL));
+
+        // same summation order, both should match exactly
+        double skip_diff = 0, pool_diff = 0;
+        for(size_t i = 0; i < out_size; i++){
+            skip_diff = max(skip_diff, (double)fabs(skip_ref_h[i] - skip_fused_h[i]));
+        }
+        for(size_t i = 0; i < pool_size; i++){
+            pool_diff = max(pool_diff, (double)fabs(pool_ref_h[i] - pool_fused_h[i]));
+        }
+        printf("%-6d %4dx%-5d %4d %4d %14.3f %12.3f %7.2fx %10.2e %10.2e\n", layer, size, size, channel, num_filter, \
+               sep_ms, fused_ms, sep_ms / fused_ms, skip_diff, pool_diff);
+
+        clReleaseMemObject(input_d);
+        clReleaseMemObject(filter_d);
+        clReleaseMemObject(skip_d);
+        clReleaseMemObject(pool_d);
+    }
+
+    clReleaseKernel(kernel_local);
+    clReleaseKernel(kernel_fused);
+    clReleaseKernel(kernel_pool);
+    clReleaseProgram(program);
+    clReleaseCommandQueue(commands);
+    clReleaseContext(context);
+}
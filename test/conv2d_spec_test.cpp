@@ -0,0 +1,224 @@
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <math.h>
+#include <chrono>
+#include <vector>
+
+#include "../main.hpp"
+#include "../device.hpp"
+#include "../program.hpp"
+#include "../utils.hpp"
+
+using namespace std;
+
+// compare the conv kernels of conv2d.cl built for one layer shape (-DSPEC_C_IN, -DSPEC_C_OUT,
+// -DSPEC_K, -DSPEC_RELU, as tomogan_session.hpp does) with the generic build on every layer
+// shape of TomoGAN: conv2d_local_mk for the 3x3 layers and the global memory kernel of the
+// layer's input channels for all, each at the resolution it runs at for an IMG_SIZE x IMG_SIZE
+// slice; then the direct CPU loops instantiated for the shape (utils.hpp) against the generic
+// ones at CPU_IMG_SIZE
+#define IMG_SIZE     (1024)
+#define CPU_IMG_SIZE (256)
+#define N_REPS       (15)
+#define CPU_REPS     (4)
+
+//                                0  1   2   3   4   5    6    7    8    9   10   11  12  13  14  15
+const unsigned int conv_ch[16] = {3, 8,  32, 32, 64,  64, 128, 128, 256, 64, 128, 32, 64, 32, 32, 16};
+const unsigned int  n_conv[16] = {8, 32, 32, 64, 64, 128, 128, 128,  64, 64, 32,  32, 32, 32, 16, 1};
+const unsigned int conv_sz[16] = {1, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 1, 1};
+const unsigned int conv_lv[16] = {0, 0, 0, 1, 1, 2, 2, 3, 2, 2, 1, 1, 0, 0, 0, 0};
+const unsigned int conv_lanes[16] = {1, 8, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16};
+
+// average device time of a launch over N_REPS - 5 runs, the first 5 are warmup
+double time_kernel(cl_command_queue commands, cl_kernel kernel, size_t *global, size_t *local){
+    double total_ms = 0;
+    for(int rep = 0; rep < N_REPS; rep++){
+        cl_event ev;
+        oclErrchk(clEnqueueNDRangeKernel(commands, kernel, 3, NULL, global, local, 0, NULL, &ev));
+        oclErrchk(clWaitForEvents(1, &ev));
+        cl_ulong st, ed;
+        clGetEventProfilingInfo(ev, CL_PROFILING_COMMAND_START, sizeof(cl_ulong), &st, NULL);
+        clGetEventProfilingInfo(ev, CL_PROFILING_COMMAND_END,   sizeof(cl_ulong), &ed, NULL);
+        clReleaseEvent(ev);
+        if(rep >= 5){
+            total_ms += (ed - st) / 1e6;
+        }
+    }
+    return total_ms / (N_REPS - 5);
+}
+
+// best of CPU_REPS runs, the first one warms up caches and page tables
+double time_ms(const function<void()> &fn){
+    double best = 1e30;
+    for(int rep = 0; rep < CPU_REPS; rep++){
+        auto st = chrono::steady_clock::now();
+        fn();
+        auto ed = chrono::steady_clock::now();
+        if(rep > 0){
+            best = min(best, chrono::duration_cast<chrono::microseconds>(ed - st).count() / 1000.);
+        }
+    }
+    return best;
+}
+
+cl_kernel create_kernel(cl_program program, const char *name){
+    int err;
+    cl_kernel kernel = clCreateKernel(program, name, &err);
+    if (!kernel){
+        printf("Error: Failed to create compute kernel %s! %d\n", name, err);
+        exit(1);
+    }
+    return kernel;
+}
+
+// max abs difference relative to the magnitude of a
+double rel_diff(const vector<float> &a, const vector<float> &b){
+    double diff = 0, max_out = 0;
+    for(size_t i = 0; i < a.size(); i++){
+        diff = max(diff, (double)fabs(a[i] - b[i]));
+        max_out = max(max_out, (double)fabs(a[i]));
+    }
+    return diff / max(max_out, 1e-30);
+}
+
+int main(int argc, char** argv)
+{
+    int err;
+    // Pick a device, see device.hpp for the selection policy and overrides
+    ocl_device_info dev_info = select_device(argc, argv);
+    cl_device_id device_id = dev_info.device;
+
+    cl_context context = clCreateContext(0, 1, &device_id, NULL, NULL, &err);
+    if (!context){
+        printf("Error: Failed to create a compute context! %d\n", err);
+        return EXIT_FAILURE;
+    }
+    #ifdef __APPLE__
+        cl_command_queue commands = clCreateCommandQueue(context, device_id, CL_QUEUE_PROFILING_ENABLE, &err);
+    #else
+        cl_queue_properties queue_props[] = {CL_QUEUE_PROPERTIES, CL_QUEUE_PROFILING_ENABLE, 0};
+        cl_command_queue commands = clCreateCommandQueueWithProperties(context, device_id, queue_props, &err);
+    #endif
+    if (!commands){
+        printf("Error: Failed to create a command commands! %d\n", err);
+        return EXIT_FAILURE;
+    }
+
+    cl_program program = build_program(context, dev_info, "../conv2d.cl");
+
+    printf("%-6s %10s %4s %4s %3s %-16s %12s %12s %8s %10s\n", "layer", "HxW", "C", "NF", "FS", "kernel", "generic ms", \
+           "special ms", "speedup", "max diff");
+    double total_generic = 0, total_spec = 0;
+    for(int layer = 0; layer < 16; layer++){
+        unsigned int size = IMG_SIZE >> conv_lv[layer];
+        unsigned int channel = conv_ch[layer], num_filter = n_conv[layer], filter_size = conv_sz[layer];
+        unsigned char relu = layer < 15;
+        size_t in_size  = (size_t)size * size * channel;
+        size_t out_size = (size_t)size * size * num_filter;
+        size_t w_size   = (size_t)filter_size * filter_size * channel * num_filter;
+
+        vector<float> input_h(in_size), filter_h(w_size), out_generic_h(out_size), out_spec_h(out_size);
+        srand(layer);
+        for(size_t i = 0; i < in_size; i++) input_h[i]  = rand() / (float)RAND_MAX;
+        for(size_t i = 0; i < w_size; i++)  filter_h[i] = rand() / (float)RAND_MAX - 0.5f;
+
+        cl_mem input_d  = clCreateBuffer(context, CL_MEM_READ_ONLY,  sizeof(float) * in_size,  NULL, NULL);
+        cl_mem filter_d = clCreateBuffer(context, CL_MEM_READ_ONLY,  sizeof(float) * w_size,   NULL, NULL);
+        cl_mem output_d = clCreateBuffer(context, CL_MEM_WRITE_ONLY, sizeof(float) * out_size, NULL, NULL);
+        if (!input_d || !filter_d || !output_d){
+            printf("Error: Failed to allocate device memory!\n");
+            exit(1);
+        }
+        oclErrchk(clEnqueueWriteBuffer(commands, input_d,  CL_TRUE, 0, sizeof(float) * in_size, input_h.data(), 0, NULL, NULL));
+        oclErrchk(clEnqueueWriteBuffer(commands, filter_d, CL_TRUE, 0, sizeof(float) * w_size, filter_h.data(), 0, NULL, NULL));
+
+        char spec_options[128];
+        snprintf(spec_options, sizeof(spec_options), "-DSPEC_C_IN=%d -DSPEC_C_OUT=%d -DSPEC_K=%d -DSPEC_RELU=%d", \
+                 channel, num_filter, filter_size, relu);
+        cl_program spec_program = build_program(context, dev_info, "../conv2d.cl", spec_options);
+
+        // the fallback kernel of tomogan_session.hpp, and conv2d_local_mk for the 3x3 layers
+        vector<const char*> kernel_names;
+        if(filter_size == 3){
+            kernel_names.push_back("conv2d_local_mk");
+        }
+        kernel_names.push_back(channel % 16 == 0 ? "conv2d_vec16_mk" : channel % 8 == 0 ? "conv2d_vec8_mk" : "conv2d_mk");
+        for(const char *kernel_name : kernel_names){
+            const bool local_kernel = strcmp(kernel_name, "conv2d_local_mk") == 0;
+            double ms[2];
+            for(int spec = 0; spec < 2; spec++){
+                cl_kernel kernel = create_kernel(spec ? spec_program : program, kernel_name);
+                size_t local[3] = {16, 16, 1};
+                size_t global[3];
+                if(local_kernel){
+                    // default LCONV_TILE and LCONV_KF_BLOCK of conv2d.cl
+                    conv2d_set_arg(&kernel, &input_d, size, size, channel, &filter_d, filter_size, num_filter, &output_d, relu);
+                    global[2] = (num_filter + 7) / 8;
+                }else{
+                    conv2d_mk_set_arg(&kernel, &input_d, size, size, channel, &filter_d, filter_size, num_filter, &output_d, \
+                                      relu, num_filter);
+                    fit_local_size(dev_info, local, kernel);
+                    global[2] = 1;
+                }
+                global[0] = (size + local[0] - 1) / local[0] * local[0];
+                global[1] = (size + local[1] - 1) / local[1] * local[1];
+                ms[spec] = time_kernel(commands, kernel, global, local);
+                oclErrchk(clEnqueueReadBuffer(commands, output_d, CL_TRUE, 0, sizeof(float) * out_size, \
+                                              spec ? out_spec_h.data() : out_generic_h.data(), 0, NULL, NULL));
+                clReleaseKernel(kernel);
+            }
+            // the session runs the local memory kernel for 3x3 layers, the global one otherwise
+            if(local_kernel || filter_size != 3){
+                total_generic += ms[0];
+                total_spec += ms[1];
+            }
+            printf("%-6d %4dx%-5d %4d %4d %3d %-16s %12.3f %12.3f %7.2fx %10.2e\n", layer, size, size, channel, num_filter, \
+                   filter_size, kernel_name, ms[0], ms[1], ms[0] / ms[1], rel_diff(out_generic_h, out_spec_h));
+        }
+
+        clReleaseProgram(spec_program);
+        clReleaseMemObject(input_d);
+        clReleaseMemObject(filter_d);
+        clReleaseMemObject(output_d);
+    }
+    printf("Layers as the session runs them: %.3f ms generic, %.3f ms specialized (%.2fx)\n", total_generic, total_spec, \
+           total_generic / total_spec);
+
+    printf("\nCPU direct loops, %d threads, %dx%d slice\n", cpu_num_threads(), CPU_IMG_SIZE, CPU_IMG_SIZE);
+    printf("%-6s %10s %4s %4s %3s %12s %12s %8s %10s\n", "layer", "HxW", "C", "NF", "FS", "generic ms", "special ms", \
+           "speedup", "max diff");
+    double cpu_generic = 0, cpu_spec = 0;
+    for(int layer = 0; layer < 16; layer++){
+        unsigned int size = CPU_IMG_SIZE >> conv_lv[layer];
+        unsigned int channel = conv_ch[layer], num_filter = n_conv[layer], filter_size = conv_sz[layer];
+        unsigned char relu = layer < 15;
+        size_t in_size  = (size_t)size * size * channel;
+        size_t out_size = (size_t)size * size * num_filter;
+        size_t w_size   = (size_t)filter_size * filter_size * channel * num_filter;
+
+        vector<float> input_h(in_size), filter_h(w_size), out_generic_h(out_size), out_spec_h(out_size);
+        srand(layer);
+        for(size_t i = 0; i < in_size; i++) input_h[i]  = rand() / (float)RAND_MAX;
+        for(size_t i = 0; i < w_size; i++)  filter_h[i] = rand() / (float)RAND_MAX - 0.5f;
+
+        double generic_ms = time_ms([&](){
+            conv2d_cpu(input_h.data(), size, size, channel, filter_h.data(), filter_size, num_filter, out_generic_h.data(), \
+                       relu, conv_lanes[layer], false);
+        });
+        double spec_ms = time_ms([&](){
+            conv2d_cpu(input_h.data(), size, size, channel, filter_h.data(), filter_size, num_filter, out_spec_h.data(), \
+                       relu, conv_lanes[layer], true);
+        });
+        cpu_generic += generic_ms;
+        cpu_spec += spec_ms;
+        printf("%-6d %4dx%-5d %4d %4d %3d %12.3f %12.3f %7.2fx %10.2e\n", layer, size, size, channel, num_filter, filter_size, \
+               generic_ms, spec_ms, generic_ms / spec_ms, rel_diff(out_generic_h, out_spec_h));
+    }
+    printf("All layers: %.3f ms generic, %.3f ms specialized (%.2fx)\n", cpu_generic, cpu_spec, cpu_generic / cpu_spec);
+
+    clReleaseProgram(program);
+    clReleaseCommandQueue(commands);
+    clReleaseContext(context);
+    return 0;
+}
@@ -5,6 +5,7 @@
 #include <chrono>
 
 #include "../main.hpp"
+#include "../device.hpp"
 
 #ifdef __APPLE__
     #define CL_SILENCE_DEPRECATION 
@@ -52,56 +53,12 @@ int main(int argc, char** argv)
                 input_img_h[gidx] = c;
     }
     
-    // Set up platform 
-    cl_platform_id platform_ids[2];
-    cl_uint num_platforms = 0;
-    err = clGetPlatformIDs(2, platform_ids, &num_platforms);
-    if (err != CL_SUCCESS){ 
-        printf("Failed to query platforms. Error:%i\n", err);
-    }else{
-        printf("There are %d platform(s).\n", num_platforms);
-    }
-    if(num_platforms == 0){
-        printf("Exit because there is no platform support OpenCL\n");
-        return EXIT_FAILURE;
-    }
-
-    unsigned int platform_idx = 0;
-    char *profile = NULL;
-    size_t size;
-    clGetPlatformInfo(platform_ids[platform_idx], CL_PLATFORM_VERSION, 0, profile, &size); // get size of profile char array
-    profile = new char[size]();
-    clGetPlatformInfo(platform_ids[platform_idx], CL_PLATFORM_VERSION,size, profile, NULL); // get profile char array
-    cout << profile << " is used to support computing." << endl;
-    delete[] profile;
-
-    unsigned int num_devices = 0;
-    cl_device_id device_ids[2];
-    err = clGetDeviceIDs(platform_ids[platform_idx], CL_DEVICE_TYPE_GPU, 2, device_ids, &num_devices);
-    if (err != CL_SUCCESS){
-        printf("Error: Failed to create a device group: %d\n", err);
-        return EXIT_FAILURE;
-    }else{
-        printf("There is(are) %d GPU device(s) support OCL.\n", num_devices);
-    }
-    if(num_devices == 0){
-        printf("Exit because there is no device support OpenCL\n");
-        return EXIT_FAILURE;
-    }
-
-    unsigned int dev_idx = 0;
-
-    cl_ulong local_mem_size;
-    clGetDeviceInfo(device_ids[dev_idx], CL_DEVICE_LOCAL_MEM_SIZE, sizeof(cl_ulong), &local_mem_size, 0);
-    char *vendor = NULL;
-    clGetDeviceInfo(device_ids[dev_idx], CL_DEVICE_VENDOR, 0, NULL, &size);
-    vendor = new char[size]();
-    clGetDeviceInfo(device_ids[dev_idx], CL_DEVICE_VENDOR, size, vendor, NULL);
-    printf("Device produced by %s with %lldKB local mem will be used.\n", vendor, local_mem_size/1024);
-    delete[] vendor;
+    // Pick a device, see device.hpp for the selection policy and overrides
+    ocl_device_info dev_info = select_device(argc, argv);
+    cl_device_id device_id = dev_info.device;
 
     // Create a compute context 
-    cl_context context = clCreateContext(0, 1, &(device_ids[dev_idx]), NULL, NULL, &err);
+    cl_context context = clCreateContext(0, 1, &device_id, NULL, NULL, &err);
     if (!context){
         printf("Error: Failed to create a compute context! %d\n", err);
         return EXIT_FAILURE;
@@ -109,9 +66,9 @@ int main(int argc, char** argv)
 
     // Create a command commands
     #ifdef __APPLE__
-        cl_command_queue commands = clCreateCommandQueue(context, device_ids[dev_idx], 0, &err);
+        cl_command_queue commands = clCreateCommandQueue(context, device_id, 0, &err);
     #else
-        cl_command_queue commands = clCreateCommandQueueWithProperties(context, device_ids[dev_idx], 0, &err);
+        cl_command_queue commands = clCreateCommandQueueWithProperties(context, device_id, 0, &err);
     #endif
     if (!commands){
         printf("Error: Failed to create a command commands! %d\n", err);
@@ -147,7 +104,7 @@ int main(int argc, char** argv)
         size_t len;
         char buffer[2048];
         printf("Error: Failed to build program executable!: %d\n", err);
-        clGetProgramBuildInfo(program, device_ids[dev_idx], CL_PROGRAM_BUILD_LOG, sizeof(buffer), buffer, &len);
+        clGetProgramBuildInfo(program, device_id, CL_PROGRAM_BUILD_LOG, sizeof(buffer), buffer, &len);
         printf("build error: %s\n", buffer);
         exit(1);
     }
@@ -161,7 +118,7 @@ int main(int argc, char** argv)
 
     size_t max_group_size;
     // Get the maximum work group size for executing the kernel on the device
-    err = clGetKernelWorkGroupInfo(kernel, device_ids[dev_idx], CL_KERNEL_WORK_GROUP_SIZE, sizeof(max_group_size), &max_group_size, NULL);
+    err = clGetKernelWorkGroupInfo(kernel, device_id, CL_KERNEL_WORK_GROUP_SIZE, sizeof(max_group_size), &max_group_size, NULL);
     if (err != CL_SUCCESS)
     {
         printf("Error: Failed to retrieve kernel work group info! %d\n", err);
@@ -200,7 +157,8 @@ int main(int argc, char** argv)
         }
 
         unsigned char apply_relu = 1;
-        conv2d_set_arg(&kernel, &input_d, img_height, img_width, img_channel, &filter_d, filter_size, num_filter, &output_d, apply_relu);
+        conv2d_mk_set_arg(&kernel, &input_d, img_height, img_width, img_channel, &filter_d, filter_size, num_filter, &output_d, \
+                          apply_relu, num_filter);
         // Set the arguments to our compute kernel
         // err  = 0;
         // err  = clSetKernelArg(kernel, 0, sizeof(cl_mem), &input_d);
@@ -222,6 +180,7 @@ int main(int argc, char** argv)
             return EXIT_FAILURE;
         }
         size_t local[2] = {16, 16};
+        fit_local_size(dev_info, local, kernel);
         size_t global[2] = {IMG_SIZE, IMG_SIZE};
         err = clEnqueueNDRangeKernel(commands, kernel, 2, NULL, global, local, 0, NULL, NULL);
         if (err){
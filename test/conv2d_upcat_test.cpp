@@ -0,0 +1,174 @@
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <math.h>
+#include <chrono>
+#include <vector>
+
+#include "../main.hpp"
+#include "../device.hpp"
+#include "../program.hpp"
+
+using namespace std;
+
+// compare conv2d_local_upcat_mk against upsample2d + concatenate + conv2d_local_mk on the
+// decoder blocks of TomoGAN (layers 8, 10 and 12), each layer at the resolution it runs at
+// for an IMG_SIZE x IMG_SIZE slice
+#define IMG_SIZE    (1024)
+#define N_REPS      (15)
+
+//                                0  1   2   3   4   5    6    7    8    9   10   11  12  13  14  15
+const unsigned int conv_ch[16] = {3, 8,  32, 32, 64,  64, 128, 128, 256, 64, 128, 32, 64, 32, 32, 16};
+const unsigned int  n_conv[16] = {8, 32, 32, 64, 64, 128, 128, 128,  64, 64, 32,  32, 32, 32, 16, 1};
+const unsigned int conv_lv[16] = {0, 0, 0, 1, 1, 2, 2, 3, 2, 2, 1, 1, 0, 0, 0, 0};
+
+// device time of one run of the given launches, ns
+cl_ulong run_once(cl_command_queue commands, cl_kernel *kernels, size_t **globals, size_t **locals, int n_kernels){
+    cl_ulong total_ns = 0;
+    for(int i = 0; i < n_kernels; i++){
+        cl_event ev;
+        oclErrchk(clEnqueueNDRangeKernel(commands, kernels[i], 3, NULL, globals[i], locals[i], 0, NULL, &ev));
+        oclErrchk(clWaitForEvents(1, &ev));
+        cl_ulong st, ed;
+        clGetEventProfilingInfo(ev, CL_PROFILING_COMMAND_START, sizeof(cl_ulong), &st, NULL);
+        clGetEventProfilingInfo(ev, CL_PROFILING_COMMAND_END,   sizeof(cl_ulong), &ed, NULL);
+        clReleaseEvent(ev);
+        total_ns += ed - st;
+    }
+    return total_ns;
+}
+
+// average device time over N_REPS - 5 runs, the first 5 are warmup
+double time_kernels(cl_command_queue commands, cl_kernel *kernels, size_t **globals, size_t **locals, int n_kernels){
+    double total_ms = 0;
+    for(int rep = 0; rep < N_REPS; rep++){
+        cl_ulong ns = run_once(commands, kernels, globals, locals, n_kernels);
+        if(rep >= 5){
+            total_ms += ns / 1e6;
+        }
+    }
+    return total_ms / (N_REPS - 5);
+}
+
+int main(int argc, char** argv)
+{
+    int err;
+    // Pick a device, see device.hpp for the selection policy and overrides
+    ocl_device_info dev_info = select_device(argc, argv);
+    cl_device_id device_id = dev_info.device;
+
+    cl_context context = clCreateContext(0, 1, &device_id, NULL, NULL, &err);
+    if (!context){
+        printf("Error: Failed to create a compute context! %d\n", err);
+        return EXIT_FAILURE;
+    }
+    #ifdef __APPLE__
+        cl_command_queue commands = clCreateCommandQueue(context, device_id, CL_QUEUE_PROFILING_ENABLE, &err);
+    #else
+        cl_queue_properties queue_props[] = {CL_QUEUE_PROPERTIES, CL_QUEUE_PROFILING_ENABLE, 0};
+        cl_command_queue commands = clCreateCommandQueueWithProperties(context, device_id, queue_props, &err);
+    #endif
+    if (!commands){
+        printf("Error: Failed to create a command commands! %d\n", err);
+        return EXIT_FAILURE;
+    }
+
+    cl_program program = build_program(context, dev_info, "../conv2d.cl");
+    cl_kernel kernel_local = clCreateKernel(program, "conv2d_local_mk", &err);
+    cl_kernel kernel_fused  = clCreateKernel(program, "conv2d_local_upcat_mk", &err);
+    cl_kernel kernel_up     = clCreateKernel(program, "upsample2d", &err);
+    cl_kernel kernel_concat = clCreateKernel(program, "concatenate", &err);
+    if (!kernel_local || !kernel_fused || !kernel_up || !kernel_concat){
+        printf("Error: Failed to create compute kernel! %d\n", err);
+        exit(1);
+    }
+
+    printf("%-6s %10s %4s %4s %4s %17s %12s %8s %10s\n", "layer", "HxW", "C1", "C2", "NF", "up+cat+conv ms", "fused ms", \
+           "speedup", "max diff");
+    // layer, the encoder layer of its skip input, the decoder layer of its low resolution input
+    const int layers[3][3] = {{8, 6, 7}, {10, 4, 9}, {12, 2, 11}};
+    for(int l = 0; l < 3; l++){
+        int layer = layers[l][0];
+        unsigned int size = IMG_SIZE >> conv_lv[layer];
+        unsigned int skip_channel = n_conv[layers[l][1]], low_channel = n_conv[layers[l][2]];
+        unsigned int channel = conv_ch[layer], num_filter = n_conv[layer], filter_size = 3;
+        size_t skip_size = (size_t)size * size * skip_channel;
+        size_t low_size  = (size_t)size * size / 4 * low_channel;
+        size_t up_size   = (size_t)size * size * low_channel;
+        size_t cat_size  = (size_t)size * size * channel;
+        size_t out_size  = (size_t)size * size * num_filter;
+        size_t w_size    = (size_t)filter_size * filter_size * channel * num_filter;
+
+        vector<float> skip_h(skip_size), low_h(low_size), filter_h(w_size), out_ref_h(out_size), out_fused_h(out_size);
+        srand(layer);
+        for(size_t i = 0; i < skip_size; i++) skip_h[i]  = rand() / (float)RAND_MAX;
+        for(size_t i = 0; i < low_size; i++)  low_h[i]   = rand() / (float)RAND_MAX;
+        for(size_t i = 0; i < w_size; i++)    filter_h[i] = rand() / (float)RAND_MAX - 0.5f;
+
+        cl_mem skip_d   = clCreateBuffer(context, CL_MEM_READ_ONLY,  sizeof(float) * skip_size, NULL, NULL);
+        cl_mem low_d    = clCreateBuffer(context, CL_MEM_READ_ONLY,  sizeof(float) * low_size,  NULL, NULL);
+        cl_mem filter_d = clCreateBuffer(context, CL_MEM_READ_ONLY,  sizeof(float) * w_size,    NULL, NULL);
+        cl_mem up_d     = clCreateBuffer(context, CL_MEM_READ_WRITE, sizeof(float) * up_size,   NULL, NULL);
+        cl_mem cat_d    = clCreateBuffer(context, CL_MEM_READ_WRITE, sizeof(float) * cat_size,  NULL, NULL);
+        cl_mem output_d = clCreateBuffer(context, CL_MEM_WRITE_ONLY, sizeof(float) * out_size,  NULL, NULL);
+        if (!skip_d || !low_d || !filter_d || !up_d || !cat_d || !output_d){
+            printf("Error: Failed to allocate device memory!\n");
+            exit(1);
+        }
+        oclErrchk(clEnqueueWriteBuffer(commands, skip_d,   CL_TRUE, 0, sizeof(float) * skip_size, skip_h.data(), 0, NULL, NULL));
+        oclErrchk(clEnqueueWriteBuffer(commands, low_d,    CL_TRUE, 0, sizeof(float) * low_size, low_h.data(), 0, NULL, NULL));
+        oclErrchk(clEnqueueWriteBuffer(commands, filter_d, CL_TRUE, 0, sizeof(float) * w_size, filter_h.data(), 0, NULL, NULL));
+
+        // default LCONV_TILE and LCONV_KF_BLOCK of conv2d.cl
+        size_t local_tile[3]  = {16, 16, 1};
+        size_t global_tile[3] = {(size + 15) / 16 * 16, (size + 15) / 16 * 16, (num_filter + 7) / 8};
+        size_t local_up[3]  = {16, 16, 1};
+        fit_local_size(dev_info, local_up, kernel_up);
+        size_t global_up[3] = {(size / 2 + local_up[0] - 1) / local_up[0] * local_up[0], \
+                               (size / 2 + local_up[1] - 1) / local_up[1] * local_up[1], 1};
+        size_t local_cat[3]  = {16, 16, 1};
+        fit_local_size(dev_info, local_cat, kernel_concat);
+        size_t global_cat[3] = {(size + local_cat[0] - 1) / local_cat[0] * local_cat[0], \
+                                (size + local_cat[1] - 1) / local_cat[1] * local_cat[1], 1};
+
+        upsample_set_arg(&kernel_up, &low_d, size / 2, size / 2, low_channel, &up_d);
+        concat_set_arg(&kernel_concat, &skip_d, &up_d, size, size, skip_channel, low_channel, &cat_d);
+        conv2d_set_arg(&kernel_local, &cat_d, size, size, channel, &filter_d, filter_size, num_filter, &output_d, 1);
+        cl_kernel sep_kernels[3] = {kernel_up, kernel_concat, kernel_local};
+        size_t *sep_globals[3] = {global_up, global_cat, global_tile};
+        size_t *sep_locals[3]  = {local_up, local_cat, local_tile};
+        double sep_ms = time_kernels(commands, sep_kernels, sep_globals, sep_locals, 3);
+        oclErrchk(clEnqueueReadBuffer(commands, output_d, CL_TRUE, 0, sizeof(float) * out_size, out_ref_h.data(), 0, NULL, NULL));
+
+        conv2d_set_arg(&kernel_fused, &skip_d, size, size, channel, &filter_d, filter_size, num_filter, &output_d, 1);
+        oclErrchk(clSetKernelArg(kernel_fused, 9,  sizeof(cl_mem), &low_d));
+        oclErrchk(clSetKernelArg(kernel_fused, 10, sizeof(unsigned int), &skip_channel));
+        size_t *fused_globals[1] = {global_tile};
+        size_t *fused_locals[1]  = {local_tile};
+        double fused_ms = time_kernels(commands, &kernel_fused, fused_globals, fused_locals, 1);
+        oclErrchk(clEnqueueReadBuffer(commands, output_d, CL_TRUE, 0, sizeof(float) * out_size, out_fused_h.data(), 0, NULL, NULL));
+
+        // same summation order, both should match exactly
+        double max_diff = 0;
+        for(size_t i = 0; i < out_size; i++){
+            max_diff = max(max_diff, (double)fabs(out_ref_h[i] - out_fused_h[i]));
+        }
+        printf("%-6d %4dx%-5d %4d %4d %4d %17.3f %12.3f %7.2fx %10.2e\n", layer, size, size, skip_channel, low_channel, \
+               num_filter, sep_ms, fused_ms, sep_ms / fused_ms, max_diff);
+
+        clReleaseMemObject(skip_d);
+        clReleaseMemObject(low_d);
+        clReleaseMemObject(filter_d);
+        clReleaseMemObject(up_d);
+        clReleaseMemObject(cat_d);
+        clReleaseMemObject(output_d);
+    }
+
+    clReleaseKernel(kernel_local);
+    clReleaseKernel(kernel_fused);
+    clReleaseKernel(kernel_up);
+    clReleaseKernel(kernel_concat);
+    clReleaseProgram(program);
+    clReleaseCommandQueue(commands);
+    clReleaseContext(context);
+}
@@ -0,0 +1,82 @@
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <math.h>
+#include <chrono>
+#include <random>
+#include <vector>
+#include <unistd.h>
+
+#include "../tomogan_session.hpp"
+
+using namespace std;
+
+// infer_tiled against a whole-image run of the same network on a random image, on sizes that
+// are not a multiple of the pooling grid so the last tiles reach past the border, with tile
+// sizes on and off the grid (tile_side() rounds them down). The session loads conv2d.cl,
+// tomogan.net and the weights from the repo root.
+// usage: ./tiled_test [height width tile] [--device ...]
+
+// max difference relative to the output magnitude, 0 when both match
+double tiled_diff(const ocl_device_info &dev_info, const network &net, unsigned int img_height, unsigned int img_width,
+                  unsigned int tile){
+    const unsigned int img_ch = net.channel(), out_ch = net.node(net.output()).channel;
+    const size_t img_pixels = (size_t)img_height * img_width;
+    std::vector<float> input_h(img_pixels * img_ch);
+    std::mt19937 gen(7);
+    std::uniform_real_distribution<float> dist(0.f, 1.f);
+    for(float &v : input_h){
+        v = dist(gen);
+    }
+
+    std::vector<float> whole_h(img_pixels * out_ch), tiled_h(img_pixels * out_ch);
+    {
+        TomoGANSession session(dev_info, net, "tomogan_weights_serilize.bin", img_height, img_width, img_ch);
+        session.infer(input_h.data(), whole_h.data());
+        printf("It takes %.3f ms to run the %dx%d image whole\n", session.last_infer_ms(), img_height, img_width);
+    }
+    {
+        TomoGANSession session(dev_info, net, "tomogan_weights_serilize.bin", tile_side(net, tile, img_height), \
+                               tile_side(net, tile, img_width), img_ch);
+        session.infer_tiled(input_h.data(), img_height, img_width, tiled_h.data());
+        printf("It takes %.3f ms to run it in %dx%d tiles (--tile %d)\n", session.last_infer_ms(), session.height(), \
+               session.width(), tile);
+    }
+
+    // the same kernels sum in the same order, up to a different launch configuration per size
+    double max_diff = 0, max_out = 1e-30;
+    size_t worst = 0;
+    for(size_t i = 0; i < whole_h.size(); i++){
+        double diff = fabs((double)whole_h[i] - tiled_h[i]);
+        if(diff > max_diff){
+            max_diff = diff;
+            worst = i;
+        }
+        max_out = max(max_out, (double)fabs(whole_h[i]));
+    }
+    printf("max diff %.3e relative to the output magnitude, at row %ld col %ld\n", max_diff / max_out, \
+           worst / out_ch / img_width, worst / out_ch % img_width);
+    return max_diff / max_out;
+}
+
+int main(int argc, char** argv)
+{
+    // height, width, tile
+    std::vector<std::vector<unsigned int> > cases = {{1001, 1003, 512}, {1001, 1003, 509}, {112, 112, 105}};
+    if(argc > 3 && isdigit(argv[1][0]) && isdigit(argv[2][0]) && isdigit(argv[3][0])){
+        cases = {{(unsigned int)atoi(argv[1]), (unsigned int)atoi(argv[2]), (unsigned int)atoi(argv[3])}};
+    }
+    if(chdir("..") != 0){
+        printf("Error: failed to change to the repo root\n");
+        exit(1);
+    }
+
+    network net = network::load("tomogan.net");
+    ocl_device_info dev_info = select_device(argc, argv);
+    int n_failed = 0;
+    for(const std::vector<unsigned int> &c : cases){
+        n_failed += tiled_diff(dev_info, net, c[0], c[1], c[2]) > 1e-5;
+    }
+    printf("%d of %ld cases differ\n", n_failed, cases.size());
+    return n_failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,118 @@
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <math.h>
+#include <chrono>
+#include <vector>
+
+#include "../utils.hpp"
+#include "../conv_gemm.hpp"
+#include "../winograd.hpp"
+
+using namespace std;
+
+// accuracy and speed of Winograd F(2x2,3x3) and F(4x4,3x3) against the direct conv2d_cpu
+// (same summation order as conv2d_vec16_mk) and the GEMM path, on the 3x3 layers with the
+// real weights of ../tomogan_weights_serilize.bin, each layer at the resolution it runs
+// at for an img_size x img_size slice. Inputs are uniform in [0, 1), like ReLU activations.
+// usage: ./winograd_test [img_size] [threads]
+#define N_REPS (3)
+
+//                                0  1   2   3   4   5    6    7    8    9   10   11  12  13  14  15
+const unsigned int conv_ch[16] = {3, 8,  32, 32, 64,  64, 128, 128, 256, 64, 128, 32, 64, 32, 32, 16};
+const unsigned int  n_conv[16] = {8, 32, 32, 64, 64, 128, 128, 128,  64, 64, 32,  32, 32, 32, 16, 1};
+const unsigned int conv_sz[16] = {1, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 1, 1};
+const unsigned int conv_lv[16] = {0, 0, 0, 1, 1, 2, 2, 3, 2, 2, 1, 1, 0, 0, 0, 0};
+const unsigned int conv_lanes[16] = {1, 8, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16};
+
+// best of N_REPS runs, the first one warms up caches and page tables
+double time_ms(const function<void()> &fn){
+    double best = 1e30;
+    for(int rep = 0; rep < N_REPS; rep++){
+        auto st = chrono::steady_clock::now();
+        fn();
+        auto ed = chrono::steady_clock::now();
+        if(rep > 0){
+            best = min(best, chrono::duration_cast<chrono::microseconds>(ed - st).count() / 1000.);
+        }
+    }
+    return best;
+}
+
+// max abs error and RMS error relative to the largest reference magnitude
+void rel_errors(const vector<float> &ref, const vector<float> &out, double *max_err, double *rms_err){
+    double max_diff = 0, sq_sum = 0, max_ref = 1e-30;
+    for(size_t i = 0; i < ref.size(); i++){
+        double diff = fabs((double)ref[i] - out[i]);
+        max_diff = max(max_diff, diff);
+        sq_sum  += diff * diff;
+        max_ref  = max(max_ref, (double)fabs(ref[i]));
+    }
+    *max_err = max_diff / max_ref;
+    *rms_err = sqrt(sq_sum / ref.size()) / max_ref;
+}
+
+int main(int argc, char** argv)
+{
+    unsigned int img_size = argc > 1 ? atoi(argv[1]) : 1024;
+    if(argc > 2){
+        cpu_num_threads(atoi(argv[2]));
+    }
+
+    float* conv_kernels_h[16];
+    std::ifstream weights_fin("../tomogan_weights_serilize.bin", std::ios::binary);
+    for(int i = 0; i < 16; i++){
+        unsigned int n_weights = (conv_sz[i] * conv_sz[i] * conv_ch[i] * n_conv[i]);
+        conv_kernels_h[i] = new float[n_weights]();
+        weights_fin.read((char *) conv_kernels_h[i], sizeof(float) * n_weights);
+        if(!weights_fin){
+            printf("Error while load weights for conv %02d, EoF reached, only %ld bytes could be read\n", i, weights_fin.gcount());
+            exit(-1);
+        }
+    }
+    weights_fin.close();
+
+    printf("%d threads, %dx%d slice, GEMM micro-kernel %s\n", cpu_num_threads(), img_size, img_size, GEMM_ISA);
+    printf("%-6s %10s %4s %4s %10s %10s %10s %10s %10s %10s %10s\n", "layer", "HxW", "C", "NF", "direct ms", "gemm ms", \
+           "F2 ms", "F4 ms", "F2 maxerr", "F4 maxerr", "F4 rmserr");
+    for(int layer = 0; layer < 16; layer++){
+        if(conv_sz[layer] != 3){
+            continue;
+        }
+        unsigned int size = img_size >> conv_lv[layer];
+        unsigned int channel = conv_ch[layer], num_filter = n_conv[layer];
+        size_t in_size  = (size_t)size * size * channel;
+        size_t out_size = (size_t)size * size * num_filter;
+
+        vector<float> input_h(in_size), out_direct_h(out_size), out_gemm_h(out_size), out_f2_h(out_size), out_f4_h(out_size);
+        srand(layer);
+        for(size_t i = 0; i < in_size; i++) input_h[i] = rand() / (float)RAND_MAX;
+
+        // no ReLU so that negative outputs are compared too
+        double direct_ms = time_ms([&](){
+            conv2d_cpu(input_h.data(), size, size, channel, conv_kernels_h[layer], 3, num_filter, out_direct_h.data(), 0, conv_lanes[layer]);
+        });
+        gemm_packed_filters gemm_filters = gemm_pack_filters(conv_kernels_h[layer], 9 * channel, num_filter);
+        double gemm_ms = time_ms([&](){
+            conv2d_gemm_cpu(input_h.data(), size, size, channel, gemm_filters, 3, out_gemm_h.data(), 0);
+        });
+        winograd_packed_filters f2_filters = winograd_pack_filters(conv_kernels_h[layer], channel, num_filter, winograd_f2());
+        double f2_ms = time_ms([&](){
+            conv2d_winograd_cpu(input_h.data(), size, size, channel, f2_filters, out_f2_h.data(), 0);
+        });
+        winograd_packed_filters f4_filters = winograd_pack_filters(conv_kernels_h[layer], channel, num_filter, winograd_f4());
+        double f4_ms = time_ms([&](){
+            conv2d_winograd_cpu(input_h.data(), size, size, channel, f4_filters, out_f4_h.data(), 0);
+        });
+
+        double f2_max, f2_rms, f4_max, f4_rms;
+        rel_errors(out_direct_h, out_f2_h, &f2_max, &f2_rms);
+        rel_errors(out_direct_h, out_f4_h, &f4_max, &f4_rms);
+        printf("%-6d %4dx%-5d %4d %4d %10.3f %10.3f %10.3f %10.3f %10.2e %10.2e %10.2e\n", layer, size, size, channel, num_filter, \
+               direct_ms, gemm_ms, f2_ms, f4_ms, f2_max, f4_max, f4_rms);
+    }
+
+    for(int i = 0; i < 16; i++){
+        delete[] conv_kernels_h[i];
+    }
+}
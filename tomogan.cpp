@@ -4,73 +4,153 @@
 #include <math.h>
 #include <chrono>
 
-#include "main.hpp"
-
-#ifdef __APPLE__
-    #define CL_SILENCE_DEPRECATION 
-    #include <OpenCL/opencl.h>
-#else
-    #define CL_TARGET_OPENCL_VERSION 210
-    #include <CL/cl.h>
-#endif
+#include "tomogan_session.hpp"
+#include "quality.hpp"
 
 using namespace std;
 
-// Use a static data size for simplicity
-#define IMG_SIZE    (1024)
-#define IMG_WIDTH   IMG_SIZE
-#define IMG_HEIGHT  IMG_SIZE
-#define IMG_CH      (3)
-#define INPUT_SIZE  (IMG_SIZE * IMG_SIZE * IMG_CH)
-#define OUTPUT_SIZE (IMG_SIZE * IMG_SIZE)
-#define BOX1_IMG_SIZE (IMG_SIZE)
-#define BOX2_IMG_SIZE (IMG_SIZE/2)
-#define BOX3_IMG_SIZE (IMG_SIZE/4)
-#define INTR_IMG_SIZE (IMG_SIZE/8)
-
-#define MAX_SOURCE_SIZE (0x100000)
-
 int main(int argc, char** argv)
 {
-    int err;                            // error code returned from api calls
-    float* input_h   = new float[INPUT_SIZE]();
-    float *results_h = new float[IMG_SIZE*IMG_SIZE]();  // results returned from device
-    cl_mem conv_kernels_d[16];
-    float* conv_kernels_h[16];
-    //                                   0    1   2   3   4   5    6    7    8    9   10   11  12  13  14  15
-    const unsigned int conv_ch[16] = {IMG_CH, 8,  32, 32, 64,  64, 128, 128, 256, 64, 128, 32, 64, 32, 32, 16};
-    const unsigned int  n_conv[16] = {8,      32, 32, 64, 64, 128, 128, 128,  64, 64, 32,  32, 32, 32, 16, 1};
-    // const unsigned int conv_ch[16] = {IMG_CH, 8,  32, 32, 64, 64,  128, 128, 256, 128, 192, 64, 96, 32, 32, 16};
-    // const unsigned int  n_conv[16] = {8,      32, 32, 64, 64, 128, 128, 128, 128, 128, 64,  64, 32, 32, 16, 1};
-    const unsigned int conv_sz[16] = {1, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 1, 1};
+    // number of copies of the slice run through the session, to measure sustained throughput
+    unsigned int n_slices = 1;
+    // slices per batch, 0 lets the session pick from device memory
+    unsigned int max_batch = 0;
+    // size of the input image, a missing dimension is deduced from the input file size
+    unsigned int img_height = 0, img_width = 0, img_ch = 0;
+    // run images through the session in tiles of tile x tile pixels, 0 runs them whole
+    unsigned int tile = 0;
+    // write the per-step device times of the first inference to this JSON file
+    const char *profile_path = NULL;
+    // network description, channels default to its input
+    const char *network_path = "tomogan.net";
+    // a model container (see model.hpp) or the legacy headerless file
+    const char *weights_path = "tomogan_weights_serilize.bin";
+    // stream a raw volume of slices (a file or - for stdin) through the session instead
+    const char *stream_in = NULL, *stream_out = "output_volume.bin";
+    // storage and arithmetic on the device, fp32, fp16 or fp16acc (see tomogan_session.hpp)
+    session_precision precision = PRECISION_FP32;
+    // tensor layout on the device, hwc or nchwc8 (see tomogan_session.hpp)
+    session_layout layout = LAYOUT_HWC;
+    // fp32 output the result is compared with, by default output_img.bin for reduced precision
+    const char *reference_path = NULL;
+    // benchmark the launch configurations first and save them to the tuning database
+    bool tune = false;
+    for(int i = 1; i < argc; i++){
+        if(strcmp(argv[i], "--tune") == 0){
+            tune = true;
+        }
+    }
+    for(int i = 1; i < argc - 1; i++){
+        if(strcmp(argv[i], "--slices") == 0){
+            n_slices = max(1, atoi(argv[i+1]));
+        }
+        if(strcmp(argv[i], "--batch") == 0){
+            max_batch = max(0, atoi(argv[i+1]));
+        }
+        if(strcmp(argv[i], "--height") == 0){
+            img_height = max(1, atoi(argv[i+1]));
+        }
+        if(strcmp(argv[i], "--width") == 0){
+            img_width = max(1, atoi(argv[i+1]));
+        }
+        if(strcmp(argv[i], "--channels") == 0){
+            img_ch = max(1, atoi(argv[i+1]));
+        }
+        if(strcmp(argv[i], "--tile") == 0){
+            tile = max(0, atoi(argv[i+1]));
+        }
+        if(strcmp(argv[i], "--profile") == 0){
+            profile_path = argv[i+1];
+        }
+        if(strcmp(argv[i], "--network") == 0){
+            network_path = argv[i+1];
+        }
+        if(strcmp(argv[i], "--weights") == 0){
+            weights_path = argv[i+1];
+        }
+        if(strcmp(argv[i], "--stream-in") == 0){
+            stream_in = argv[i+1];
+        }
+        if(strcmp(argv[i], "--stream-out") == 0){
+            stream_out = argv[i+1];
+        }
+        if(strcmp(argv[i], "--precision") == 0){
+            precision = parse_precision(argv[i+1]);
+        }
+        if(strcmp(argv[i], "--layout") == 0){
+            layout = parse_layout(argv[i+1]);
+        }
+        if(strcmp(argv[i], "--reference") == 0){
+            reference_path = argv[i+1];
+        }
+    }
 
-    std::ifstream weights_fin("tomogan_weights_serilize.bin", std::ios::binary);
-    unsigned int total_params = 0;
-    for(int i = 0; i < 16; i++){
-        unsigned int n_weights = (conv_sz[i] * conv_sz[i] * conv_ch[i] * n_conv[i]);
-        unsigned int buf_size = sizeof(float) * n_weights;
-        total_params += n_weights;
-        printf("%6d paras for conv2d_%02d kernel in_ch: %3d, no_ch: %3d\n", n_weights, i, conv_ch[i], n_conv[i]);
-        conv_kernels_h[i] = new float[buf_size]();
-        weights_fin.read((char *) conv_kernels_h[i], buf_size);
-        if(weights_fin){
-            continue;
-            // printf("%ld bytes of weights for conv %02d have been successfully read\n", weights_fin.gcount(), i);
-        }else{
-            printf("Error while load weights for conv %02d, EoF reached, only %ld bytes could be read\n", i, weights_fin.gcount());
+    network net = network::load(network_path);
+    net.print();
+    if(img_ch == 0){
+        img_ch = net.channel();
+    }
+    const unsigned int out_ch = net.node(net.output()).channel;
+
+    if(stream_in != NULL){
+        // the number of slices is not known up front, so both dimensions are needed
+        if(img_height == 0 || img_width == 0){
+            printf("Error: --stream-in needs --height and --width\n");
+            exit(-1);
+        }
+        FILE *volume_in = strcmp(stream_in, "-") == 0 ? stdin : fopen(stream_in, "rb");
+        FILE *volume_out = fopen(stream_out, "wb");
+        if(!volume_in || !volume_out){
+            printf("Error: failed to open %s or %s\n", stream_in, stream_out);
             exit(-1);
         }
+        ocl_device_info dev_info = select_device(argc, argv);
+        TomoGANSession session(dev_info, net, weights_path, img_height, img_width, img_ch, max_batch, precision, layout);
+        printf("It takes %.3f ms to set up the session (context, kernels, buffers and weights)\n", session.setup_ms());
+        if(tune){
+            session.autotune();
+        }
+        unsigned int n_streamed = session.infer_stream(volume_in, volume_out);
+        double avg_ms = session.last_infer_ms() / max(1u, n_streamed);
+        printf("%d slices streamed to %s in batches of %d: per-slice %.3f ms, %.2f slices/s, host enqueue %.3f ms in total\n", \
+               n_streamed, stream_out, session.max_batch(), avg_ms, 1000. / avg_ms, session.last_enqueue_ms());
+        if(volume_in != stdin){
+            fclose(volume_in);
+        }
+        fclose(volume_out);
+        return 0;
+    }
+
+    std::ifstream inputs_fin("test_input_serilize.bin", std::ios::binary | std::ios::ate);
+    if(!inputs_fin){
+        printf("Error: failed to open test_input_serilize.bin\n");
+        exit(-1);
     }
-    weights_fin.close();
+    size_t file_pixels = (size_t)inputs_fin.tellg() / sizeof(float) / img_ch;
+    inputs_fin.seekg(0);
+    if(img_height == 0 && img_width == 0){
+        img_height = img_width = (unsigned int)sqrt((double)file_pixels);
+    }else if(img_height == 0){
+        img_height = file_pixels / img_width;
+    }else if(img_width == 0){
+        img_width = file_pixels / img_height;
+    }
+    if(img_height == 0 || img_width == 0){
+        printf("Error: test_input_serilize.bin is too small for a %d channel image\n", img_ch);
+        exit(-1);
+    }
+    const size_t img_pixels = (size_t)img_height * img_width;
+    const bool tiled = (tile > 0 && (img_height > tile || img_width > tile));
+    if(tiled && n_slices > 1){
+        printf("Error: --slices runs whole slices, it cannot be combined with --tile for a %dx%d image\n", img_height, img_width);
+        exit(-1);
+    }
+    printf("Input image is %dx%dx%d\n", img_height, img_width, img_ch);
 
-    // printf("Total params: %d, the last one: ", total_params);
-    // for(int i = 0; i < 16; i++){
-    //     printf("%.3f ", conv_kernels_h[15][i]);
-    // }
-    // printf("\n");
+    float* input_h   = new float[img_pixels * img_ch]();
+    float *results_h = new float[img_pixels * out_ch]();  // results returned from device
 
-    std::ifstream inputs_fin("test_input_serilize.bin", std::ios::binary);
-    inputs_fin.read((char *) input_h, sizeof(float) * INPUT_SIZE);
+    inputs_fin.read((char *) input_h, sizeof(float) * img_pixels * img_ch);
     if(inputs_fin){
         printf("%ld bytes of input data have been successfully read\n", inputs_fin.gcount());
     }else{
@@ -79,339 +159,72 @@ int main(int argc, char** argv)
     }
     inputs_fin.close();
 
-    // printf("The first 16 pixels in the input: ");
-    // for(int i = 0; i < 16; i++){
-    //     printf("%.0f ", input_h[i]);
-    // }
-    // printf("\n");
+    // Pick a device, see device.hpp for the selection policy and overrides
+    ocl_device_info dev_info = select_device(argc, argv);
 
-    // Set up platform 
-    cl_platform_id platform_ids[2];
-    cl_uint num_platforms = 0;
-    err = clGetPlatformIDs(2, platform_ids, &num_platforms);
-    if (err != CL_SUCCESS){ 
-        printf("Failed to query platforms. Error:%i\n", err);
-    }else{
-        printf("There are %d platform(s).\n", num_platforms);
-    }
-    if(num_platforms == 0){
-        printf("Exit because there is no platform support OpenCL\n");
-        return EXIT_FAILURE;
+    // the session is sized to one tile when tiling, to the whole image otherwise
+    TomoGANSession session(dev_info, net, weights_path, tiled ? tile_side(net, tile, img_height) : img_height, \
+                           tiled ? tile_side(net, tile, img_width) : img_width, img_ch, max_batch, precision, layout);
+    printf("It takes %.3f ms to set up the session (context, kernels, buffers and weights)\n", session.setup_ms());
+    if(tune){
+        session.autotune();
     }
 
-    unsigned int platform_idx = 0;
-    char *profile = NULL;
-    size_t size;
-    clGetPlatformInfo(platform_ids[platform_idx], CL_PLATFORM_VERSION, 0, profile, &size); // get size of profile char array
-    profile = new char[size]();
-    clGetPlatformInfo(platform_ids[platform_idx], CL_PLATFORM_VERSION,size, profile, NULL); // get profile char array
-    cout << profile << " is used to support computing." << endl;
-    delete[] profile;
-
-    unsigned int num_devices = 0;
-    cl_device_id device_ids[2];
-    err = clGetDeviceIDs(platform_ids[platform_idx], CL_DEVICE_TYPE_GPU, 2, device_ids, &num_devices);
-    if (err != CL_SUCCESS){
-        printf("Error: Failed to create a device group: %d\n", err);
-        return EXIT_FAILURE;
+    session.profiler().set_enabled(profile_path != NULL);
+    if(tiled){
+        session.infer_tiled(input_h, img_height, img_width, results_h);
     }else{
-        printf("There is(are) %d GPU device(s) support OCL.\n", num_devices);
-    }
-    if(num_devices == 0){
-        printf("Exit because there is no device support OpenCL\n");
-        return EXIT_FAILURE;
-    }
-
-    unsigned int dev_idx = 0;
-
-    cl_ulong local_mem_size;
-    clGetDeviceInfo(device_ids[dev_idx], CL_DEVICE_LOCAL_MEM_SIZE, sizeof(cl_ulong), &local_mem_size, 0);
-    char *vendor = NULL;
-    clGetDeviceInfo(device_ids[dev_idx], CL_DEVICE_VENDOR, 0, NULL, &size);
-    vendor = new char[size]();
-    clGetDeviceInfo(device_ids[dev_idx], CL_DEVICE_VENDOR, size, vendor, NULL);
-    printf("Device produced by %s with %lldKB local mem will be used.\n", vendor, local_mem_size/1024);
-    delete[] vendor;
-
-    // Create a compute context 
-    cl_context context = clCreateContext(0, 1, &(device_ids[dev_idx]), NULL, NULL, &err);
-    if (!context){
-        printf("Error: Failed to create a compute context! %d\n", err);
-        return EXIT_FAILURE;
-    }
-
-    // Create a command commands
-    #ifdef __APPLE__
-        cl_command_queue commands = clCreateCommandQueue(context, device_ids[dev_idx], 0, &err);
-    #else
-        cl_command_queue commands = clCreateCommandQueueWithProperties(context, device_ids[dev_idx], 0, &err);
-    #endif
-    if (!commands){
-        printf("Error: Failed to create a command commands! %d\n", err);
-        return EXIT_FAILURE;
-    }
-
-    auto compile_st = chrono::steady_clock::now();
-    // Load the kernel source code into the array source_str
-    FILE *fp;
-    char *source_str;
-    size_t source_size;
- 
-    fp = fopen("conv2d.cl", "r");
-    if (!fp){
-        fprintf(stderr, "Failed to load kernel.\n");
-        exit(1);
-    }
-    source_str = new char[MAX_SOURCE_SIZE]();
-    source_size = fread( source_str, 1, MAX_SOURCE_SIZE, fp);
-    fclose( fp );
-    
-    // Create the compute program from the source buffer
-    cl_program program = clCreateProgramWithSource(context, 1, (const char **) &source_str, NULL, &err);
-    if (!program){
-        printf("Error: Failed to create compute program! %d\n", err);
-        return EXIT_FAILURE;
-    }
-    delete[] source_str;
-
-    // Build the program executable
-    err = clBuildProgram(program, 0, NULL, NULL, NULL, NULL);
-    if (err != CL_SUCCESS){
-        size_t len;
-        char buffer[2048];
-        printf("Error: Failed to build program executable!: %d\n", err);
-        clGetProgramBuildInfo(program, device_ids[dev_idx], CL_PROGRAM_BUILD_LOG, sizeof(buffer), buffer, &len);
-        printf("build error: %s\n", buffer);
-        exit(1);
-    }
-
-    // Create the compute kernel in the program we wish to run
-    cl_kernel kernel_conv2d_v16 = clCreateKernel(program, "conv2d_vec16_mk", &err);
-    if (!kernel_conv2d_v16 || err != CL_SUCCESS){
-        printf("Error: Failed to create conv2d-v16 kernel! %d\n", err);
-        exit(1);
-    }
-    cl_kernel kernel_conv2d_v8 = clCreateKernel(program, "conv2d_vec8_mk", &err);
-    if (!kernel_conv2d_v8 || err != CL_SUCCESS){
-        printf("Error: Failed to create conv2d-v8 kernel! %d\n", err);
-        exit(1);
-    }
-    cl_kernel kernel_conv2d = clCreateKernel(program, "conv2d_mk", &err);
-    if (!kernel_conv2d || err != CL_SUCCESS){
-        printf("Error: Failed to create conv2d-v8 kernel! %d\n", err);
-        exit(1);
-    }
-    cl_kernel kernel_pool = clCreateKernel(program, "maxpooling2d", &err);
-    if (!kernel_pool || err != CL_SUCCESS){
-        printf("Error: Failed to create maxpooling2d kernel! %d\n", err);
-        exit(1);
-    }
-    cl_kernel kernel_concat = clCreateKernel(program, "concatenate", &err);
-    if (!kernel_concat || err != CL_SUCCESS){
-        printf("Error: Failed to create concat kernel! %d\n", err);
-        exit(1);
-    }
-    cl_kernel kernel_upsample = clCreateKernel(program, "upsample2d", &err);
-    if (!kernel_upsample || err != CL_SUCCESS){
-        printf("Error: Failed to create upsample2d kernel! %d\n", err);
-        exit(1);
-    }
-
-    auto compile_ed = chrono::steady_clock::now();
-    printf("It takes %.3f ms to compile OCL kernel\n", \
-           chrono::duration_cast<chrono::microseconds>(compile_ed - compile_st).count()/1000.);
-
-    // Create the input and output arrays in device memory for our calculation
-    cl_mem input_d    = clCreateBuffer(context, CL_MEM_READ_ONLY,   sizeof(float) * INPUT_SIZE, NULL, NULL); // 12 MB
-    cl_mem layer_buf1 = clCreateBuffer(context, CL_MEM_READ_WRITE,  sizeof(float) * IMG_SIZE * IMG_SIZE * 32,     NULL, NULL); // 128 MB
-    cl_mem layer_buf2 = clCreateBuffer(context, CL_MEM_READ_WRITE,  sizeof(float) * IMG_SIZE * IMG_SIZE * 64,     NULL, NULL); // 256 MB
-    cl_mem box1_out   = clCreateBuffer(context, CL_MEM_READ_WRITE,  sizeof(float) * BOX1_IMG_SIZE * BOX1_IMG_SIZE * 32,  NULL, NULL); // 128 MB
-    cl_mem box2_out   = clCreateBuffer(context, CL_MEM_READ_WRITE,  sizeof(float) * BOX2_IMG_SIZE * BOX2_IMG_SIZE * 64,  NULL, NULL); // 64 MB
-    cl_mem box3_out   = clCreateBuffer(context, CL_MEM_READ_WRITE,  sizeof(float) * BOX3_IMG_SIZE * BOX3_IMG_SIZE * 128, NULL, NULL); // 32 MB
-    cl_mem output_d   = clCreateBuffer(context, CL_MEM_WRITE_ONLY,  sizeof(float) * OUTPUT_SIZE, NULL, NULL);
-
-    if (!input_d || !layer_buf1 || !layer_buf2 || !box1_out || !box2_out || !box3_out || !output_d){
-        printf("Error: Failed to allocate device memory!\n");
-        exit(1);
-    }    
-
-    // transfer input data to device 
-    err = clEnqueueWriteBuffer(commands, input_d, CL_TRUE, 0, sizeof(float) * INPUT_SIZE, input_h, 0, NULL, NULL);  
-    oclErrchk(err);
-
-    // allocate device memory for model weights and copy weights to device
-    auto weights_cp_st = chrono::steady_clock::now();
-    for(int i = 0; i < 16; i++){
-        unsigned int buf_size = sizeof(float) * (conv_sz[i] * conv_sz[i] * conv_ch[i] * n_conv[i]);
-        conv_kernels_d[i] = clCreateBuffer(context, CL_MEM_READ_ONLY, buf_size, NULL, NULL);
-        if(!conv_kernels_d[i]){
-            printf("Error: Failed to allocate device memory for kernel of layer %d!\n", i);
-            exit(1);
+        session.infer(input_h, results_h);
+    }
+    printf("It takes %.3f ms to compute the first slice on device!\n", session.last_infer_ms());
+    printf("Host enqueue overhead: %.3f ms for %d launches\n", session.last_enqueue_ms(), session.n_launches());
+    if(profile_path != NULL){
+        session.profiler().print_report();
+        session.profiler().write_json(profile_path);
+        session.profiler().set_enabled(false);
+    }
+
+    if(n_slices > 1){
+        // the first slice pays for lazy allocations of the runtime, keep it out of the average
+        float *stack_in_h  = new float[img_pixels * img_ch * n_slices];
+        float *stack_out_h = new float[img_pixels * out_ch * n_slices];
+        for(unsigned int i = 0; i < n_slices; i++){
+            memcpy(stack_in_h + img_pixels * img_ch * i, input_h, sizeof(float) * img_pixels * img_ch);
+        }
+        session.infer_batch(stack_in_h, stack_out_h, n_slices);
+        double avg_ms = session.last_infer_ms() / n_slices;
+        printf("%d slices in batches of %d: per-slice %.3f ms, %.2f slices/s, host enqueue %.3f ms in total\n", \
+               n_slices, session.max_batch(), avg_ms, 1000. / avg_ms, session.last_enqueue_ms());
+        delete[] stack_in_h;
+        delete[] stack_out_h;
+    }
+
+    // a reduced precision run keeps the fp32 output_img.bin as its reference
+    if(reference_path == NULL && session.precision() != PRECISION_FP32){
+        reference_path = "output_img.bin";
+    }
+    if(reference_path != NULL){
+        std::ifstream ref_fin(reference_path, std::ios::binary);
+        float *ref_h = new float[img_pixels * out_ch];
+        ref_fin.read((char *) ref_h, sizeof(float) * img_pixels * out_ch);
+        if(ref_fin){
+            print_quality(precision_name(session.precision()), reference_path, \
+                          compare_images(results_h, ref_h, img_height, img_width, out_ch));
+        }else{
+            printf("No %dx%dx%d reference in %s, run with --precision fp32 first\n", img_height, img_width, out_ch, reference_path);
         }
-        err = clEnqueueWriteBuffer(commands, conv_kernels_d[i], CL_TRUE, 0, buf_size, conv_kernels_h[i], 0, NULL, NULL);  
-        oclErrchk(err);
+        delete[] ref_h;
     }
-    auto weights_cp_ed = chrono::steady_clock::now();
-    printf("It takes %.3f ms to transfer weights from host to device!\n", \
-           chrono::duration_cast<chrono::microseconds>(weights_cp_ed - weights_cp_st).count()/1000.);
-
-    // start computing
-    auto comp_st = chrono::steady_clock::now();
-    size_t local[2] = {16, 16};
-    size_t global[2] = {IMG_SIZE, IMG_SIZE};
-    // conv layer 0
-    conv2d_set_arg(&kernel_conv2d, &input_d, BOX1_IMG_SIZE, BOX1_IMG_SIZE, conv_ch[0], &conv_kernels_d[0], conv_sz[0], n_conv[0], &layer_buf1, 1);
-    err = clEnqueueNDRangeKernel(commands, kernel_conv2d, 2, NULL, global, local, 0, NULL, NULL);
-    oclErrchk(err);
-
-    // conv layer 1
-    conv2d_set_arg(&kernel_conv2d_v8, &layer_buf1, BOX1_IMG_SIZE, BOX1_IMG_SIZE, conv_ch[1], &conv_kernels_d[1], conv_sz[1], n_conv[1], &layer_buf2, 1);
-    err = clEnqueueNDRangeKernel(commands, kernel_conv2d_v8, 2, NULL, global, local, 0, NULL, NULL);
-    oclErrchk(err);
-
-    // conv layer 2
-    conv2d_set_arg(&kernel_conv2d_v16, &layer_buf2, BOX1_IMG_SIZE, BOX1_IMG_SIZE, conv_ch[2], &conv_kernels_d[2], conv_sz[2], n_conv[2], &box1_out, 1);
-    err = clEnqueueNDRangeKernel(commands, kernel_conv2d_v16, 2, NULL, global, local, 0, NULL, NULL);
-    oclErrchk(err);
-
-    // max pooling
-    maxpool_set_arg(&kernel_pool, &box1_out, BOX1_IMG_SIZE, BOX1_IMG_SIZE, n_conv[2], &layer_buf1);
-    err = clEnqueueNDRangeKernel(commands, kernel_pool, 2, NULL, global, local, 0, NULL, NULL);
-    oclErrchk(err);
-
-    // conv layer 3
-    conv2d_set_arg(&kernel_conv2d_v16, &layer_buf1, BOX2_IMG_SIZE, BOX2_IMG_SIZE, conv_ch[3], &conv_kernels_d[3], conv_sz[3], n_conv[3], &layer_buf2, 1);
-    err = clEnqueueNDRangeKernel(commands, kernel_conv2d_v16, 2, NULL, global, local, 0, NULL, NULL);
-    oclErrchk(err);
-
-    // conv layer 4
-    conv2d_set_arg(&kernel_conv2d_v16, &layer_buf2, BOX2_IMG_SIZE, BOX2_IMG_SIZE, conv_ch[4], &conv_kernels_d[4], conv_sz[4], n_conv[4], &box2_out, 1);
-    err = clEnqueueNDRangeKernel(commands, kernel_conv2d_v16, 2, NULL, global, local, 0, NULL, NULL);
-    oclErrchk(err);
-
-    // max pooling 1
-    maxpool_set_arg(&kernel_pool, &box2_out, BOX2_IMG_SIZE, BOX2_IMG_SIZE, n_conv[4], &layer_buf1);
-    err = clEnqueueNDRangeKernel(commands, kernel_pool, 2, NULL, global, local, 0, NULL, NULL);
-    oclErrchk(err);
-
-    // conv layer 5
-    conv2d_set_arg(&kernel_conv2d_v16, &layer_buf1, BOX3_IMG_SIZE, BOX3_IMG_SIZE, conv_ch[5], &conv_kernels_d[5], conv_sz[5], n_conv[5], &layer_buf2, 1);
-    err = clEnqueueNDRangeKernel(commands, kernel_conv2d_v16, 2, NULL, global, local, 0, NULL, NULL);
-    oclErrchk(err);
 
-    // conv layer 6
-    conv2d_set_arg(&kernel_conv2d_v16, &layer_buf2, BOX3_IMG_SIZE, BOX3_IMG_SIZE, conv_ch[6], &conv_kernels_d[6], conv_sz[6], n_conv[6], &box3_out, 1);
-    err = clEnqueueNDRangeKernel(commands, kernel_conv2d_v16, 2, NULL, global, local, 0, NULL, NULL);
-    oclErrchk(err);
-
-    // max pooling 2
-    maxpool_set_arg(&kernel_pool, &box3_out, BOX3_IMG_SIZE, BOX3_IMG_SIZE, n_conv[6], &layer_buf1);
-    err = clEnqueueNDRangeKernel(commands, kernel_pool, 2, NULL, global, local, 0, NULL, NULL);
-    oclErrchk(err);
-
-    // conv layer 7
-    conv2d_set_arg(&kernel_conv2d_v16, &layer_buf1, INTR_IMG_SIZE, INTR_IMG_SIZE, conv_ch[7], &conv_kernels_d[7], conv_sz[7], n_conv[7], &layer_buf2, 1);
-    err = clEnqueueNDRangeKernel(commands, kernel_conv2d_v16, 2, NULL, global, local, 0, NULL, NULL);
-    oclErrchk(err);
-
-    // upsample 0
-    maxpool_set_arg(&kernel_upsample, &layer_buf2, INTR_IMG_SIZE, INTR_IMG_SIZE, n_conv[7], &layer_buf1);
-    err = clEnqueueNDRangeKernel(commands, kernel_upsample, 2, NULL, global, local, 0, NULL, NULL);
-    oclErrchk(err);
-
-    // concat 0
-    concat_set_arg(&kernel_concat, &box3_out, &layer_buf1, BOX3_IMG_SIZE, BOX3_IMG_SIZE, n_conv[6], n_conv[7], &layer_buf2);
-    err = clEnqueueNDRangeKernel(commands, kernel_concat, 2, NULL, global, local, 0, NULL, NULL);
-    oclErrchk(err);
-
-    // conv layer 8
-    conv2d_set_arg(&kernel_conv2d_v16, &layer_buf2, BOX3_IMG_SIZE, BOX3_IMG_SIZE, conv_ch[8], &conv_kernels_d[8], conv_sz[8], n_conv[8], &layer_buf1, 1);
-    err = clEnqueueNDRangeKernel(commands, kernel_conv2d_v16, 2, NULL, global, local, 0, NULL, NULL);
-    oclErrchk(err);
-
-    // conv layer 9
-    conv2d_set_arg(&kernel_conv2d_v16, &layer_buf1, BOX3_IMG_SIZE, BOX3_IMG_SIZE, conv_ch[9], &conv_kernels_d[9], conv_sz[9], n_conv[9], &layer_buf2, 1);
-    err = clEnqueueNDRangeKernel(commands, kernel_conv2d_v16, 2, NULL, global, local, 0, NULL, NULL);
-    oclErrchk(err);
-
-    // upsample 1
-    maxpool_set_arg(&kernel_upsample, &layer_buf2, BOX3_IMG_SIZE, BOX3_IMG_SIZE, n_conv[9], &layer_buf1);
-    err = clEnqueueNDRangeKernel(commands, kernel_upsample, 2, NULL, global, local, 0, NULL, NULL);
-    oclErrchk(err);
-
-    // concat 1
-    concat_set_arg(&kernel_concat, &box2_out, &layer_buf1, BOX2_IMG_SIZE, BOX2_IMG_SIZE, n_conv[4], n_conv[9], &layer_buf2);
-    err = clEnqueueNDRangeKernel(commands, kernel_concat, 2, NULL, global, local, 0, NULL, NULL);
-    oclErrchk(err);
-
-    // conv layer 10
-    conv2d_set_arg(&kernel_conv2d_v16, &layer_buf2, BOX2_IMG_SIZE, BOX2_IMG_SIZE, conv_ch[10], &conv_kernels_d[10], conv_sz[10], n_conv[10], &layer_buf1, 1);
-    err = clEnqueueNDRangeKernel(commands, kernel_conv2d_v16, 2, NULL, global, local, 0, NULL, NULL);
-    oclErrchk(err);
-
-    // conv layer 11
-    conv2d_set_arg(&kernel_conv2d_v16, &layer_buf1, BOX2_IMG_SIZE, BOX2_IMG_SIZE, conv_ch[11], &conv_kernels_d[11], conv_sz[11], n_conv[11], &layer_buf2, 1);
-    err = clEnqueueNDRangeKernel(commands, kernel_conv2d_v16, 2, NULL, global, local, 0, NULL, NULL);
-    oclErrchk(err);
-
-   // upsample 2
-    maxpool_set_arg(&kernel_upsample, &layer_buf2, BOX2_IMG_SIZE, BOX2_IMG_SIZE, n_conv[11], &layer_buf1);
-    err = clEnqueueNDRangeKernel(commands, kernel_upsample, 2, NULL, global, local, 0, NULL, NULL);
-    oclErrchk(err);
-
-    // concat 2
-    concat_set_arg(&kernel_concat, &box1_out, &layer_buf1, BOX1_IMG_SIZE, BOX1_IMG_SIZE, n_conv[2], n_conv[11], &layer_buf2);
-    err = clEnqueueNDRangeKernel(commands, kernel_concat, 2, NULL, global, local, 0, NULL, NULL);
-    oclErrchk(err);
-
-    // conv layer 12
-    conv2d_set_arg(&kernel_conv2d_v16, &layer_buf2, BOX1_IMG_SIZE, BOX1_IMG_SIZE, conv_ch[12], &conv_kernels_d[12], conv_sz[12], n_conv[12], &layer_buf1, 1);
-    err = clEnqueueNDRangeKernel(commands, kernel_conv2d_v16, 2, NULL, global, local, 0, NULL, NULL);
-    oclErrchk(err);
-
-    // conv layer 13
-    conv2d_set_arg(&kernel_conv2d_v16, &layer_buf1, BOX1_IMG_SIZE, BOX1_IMG_SIZE, conv_ch[13], &conv_kernels_d[13], conv_sz[13], n_conv[13], &layer_buf2, 1);
-    err = clEnqueueNDRangeKernel(commands, kernel_conv2d_v16, 2, NULL, global, local, 0, NULL, NULL);
-    oclErrchk(err);
-
-    // conv layer 14
-    conv2d_set_arg(&kernel_conv2d_v16, &layer_buf2, BOX1_IMG_SIZE, BOX1_IMG_SIZE, conv_ch[14], &conv_kernels_d[14], conv_sz[14], n_conv[14], &layer_buf1, 1);
-    err = clEnqueueNDRangeKernel(commands, kernel_conv2d_v16, 2, NULL, global, local, 0, NULL, NULL);
-    oclErrchk(err);
-
-    // conv layer 15
-    conv2d_set_arg(&kernel_conv2d_v16, &layer_buf1, BOX1_IMG_SIZE, BOX1_IMG_SIZE, conv_ch[15], &conv_kernels_d[15], conv_sz[15], n_conv[15], &output_d, 0);
-    err = clEnqueueNDRangeKernel(commands, kernel_conv2d_v16, 2, NULL, global, local, 0, NULL, NULL);
-    oclErrchk(err);
-    clFinish(commands);
-
-    auto comp_ed = chrono::steady_clock::now();
-    printf("It takes %.3f ms to compute on device!\n", \
-           chrono::duration_cast<chrono::microseconds>(comp_ed - comp_st).count()/1000.);
-
-    // Read back the results from the device 
-    err = clEnqueueReadBuffer(commands, output_d, CL_TRUE, 0, sizeof(float) * OUTPUT_SIZE, results_h, 0, NULL, NULL );  
-    oclErrchk(err);
-
-    // dump output array to a file
-    std::ofstream img_fout("output_img.bin", std::ios::out | std::ios::binary);
-    img_fout.write((char *) results_h, sizeof(float) * OUTPUT_SIZE);
-    img_fout.close();
-
-    for(int i = 0; i < 16; i++){
-        clReleaseMemObject(conv_kernels_d[i]);
-        delete[] conv_kernels_h[i];
+    // dump output array to a file, output_img_<precision>.bin for reduced precision
+    std::string output_path = "output_img.bin";
+    if(session.precision() != PRECISION_FP32){
+        output_path = std::string("output_img_") + precision_name(session.precision()) + ".bin";
     }
-    // clReleaseMemObject(input_d);
-    clReleaseMemObject(layer_buf1);
-    clReleaseMemObject(layer_buf2);
-    // clReleaseMemObject(box1_out);
-    // clReleaseMemObject(box2_out);
-    // clReleaseMemObject(box3_out);
-
-    clReleaseProgram(program);
-    clReleaseCommandQueue(commands);
-    clReleaseContext(context);
+    std::ofstream img_fout(output_path, std::ios::out | std::ios::binary);
+    img_fout.write((char *) results_h, sizeof(float) * img_pixels * out_ch);
+    img_fout.close();
 
     delete[] results_h;
-}
\ No newline at end of file
+    delete[] input_h;
+}
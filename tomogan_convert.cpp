@@ -0,0 +1,61 @@
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "network.hpp"
+#include "model.hpp"
+
+using namespace std;
+
+// Convert a legacy headerless weights file to a model container, with the tensor names and
+// shapes of the convs of a network file, e.g.
+//   ./tomogan_convert tomogan_weights_serilize.bin tomogan.model [--network tomogan.net]
+// A container given as input is checked against the network and listed.
+int main(int argc, char** argv)
+{
+    const char *network_path = "tomogan.net";
+    vector<const char *> paths;
+    for(int i = 1; i < argc; i++){
+        if(strcmp(argv[i], "--network") == 0 && i + 1 < argc){
+            network_path = argv[++i];
+        }else{
+            paths.push_back(argv[i]);
+        }
+    }
+    if(paths.empty()){
+        printf("Usage: %s <weights> [<output model>] [--network <file>]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    network net = network::load(network_path);
+    model_file weights(paths[0]);
+    vector<model_tensor> tensors;
+    vector<const void *> data;
+    for(unsigned int i = 0; i < net.n_convs(); i++){
+        const net_node &conv = net.node(net.conv_node(i));
+        model_tensor t;
+        memset(&t, 0, sizeof(t));
+        if(conv.name.size() >= sizeof(t.name)){
+            printf("Error: conv name %s is longer than %ld characters\n", conv.name.c_str(), sizeof(t.name) - 1);
+            return EXIT_FAILURE;
+        }
+        strcpy(t.name, conv.name.c_str());
+        t.dtype  = MODEL_F32;
+        t.layout = MODEL_KRSC;
+        t.shape[0] = conv.channel;
+        t.shape[1] = t.shape[2] = conv.filter_size;
+        t.shape[3] = conv.in_channel;
+        t.bytes = sizeof(float) * conv.channel * conv.filter_size * conv.filter_size * conv.in_channel;
+        tensors.push_back(t);
+        data.push_back(weights.conv_weights(t.name, conv.channel, conv.filter_size, conv.in_channel));
+    }
+    weights.finish();
+
+    if(paths.size() < 2){
+        weights.print();
+        return 0;
+    }
+    write_model(paths[1], tensors, data);
+    model_file written(paths[1]);
+    written.print();
+}
@@ -0,0 +1,338 @@
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <math.h>
+#include <chrono>
+
+#include "utils.hpp"
+#include "conv_gemm.hpp"
+#include "winograd.hpp"
+#include "simd_ops.hpp"
+#include "model.hpp"
+#include "quantize.hpp"
+#include "fp16.hpp"
+#include "quality.hpp"
+
+using namespace std;
+
+// Use a static data size for simplicity
+#define IMG_SIZE    (1024)
+#define IMG_WIDTH   IMG_SIZE
+#define IMG_HEIGHT  IMG_SIZE
+#define IMG_CH      (3)
+#define INPUT_SIZE  (IMG_SIZE * IMG_SIZE * IMG_CH)
+#define OUTPUT_SIZE (IMG_SIZE * IMG_SIZE)
+#define BOX1_IMG_SIZE (IMG_SIZE)
+#define BOX2_IMG_SIZE (IMG_SIZE/2)
+#define BOX3_IMG_SIZE (IMG_SIZE/4)
+#define INTR_IMG_SIZE (IMG_SIZE/8)
+
+// achievable memory bandwidth of this node in GB/s, estimated with a multi-threaded copy
+double measure_copy_bandwidth(){
+    const size_t n_elem = 64 * 1024 * 1024; // 256 MB per buffer
+    float *src = new float[n_elem]();
+    float *dst = new float[n_elem]();
+    double best = 0;
+    for(int rep = 0; rep < 3; rep++){
+        auto st = chrono::steady_clock::now();
+        parallel_rows(1024, [&](unsigned int row_st, unsigned int row_ed){
+            size_t chunk = n_elem / 1024;
+            memcpy(dst + chunk * row_st, src + chunk * row_st, sizeof(float) * chunk * (row_ed - row_st));
+        });
+        auto ed = chrono::steady_clock::now();
+        double sec = chrono::duration_cast<chrono::microseconds>(ed - st).count() / 1e6;
+        best = max(best, 2. * sizeof(float) * n_elem / sec / 1e9); // read + write
+    }
+    delete[] src;
+    delete[] dst;
+    return best;
+}
+
+// runs and times one op: name, bytes moved, flops; the bytes are added to total_bytes
+cpu_step_fn timed_step(double peak_bw, double &total_bytes){
+    return [peak_bw, &total_bytes](const char *name, double bytes, double flops, const std::function<void()> &step){
+        auto st = chrono::steady_clock::now();
+        step();
+        auto ed = chrono::steady_clock::now();
+        double ms = chrono::duration_cast<chrono::microseconds>(ed - st).count() / 1000.;
+        printf("%-12s %9.3f ms %8.2f GFLOP/s %8.2f GB/s (%5.1f%% of copy bw)\n", \
+               name, ms, flops / ms / 1e6, bytes / ms / 1e6, 100. * bytes / ms / 1e6 / peak_bw);
+        total_bytes += bytes;
+    };
+}
+
+// dump the output to output_img_cpu.bin and compare it with the output of the OpenCL version
+// if it is there
+void save_and_compare(const float *results_h, const char *label){
+    std::ofstream img_fout("output_img_cpu.bin", std::ios::out | std::ios::binary);
+    img_fout.write((const char *) results_h, sizeof(float) * OUTPUT_SIZE);
+    img_fout.close();
+
+    std::ifstream ref_fin("output_img.bin", std::ios::binary);
+    if(ref_fin){
+        float *ref_h = new float[OUTPUT_SIZE]();
+        ref_fin.read((char *) ref_h, sizeof(float) * OUTPUT_SIZE);
+        unsigned int n_diff = 0;
+        float max_diff = 0;
+        for(size_t i = 0; i < OUTPUT_SIZE; i++){
+            if(ref_h[i] != results_h[i]){
+                n_diff++;
+                max_diff = max(max_diff, fabsf(ref_h[i] - results_h[i]));
+            }
+        }
+        printf("Compared with output_img.bin: %d pixels differ, max abs diff %g\n", n_diff, max_diff);
+        print_quality(label, "output_img.bin", compare_images(results_h, ref_h, IMG_HEIGHT, IMG_WIDTH, 1));
+        delete[] ref_h;
+    }
+}
+
+// the generator of network_path with the quantized model of tomogan_quantize (quantize.hpp),
+// uint8 activations and int8 weights; no fp32 weights or layer buffers are needed
+int run_int8(const char *model_path, const char *network_path, const float *input_h, double peak_bw){
+    network net = network::load(network_path);
+    model_file model(model_path);
+    int8_network int8_net(net, model);
+    printf("INT8 (%s) with the quantized model %s\n", INT8_ISA, model_path);
+    if(net.channel() != IMG_CH || net.node(net.output()).channel != 1){
+        printf("Error: %s is not a %d channel to 1 channel network\n", network_path, IMG_CH);
+        return EXIT_FAILURE;
+    }
+    float *results_h = new float[OUTPUT_SIZE]();
+    double total_bytes = 0;
+    auto comp_st = chrono::steady_clock::now();
+    int8_net.run(input_h, IMG_HEIGHT, IMG_WIDTH, results_h, timed_step(peak_bw, total_bytes));
+    auto comp_ed = chrono::steady_clock::now();
+    double comp_ms = chrono::duration_cast<chrono::microseconds>(comp_ed - comp_st).count()/1000.;
+    printf("It takes %.3f ms to compute on CPU, %.2f GB/s overall (%.1f%% of copy bw)\n", \
+           comp_ms, total_bytes / comp_ms / 1e6, 100. * total_bytes / comp_ms / 1e6 / peak_bw);
+    save_and_compare(results_h, "int8");
+    delete[] results_h;
+    return 0;
+}
+
+// usage: ./tomogan_cpu [threads] [--gemm auto|all|none|<layer>,<layer>,...]
+//                      [--winograd all|none|<layer>,...] [--winograd-m 2|4] [--weights <file>] [--fp16]
+//                      [--int8 <quantized model> [--network <file>]]
+int main(int argc, char** argv)
+{
+    if(argc > 1 && argv[1][0] != '-'){
+        cpu_num_threads(atoi(argv[1]));
+    }
+    const char *gemm_layers = "auto";
+    const char *winograd_layers = "none";
+    unsigned int winograd_m = 2;
+    // a model container (see model.hpp) or the legacy headerless file
+    const char *weights_path = "tomogan_weights_serilize.bin";
+    // a model written by tomogan_quantize, run with the network file instead of the tables below
+    const char *int8_path = NULL;
+    const char *network_path = "tomogan.net";
+    // round weights, the input and every layer output to half, as the fp16 mode of the
+    // OpenCL session stores them; the layers still compute in float
+    bool fp16 = false;
+    for(int i = 1; i < argc; i++){
+        if(strcmp(argv[i], "--fp16") == 0){
+            fp16 = true;
+        }
+    }
+    for(int i = 1; i < argc - 1; i++){
+        if(strcmp(argv[i], "--gemm") == 0){
+            gemm_layers = argv[i+1];
+        }
+        if(strcmp(argv[i], "--winograd") == 0){
+            winograd_layers = argv[i+1];
+        }
+        if(strcmp(argv[i], "--winograd-m") == 0){
+            winograd_m = atoi(argv[i+1]) == 4 ? 4 : 2;
+        }
+        if(strcmp(argv[i], "--weights") == 0){
+            weights_path = argv[i+1];
+        }
+        if(strcmp(argv[i], "--int8") == 0){
+            int8_path = argv[i+1];
+        }
+        if(strcmp(argv[i], "--network") == 0){
+            network_path = argv[i+1];
+        }
+    }
+    float* input_h   = new float[INPUT_SIZE]();
+    std::ifstream inputs_fin("test_input_serilize.bin", std::ios::binary);
+    inputs_fin.read((char *) input_h, sizeof(float) * INPUT_SIZE);
+    if(inputs_fin){
+        printf("%ld bytes of input data have been successfully read\n", inputs_fin.gcount());
+    }else{
+        printf("Error while load input, EoF reached, only %ld bytes could be read\n", inputs_fin.gcount());
+        exit(-1);
+    }
+    inputs_fin.close();
+
+    printf("%d threads will be used, measuring memory bandwidth ...\n", cpu_num_threads());
+    double peak_bw = measure_copy_bandwidth();
+    printf("Copy bandwidth: %.2f GB/s\n", peak_bw);
+
+    if(int8_path){
+        int ret = run_int8(int8_path, network_path, input_h, peak_bw);
+        delete[] input_h;
+        return ret;
+    }
+
+    float *results_h = new float[OUTPUT_SIZE]();
+    const float* conv_kernels_h[16];
+    //                                   0    1   2   3   4   5    6    7    8    9   10   11  12  13  14  15
+    const unsigned int conv_ch[16] = {IMG_CH, 8,  32, 32, 64,  64, 128, 128, 256, 64, 128, 32, 64, 32, 32, 16};
+    const unsigned int  n_conv[16] = {8,      32, 32, 64, 64, 128, 128, 128,  64, 64, 32,  32, 32, 32, 16, 1};
+    const unsigned int conv_sz[16] = {1, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 1, 1};
+    // partial sums per pixel, same as the OpenCL kernel used for each layer in tomogan.cpp
+    const unsigned int conv_lanes[16] = {1, 8, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16};
+    // layers computed as im2col + GEMM (conv_gemm.hpp) instead of the direct loops; by default
+    // every layer with at least 8 filters when a SIMD micro-kernel was compiled in, see
+    // test/conv2d_gemm_test.cpp for the per-layer comparison
+    bool conv_gemm[16];
+    for(int i = 0; i < 16; i++){
+        conv_gemm[i] = n_conv[i] >= 8 && strcmp(GEMM_ISA, "scalar") != 0;
+    }
+    parse_layer_list(gemm_layers, conv_gemm, 16);
+    // Winograd F(m x m, 3 x 3) on the chosen 3x3 layers, takes precedence over GEMM
+    bool conv_winograd[16] = {false};
+    parse_layer_list(winograd_layers, conv_winograd, 16);
+    for(int i = 0; i < 16; i++){
+        conv_winograd[i] = conv_winograd[i] && conv_sz[i] == 3;
+    }
+
+    // mapped for the whole run, the layers read their weights from the mapping
+    model_file weights(weights_path);
+    for(int i = 0; i < 16; i++){
+        char name[16];
+        snprintf(name, sizeof(name), "conv2d_%02d", i);
+        conv_kernels_h[i] = weights.conv_weights(name, n_conv[i], conv_sz[i], conv_ch[i]);
+    }
+    weights.finish();
+    std::vector<float> conv_half_h[16];
+    if(fp16){
+        for(int i = 0; i < 16; i++){
+            conv_half_h[i].assign(conv_kernels_h[i], conv_kernels_h[i] + conv_sz[i] * conv_sz[i] * conv_ch[i] * n_conv[i]);
+            round_to_half(conv_half_h[i].data(), conv_half_h[i].size());
+            conv_kernels_h[i] = conv_half_h[i].data();
+        }
+        printf("Weights and activations are rounded to half (%s conversion)\n", FP16_ISA);
+        round_to_half(input_h, INPUT_SIZE);
+    }
+
+    gemm_packed_filters conv_packed[16];
+    winograd_packed_filters conv_winograd_packed[16];
+    for(int i = 0; i < 16; i++){
+        if(conv_winograd[i]){
+            conv_winograd_packed[i] = winograd_pack_filters(conv_kernels_h[i], conv_ch[i], n_conv[i], \
+                                                            winograd_m == 4 ? winograd_f4() : winograd_f2());
+        }else if(conv_gemm[i]){
+            conv_packed[i] = gemm_pack_filters(conv_kernels_h[i], conv_sz[i] * conv_sz[i] * conv_ch[i], n_conv[i]);
+        }
+    }
+    printf("GEMM (%s micro-kernel) for layers:", GEMM_ISA);
+    for(int i = 0; i < 16; i++){
+        if(conv_gemm[i] && !conv_winograd[i]) printf(" %d", i);
+    }
+    printf(", Winograd F(%dx%d,3x3) for layers:", winograd_m, winograd_m);
+    for(int i = 0; i < 16; i++){
+        if(conv_winograd[i]) printf(" %d", i);
+    }
+    printf("\n");
+    // the other layers run the direct loops instantiated for their shape (TOMOGAN_CONV_SHAPES),
+    // TOMOGAN_SPECIALIZE=0 runs the generic ones
+    const char *specialize_env = getenv("TOMOGAN_SPECIALIZE");
+    const bool specialized = !(specialize_env && strcmp(specialize_env, "0") == 0);
+    printf("Pooling, upsampling and concatenation run %s loops (simd_ops.hpp)\n", simd_level_name(cpu_simd_level()));
+
+    // same buffer plan as the OpenCL version
+    float *layer_buf1 = new float[IMG_SIZE * IMG_SIZE * 32]();
+    float *layer_buf2 = new float[IMG_SIZE * IMG_SIZE * 64]();
+    float *box1_out   = new float[BOX1_IMG_SIZE * BOX1_IMG_SIZE * 32]();
+    float *box2_out   = new float[BOX2_IMG_SIZE * BOX2_IMG_SIZE * 64]();
+    float *box3_out   = new float[BOX3_IMG_SIZE * BOX3_IMG_SIZE * 128]();
+
+    double total_bytes = 0;
+    cpu_step_fn run_step = timed_step(peak_bw, total_bytes);
+    // minimal traffic of a layer: read input and weights once, write output once
+    auto conv = [&](int i, float *in, unsigned int size, float *out, unsigned char relu){
+        char name[16];
+        sprintf(name, conv_winograd[i] ? "wino2d_%02d" : conv_gemm[i] ? "gemm2d_%02d" : "conv2d_%02d", i);
+        double bytes = sizeof(float) * ((double)size * size * (conv_ch[i] + n_conv[i]) + \
+                                        conv_sz[i] * conv_sz[i] * conv_ch[i] * n_conv[i]);
+        double flops = 2. * size * size * conv_sz[i] * conv_sz[i] * conv_ch[i] * n_conv[i];
+        run_step(name, bytes, flops, [&](){
+            if(conv_winograd[i]){
+                conv2d_winograd_cpu(in, size, size, conv_ch[i], conv_winograd_packed[i], out, relu);
+            }else if(conv_gemm[i]){
+                conv2d_gemm_cpu(in, size, size, conv_ch[i], conv_packed[i], conv_sz[i], out, relu);
+            }else{
+                conv2d_cpu(in, size, size, conv_ch[i], conv_kernels_h[i], conv_sz[i], n_conv[i], out, relu, conv_lanes[i], \
+                           specialized);
+            }
+            if(fp16){
+                round_to_half(out, (size_t)size * size * n_conv[i]);
+            }
+        });
+    };
+    auto pool = [&](float *in, unsigned int size, unsigned int ch, float *out){
+        run_step("maxpool", sizeof(float) * (double)size * size * ch * 1.25, 0, [&](){
+            maxpooling_simd(in, size / 2, size / 2, ch, out);
+        });
+    };
+    auto upsample = [&](float *in, unsigned int size, unsigned int ch, float *out){
+        run_step("upsample", sizeof(float) * (double)size * size * ch * 5, 0, [&](){
+            upsample_simd(in, size, size, ch, out);
+        });
+    };
+    auto concat = [&](float *in1, float *in2, unsigned int size, unsigned int ch1, unsigned int ch2, float *out){
+        run_step("concat", sizeof(float) * (double)size * size * (ch1 + ch2) * 2, 0, [&](){
+            concatenate_simd(in1, in2, size, size, ch1, ch2, out);
+        });
+    };
+
+    // start computing, same layer sequence as tomogan.cpp
+    auto comp_st = chrono::steady_clock::now();
+    conv(0,  input_h,    BOX1_IMG_SIZE, layer_buf1, 1);
+    conv(1,  layer_buf1, BOX1_IMG_SIZE, layer_buf2, 1);
+    conv(2,  layer_buf2, BOX1_IMG_SIZE, box1_out,   1);
+    pool(box1_out, BOX1_IMG_SIZE, n_conv[2], layer_buf1);
+
+    conv(3,  layer_buf1, BOX2_IMG_SIZE, layer_buf2, 1);
+    conv(4,  layer_buf2, BOX2_IMG_SIZE, box2_out,   1);
+    pool(box2_out, BOX2_IMG_SIZE, n_conv[4], layer_buf1);
+
+    conv(5,  layer_buf1, BOX3_IMG_SIZE, layer_buf2, 1);
+    conv(6,  layer_buf2, BOX3_IMG_SIZE, box3_out,   1);
+    pool(box3_out, BOX3_IMG_SIZE, n_conv[6], layer_buf1);
+
+    conv(7,  layer_buf1, INTR_IMG_SIZE, layer_buf2, 1);
+    upsample(layer_buf2, INTR_IMG_SIZE, n_conv[7], layer_buf1);
+    concat(box3_out, layer_buf1, BOX3_IMG_SIZE, n_conv[6], n_conv[7], layer_buf2);
+    conv(8,  layer_buf2, BOX3_IMG_SIZE, layer_buf1, 1);
+    conv(9,  layer_buf1, BOX3_IMG_SIZE, layer_buf2, 1);
+
+    upsample(layer_buf2, BOX3_IMG_SIZE, n_conv[9], layer_buf1);
+    concat(box2_out, layer_buf1, BOX2_IMG_SIZE, n_conv[4], n_conv[9], layer_buf2);
+    conv(10, layer_buf2, BOX2_IMG_SIZE, layer_buf1, 1);
+    conv(11, layer_buf1, BOX2_IMG_SIZE, layer_buf2, 1);
+
+    upsample(layer_buf2, BOX2_IMG_SIZE, n_conv[11], layer_buf1);
+    concat(box1_out, layer_buf1, BOX1_IMG_SIZE, n_conv[2], n_conv[11], layer_buf2);
+    conv(12, layer_buf2, BOX1_IMG_SIZE, layer_buf1, 1);
+    conv(13, layer_buf1, BOX1_IMG_SIZE, layer_buf2, 1);
+    conv(14, layer_buf2, BOX1_IMG_SIZE, layer_buf1, 1);
+    conv(15, layer_buf1, BOX1_IMG_SIZE, results_h,  0);
+
+    auto comp_ed = chrono::steady_clock::now();
+    double comp_ms = chrono::duration_cast<chrono::microseconds>(comp_ed - comp_st).count()/1000.;
+    printf("It takes %.3f ms to compute on CPU, %.2f GB/s overall (%.1f%% of copy bw)\n", \
+           comp_ms, total_bytes / comp_ms / 1e6, 100. * total_bytes / comp_ms / 1e6 / peak_bw);
+
+    save_and_compare(results_h, fp16 ? "fp16" : "fp32");
+
+    delete[] layer_buf1;
+    delete[] layer_buf2;
+    delete[] box1_out;
+    delete[] box2_out;
+    delete[] box3_out;
+    delete[] results_h;
+    delete[] input_h;
+}
@@ -0,0 +1,124 @@
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <chrono>
+
+#include "network.hpp"
+#include "model.hpp"
+#include "quantize.hpp"
+#include "quality.hpp"
+
+using namespace std;
+
+// Post-training INT8 quantization (quantize.hpp): calibrate the activation scales on sample
+// slices, write the quantized model, then run it on the same slices and report its accuracy
+// against fp32, e.g.
+//   ./tomogan_quantize tomogan.model tomogan_int8.model [--network tomogan.net]
+//                      [--samples test_input_serilize.bin] [--height 1024 --width 1024]
+//                      [--max-samples 16] [--percentile 100]
+// Samples are HWC float32 slices back to back, the same format as --stream-in of tomogan.cpp;
+// a missing dimension is deduced from the size of the first slice, taken as square when
+// neither is given. --percentile below 100 clips each node's range to that percentile.
+int main(int argc, char** argv)
+{
+    const char *network_path = "tomogan.net";
+    const char *samples_path = "test_input_serilize.bin";
+    unsigned int height = 0, width = 0, max_samples = 16;
+    float percentile = 100;
+    vector<const char *> paths;
+    for(int i = 1; i < argc; i++){
+        if(strcmp(argv[i], "--network") == 0 && i + 1 < argc){
+            network_path = argv[++i];
+        }else if(strcmp(argv[i], "--samples") == 0 && i + 1 < argc){
+            samples_path = argv[++i];
+        }else if(strcmp(argv[i], "--height") == 0 && i + 1 < argc){
+            height = atoi(argv[++i]);
+        }else if(strcmp(argv[i], "--width") == 0 && i + 1 < argc){
+            width = atoi(argv[++i]);
+        }else if(strcmp(argv[i], "--max-samples") == 0 && i + 1 < argc){
+            max_samples = atoi(argv[++i]);
+        }else if(strcmp(argv[i], "--percentile") == 0 && i + 1 < argc){
+            percentile = atof(argv[++i]);
+        }else{
+            paths.push_back(argv[i]);
+        }
+    }
+    if(paths.size() < 2){
+        printf("Usage: %s <fp32 weights> <output model> [--network <file>] [--samples <file>] [--height H] [--width W]\n"
+               "       [--max-samples N] [--percentile P]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    network net = network::load(network_path);
+    const unsigned int channel = net.channel();
+    ifstream samples_fin(samples_path, ios::binary | ios::ate);
+    if(!samples_fin){
+        printf("Error: failed to open samples %s\n", samples_path);
+        return EXIT_FAILURE;
+    }
+    size_t file_pixels = (size_t)samples_fin.tellg() / (sizeof(float) * channel);
+    samples_fin.seekg(0);
+    if(height == 0 && width == 0){
+        height = width = (unsigned int)sqrt((double)file_pixels);
+    }else if(height == 0){
+        height = file_pixels / width;
+    }else if(width == 0){
+        width = file_pixels / height;
+    }
+    const size_t slice_size = (size_t)height * width * channel;
+    const unsigned int n_samples = min((size_t)max_samples, file_pixels / ((size_t)height * width));
+    if(n_samples == 0){
+        printf("Error: %s has no complete %dx%dx%d slice\n", samples_path, height, width, channel);
+        return EXIT_FAILURE;
+    }
+    printf("Calibrating on %d slices of %dx%dx%d from %s, range percentile %g\n", n_samples, height, width, channel, \
+           samples_path, percentile);
+
+    // fp32 pass over every sample for the node ranges
+    model_file weights(paths[0]);
+    vector<const float *> conv_weights = load_network_fp32(net, weights);
+    vector<gemm_packed_filters> filters = pack_network_fp32(net, conv_weights);
+    vector<act_range> ranges(net.size(), act_range{0, 0});
+    vector<vector<float>> samples(n_samples, vector<float>(slice_size));
+    const unsigned int out_channel = net.node(net.output()).channel;
+    vector<float> output_fp32((size_t)height * width * out_channel), output_int8(output_fp32.size());
+    for(unsigned int s = 0; s < n_samples; s++){
+        samples_fin.read((char *)samples[s].data(), sizeof(float) * slice_size);
+        run_network_fp32(net, filters, samples[s].data(), height, width, output_fp32.data(),
+            [&](int id, const float *tensor, size_t size){
+                act_range r = measure_range(tensor, size, percentile);
+                ranges[id].min = min(ranges[id].min, r.min);
+                ranges[id].max = max(ranges[id].max, r.max);
+            });
+    }
+    vector<act_quant> quant = plan_activation_quant(net, ranges);
+    write_quantized_model(paths[1], net, conv_weights, quant);
+
+    printf("%-12s %9s %9s %11s %5s %11s %5s\n", "node", "min", "max", "scale", "zero", "group scale", "zero");
+    for(unsigned int id = 0; id < net.size(); id++){
+        act_quant q = act_quant_from_range(ranges[id]);
+        printf("%-12s %9.4g %9.4g %11.4g %5d %11.4g %5d\n", net.node(id).name.c_str(), ranges[id].min, ranges[id].max, \
+               q.scale, q.zero, quant[id].scale, quant[id].zero);
+    }
+
+    // the written model on the same slices, against fp32
+    model_file quantized(paths[1]);
+    quantized.print();
+    int8_network int8_net(net, quantized);
+    double fp32_ms = 0, int8_ms = 0;
+    for(unsigned int s = 0; s < n_samples; s++){
+        auto st = chrono::steady_clock::now();
+        run_network_fp32(net, filters, samples[s].data(), height, width, output_fp32.data());
+        auto md = chrono::steady_clock::now();
+        int8_net.run(samples[s].data(), height, width, output_int8.data());
+        auto ed = chrono::steady_clock::now();
+        fp32_ms += chrono::duration_cast<chrono::microseconds>(md - st).count() / 1000.;
+        int8_ms += chrono::duration_cast<chrono::microseconds>(ed - md).count() / 1000.;
+        char ref_name[64];
+        snprintf(ref_name, sizeof(ref_name), "fp32 (slice %d)", s);
+        print_quality("int8", ref_name, compare_images(output_int8.data(), output_fp32.data(), height, width, out_channel));
+    }
+    printf("%d threads: fp32 (%s GEMM) %.3f ms, int8 (%s) %.3f ms per slice, %.2fx\n", cpu_num_threads(), GEMM_ISA, \
+           fp32_ms / n_samples, INT8_ISA, int8_ms / n_samples, fp32_ms / int8_ms);
+}
@@ -0,0 +1,1554 @@
+#ifndef TOMOGAN_SESSION_HPP
+#define TOMOGAN_SESSION_HPP
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <chrono>
+#include <vector>
+#include <cstring>
+#include <memory>
+#include <map>
+#include <algorithm>
+
+#include "main.hpp"
+#include "program.hpp"
+#include "profiler.hpp"
+#include "winograd.hpp"
+#include "layout.hpp"
+#include "tuning.hpp"
+#include "memory_plan.hpp"
+#include "network.hpp"
+#include "model.hpp"
+#include "fp16.hpp"
+
+size_t round_up(size_t value, size_t multiple){
+    return (value + multiple - 1) / multiple * multiple;
+}
+
+// work-group tile, channels staged per step and filters per work item of conv2d_local_mk,
+// passed to the kernel build so both sides agree
+#define LCONV_TILE     (16)
+#define LCONV_CH_CHUNK (8)
+#define LCONV_KF_BLOCK (8)
+// filters per work item of conv2d_winograd_f2
+#define WINO_KF_BLOCK  (4)
+
+// batches in flight in infer_stream(), each with its own device input/output tensors
+#define STREAM_DEPTH   (2)
+
+// Storage and arithmetic of tensors and weights on the device, see the top of conv2d.cl.
+// The host side of infer*() stays float either way, inputs are rounded to half on upload
+// and outputs widened back to float after the readback.
+enum session_precision{
+    // float storage and arithmetic
+    PRECISION_FP32,
+    // half storage, float accumulation; vload_half/vstore_half are core OpenCL so any
+    // device can run it, with half the memory traffic and footprint of fp32
+    PRECISION_FP16,
+    // half storage and half multiply-accumulate in the convolutions, needs cl_khr_fp16
+    PRECISION_FP16_ACC
+};
+
+const char* precision_name(session_precision precision){
+    const char *names[] = {"fp32", "fp16", "fp16acc"};
+    return names[precision];
+}
+
+// fp32, fp16 or fp16acc, any other name is fatal
+session_precision parse_precision(const char *name){
+    for(int p = PRECISION_FP32; p <= PRECISION_FP16_ACC; p++){
+        if(strcmp(name, precision_name((session_precision)p)) == 0){
+            return (session_precision)p;
+        }
+    }
+    printf("Error: unknown precision %s, use fp32, fp16 or fp16acc\n", name);
+    exit(1);
+}
+
+// Layout of the tensors on the device. The host side of infer*() is HWC either way.
+enum session_layout{
+    // HWC, all kernels of conv2d.cl including the local memory, fused and Winograd convs
+    LAYOUT_HWC,
+    // channel-blocked NCHWc8 (layout.hpp), the *_nchwc8 kernels with coalesced 8-channel
+    // vectors for any channel count; the input is converted after the upload and the output
+    // before the readback, by kernels on the device
+    LAYOUT_NCHWC8
+};
+
+const char* layout_name(session_layout layout){
+    const char *names[] = {"hwc", "nchwc8"};
+    return names[layout];
+}
+
+// hwc or nchwc8, any other name is fatal
+session_layout parse_layout(const char *name){
+    for(int l = LAYOUT_HWC; l <= LAYOUT_NCHWC8; l++){
+        if(strcmp(name, layout_name((session_layout)l)) == 0){
+            return (session_layout)l;
+        }
+    }
+    printf("Error: unknown layout %s, use hwc or nchwc8\n", name);
+    exit(1);
+}
+
+// One slot of the infer_stream() pipeline: the device input and output tensors of a batch,
+// pinned host staging for both (mapped at in_h and out_h, in the device element type) and
+// the events of its upload, compute and download, NULL while the slot is free.
+struct stream_stage{
+    cl_mem in_d;
+    cl_mem out_d;
+    cl_mem in_pinned;
+    cl_mem out_pinned;
+    void *in_h;
+    void *out_h;
+    cl_event uploaded;
+    cl_event computed;
+    cl_event downloaded;
+    unsigned int n_batch;
+};
+
+// One launch of the executor: the node it computes (conv, pool, upsample or concat) and,
+// for a conv, the pool node of its output or the concat node of its input when they are
+// fused into the same launch, else -1. A layout conversion of LAYOUT_NCHWC8 writes tensor
+// `node` from tensor `convert`, else convert is -1. bind_step() gives it its own kernel
+// instance with all arguments set, the grid for one slice (rows, cols, filter blocks; cols
+// and rows for the NCHWc8 kernels, whose 1st dimension is the column), and its name, work
+// and traffic per slice for the profiler, so enqueueing it is a single call. The tuner
+// (autotune() or the tuning database) may set its kernel variant, work-group shape and
+// filters per work item, else the defaults below apply.
+struct session_step{
+    int node = -1;
+    int pool = -1;
+    int concat = -1;
+    int convert = -1;
+    cl_kernel kernel = NULL;
+    std::string kernel_name;
+    unsigned int grid_h = 0;
+    unsigned int grid_w = 0;
+    unsigned int kf_blocks = 1;
+    std::string name;
+    double flops = 0;
+    double bytes = 0;
+    // kernel of a plain conv, empty for the default of bind_conv()
+    std::string variant;
+    // work-group shape, {0, 0} for the session's local_
+    size_t local[2] = {0, 0};
+    // filters per work item of conv2d_mk, conv2d_vec8_mk and conv2d_vec16_mk, 0 for all
+    unsigned int kf_block = 0;
+    // program the kernel was created from, the session's or a conv's specialized one
+    cl_program program = NULL;
+};
+
+// Owns everything needed to run a generator described by a network (see network.hpp) on
+// one device: context, queue, kernels, weights and intermediate buffers are set up once in
+// the constructor, then infer() can be called for as many slices as needed.
+// The nodes are turned into a list of launches, a conv taking the pooling of its output or
+// the upsample + concatenate of its input when it runs on the local memory kernel, and
+// picking its kernel from its filter size and input channels.
+// Intermediate tensors hold up to max_batch slices (NHWC) which go through each step in
+// one launch; they are sub-buffers of an arena laid out by a memory_plan from their
+// lifetimes. max_batch = 0 picks the largest batch whose arena fits in device memory.
+// Slices are height x width x channel; internally both sides are zero padded to a multiple
+// of 2^max_level so all poolings stay exact, and outputs are cropped back.
+// PRECISION_FP16_ACC falls back to PRECISION_FP16 on devices without cl_khr_fp16.
+// LAYOUT_NCHWC8 runs every node on the blocked kernels, without fusion or Winograd.
+class TomoGANSession{
+public:
+    TomoGANSession(const ocl_device_info &dev_info, const network &net, const char *weights_path, \
+                   unsigned int height, unsigned int width, unsigned int channel, unsigned int max_batch = 0, \
+                   session_precision precision = PRECISION_FP32, session_layout layout = LAYOUT_HWC);
+    ~TomoGANSession();
+
+    // input_h is height x width x channel (HWC), output_h is height x width x out_channel
+    void infer(const float *input_h, float *output_h);
+    // n_slices inputs and outputs back to back (NHWC), any n_slices, runs max_batch at a time
+    void infer_batch(const float *input_h, float *output_h, unsigned int n_slices);
+    // an image of any size (img_height x img_width x channel), split into overlapping
+    // height x width tiles with network::halo() pixels of context, sized by tile_side();
+    // output_h is img_height x img_width x out_channel
+    void infer_tiled(const float *input_h, unsigned int img_height, unsigned int img_width, float *output_h);
+    // height x width x channel slices read from input (a raw volume file or stdin) until it
+    // ends, height x width x out_channel results written to output in the same order; the
+    // upload of a batch, the compute of the one before and the download of the one before
+    // that run on separate queues, so file I/O and transfers hide behind the compute.
+    // Returns the number of slices.
+    unsigned int infer_stream(FILE *input, FILE *output);
+    // Benchmark every tunable launch over its kernel variants, work-group shapes and filters
+    // per work item at max_batch slices, keep the fastest and store them in the device's
+    // tuning database, which later sessions of the same shapes load at setup. Each variant
+    // is searched coordinate-wise: work-group shape, then filters per work item, then the
+    // shape again when the filters changed. The launches run on the session's own tensors
+    // and weights, whatever they hold.
+    void autotune();
+
+    unsigned int height() const { return height_; }
+    unsigned int width() const { return width_; }
+    unsigned int channel() const { return channel_; }
+    unsigned int out_channel() const { return net_.node(net_.output()).channel; }
+    unsigned int max_batch() const { return max_batch_; }
+    session_precision precision() const { return precision_; }
+    session_layout layout() const { return layout_; }
+    double setup_ms() const { return setup_ms_; }
+    double last_infer_ms() const { return last_infer_ms_; }
+    // host time spent enqueueing the kernels of the last infer call, all batches
+    double last_enqueue_ms() const { return last_enqueue_ms_; }
+    unsigned int n_launches() const { return steps_.size(); }
+    // launches configured from the tuning database or autotune()
+    unsigned int n_tuned() const { return n_tuned_; }
+    // per-step device times, the weight upload is always recorded, enable the profiler to
+    // also record the uploads, kernels and readbacks of the following inferences
+    ocl_profiler& profiler() { return profiler_; }
+
+private:
+    unsigned int pick_batch_size(unsigned int max_batch) const;
+    // the tensors of one run over n_slices with their lifetimes in step order, plan_id[node]
+    // is the plan's id of the node's output or -1 when it is fused away
+    memory_plan plan_memory(unsigned int n_slices, std::vector<int> &plan_id) const;
+    size_t plan_alignment() const;
+    // 3x3 convs run conv2d_local_mk, fused with their pooling or upsample + concatenate,
+    // unless the device cannot, they are selected for Winograd or tensors are NCHWc8
+    bool local_conv(const net_node &conv) const{
+        return layout_ == LAYOUT_HWC && use_local_conv_ && conv.filter_size == 3 && !use_winograd_[conv.conv];
+    }
+    // tensors uploaded to and read back from, the input and output nodes in HWC; with
+    // LAYOUT_NCHWC8 two HWC tensors after the nodes, converted from and to the blocked ones
+    int upload_tensor() const { return layout_ == LAYOUT_HWC ? net_.input() : net_.size(); }
+    int readback_tensor() const { return layout_ == LAYOUT_HWC ? net_.output() : net_.size() + 1; }
+    std::string tensor_name(int tensor) const{
+        return tensor < (int)net_.size() ? net_.node(tensor).name : tensor == upload_tensor() ? "input_hwc" : "output_hwc";
+    }
+    // the global memory kernel for the other convs, by the vector width of their input
+    const char* fallback_kernel(const net_node &conv) const;
+    void build_steps();
+    // nodes read and written by a step
+    void step_io(const session_step &step, std::vector<int> &reads, std::vector<int> &writes) const;
+    void load_weights(const char *weights_path);
+    cl_command_queue create_queue(cl_command_queue_properties properties);
+    // queues and stages of infer_stream(), on its first call
+    void setup_stream();
+    // fill the stage with up to max_batch slices, returns how many, 0 at the end of input
+    unsigned int read_stage(FILE *input, stream_stage &stage);
+    // wait for the stage's download, write its slices and free it, if it is in use
+    void finish_stage(stream_stage &stage, FILE *output);
+    // set the step's kernel (created on the first call), its arguments from tensor_d_ and
+    // its launch; called once per step at setup, and again for the steps touching the input
+    // or output when infer_stream() swaps those tensors
+    void bind_step(session_step &step);
+    // conv node from its input to its output, 3x3 layers use Winograd F(2x2, 3x3) when
+    // selected by TOMOGAN_WINOGRAD, else the local memory kernel when the device supports
+    // it, others fallback_kernel()
+    void bind_conv(session_step &step);
+    // conv node followed by 2x2 max pooling of its output into pool, fused in one launch of
+    // conv2d_local_pool_mk
+    void bind_conv_pool(session_step &step);
+    // conv node on concat, the concatenation of a skip tensor and the 2x upsampling of a low
+    // resolution one, fused in one launch of conv2d_local_upcat_mk
+    void bind_upcat_conv(session_step &step);
+    // conversion of the input to NCHWc8 or of the output back to HWC
+    void bind_convert(session_step &step);
+    // grid of an NCHWc8 kernel over height x width pixels, a work item per block of 8 channels
+    void nchwc8_grid(session_step &step, unsigned int height, unsigned int width, unsigned int channel) const;
+    // the step's kernel instance from program (the session's by default), created the first time
+    cl_kernel step_kernel(session_step &step, const char *kernel_name, cl_program program = NULL);
+    // conv2d.cl built for the shape of a conv node, with its input channels, filters, filter
+    // size and ReLU as SPEC_* constants, on first use (and from the program cache); program_
+    // when specialization is off
+    cl_program conv_program(const net_node &conv);
+    // useful work and minimal traffic per slice of a conv node, and bytes of a tensor at a level
+    double conv_flops(int node) const;
+    double conv_bytes(int node) const;
+    double level_bytes(unsigned int level, unsigned int channel) const;
+    // all steps back to back on the queue, no host synchronization or output in between
+    void enqueue_layers(unsigned int n_slices);
+    void enqueue_step(const session_step &step, unsigned int n_slices, cl_event *event);
+    // the launch as the tuning database knows it, empty for the fused local memory convs
+    // whose kernel and work-group shape are fixed
+    std::string tuning_key(const session_step &step) const;
+    // kernels the step can run, its default first
+    std::vector<std::string> tuning_kernels(const session_step &step) const;
+    // whether a work-group shape fits the device and the step's kernel
+    bool local_fits(const session_step &step, const size_t *local) const;
+    // best device time of a launch at max_batch slices over reps runs after a warmup
+    double time_step(const session_step &step, unsigned int reps);
+    // configure the steps found in the device's tuning database
+    void load_tuning();
+
+    ocl_device_info  dev_info_;
+    network          net_;
+    std::vector<session_step> steps_;
+    cl_context       context_;
+    cl_command_queue commands_;
+    // transfers of infer_stream(), NULL until it is called
+    cl_command_queue upload_queue_;
+    cl_command_queue download_queue_;
+    std::vector<stream_stage> stages_;
+    cl_program       program_;
+    // build options of program_, and the programs of conv shapes keyed by their options
+    std::string      build_options_;
+    std::map<std::string, cl_program> spec_programs_;
+
+    // weights of each conv in weights order
+    std::vector<cl_mem> conv_kernels_d_;
+    // Winograd transformed weights [16][channel][num_filter] of the convs in use_winograd_
+    std::vector<cl_mem> wino_kernels_d_;
+    // chunks of the arena, each at most the max allocation size
+    std::vector<cl_mem> arena_d_;
+    // output of each node, then the HWC ends of LAYOUT_NCHWC8, sub-buffers of arena_d_, NULL
+    // for nodes fused away
+    std::vector<cl_mem> tensor_d_;
+
+    unsigned int height_;
+    unsigned int width_;
+    unsigned int channel_;
+    // padded height and width at each U-Net level
+    std::vector<unsigned int> lv_h_;
+    std::vector<unsigned int> lv_w_;
+    // elements per slice of each tensor of tensor_d_, with the padding channels of NCHWc8
+    std::vector<size_t> tensor_floats_;
+    // host staging for padding inputs and cropping outputs, when padding is needed
+    std::vector<float> pad_in_h_;
+    std::vector<float> pad_out_h_;
+    // half inputs and outputs of a batch, and a float row of infer_stream(), in fp16 modes
+    std::vector<uint16_t> half_in_h_;
+    std::vector<uint16_t> half_out_h_;
+    std::vector<float> stream_row_h_;
+
+    session_precision precision_;
+    session_layout layout_;
+    // bytes of a tensor or weight element on the device
+    size_t elem_bytes_;
+
+    size_t local_[2];
+    bool use_local_conv_;
+    bool use_specialized_;
+    std::vector<bool> use_winograd_;
+    unsigned int n_tuned_;
+    unsigned int max_batch_;
+    double setup_ms_;
+    double last_infer_ms_;
+    double last_enqueue_ms_;
+    ocl_profiler profiler_;
+};
+
+// work-group shapes tried by autotune(), along the first two dimensions of the NDRange
+const size_t tuning_locals[][2] = {{16, 16}, {8, 8}, {16, 8}, {8, 16}, {32, 8}, {8, 32}, {32, 4}, {4, 32}, \
+                                   {64, 4}, {4, 64}, {32, 16}, {16, 32}, {64, 1}, {1, 64}};
+// filters per work item tried for the *_mk convs, besides all of them
+const unsigned int tuning_kf_blocks[] = {32, 16, 8, 4, 2, 1};
+
+// the local memory convs require LCONV_TILE x LCONV_TILE work groups
+bool fixed_local_kernel(const std::string &kernel_name){
+    return kernel_name.compare(0, 12, "conv2d_local") == 0;
+}
+
+// the global memory convs computing kf_block filters per work item
+bool kf_block_kernel(const std::string &kernel_name){
+    return kernel_name == "conv2d_mk" || kernel_name == "conv2d_vec8_mk" || kernel_name == "conv2d_vec16_mk";
+}
+
+cl_kernel create_kernel(cl_program program, const char *name){
+    int err;
+    cl_kernel kernel = clCreateKernel(program, name, &err);
+    if (!kernel || err != CL_SUCCESS){
+        printf("Error: Failed to create %s kernel! %d\n", name, err);
+        exit(1);
+    }
+    return kernel;
+}
+
+// Standard OpenCL cannot query free device memory, so the budget is the global memory
+// with 20% headroom (weights, runtime, other users); the arena is allocated in chunks of
+// the max allocation size, so no single tensor may exceed it either.
+unsigned int TomoGANSession::pick_batch_size(unsigned int max_batch) const{
+    std::vector<int> plan_id;
+    memory_plan plan = plan_memory(1, plan_id);
+    size_t slice_bytes = plan.solve(plan_alignment()), largest_bytes = 0;
+    for(unsigned int i = 0; i < plan.size(); i++){
+        largest_bytes = std::max(largest_bytes, plan.tensor(i).bytes);
+    }
+    size_t budget = 0.8 * dev_info_.global_mem_size;
+    size_t fit = std::min(budget / slice_bytes, (size_t)dev_info_.max_alloc_size / largest_bytes);
+    if(max_batch > 0){
+        fit = std::min(fit, (size_t)max_batch);
+    }
+    // aligned offsets and chunk boundaries can take a bit more than fit times one slice; the
+    // arena grows with the batch, so bisect for the largest batch within the budget
+    auto fits = [&](size_t n_slices){
+        return plan_memory(n_slices, plan_id).solve(plan_alignment(), dev_info_.max_alloc_size) <= budget;
+    };
+    if(fit <= 1 || fits(fit)){
+        return std::max((size_t)1, fit);
+    }
+    size_t lo = 1, hi = fit;    // lo is returned even when it does not fit, hi does not fit
+    while(hi - lo > 1){
+        size_t mid = lo + (hi - lo) / 2;
+        if(fits(mid)){
+            lo = mid;
+        }else{
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+size_t TomoGANSession::plan_alignment() const{
+    return std::max((size_t)dev_info_.mem_base_addr_align / 8, (size_t)64);
+}
+
+const char* TomoGANSession::fallback_kernel(const net_node &conv) const{
+    if(conv.in_channel % 16 == 0){
+        return "conv2d_vec16_mk";
+    }
+    if(conv.in_channel % 8 == 0){
+        return "conv2d_vec8_mk";
+    }
+    return "conv2d_mk";
+}
+
+// Every node is a step of its own, except pools and upsample + concatenate pairs that only
+// feed one conv which can run them in its local memory kernel: a conv's pooling is written
+// by the conv, a concatenation of a skip tensor and an upsampling only read by the conv is
+// read from the two tensors it is made of. NCHWc8 tensors are converted from the upload
+// before the first step and to the readback after the last.
+void TomoGANSession::build_steps(){
+    std::vector<session_step> fused(net_.size());
+    std::vector<bool> fused_away(net_.size(), false);
+    for(unsigned int i = 0; i < net_.n_convs(); i++){
+        int id = net_.conv_node(i);
+        const net_node &conv = net_.node(id);
+        if(!local_conv(conv)){
+            continue;
+        }
+        const net_node &in = net_.node(conv.input[0]);
+        if(in.op == NET_CONCAT && in.n_consumers == 1 && net_.node(in.input[1]).op == NET_UPSAMPLE && \
+           net_.node(in.input[1]).n_consumers == 1){
+            fused[id].concat = conv.input[0];
+            fused_away[conv.input[0]] = fused_away[in.input[1]] = true;
+            continue;
+        }
+        for(unsigned int j = id + 1; j < net_.size(); j++){
+            if(net_.node(j).op == NET_POOL && net_.node(j).input[0] == id){
+                fused[id].pool = j;
+                fused_away[j] = true;
+                break;
+            }
+        }
+    }
+    steps_.clear();
+    if(layout_ != LAYOUT_HWC){
+        session_step step;
+        step.node = net_.input();
+        step.convert = upload_tensor();
+        steps_.push_back(step);
+    }
+    for(unsigned int i = 1; i < net_.size(); i++){
+        if(!fused_away[i]){
+            session_step step;
+            step.node = i;
+            step.pool = fused[i].pool;
+            step.concat = fused[i].concat;
+            steps_.push_back(step);
+        }
+    }
+    if(layout_ != LAYOUT_HWC){
+        session_step step;
+        step.node = readback_tensor();
+        step.convert = net_.output();
+        steps_.push_back(step);
+    }
+}
+
+void TomoGANSession::step_io(const session_step &step, std::vector<int> &reads, std::vector<int> &writes) const{
+    reads.clear();
+    writes.assign(1, step.node);
+    if(step.convert >= 0){
+        reads.push_back(step.convert);
+        return;
+    }
+    const net_node &n = net_.node(step.node);
+    if(step.concat >= 0){
+        const net_node &concat = net_.node(step.concat);
+        reads.push_back(concat.input[0]);
+        reads.push_back(net_.node(concat.input[1]).input[0]);
+    }else{
+        for(int k = 0; k < 2 && n.input[k] >= 0; k++){
+            reads.push_back(n.input[k]);
+        }
+    }
+    if(step.pool >= 0){
+        writes.push_back(step.pool);
+    }
+}
+
+memory_plan TomoGANSession::plan_memory(unsigned int n_slices, std::vector<int> &plan_id) const{
+    memory_plan plan;
+    plan_id.assign(tensor_floats_.size(), -1);
+    // upload, the steps, then the readback
+    int step = 0;
+    plan_id[upload_tensor()] = plan.add(tensor_name(upload_tensor()).c_str(), elem_bytes_ * n_slices * tensor_floats_[upload_tensor()], \
+                                        step);
+    step++;
+    std::vector<int> reads, writes;
+    for(const session_step &s : steps_){
+        step_io(s, reads, writes);
+        for(int r : reads){
+            plan.use(plan_id[r], step);
+        }
+        for(int w : writes){
+            plan_id[w] = plan.add(tensor_name(w).c_str(), elem_bytes_ * n_slices * tensor_floats_[w], step);
+        }
+        step++;
+    }
+    plan.use(plan_id[readback_tensor()], step);
+    return plan;
+}
+
+TomoGANSession::TomoGANSession(const ocl_device_info &dev_info, const network &net, const char *weights_path, \
+                               unsigned int height, unsigned int width, unsigned int channel, unsigned int max_batch, \
+                               session_precision precision, session_layout layout)
+    : dev_info_(dev_info), net_(net), upload_queue_(NULL), download_queue_(NULL), height_(height), width_(width), \
+      channel_(channel), precision_(precision), layout_(layout), n_tuned_(0), last_infer_ms_(0), last_enqueue_ms_(0){
+    auto setup_st = std::chrono::steady_clock::now();
+    int err;
+
+    if(channel_ != net_.channel()){
+        printf("Error: the model takes %d input channels, got %d\n", net_.channel(), channel_);
+        exit(1);
+    }
+    const unsigned int n_levels = net_.max_level() + 1;
+    lv_h_.resize(n_levels);
+    lv_w_.resize(n_levels);
+    lv_h_[0] = round_up(height_, 1 << net_.max_level());
+    lv_w_[0] = round_up(width_, 1 << net_.max_level());
+    for(unsigned int lv = 1; lv < n_levels; lv++){
+        lv_h_[lv] = lv_h_[lv-1] / 2;
+        lv_w_[lv] = lv_w_[lv-1] / 2;
+    }
+    tensor_floats_.resize(layout_ == LAYOUT_HWC ? net_.size() : net_.size() + 2);
+    for(unsigned int i = 0; i < net_.size(); i++){
+        const net_node &n = net_.node(i);
+        tensor_floats_[i] = layout_ == LAYOUT_HWC ? (size_t)lv_h_[n.level] * lv_w_[n.level] * n.channel : \
+                                                    nchwc8_size(lv_h_[n.level], lv_w_[n.level], n.channel);
+    }
+    if(layout_ != LAYOUT_HWC){
+        tensor_floats_[upload_tensor()]   = (size_t)lv_h_[0] * lv_w_[0] * channel_;
+        tensor_floats_[readback_tensor()] = (size_t)lv_h_[0] * lv_w_[0] * out_channel();
+    }
+    // Create a compute context
+    context_ = clCreateContext(0, 1, &dev_info_.device, NULL, NULL, &err);
+    if (!context_){
+        printf("Error: Failed to create a compute context! %d\n", err);
+        exit(1);
+    }
+
+    // Create a command commands, with profiling so the events of each step can be timed
+    commands_ = create_queue(CL_QUEUE_PROFILING_ENABLE);
+
+    if(precision_ == PRECISION_FP16_ACC && !ocl_has_extension(dev_info_, "cl_khr_fp16")){
+        printf("Warning: the device has no cl_khr_fp16, accumulating in float\n");
+        precision_ = PRECISION_FP16;
+    }
+    elem_bytes_ = (precision_ == PRECISION_FP32) ? sizeof(float) : sizeof(uint16_t);
+    printf("Precision %s: tensors and weights stored as %s, accumulated in %s\n", precision_name(precision_), \
+           precision_ == PRECISION_FP32 ? "float" : "half", precision_ == PRECISION_FP16_ACC ? "half" : "float");
+
+    // Build the program executable, or load it from the program cache
+    char build_options[256];
+    snprintf(build_options, sizeof(build_options), "-DLCONV_TILE=%d -DLCONV_CH_CHUNK=%d -DLCONV_KF_BLOCK=%d -DWINO_KF_BLOCK=%d%s%s", \
+             LCONV_TILE, LCONV_CH_CHUNK, LCONV_KF_BLOCK, WINO_KF_BLOCK, precision_ != PRECISION_FP32 ? " -DTOMOGAN_FP16" : "", \
+             precision_ == PRECISION_FP16_ACC ? " -DTOMOGAN_FP16_ACC" : "");
+    program_ = build_program(context_, dev_info_, "conv2d.cl", build_options);
+    build_options_ = build_options;
+    // convs run kernels built for their shape unless TOMOGAN_SPECIALIZE=0
+    const char *specialize_env = getenv("TOMOGAN_SPECIALIZE");
+    use_specialized_ = !(specialize_env && strcmp(specialize_env, "0") == 0);
+
+    cl_kernel kernel_conv2d_v16 = create_kernel(program_, "conv2d_vec16_mk");
+    local_[0] = 16;
+    local_[1] = 16;
+    fit_local_size(dev_info_, local_, kernel_conv2d_v16);
+    clReleaseKernel(kernel_conv2d_v16);
+
+    // the local memory kernel needs full LCONV_TILE x LCONV_TILE work groups and its tiles
+    // in local memory, TOMOGAN_LOCAL_CONV=0 forces the global memory kernels for comparison
+    size_t local_conv_wg = 0;
+    cl_kernel kernel_conv2d_local = create_kernel(program_, "conv2d_local_mk");
+    clGetKernelWorkGroupInfo(kernel_conv2d_local, dev_info_.device, CL_KERNEL_WORK_GROUP_SIZE, sizeof(size_t), &local_conv_wg, NULL);
+    clReleaseKernel(kernel_conv2d_local);
+    // the local tiles hold the accumulation type
+    const size_t local_conv_mem = (precision_ == PRECISION_FP16_ACC ? sizeof(uint16_t) : sizeof(float)) * LCONV_CH_CHUNK * \
+                                  ((LCONV_TILE + 2) * (LCONV_TILE + 2) + 9 * LCONV_KF_BLOCK);
+    const char *local_conv_env = getenv("TOMOGAN_LOCAL_CONV");
+    use_local_conv_ = local_[0] == LCONV_TILE && local_[1] == LCONV_TILE && local_conv_wg >= LCONV_TILE * LCONV_TILE && \
+                      dev_info_.local_mem_size >= local_conv_mem && !(local_conv_env && strcmp(local_conv_env, "0") == 0);
+    if(layout_ == LAYOUT_HWC){
+        printf("3x3 convolutions use %s\n", use_local_conv_ ? "conv2d_local_mk" : "conv2d_vec16_mk");
+    }else{
+        printf("Tensors are %s, convolutions use conv2d_nchwc8\n", layout_name(layout_));
+    }
+
+    // Winograd F(2x2, 3x3) is off by default, TOMOGAN_WINOGRAD=all|<conv list> selects 3x3 convs
+    // for it, by their index in weights order
+    std::unique_ptr<bool[]> wino_list(new bool[net_.n_convs()]());
+    parse_layer_list(getenv("TOMOGAN_WINOGRAD"), wino_list.get(), net_.n_convs());
+    use_winograd_.resize(net_.n_convs());
+    for(unsigned int i = 0; i < net_.n_convs(); i++){
+        const net_node &conv = net_.node(net_.conv_node(i));
+        use_winograd_[i] = wino_list[i] && conv.filter_size == 3 && layout_ == LAYOUT_HWC;
+        if(use_winograd_[i]){
+            printf("%s uses conv2d_winograd_f2\n", conv.name.c_str());
+        }
+    }
+
+    build_steps();
+    printf("%d nodes run in %ld launches\n", net_.size() - 1, steps_.size());
+
+    max_batch_ = pick_batch_size(max_batch);
+    printf("Up to %d slice(s) of %dx%dx%d will be computed per batch\n", max_batch_, height_, width_, channel_);
+    if(lv_h_[0] != height_ || lv_w_[0] != width_){
+        pad_in_h_.resize(tensor_floats_[upload_tensor()] * max_batch_);
+        pad_out_h_.resize(tensor_floats_[readback_tensor()] * max_batch_);
+    }
+    if(precision_ != PRECISION_FP32){
+        half_in_h_.resize(tensor_floats_[upload_tensor()] * max_batch_);
+        half_out_h_.resize(tensor_floats_[readback_tensor()] * max_batch_);
+    }
+
+    // Lay out all intermediate tensors in an arena, each one a sub-buffer of it
+    std::vector<int> plan_id;
+    memory_plan plan = plan_memory(max_batch_, plan_id);
+    plan.solve(plan_alignment(), dev_info_.max_alloc_size);
+    plan.print();
+    printf("Memory plan for %d slice(s): %.2f MB arena, %.2f MB without reuse\n", max_batch_, \
+           plan.arena_bytes() / 1048576., plan.total_bytes() / 1048576.);
+    arena_d_.resize(plan.n_chunks());
+    for(unsigned int i = 0; i < arena_d_.size(); i++){
+        arena_d_[i] = clCreateBuffer(context_, CL_MEM_READ_WRITE, plan.chunk_bytes(i), NULL, NULL);
+        if (!arena_d_[i]){
+            printf("Error: Failed to allocate device memory!\n");
+            exit(1);
+        }
+    }
+    tensor_d_.assign(tensor_floats_.size(), NULL);
+    for(unsigned int i = 0; i < tensor_d_.size(); i++){
+        if(plan_id[i] < 0){
+            continue;
+        }
+        cl_buffer_region region = {plan.chunk_offset(plan_id[i]), plan.tensor(plan_id[i]).bytes};
+        tensor_d_[i] = clCreateSubBuffer(arena_d_[plan.chunk_of(plan_id[i])], CL_MEM_READ_WRITE, CL_BUFFER_CREATE_TYPE_REGION, \
+                                         &region, &err);
+        if (!tensor_d_[i] || err != CL_SUCCESS){
+            printf("Error: Failed to create sub-buffer for %s! %d\n", plan.tensor(plan_id[i]).name.c_str(), err);
+            exit(1);
+        }
+    }
+
+    profiler_.set_enabled(true);
+    load_weights(weights_path);
+    profiler_.collect();
+    profiler_.set_enabled(false);
+
+    // kernels and arguments are set once here, inferences only enqueue
+    load_tuning();
+    printf("%-36s %-22s %16s %8s\n", "step", "kernel", "grid", "local");
+    for(session_step &step : steps_){
+        bind_step(step);
+        if(step.local[0] > 0 && !local_fits(step, step.local)){
+            printf("Warning: tuned work group %ldx%ld does not fit %s, using the default\n", step.local[0], step.local[1], \
+                   step.kernel_name.c_str());
+            step.local[0] = step.local[1] = 0;
+        }
+        char grid[32], local[16];
+        snprintf(grid, sizeof(grid), "%dx%dx%d", step.grid_h, step.grid_w, step.kf_blocks);
+        snprintf(local, sizeof(local), "%ldx%ld", step.local[0] ? step.local[0] : local_[0], step.local[1] ? step.local[1] : local_[1]);
+        printf("%-36s %-22s %16s %8s\n", step.name.c_str(), step.kernel_name.c_str(), grid, local);
+    }
+    if(use_specialized_){
+        printf("Convolutions run kernels specialized for %ld layer shapes\n", spec_programs_.size());
+    }
+
+    auto setup_ed = std::chrono::steady_clock::now();
+    setup_ms_ = std::chrono::duration_cast<std::chrono::microseconds>(setup_ed - setup_st).count()/1000.;
+}
+
+cl_command_queue TomoGANSession::create_queue(cl_command_queue_properties properties){
+    int err;
+    #ifdef __APPLE__
+        cl_command_queue queue = clCreateCommandQueue(context_, dev_info_.device, properties, &err);
+    #else
+        cl_queue_properties queue_props[] = {CL_QUEUE_PROPERTIES, properties, 0};
+        cl_command_queue queue = clCreateCommandQueueWithProperties(context_, dev_info_.device, queue_props, &err);
+    #endif
+    if (!queue){
+        printf("Error: Failed to create a command commands! %d\n", err);
+        exit(1);
+    }
+    return queue;
+}
+
+// map the weights of all convs, checked against the network before anything is uploaded,
+// and copy them to device straight from the mapping, or rounded to half in fp16 modes, or
+// packed into filter blocks for NCHWc8
+void TomoGANSession::load_weights(const char *weights_path){
+    int err;
+    const unsigned int n_convs = net_.n_convs();
+    model_file weights(weights_path);
+    std::vector<const float*> conv_kernels_h(n_convs);
+    for(unsigned int i = 0; i < n_convs; i++){
+        const net_node &conv = net_.node(net_.conv_node(i));
+        printf("%6d paras for %s kernel in_ch: %3d, no_ch: %3d\n", conv.filter_size * conv.filter_size * conv.in_channel * conv.channel, \
+               conv.name.c_str(), conv.in_channel, conv.channel);
+        conv_kernels_h[i] = weights.conv_weights(conv.name.c_str(), conv.channel, conv.filter_size, conv.in_channel);
+    }
+    weights.finish();
+    if(weights.legacy()){
+        printf("%s has no header, its sizes are trusted, see tomogan_convert.cpp\n", weights_path);
+    }
+
+    // allocate device memory for model weights and copy weights to device, all writes are
+    // non-blocking and waited for once, the mapping, the Winograd and the half weights stay
+    // alive until then
+    auto weights_cp_st = std::chrono::steady_clock::now();
+    conv_kernels_d_.assign(n_convs, NULL);
+    wino_kernels_d_.assign(n_convs, NULL);
+    std::vector<std::vector<float> > wino_h(n_convs), blocked_h(n_convs);
+    std::vector<std::vector<uint16_t> > half_h(n_convs), wino_half_h(n_convs);
+    for(unsigned int i = 0; i < n_convs; i++){
+        const net_node &conv = net_.node(net_.conv_node(i));
+        size_t n_weights = conv.filter_size * conv.filter_size * conv.in_channel * conv.channel;
+        const float *float_h = conv_kernels_h[i];
+        if(layout_ == LAYOUT_NCHWC8){
+            blocked_h[i] = nchwc8_transform_filters(conv_kernels_h[i], conv.filter_size, conv.in_channel, conv.channel);
+            float_h = blocked_h[i].data();
+            n_weights = blocked_h[i].size();
+        }
+        size_t buf_size = elem_bytes_ * n_weights;
+        const void *weights_h = float_h;
+        if(precision_ != PRECISION_FP32){
+            half_h[i].resize(n_weights);
+            floats_to_halves(float_h, half_h[i].data(), n_weights);
+            weights_h = half_h[i].data();
+        }
+        conv_kernels_d_[i] = clCreateBuffer(context_, CL_MEM_READ_ONLY, buf_size, NULL, NULL);
+        if(!conv_kernels_d_[i]){
+            printf("Error: Failed to allocate device memory for kernel of %s!\n", conv.name.c_str());
+            exit(1);
+        }
+        err = clEnqueueWriteBuffer(commands_, conv_kernels_d_[i], CL_FALSE, 0, buf_size, weights_h, 0, NULL, \
+                                   profiler_.event("weights", 0, buf_size));
+        oclErrchk(err);
+
+        if(use_winograd_[i]){
+            // transformed from the float weights, rounded once
+            wino_h[i] = winograd_transform_filters(conv_kernels_h[i], conv.in_channel, conv.channel, winograd_f2());
+            size_t wino_size = elem_bytes_ * wino_h[i].size();
+            const void *wino_weights_h = wino_h[i].data();
+            if(precision_ != PRECISION_FP32){
+                wino_half_h[i].resize(wino_h[i].size());
+                floats_to_halves(wino_h[i].data(), wino_half_h[i].data(), wino_h[i].size());
+                wino_weights_h = wino_half_h[i].data();
+            }
+            wino_kernels_d_[i] = clCreateBuffer(context_, CL_MEM_READ_ONLY, wino_size, NULL, NULL);
+            if(!wino_kernels_d_[i]){
+                printf("Error: Failed to allocate device memory for Winograd kernel of %s!\n", conv.name.c_str());
+                exit(1);
+            }
+            err = clEnqueueWriteBuffer(commands_, wino_kernels_d_[i], CL_FALSE, 0, wino_size, wino_weights_h, 0, NULL, \
+                                       profiler_.event("weights", 0, wino_size));
+            oclErrchk(err);
+        }
+    }
+    oclErrchk(clFinish(commands_));
+    auto weights_cp_ed = std::chrono::steady_clock::now();
+    printf("It takes %.3f ms to transfer weights from host to device!\n", \
+           std::chrono::duration_cast<std::chrono::microseconds>(weights_cp_ed - weights_cp_st).count()/1000.);
+}
+
+void TomoGANSession::infer(const float *input_h, float *output_h){
+    infer_batch(input_h, output_h, 1);
+}
+
+void TomoGANSession::infer_batch(const float *input_h, float *output_h, unsigned int n_slices){
+    auto infer_st = std::chrono::steady_clock::now();
+    last_enqueue_ms_ = 0;
+    const size_t in_slice  = (size_t)height_ * width_ * channel_;
+    const size_t out_slice = (size_t)height_ * width_ * out_channel();
+    const bool padded = !pad_in_h_.empty();
+
+    for(unsigned int st = 0; st < n_slices; st += max_batch_){
+        unsigned int n_batch = std::min(max_batch_, n_slices - st);
+        const float *batch_in_h = input_h + in_slice * st;
+        if(padded){
+            // zero pad each slice to the padded width and height
+            std::fill(pad_in_h_.begin(), pad_in_h_.end(), 0.0f);
+            for(unsigned int n = 0; n < n_batch; n++)
+                for(unsigned int r = 0; r < height_; r++){
+                    memcpy(pad_in_h_.data() + tensor_floats_[upload_tensor()] * n + (size_t)lv_w_[0] * channel_ * r, \
+                           batch_in_h + in_slice * n + (size_t)width_ * channel_ * r, sizeof(float) * width_ * channel_);
+            }
+            batch_in_h = pad_in_h_.data();
+        }
+        const void *upload_h = batch_in_h;
+        if(precision_ != PRECISION_FP32){
+            floats_to_halves(batch_in_h, half_in_h_.data(), tensor_floats_[upload_tensor()] * n_batch);
+            upload_h = half_in_h_.data();
+        }
+        // transfer input data to device without waiting, the in-order queue runs the kernels
+        // after it and upload_h is not touched again before the readback below
+        const size_t in_bytes = elem_bytes_ * tensor_floats_[upload_tensor()] * n_batch;
+        int err = clEnqueueWriteBuffer(commands_, tensor_d_[upload_tensor()], CL_FALSE, 0, in_bytes, upload_h, 0, NULL, \
+                                       profiler_.event("upload", 0, in_bytes));
+        oclErrchk(err);
+
+        enqueue_layers(n_batch);
+
+        // Read back the results from the device, the only wait of the batch
+        float *batch_out_h = padded ? pad_out_h_.data() : output_h + out_slice * st;
+        void *readback_h = (precision_ != PRECISION_FP32) ? (void *)half_out_h_.data() : (void *)batch_out_h;
+        const size_t out_bytes = elem_bytes_ * tensor_floats_[readback_tensor()] * n_batch;
+        err = clEnqueueReadBuffer(commands_, tensor_d_[readback_tensor()], CL_TRUE, 0, out_bytes, readback_h, 0, NULL, \
+                                  profiler_.event("readback", 0, out_bytes));
+        oclErrchk(err);
+        profiler_.collect();
+        if(precision_ != PRECISION_FP32){
+            halves_to_floats(half_out_h_.data(), batch_out_h, tensor_floats_[readback_tensor()] * n_batch);
+        }
+        if(padded){
+            for(unsigned int n = 0; n < n_batch; n++)
+                for(unsigned int r = 0; r < height_; r++){
+                    memcpy(output_h + out_slice * (st + n) + (size_t)width_ * out_channel() * r, \
+                           batch_out_h + tensor_floats_[readback_tensor()] * n + (size_t)lv_w_[0] * out_channel() * r, \
+                           sizeof(float) * width_ * out_channel());
+            }
+        }
+    }
+
+    auto infer_ed = std::chrono::steady_clock::now();
+    last_infer_ms_ = std::chrono::duration_cast<std::chrono::microseconds>(infer_ed - infer_st).count()/1000.;
+}
+
+// Host staging is pinned (CL_MEM_ALLOC_HOST_PTR, mapped once) so transfers can run as DMA
+// while the host reads and writes files. The stage tensors come on top of the planned
+// arena, which keeps its own input and output tensors for infer_batch().
+void TomoGANSession::setup_stream(){
+    if(!stages_.empty()){
+        return;
+    }
+    int err;
+    upload_queue_   = create_queue(0);
+    download_queue_ = create_queue(0);
+    const size_t in_bytes  = elem_bytes_ * tensor_floats_[upload_tensor()] * max_batch_;
+    const size_t out_bytes = elem_bytes_ * tensor_floats_[readback_tensor()] * max_batch_;
+    if(precision_ != PRECISION_FP32){
+        stream_row_h_.resize((size_t)width_ * std::max(channel_, out_channel()));
+    }
+    stages_.resize(STREAM_DEPTH);
+    for(stream_stage &stage : stages_){
+        stage.in_d       = clCreateBuffer(context_, CL_MEM_READ_ONLY,  in_bytes,  NULL, NULL);
+        stage.out_d      = clCreateBuffer(context_, CL_MEM_WRITE_ONLY, out_bytes, NULL, NULL);
+        stage.in_pinned  = clCreateBuffer(context_, CL_MEM_READ_WRITE | CL_MEM_ALLOC_HOST_PTR, in_bytes,  NULL, NULL);
+        stage.out_pinned = clCreateBuffer(context_, CL_MEM_READ_WRITE | CL_MEM_ALLOC_HOST_PTR, out_bytes, NULL, NULL);
+        if (!stage.in_d || !stage.out_d || !stage.in_pinned || !stage.out_pinned){
+            printf("Error: Failed to allocate device memory for streaming!\n");
+            exit(1);
+        }
+        stage.in_h = clEnqueueMapBuffer(upload_queue_, stage.in_pinned, CL_TRUE, CL_MAP_WRITE, 0, in_bytes, \
+                                        0, NULL, NULL, &err);
+        oclErrchk(err);
+        stage.out_h = clEnqueueMapBuffer(download_queue_, stage.out_pinned, CL_TRUE, CL_MAP_READ, 0, out_bytes, \
+                                         0, NULL, NULL, &err);
+        oclErrchk(err);
+        // the padding is never written by read_stage(), zero is also +0 as a half
+        memset(stage.in_h, 0, in_bytes);
+        stage.uploaded = stage.computed = stage.downloaded = NULL;
+        stage.n_batch = 0;
+    }
+    printf("Streaming through %d stages of %d slice(s)\n", STREAM_DEPTH, max_batch_);
+}
+
+// in fp16 modes rows go through stream_row_h_ and are converted into the staging
+unsigned int TomoGANSession::read_stage(FILE *input, stream_stage &stage){
+    const size_t row = (size_t)width_ * channel_;
+    for(unsigned int n = 0; n < max_batch_; n++){
+        for(unsigned int r = 0; r < height_; r++){
+            size_t offset = tensor_floats_[upload_tensor()] * n + (size_t)lv_w_[0] * channel_ * r;
+            float *row_h = (precision_ != PRECISION_FP32) ? stream_row_h_.data() : (float *)stage.in_h + offset;
+            size_t got = fread(row_h, sizeof(float), row, input);
+            if(got == 0 && r == 0){
+                return n;
+            }
+            if(got != row){
+                printf("Error: the input ends in the middle of a %dx%dx%d slice\n", height_, width_, channel_);
+                exit(1);
+            }
+            if(precision_ != PRECISION_FP32){
+                floats_to_halves(row_h, (uint16_t *)stage.in_h + offset, row);
+            }
+        }
+    }
+    return max_batch_;
+}
+
+void TomoGANSession::finish_stage(stream_stage &stage, FILE *output){
+    if(stage.n_batch == 0){
+        return;
+    }
+    oclErrchk(clWaitForEvents(1, &stage.downloaded));
+    const size_t row = (size_t)width_ * out_channel();
+    for(unsigned int n = 0; n < stage.n_batch; n++)
+        for(unsigned int r = 0; r < height_; r++){
+            size_t offset = tensor_floats_[readback_tensor()] * n + (size_t)lv_w_[0] * out_channel() * r;
+            const float *row_h = (const float *)stage.out_h + offset;
+            if(precision_ != PRECISION_FP32){
+                halves_to_floats((const uint16_t *)stage.out_h + offset, stream_row_h_.data(), row);
+                row_h = stream_row_h_.data();
+            }
+            if(fwrite(row_h, sizeof(float), row, output) != row){
+                printf("Error: failed to write the output\n");
+                exit(1);
+            }
+    }
+    clReleaseEvent(stage.uploaded);
+    clReleaseEvent(stage.computed);
+    clReleaseEvent(stage.downloaded);
+    stage.uploaded = stage.computed = stage.downloaded = NULL;
+    stage.n_batch = 0;
+}
+
+// Batch b goes through stage b % STREAM_DEPTH. Before the stage is refilled, the batch it
+// held is finished, which also guarantees its compute no longer reads the stage's input.
+// The compute queue is in order, so batches share the arena one after the other.
+unsigned int TomoGANSession::infer_stream(FILE *input, FILE *output){
+    auto infer_st = std::chrono::steady_clock::now();
+    setup_stream();
+    const int in = upload_tensor(), out = readback_tensor();
+    cl_mem arena_in = tensor_d_[in], arena_out = tensor_d_[out];
+    // the steps whose arguments follow the stage tensors
+    std::vector<unsigned int> io_steps;
+    std::vector<int> reads, writes;
+    for(unsigned int i = 0; i < steps_.size(); i++){
+        step_io(steps_[i], reads, writes);
+        if(std::count(reads.begin(), reads.end(), in) > 0 || std::count(writes.begin(), writes.end(), out) > 0){
+            io_steps.push_back(i);
+        }
+    }
+    last_enqueue_ms_ = 0;
+    unsigned int n_slices = 0, b = 0;
+    for(; ; b++){
+        stream_stage &stage = stages_[b % STREAM_DEPTH];
+        finish_stage(stage, output);
+        stage.n_batch = read_stage(input, stage);
+        if(stage.n_batch == 0){
+            break;
+        }
+        n_slices += stage.n_batch;
+        const size_t in_bytes  = elem_bytes_ * tensor_floats_[in] * stage.n_batch;
+        const size_t out_bytes = elem_bytes_ * tensor_floats_[out] * stage.n_batch;
+        oclErrchk(clEnqueueWriteBuffer(upload_queue_, stage.in_d, CL_FALSE, 0, in_bytes, stage.in_h, 0, NULL, &stage.uploaded));
+        oclErrchk(clFlush(upload_queue_));
+
+        oclErrchk(clEnqueueBarrierWithWaitList(commands_, 1, &stage.uploaded, NULL));
+        tensor_d_[in]  = stage.in_d;
+        tensor_d_[out] = stage.out_d;
+        for(unsigned int i : io_steps){
+            bind_step(steps_[i]);
+        }
+        enqueue_layers(stage.n_batch);
+        oclErrchk(clEnqueueMarkerWithWaitList(commands_, 0, NULL, &stage.computed));
+        oclErrchk(clFlush(commands_));
+
+        oclErrchk(clEnqueueReadBuffer(download_queue_, stage.out_d, CL_FALSE, 0, out_bytes, stage.out_h, 1, &stage.computed, \
+                                      &stage.downloaded));
+        oclErrchk(clFlush(download_queue_));
+    }
+    tensor_d_[in]  = arena_in;
+    tensor_d_[out] = arena_out;
+    for(unsigned int i : io_steps){
+        bind_step(steps_[i]);
+    }
+    // the batches still in flight, oldest first
+    for(unsigned int k = 1; k < STREAM_DEPTH; k++){
+        finish_stage(stages_[(b + k) % STREAM_DEPTH], output);
+    }
+    profiler_.collect();
+
+    auto infer_ed = std::chrono::steady_clock::now();
+    last_infer_ms_ = std::chrono::duration_cast<std::chrono::microseconds>(infer_ed - infer_st).count()/1000.;
+    return n_slices;
+}
+
+// tile origins along one axis: step by the valid interior, the last tile covers the border.
+// Origins are multiples of align (2^max_level) so the poolings of every tile run on the
+// grid of the whole image; the last tile may reach past the border into the zero fill,
+// which is the padding a full-size run adds to reach a multiple of align.
+std::vector<unsigned int> tile_origins(unsigned int length, unsigned int tile, unsigned int halo, unsigned int align){
+    std::vector<unsigned int> origins(1, 0);
+    const unsigned int stride = (tile - 2 * halo) / align * align;
+    while(origins.back() + tile < length){
+        origins.push_back(std::min(origins.back() + stride, (unsigned int)round_up(length - tile, align)));
+    }
+    return origins;
+}
+
+// side of the session for infer_tiled() along an axis of the given length: the whole axis
+// when it fits in a tile, else tile rounded down to a multiple of 2^max_level, which the
+// session then pads like a whole-image run pads the image
+unsigned int tile_side(const network &net, unsigned int tile, unsigned int length){
+    if(length <= tile){
+        return length;
+    }
+    const unsigned int align = 1 << net.max_level();
+    return tile / align * align;
+}
+
+// Tiles are gathered max_batch at a time, so host and device memory stay bounded by the
+// tile size. Each tile contributes the rows/cols that are at least `halo` pixels away from
+// its cut edges; edges on the image border keep the same zero padding as a full-size run.
+// An image smaller than a tile is zero padded, which approximates the border padding.
+void TomoGANSession::infer_tiled(const float *input_h, unsigned int img_height, unsigned int img_width, float *output_h){
+    auto infer_st = std::chrono::steady_clock::now();
+    const unsigned int halo = net_.halo();
+    const unsigned int align = 1 << net_.max_level();
+    double enqueue_ms = 0;
+    if(2 * halo + align > std::min(height_, width_)){
+        printf("Error: %dx%d tiles are too small for a halo of %d pixels\n", height_, width_, halo);
+        exit(1);
+    }
+    if((img_height > height_ && height_ % align != 0) || (img_width > width_ && width_ % align != 0)){
+        printf("Error: %dx%d tiles are not a multiple of %d, see tile_side()\n", height_, width_, align);
+        exit(1);
+    }
+    std::vector<unsigned int> row_origins = tile_origins(img_height, height_, halo, align);
+    std::vector<unsigned int> col_origins = tile_origins(img_width,  width_,  halo, align);
+    std::vector<std::pair<unsigned int, unsigned int> > tiles;
+    for(size_t i = 0; i < row_origins.size(); i++)
+        for(size_t j = 0; j < col_origins.size(); j++){
+            tiles.push_back(std::make_pair(row_origins[i], col_origins[j]));
+    }
+    printf("%dx%d image is split into %ld tiles of %dx%d with %d pixels halo\n", \
+           img_height, img_width, tiles.size(), height_, width_, halo);
+
+    const size_t in_tile  = (size_t)height_ * width_ * channel_;
+    const unsigned int out_ch = out_channel();
+    const size_t out_tile = (size_t)height_ * width_ * out_ch;
+    float *tiles_in_h  = new float[in_tile * max_batch_];
+    float *tiles_out_h = new float[out_tile * max_batch_];
+    for(size_t st = 0; st < tiles.size(); st += max_batch_){
+        unsigned int n_batch = std::min((size_t)max_batch_, tiles.size() - st);
+        std::fill(tiles_in_h, tiles_in_h + in_tile * n_batch, 0.0f);
+        for(unsigned int t = 0; t < n_batch; t++){
+            unsigned int oy = tiles[st + t].first, ox = tiles[st + t].second;
+            unsigned int copy_w = std::min(width_, img_width - ox);
+            for(unsigned int r = 0; r < height_ && oy + r < img_height; r++){
+                memcpy(tiles_in_h + in_tile * t + (size_t)width_ * channel_ * r, \
+                       input_h + ((size_t)img_width * (oy + r) + ox) * channel_, sizeof(float) * channel_ * copy_w);
+            }
+        }
+        infer_batch(tiles_in_h, tiles_out_h, n_batch);
+        enqueue_ms += last_enqueue_ms_;
+        for(unsigned int t = 0; t < n_batch; t++){
+            unsigned int oy = tiles[st + t].first, ox = tiles[st + t].second;
+            unsigned int row_st = (oy == 0) ? 0 : oy + halo;
+            unsigned int col_st = (ox == 0) ? 0 : ox + halo;
+            unsigned int row_ed = (oy + height_ >= img_height) ? img_height : oy + height_ - halo;
+            unsigned int col_ed = (ox + width_  >= img_width)  ? img_width  : ox + width_  - halo;
+            for(unsigned int r = row_st; r < row_ed; r++){
+                memcpy(output_h + ((size_t)img_width * r + col_st) * out_ch, \
+                       tiles_out_h + out_tile * t + ((size_t)width_ * (r - oy) + (col_st - ox)) * out_ch, \
+                       sizeof(float) * (col_ed - col_st) * out_ch);
+            }
+        }
+    }
+    delete[] tiles_in_h;
+    delete[] tiles_out_h;
+
+    auto infer_ed = std::chrono::steady_clock::now();
+    last_infer_ms_ = std::chrono::duration_cast<std::chrono::microseconds>(infer_ed - infer_st).count()/1000.;
+    last_enqueue_ms_ = enqueue_ms;
+}
+
+cl_kernel TomoGANSession::step_kernel(session_step &step, const char *kernel_name, cl_program program){
+    if(program == NULL){
+        program = program_;
+    }
+    if(step.kernel && (step.kernel_name != kernel_name || step.program != program)){
+        clReleaseKernel(step.kernel);
+        step.kernel = NULL;
+    }
+    if(!step.kernel){
+        step.kernel = create_kernel(program, kernel_name);
+        step.kernel_name = kernel_name;
+        step.program = program;
+    }
+    return step.kernel;
+}
+
+cl_program TomoGANSession::conv_program(const net_node &conv){
+    if(!use_specialized_){
+        return program_;
+    }
+    char spec_options[128];
+    snprintf(spec_options, sizeof(spec_options), " -DSPEC_C_IN=%d -DSPEC_C_OUT=%d -DSPEC_K=%d -DSPEC_RELU=%d", \
+             conv.in_channel, conv.channel, conv.filter_size, conv.relu ? 1 : 0);
+    const std::string options = build_options_ + spec_options;
+    auto it = spec_programs_.find(options);
+    if(it != spec_programs_.end()){
+        return it->second;
+    }
+    cl_program program = build_program(context_, dev_info_, "conv2d.cl", options.c_str());
+    spec_programs_[options] = program;
+    return program;
+}
+
+void TomoGANSession::bind_conv(session_step &step){
+    const net_node &conv = net_.node(step.node);
+    unsigned int lv = conv.level;
+    step.name = conv.name;
+    step.flops = conv_flops(step.node);
+    step.bytes = conv_bytes(step.node);
+    if(layout_ == LAYOUT_NCHWC8){
+        cl_kernel kernel = step_kernel(step, "conv2d_nchwc8", conv_program(conv));
+        conv2d_set_arg(&kernel, &tensor_d_[conv.input[0]], lv_h_[lv], lv_w_[lv], conv.in_channel, &conv_kernels_d_[conv.conv], \
+                       conv.filter_size, conv.channel, &tensor_d_[step.node], conv.relu);
+        nchwc8_grid(step, lv_h_[lv], lv_w_[lv], conv.channel);
+        return;
+    }
+    if(use_winograd_[conv.conv]){
+        // one work item per 2x2 output tile and WINO_KF_BLOCK filters
+        cl_kernel kernel = step_kernel(step, "conv2d_winograd_f2");
+        conv2d_set_arg(&kernel, &tensor_d_[conv.input[0]], lv_h_[lv], lv_w_[lv], conv.in_channel, \
+                       &wino_kernels_d_[conv.conv], conv.filter_size, conv.channel, &tensor_d_[step.node], conv.relu);
+        step.grid_h = (lv_h_[lv] + 1) / 2;
+        step.grid_w = (lv_w_[lv] + 1) / 2;
+        step.kf_blocks = (conv.channel + WINO_KF_BLOCK - 1) / WINO_KF_BLOCK;
+        return;
+    }
+    const std::string kernel_name = !step.variant.empty() ? step.variant : \
+                                    local_conv(conv) ? "conv2d_local_mk" : fallback_kernel(conv);
+    cl_kernel kernel = step_kernel(step, kernel_name.c_str(), conv_program(conv));
+    step.grid_h = lv_h_[lv];
+    step.grid_w = lv_w_[lv];
+    if(kf_block_kernel(kernel_name)){
+        const unsigned int kf_block = step.kf_block > 0 ? std::min(step.kf_block, conv.channel) : conv.channel;
+        conv2d_mk_set_arg(&kernel, &tensor_d_[conv.input[0]], lv_h_[lv], lv_w_[lv], conv.in_channel, \
+                          &conv_kernels_d_[conv.conv], conv.filter_size, conv.channel, &tensor_d_[step.node], conv.relu, kf_block);
+        step.kf_blocks = (conv.channel + kf_block - 1) / kf_block;
+        return;
+    }
+    conv2d_set_arg(&kernel, &tensor_d_[conv.input[0]], lv_h_[lv], lv_w_[lv], conv.in_channel, &conv_kernels_d_[conv.conv], \
+                   conv.filter_size, conv.channel, &tensor_d_[step.node], conv.relu);
+    step.kf_blocks = (conv.channel + LCONV_KF_BLOCK - 1) / LCONV_KF_BLOCK;
+}
+
+void TomoGANSession::bind_conv_pool(session_step &step){
+    const net_node &conv = net_.node(step.node);
+    unsigned int lv = conv.level;
+    cl_kernel kernel = step_kernel(step, "conv2d_local_pool_mk", conv_program(conv));
+    conv2d_set_arg(&kernel, &tensor_d_[conv.input[0]], lv_h_[lv], lv_w_[lv], conv.in_channel, \
+                   &conv_kernels_d_[conv.conv], conv.filter_size, conv.channel, &tensor_d_[step.node], conv.relu);
+    oclErrchk(clSetKernelArg(kernel, 9, sizeof(cl_mem), &tensor_d_[step.pool]));
+    step.name = conv.name + "+" + net_.node(step.pool).name;
+    step.flops = conv_flops(step.node);
+    step.bytes = conv_bytes(step.node) + level_bytes(lv + 1, conv.channel);
+    step.grid_h = lv_h_[lv];
+    step.grid_w = lv_w_[lv];
+    step.kf_blocks = (conv.channel + LCONV_KF_BLOCK - 1) / LCONV_KF_BLOCK;
+}
+
+void TomoGANSession::bind_upcat_conv(session_step &step){
+    const net_node &conv = net_.node(step.node);
+    const net_node &cat = net_.node(step.concat);
+    const net_node &up = net_.node(cat.input[1]);
+    unsigned int lv = conv.level;
+    unsigned int skip_channel = net_.node(cat.input[0]).channel;
+    unsigned int low_channel = up.channel;
+    cl_kernel kernel = step_kernel(step, "conv2d_local_upcat_mk", conv_program(conv));
+    conv2d_set_arg(&kernel, &tensor_d_[cat.input[0]], lv_h_[lv], lv_w_[lv], conv.in_channel, \
+                   &conv_kernels_d_[conv.conv], conv.filter_size, conv.channel, &tensor_d_[step.node], conv.relu);
+    int err;
+    err  = clSetKernelArg(kernel, 9,  sizeof(cl_mem), &tensor_d_[up.input[0]]);
+    err |= clSetKernelArg(kernel, 10, sizeof(unsigned int), &skip_channel);
+    oclErrchk(err);
+    step.name = up.name + "+" + cat.name + "+" + conv.name;
+    step.flops = conv_flops(step.node);
+    // the skip tensor and the low resolution tensor are read instead of the concatenation
+    step.bytes = conv_bytes(step.node) - level_bytes(lv, low_channel) + level_bytes(lv + 1, low_channel);
+    step.grid_h = lv_h_[lv];
+    step.grid_w = lv_w_[lv];
+    step.kf_blocks = (conv.channel + LCONV_KF_BLOCK - 1) / LCONV_KF_BLOCK;
+}
+
+void TomoGANSession::bind_convert(session_step &step){
+    const bool to_blocked = step.node == net_.input();
+    const unsigned int channel = to_blocked ? channel_ : out_channel();
+    cl_kernel kernel = step_kernel(step, to_blocked ? "hwc_to_nchwc8" : "nchwc8_to_hwc");
+    layout_set_arg(&kernel, &tensor_d_[step.convert], lv_h_[0], lv_w_[0], channel, &tensor_d_[step.node]);
+    step.name = to_blocked ? "input to nchwc8" : "output to hwc";
+    step.bytes = level_bytes(0, channel + nchwc8_blocks(channel) * NCHWC_BLOCK);
+    nchwc8_grid(step, lv_h_[0], lv_w_[0], channel);
+}
+
+void TomoGANSession::nchwc8_grid(session_step &step, unsigned int height, unsigned int width, unsigned int channel) const{
+    step.grid_h = width;
+    step.grid_w = height;
+    step.kf_blocks = nchwc8_blocks(channel);
+}
+
+void TomoGANSession::bind_step(session_step &step){
+    step.flops = 0;
+    step.kf_blocks = 1;
+    if(step.convert >= 0){
+        bind_convert(step);
+        return;
+    }
+    const net_node &n = net_.node(step.node);
+    unsigned int lv = n.level;
+    const bool blocked = layout_ == LAYOUT_NCHWC8;
+    cl_kernel kernel;
+    step.name = n.name;
+    switch(n.op){
+    case NET_CONV:
+        if(step.pool >= 0){
+            bind_conv_pool(step);
+        }else if(step.concat >= 0){
+            bind_upcat_conv(step);
+        }else{
+            bind_conv(step);
+        }
+        break;
+    case NET_POOL:
+        kernel = step_kernel(step, blocked ? "maxpooling2d_nchwc8" : "maxpooling2d");
+        maxpool_set_arg(&kernel, &tensor_d_[n.input[0]], lv_h_[lv], lv_w_[lv], n.channel, &tensor_d_[step.node]);
+        step.grid_h = lv_h_[lv];
+        step.grid_w = lv_w_[lv];
+        if(blocked){
+            nchwc8_grid(step, lv_h_[lv], lv_w_[lv], n.channel);
+        }
+        step.bytes = 1.25 * level_bytes(lv - 1, n.channel);
+        break;
+    case NET_UPSAMPLE:
+        // one work item per input pixel
+        kernel = step_kernel(step, blocked ? "upsample2d_nchwc8" : "upsample2d");
+        upsample_set_arg(&kernel, &tensor_d_[n.input[0]], lv_h_[lv + 1], lv_w_[lv + 1], n.channel, &tensor_d_[step.node]);
+        step.grid_h = lv_h_[lv + 1];
+        step.grid_w = lv_w_[lv + 1];
+        if(blocked){
+            nchwc8_grid(step, lv_h_[lv + 1], lv_w_[lv + 1], n.channel);
+        }
+        step.bytes = 5 * level_bytes(lv + 1, n.channel);
+        break;
+    case NET_CONCAT:
+        kernel = step_kernel(step, blocked ? "concatenate_nchwc8" : "concatenate");
+        concat_set_arg(&kernel, &tensor_d_[n.input[0]], &tensor_d_[n.input[1]], lv_h_[lv], lv_w_[lv], \
+                       net_.node(n.input[0]).channel, net_.node(n.input[1]).channel, &tensor_d_[step.node]);
+        step.grid_h = lv_h_[lv];
+        step.grid_w = lv_w_[lv];
+        if(blocked){
+            nchwc8_grid(step, lv_h_[lv], lv_w_[lv], n.channel);
+        }
+        step.bytes = 2 * level_bytes(lv, n.channel);
+        break;
+    default:
+        break;
+    }
+}
+
+double TomoGANSession::conv_flops(int node) const{
+    const net_node &conv = net_.node(node);
+    return 2. * lv_h_[conv.level] * lv_w_[conv.level] * conv.filter_size * conv.filter_size * conv.in_channel * conv.channel;
+}
+
+// read the input and the weights once, write the output once
+double TomoGANSession::conv_bytes(int node) const{
+    const net_node &conv = net_.node(node);
+    return level_bytes(conv.level, conv.in_channel + conv.channel) + \
+           elem_bytes_ * conv.filter_size * conv.filter_size * conv.in_channel * conv.channel;
+}
+
+double TomoGANSession::level_bytes(unsigned int level, unsigned int channel) const{
+    return elem_bytes_ * (double)lv_h_[level] * lv_w_[level] * channel;
+}
+
+// The NDRange is rounded up to the work-group size and the kernels skip the items outside
+// the image; slices of the batch (times the filter blocks) go along the third dimension.
+void TomoGANSession::enqueue_layers(unsigned int n_slices){
+    auto enqueue_st = std::chrono::steady_clock::now();
+    for(const session_step &step : steps_){
+        enqueue_step(step, n_slices, profiler_.event(step.name.c_str(), step.flops * n_slices, step.bytes * n_slices));
+    }
+    auto enqueue_ed = std::chrono::steady_clock::now();
+    last_enqueue_ms_ += std::chrono::duration_cast<std::chrono::microseconds>(enqueue_ed - enqueue_st).count()/1000.;
+}
+
+void TomoGANSession::enqueue_step(const session_step &step, unsigned int n_slices, cl_event *event){
+    size_t local[3] = {step.local[0] ? step.local[0] : local_[0], step.local[1] ? step.local[1] : local_[1], 1};
+    size_t global[3] = {round_up(step.grid_h, local[0]), round_up(step.grid_w, local[1]), (size_t)n_slices * step.kf_blocks};
+    oclErrchk(clEnqueueNDRangeKernel(commands_, step.kernel, 3, NULL, global, local, 0, NULL, event));
+}
+
+std::string TomoGANSession::tuning_key(const session_step &step) const{
+    if(step.pool >= 0 || step.concat >= 0){
+        return "";
+    }
+    char key[160], suffix[32];
+    snprintf(suffix, sizeof(suffix), ":%s:%s", precision_name(precision_), layout_name(layout_));
+    if(step.convert >= 0){
+        const bool to_blocked = step.node == net_.input();
+        snprintf(key, sizeof(key), "%s:%dx%dx%d%s", to_blocked ? "to_nchwc8" : "to_hwc", lv_h_[0], lv_w_[0], \
+                 to_blocked ? channel_ : out_channel(), suffix);
+        return key;
+    }
+    const net_node &n = net_.node(step.node);
+    const unsigned int h = lv_h_[n.level], w = lv_w_[n.level];
+    switch(n.op){
+    case NET_CONV:
+        snprintf(key, sizeof(key), "conv%dx%d%s:%dx%dx%d>%d%s", n.filter_size, n.filter_size, \
+                 use_winograd_[n.conv] ? "_wino" : "", h, w, n.in_channel, n.channel, suffix);
+        break;
+    case NET_POOL:
+        snprintf(key, sizeof(key), "pool:%dx%dx%d%s", h, w, n.channel, suffix);
+        break;
+    case NET_UPSAMPLE:
+        snprintf(key, sizeof(key), "upsample:%dx%dx%d%s", h, w, n.channel, suffix);
+        break;
+    case NET_CONCAT:
+        snprintf(key, sizeof(key), "concat:%dx%dx%d+%d%s", h, w, net_.node(n.input[0]).channel, \
+                 net_.node(n.input[1]).channel, suffix);
+        break;
+    default:
+        return "";
+    }
+    return key;
+}
+
+std::vector<std::string> TomoGANSession::tuning_kernels(const session_step &step) const{
+    std::vector<std::string> kernels;
+    if(step.convert >= 0 || net_.node(step.node).op != NET_CONV || layout_ != LAYOUT_HWC){
+        return kernels;
+    }
+    const net_node &conv = net_.node(step.node);
+    if(use_winograd_[conv.conv]){
+        return kernels;
+    }
+    kernels.push_back(local_conv(conv) ? "conv2d_local_mk" : fallback_kernel(conv));
+    // conv2d_mk and conv2d_vec8_mk take the filters as a __constant argument
+    const bool filters_fit = elem_bytes_ * conv.filter_size * conv.filter_size * conv.in_channel * conv.channel <= \
+                             dev_info_.max_constant_size;
+    const char *candidates[4] = {"conv2d_local_mk", "conv2d_mk", "conv2d_vec8_mk", "conv2d_vec16_mk"};
+    const bool usable[4] = {use_local_conv_ && (conv.filter_size == 1 || conv.filter_size == 3), filters_fit, \
+                            filters_fit && conv.in_channel % 8 == 0, conv.in_channel % 16 == 0};
+    for(int k = 0; k < 4; k++){
+        if(usable[k] && kernels[0] != candidates[k]){
+            kernels.push_back(candidates[k]);
+        }
+    }
+    return kernels;
+}
+
+bool TomoGANSession::local_fits(const session_step &step, const size_t *local) const{
+    size_t kernel_wg_size = dev_info_.max_work_group_size;
+    clGetKernelWorkGroupInfo(step.kernel, dev_info_.device, CL_KERNEL_WORK_GROUP_SIZE, sizeof(size_t), &kernel_wg_size, NULL);
+    return local[0] * local[1] <= std::min(kernel_wg_size, dev_info_.max_work_group_size) && \
+           local[0] <= dev_info_.max_work_item_sizes[0] && local[1] <= dev_info_.max_work_item_sizes[1];
+}
+
+double TomoGANSession::time_step(const session_step &step, unsigned int reps){
+    double best_ms = 1e30;
+    for(unsigned int rep = 0; rep <= reps; rep++){
+        cl_event ev;
+        enqueue_step(step, max_batch_, &ev);
+        oclErrchk(clWaitForEvents(1, &ev));
+        cl_ulong st, ed;
+        clGetEventProfilingInfo(ev, CL_PROFILING_COMMAND_START, sizeof(cl_ulong), &st, NULL);
+        clGetEventProfilingInfo(ev, CL_PROFILING_COMMAND_END,   sizeof(cl_ulong), &ed, NULL);
+        clReleaseEvent(ev);
+        if(rep > 0){
+            best_ms = std::min(best_ms, (ed - st) / 1e6);
+        }
+    }
+    return best_ms;
+}
+
+// TOMOGAN_TUNING=0 runs the defaults for comparison. An entry whose kernel is not a
+// variant of the step any more (e.g. Winograd was selected since, or its filters exceed the
+// device's constant memory) is ignored; its work-group shape is checked against the kernel
+// once it is bound.
+void TomoGANSession::load_tuning(){
+    tuning_db db;
+    const std::string path = tuning_db::device_path(dev_info_);
+    const char *tuning_env = getenv("TOMOGAN_TUNING");
+    if((tuning_env && strcmp(tuning_env, "0") == 0) || !db.load(path)){
+        return;
+    }
+    n_tuned_ = 0;
+    for(session_step &step : steps_){
+        const std::string key = tuning_key(step);
+        const tuning_entry *entry = key.empty() ? NULL : db.find(key);
+        if(entry == NULL){
+            continue;
+        }
+        std::vector<std::string> kernels = tuning_kernels(step);
+        if(!kernels.empty() && std::find(kernels.begin(), kernels.end(), entry->kernel) == kernels.end()){
+            continue;
+        }
+        step.variant = kernels.empty() ? "" : entry->kernel;
+        step.local[0] = fixed_local_kernel(entry->kernel) ? 0 : entry->local[0];
+        step.local[1] = fixed_local_kernel(entry->kernel) ? 0 : entry->local[1];
+        step.kf_block = entry->kf_block;
+        n_tuned_++;
+    }
+    printf("%d of %ld launches configured from the tuning database %s\n", n_tuned_, steps_.size(), path.c_str());
+}
+
+void TomoGANSession::autotune(){
+    const unsigned int reps = 3;
+    tuning_db db;
+    const std::string path = tuning_db::device_path(dev_info_);
+    db.load(path);
+    auto tune_st = std::chrono::steady_clock::now();
+    double default_total = 0, tuned_total = 0;
+    n_tuned_ = 0;
+    printf("Tuning %ld launches at %d slice(s), best of %d runs each\n", steps_.size(), max_batch_, reps);
+    printf("%-36s %-22s %8s %4s %10s %10s %8s\n", "step", "kernel", "local", "kf", "default ms", "tuned ms", "speedup");
+    for(session_step &step : steps_){
+        const std::string key = tuning_key(step);
+        if(key.empty()){
+            double ms = time_step(step, reps);
+            default_total += ms;
+            tuned_total += ms;
+            printf("%-36s %-22s %8s %4s %10.3f %10s %8s\n", step.name.c_str(), step.kernel_name.c_str(), "fixed", "-", ms, "-", "-");
+            continue;
+        }
+        // the default launch, without what a loaded database picked
+        step.variant.clear();
+        step.local[0] = step.local[1] = 0;
+        step.kf_block = 0;
+        bind_step(step);
+        const double default_ms = time_step(step, reps);
+        tuning_entry best = {step.kernel_name, {0, 0}, 0, default_ms};
+
+        std::vector<std::string> kernels = tuning_kernels(step);
+        if(kernels.empty()){
+            kernels.push_back(step.kernel_name);
+        }
+        for(const std::string &kernel_name : kernels){
+            step.variant = tuning_kernels(step).empty() ? "" : kernel_name;
+            step.local[0] = step.local[1] = 0;
+            step.kf_block = 0;
+            bind_step(step);
+            tuning_entry cur = {kernel_name, {0, 0}, 0, time_step(step, reps)};
+            if(!fixed_local_kernel(kernel_name)){
+                // work-group shapes, then filters per work item, then the shapes again
+                const unsigned int num_filter = net_.node(step.node).channel;
+                for(int pass = 0; pass < 3; pass++){
+                    if(pass == 1){
+                        if(!kf_block_kernel(kernel_name)){
+                            break;
+                        }
+                        const unsigned int kf_before = cur.kf_block;
+                        for(unsigned int kf : tuning_kf_blocks){
+                            if(kf >= num_filter){
+                                continue;
+                            }
+                            step.kf_block = kf;
+                            bind_step(step);
+                            double ms = time_step(step, reps);
+                            if(ms < cur.ms){
+                                cur.kf_block = kf;
+                                cur.ms = ms;
+                            }
+                        }
+                        step.kf_block = cur.kf_block;
+                        bind_step(step);
+                        if(cur.kf_block == kf_before){
+                            break;
+                        }
+                        continue;
+                    }
+                    for(const size_t *local : tuning_locals){
+                        if(!local_fits(step, local)){
+                            continue;
+                        }
+                        step.local[0] = local[0];
+                        step.local[1] = local[1];
+                        double ms = time_step(step, reps);
+                        if(ms < cur.ms){
+                            cur.local[0] = local[0];
+                            cur.local[1] = local[1];
+                            cur.ms = ms;
+                        }
+                    }
+                    step.local[0] = cur.local[0];
+                    step.local[1] = cur.local[1];
+                }
+            }
+            if(cur.ms < best.ms){
+                best = cur;
+            }
+        }
+
+        step.variant = tuning_kernels(step).empty() ? "" : best.kernel;
+        step.local[0] = best.local[0];
+        step.local[1] = best.local[1];
+        step.kf_block = best.kf_block;
+        bind_step(step);
+        db.set(key, best);
+        n_tuned_++;
+        default_total += default_ms;
+        tuned_total += best.ms;
+        char local[16], kf[8];
+        snprintf(local, sizeof(local), "%ldx%ld", best.local[0] ? best.local[0] : local_[0], best.local[1] ? best.local[1] : local_[1]);
+        snprintf(kf, sizeof(kf), "%d", best.kf_block);
+        printf("%-36s %-22s %8s %4s %10.3f %10.3f %7.2fx\n", step.name.c_str(), step.kernel_name.c_str(), local, \
+               kf_block_kernel(best.kernel) ? kf : "-", default_ms, best.ms, default_ms / best.ms);
+    }
+    db.save(path, dev_info_);
+    auto tune_ed = std::chrono::steady_clock::now();
+    printf("Tuned %d launches in %.3f s: %.3f ms -> %.3f ms per batch (%.2fx), saved to %s\n", n_tuned_, \
+           std::chrono::duration_cast<std::chrono::milliseconds>(tune_ed - tune_st).count()/1000., \
+           default_total, tuned_total, default_total / tuned_total, path.c_str());
+}
+
+TomoGANSession::~TomoGANSession(){
+    for(unsigned int i = 0; i < conv_kernels_d_.size(); i++){
+        clReleaseMemObject(conv_kernels_d_[i]);
+        if(wino_kernels_d_[i]){
+            clReleaseMemObject(wino_kernels_d_[i]);
+        }
+    }
+    for(unsigned int i = 0; i < tensor_d_.size(); i++){
+        if(tensor_d_[i]){
+            clReleaseMemObject(tensor_d_[i]);
+        }
+    }
+    for(unsigned int i = 0; i < arena_d_.size(); i++){
+        clReleaseMemObject(arena_d_[i]);
+    }
+    for(stream_stage &stage : stages_){
+        clEnqueueUnmapMemObject(upload_queue_, stage.in_pinned, stage.in_h, 0, NULL, NULL);
+        clEnqueueUnmapMemObject(download_queue_, stage.out_pinned, stage.out_h, 0, NULL, NULL);
+        clFinish(upload_queue_);
+        clFinish(download_queue_);
+        clReleaseMemObject(stage.in_d);
+        clReleaseMemObject(stage.out_d);
+        clReleaseMemObject(stage.in_pinned);
+        clReleaseMemObject(stage.out_pinned);
+    }
+    if(upload_queue_){
+        clReleaseCommandQueue(upload_queue_);
+        clReleaseCommandQueue(download_queue_);
+    }
+
+    for(session_step &step : steps_){
+        clReleaseKernel(step.kernel);
+    }
+    for(auto &it : spec_programs_){
+        clReleaseProgram(it.second);
+    }
+    clReleaseProgram(program_);
+    clReleaseCommandQueue(commands_);
+    clReleaseContext(context_);
+}
+
+#endif
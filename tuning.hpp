@@ -0,0 +1,92 @@
+#ifndef TOMOGAN_TUNING_HPP
+#define TOMOGAN_TUNING_HPP
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <map>
+#include <sys/stat.h>
+
+#include "device.hpp"
+#include "program.hpp"
+
+// Launch configurations picked by TomoGANSession::autotune(), one file per device in the
+// directory given by TOMOGAN_TUNING_DIR (default .tomogan_tuning), keyed like the program
+// cache by device name and driver version. Each line is
+//   <launch key> <kernel> <local rows> <local cols> <filters per work item> <ms>
+// where the key describes the launch (op, shape, precision, layout, see tuning_key()) so a
+// later session of the same shapes finds it whatever the node names; 0 is the session's
+// default for the local size and the kernel's default for the filters per work item.
+struct tuning_entry{
+    std::string kernel;
+    size_t local[2];
+    unsigned int kf_block;
+    double ms;
+};
+
+class tuning_db{
+public:
+    // the file of the device, whether or not it exists
+    static std::string device_path(const ocl_device_info &dev_info){
+        const char *tuning_dir = getenv("TOMOGAN_TUNING_DIR");
+        if(tuning_dir == NULL){
+            tuning_dir = ".tomogan_tuning";
+        }
+        char path[512];
+        snprintf(path, sizeof(path), "%s/%016llx.txt", tuning_dir, \
+                 (unsigned long long)fnv1a_hash(dev_info.name + '\0' + dev_info.driver_version));
+        return path;
+    }
+
+    // false when there is no file, malformed lines are skipped
+    bool load(const std::string &path){
+        std::ifstream fin(path.c_str());
+        if(!fin){
+            return false;
+        }
+        std::string line;
+        while(std::getline(fin, line)){
+            if(line.empty() || line[0] == '#'){
+                continue;
+            }
+            std::istringstream ss(line);
+            std::string key;
+            tuning_entry entry;
+            if(ss >> key >> entry.kernel >> entry.local[0] >> entry.local[1] >> entry.kf_block >> entry.ms){
+                entries_[key] = entry;
+            }
+        }
+        return true;
+    }
+
+    // the directory is created as needed, a failure is reported and otherwise ignored
+    void save(const std::string &path, const ocl_device_info &dev_info) const{
+        size_t slash = path.rfind('/');
+        if(slash != std::string::npos){
+            mkdir(path.substr(0, slash).c_str(), 0755);
+        }
+        std::ofstream fout(path.c_str());
+        if(!fout){
+            printf("Warning: failed to write the tuning database %s\n", path.c_str());
+            return;
+        }
+        fout << "# " << dev_info.name << ", driver " << dev_info.driver_version << "\n";
+        for(const auto &it : entries_){
+            const tuning_entry &e = it.second;
+            fout << it.first << " " << e.kernel << " " << e.local[0] << " " << e.local[1] << " " << e.kf_block << " " << e.ms << "\n";
+        }
+    }
+
+    const tuning_entry* find(const std::string &key) const{
+        auto it = entries_.find(key);
+        return it == entries_.end() ? NULL : &it->second;
+    }
+    void set(const std::string &key, const tuning_entry &entry){ entries_[key] = entry; }
+    size_t size() const { return entries_.size(); }
+
+private:
+    std::map<std::string, tuning_entry> entries_;
+};
+
+#endif
@@ -1,12 +1,228 @@
+#ifndef TOMOGAN_UTILS_HPP
+#define TOMOGAN_UTILS_HPP
+
 #include <iostream>
 #include <cstdint>
 #include <cstring>
+#include <cstdlib>
+#include <cctype>
+#include <thread>
+#include <vector>
+#include <functional>
+#include <algorithm>
+
+// number of worker threads used by the CPU operators, TOMOGAN_THREADS overrides
+// the hardware concurrency; a non-zero argument sets it for the rest of the run
+unsigned int cpu_num_threads(unsigned int set = 0){
+    static unsigned int n_threads = 0;
+    if(set > 0){
+        n_threads = set;
+    }
+    if(n_threads == 0){
+        const char *env = getenv("TOMOGAN_THREADS");
+        n_threads = env ? atoi(env) : std::thread::hardware_concurrency();
+        if(n_threads == 0){
+            n_threads = 1;
+        }
+    }
+    return n_threads;
+}
+
+// parse "all", "none" or a comma separated list of layer indexes into enabled[n_layers],
+// NULL or "auto" leave enabled as it is
+void parse_layer_list(const char *list, bool *enabled, unsigned int n_layers){
+    if(list == NULL || strcmp(list, "auto") == 0){
+        return;
+    }
+    bool all = strcmp(list, "all") == 0;
+    for(unsigned int i = 0; i < n_layers; i++){
+        enabled[i] = all;
+    }
+    for(const char *p = list; *p; ){
+        if(!isdigit(*p)){
+            p++;
+            continue;
+        }
+        unsigned int layer = strtoul(p, (char **)&p, 10);
+        if(layer < n_layers){
+            enabled[layer] = true;
+        }
+    }
+}
+
+// split [0, rows) into contiguous chunks, one per thread, fn(row_st, row_ed)
+void parallel_rows(unsigned int rows, const std::function<void(unsigned int, unsigned int)> &fn){
+    unsigned int n_threads = std::min(cpu_num_threads(), rows);
+    if(n_threads <= 1){
+        fn(0, rows);
+        return;
+    }
+    std::vector<std::thread> workers;
+    unsigned int chunk = (rows + n_threads - 1) / n_threads;
+    for(unsigned int st = 0; st < rows; st += chunk){
+        workers.push_back(std::thread(fn, st, std::min(rows, st + chunk)));
+    }
+    for(auto &t : workers){
+        t.join();
+    }
+}
+
+// HWC; stride = 1; padding = same; square filter, filters are [num_filter][fs][fs][channel]
+// the channel loop accumulates into LANES partial sums which are reduced in order at
+// the end, i.e., the same summation order as conv2d_mk (1), conv2d_vec8_mk (8) and 
+// conv2d_vec16_mk (16), so results match the OpenCL kernels up to FMA contraction.
+// taps are the outer loop so each input pixel is reused by all filters; as in conv2d.cl the
+// taps are not tested against the image, interior pixels take the whole window and border
+// pixels the clipped one
+// CH, FS and NF > 0 replace channel, filter_size and num_filter with compile-time constants,
+// like the SPEC_* builds of conv2d.cl, so the tap and channel loops can be unrolled
+template <unsigned int LANES, unsigned int CH = 0, unsigned int FS = 0, unsigned int NF = 0>
+void conv2d_cpu_lanes(const float *input,
+                      const unsigned int height,
+                      const unsigned int width,
+                      const unsigned int channel_arg,
+                      const float *filter_values,
+                      const unsigned int filter_size_arg,
+                      const unsigned int num_filter_arg,
+                      float *output,
+                      const unsigned char relu){
+    parallel_rows(height, [&](unsigned int row_st, unsigned int row_ed){
+        // inside the worker so the constants are not read through the captures
+        const unsigned int channel = CH ? CH : channel_arg;
+        const unsigned int filter_size = FS ? FS : filter_size_arg;
+        const unsigned int num_filter = NF ? NF : num_filter_arg;
+        const int half_filter_size = filter_size / 2;
+        const unsigned int n_batch = channel / LANES;
+        const unsigned int filter_value_size = filter_size * filter_size * channel;
+        std::vector<float> acc_buf(num_filter * LANES);
+        float *acc = acc_buf.data();
+        // taps [kr_st, kr_ed) x [kc_st, kc_ed) of the window starting at row0, col0
+        auto accumulate = [&](int row0, int col0, int kr_st, int kr_ed, int kc_st, int kc_ed){
+            for(int krow = kr_st; krow < kr_ed; krow++)
+                for(int kcol = kc_st; kcol < kc_ed; kcol++){
+                    const float *in_px = input + (size_t)channel * width * (row0 + krow) + (size_t)channel * (col0 + kcol);
+                    const float *w_px  = filter_values + channel * filter_size * krow + channel * kcol;
+                    for(unsigned int kf = 0; kf < num_filter; kf++){
+                        const float *w_kf = w_px + kf * filter_value_size;
+                        // local copy so the partial sums stay in registers
+                        float acc_kf[LANES];
+                        for(unsigned int l = 0; l < LANES; l++){
+                            acc_kf[l] = acc[kf * LANES + l];
+                        }
+                        for(unsigned int batch = 0; batch < n_batch; batch++)
+                            for(unsigned int l = 0; l < LANES; l++){
+                                acc_kf[l] += in_px[batch * LANES + l] * w_kf[batch * LANES + l];
+                        }
+                        for(unsigned int l = 0; l < LANES; l++){
+                            acc[kf * LANES + l] = acc_kf[l];
+                        }
+                    }
+            }
+        };
+        for(int row = row_st; row < (int)row_ed; row++)
+            for(int col = 0; col < (int)width; col++){
+                std::fill(acc_buf.begin(), acc_buf.end(), 0.0f);
+                const int row0 = row - half_filter_size, col0 = col - half_filter_size;
+                const int kr_st = std::max(0, -row0), kr_ed = std::min((int)filter_size, (int)height - row0);
+                const int kc_st = std::max(0, -col0), kc_ed = std::min((int)filter_size, (int)width - col0);
+                if(kr_st == 0 && kc_st == 0 && kr_ed == (int)filter_size && kc_ed == (int)filter_size){
+                    accumulate(row0, col0, 0, filter_size, 0, filter_size);
+                }else{
+                    accumulate(row0, col0, kr_st, kr_ed, kc_st, kc_ed);
+                }
+                float *out_px = output + (size_t)num_filter * width * row + (size_t)num_filter * col;
+                for(unsigned int kf = 0; kf < num_filter; kf++){
+                    float pixel_conv = acc[kf * LANES];
+                    for(unsigned int l = 1; l < LANES; l++){
+                        pixel_conv += acc[kf * LANES + l];
+                    }
+                    out_px[kf] = (relu != 0) ? std::max(0.0f, pixel_conv) : pixel_conv;
+                }
+        }
+    });
+}
 
-void upsample_cpu(float *input,
+// conv shapes of the TomoGAN generator as (channel, filter size, filters), which conv2d_cpu
+// runs on instantiations of conv2d_cpu_lanes specialized for them
+#define TOMOGAN_CONV_SHAPES(X) \
+    X(3, 1, 8) X(8, 3, 32) X(32, 3, 32) X(32, 3, 64) X(64, 3, 64) X(64, 3, 128) X(128, 3, 128) \
+    X(256, 3, 64) X(128, 3, 32) X(64, 3, 32) X(32, 1, 16) X(16, 1, 1)
+
+// conv2d_cpu_lanes for the shape when it is in TOMOGAN_CONV_SHAPES and specialized is set
+template <unsigned int LANES>
+void conv2d_cpu_dispatch(const float *input,
+                         const unsigned int height,
+                         const unsigned int width,
+                         const unsigned int channel,
+                         const float *filter_values,
+                         const unsigned int filter_size,
+                         const unsigned int num_filter,
+                         float *output,
+                         const unsigned char relu,
+                         const bool specialized){
+#define TOMOGAN_CONV_SPEC(CH, FS, NF) \
+    if(specialized && channel == CH && filter_size == FS && num_filter == NF){ \
+        conv2d_cpu_lanes<LANES, CH, FS, NF>(input, height, width, channel, filter_values, filter_size, num_filter, output, relu); \
+        return; \
+    }
+    TOMOGAN_CONV_SHAPES(TOMOGAN_CONV_SPEC)
+#undef TOMOGAN_CONV_SPEC
+    conv2d_cpu_lanes<LANES>(input, height, width, channel, filter_values, filter_size, num_filter, output, relu);
+}
+
+void conv2d_cpu(const float *input,
+                const unsigned int height,
+                const unsigned int width,
+                const unsigned int channel,
+                const float *filter_values,
+                const unsigned int filter_size,
+                const unsigned int num_filter,
+                float *output,
+                const unsigned char relu,
+                const unsigned int lanes,
+                const bool specialized = true){
+    if(lanes == 16 && channel % 16 == 0){
+        conv2d_cpu_dispatch<16>(input, height, width, channel, filter_values, filter_size, num_filter, output, relu, specialized);
+    }else if(lanes == 8 && channel % 8 == 0){
+        conv2d_cpu_dispatch<8>(input, height, width, channel, filter_values, filter_size, num_filter, output, relu, specialized);
+    }else{
+        conv2d_cpu_dispatch<1>(input, height, width, channel, filter_values, filter_size, num_filter, output, relu, specialized);
+    }
+}
+
+// height and width are for the output (pooled) image, same as the maxpooling2d kernel;
+// these ops only move or compare elements, so they also run on the uint8 tensors of the
+// INT8 engine (quantize.hpp)
+template <typename T>
+void maxpooling_cpu(const T *input,
+                    const unsigned int height,
+                    const unsigned int width,
+                    const unsigned int channel,
+                    T *output){
+    parallel_rows(height, [&](unsigned int row_st, unsigned int row_ed){
+        const size_t uwidth = 2 * width;
+        for(size_t r = row_st; r < row_ed; r++)
+            for(size_t c = 0; c < width; c++){
+                const T *in00 = input + (uwidth * 2 * r + 2 * c) * channel;
+                const T *in10 = in00 + uwidth * channel;
+                T *out_px = output + (width * r + c) * channel;
+                for(unsigned int ch = 0; ch < channel; ch++){
+                    T pixel = in00[ch];
+                    pixel = std::max(pixel, in10[ch]);
+                    pixel = std::max(pixel, in00[channel + ch]);
+                    pixel = std::max(pixel, in10[channel + ch]);
+                    out_px[ch] = pixel;
+                }
+        }
+    });
+}
+
+template <typename T>
+void upsample_cpu(T *input,
                   const unsigned int height,
                   const unsigned int width,
                   const unsigned int channel,
-                  float    *output){
+                  T        *output){
     for(size_t r = 0; r < height; r++)
         for(size_t c = 0; c < width; c++){
             unsigned int urow = 2 * r;
@@ -14,7 +230,7 @@ void upsample_cpu(float *input,
             unsigned int uwidth = 2 * width;
             unsigned int uheight= 2 * height;
             for(unsigned int ch = 0; ch < channel; ch++){
-                float pixel = input[width * r * channel + c * channel + ch];
+                T pixel = input[width * r * channel + c * channel + ch];
                 output[uwidth * urow     * channel + ucol     * channel + ch] = pixel;  // [urow][ucol][ch] 
                 output[uwidth * (urow+1) * channel + ucol     * channel + ch] = pixel;  // [urow+1][ucol][ch] 
                 output[uwidth * urow     * channel + (ucol+1) * channel + ch] = pixel;  // [urow][ucol+1][ch]
@@ -25,21 +241,51 @@ void upsample_cpu(float *input,
 
 }
 
-void concatenate(float *input1,
-                 float *input2,
+template <typename T>
+void concatenate(T *input1,
+                 T *input2,
                  unsigned int height,
                  unsigned int width,
                  unsigned int channel1,
                  unsigned int channel2,
-                 float *output){
+                 T *output){
 
     unsigned int channel_out = channel1 + channel2;
     for (int r = 0; r < height; ++r)
         for (int c = 0; c < width; ++c){
             std::memcpy(output + channel_out * width * r + channel_out * c, \
-                   input1 + channel1 * width * r + channel1 * c, sizeof(float) * channel1);
+                   input1 + channel1 * width * r + channel1 * c, sizeof(T) * channel1);
 
             std::memcpy(output + channel_out * width * r + channel_out * c + channel1, \
-                   input2 + channel2 * width * r + channel2 * c, sizeof(float) * channel2);
+                   input2 + channel2 * width * r + channel2 * c, sizeof(T) * channel2);
         }
-}
\ No newline at end of file
+}
+
+// row-parallel wrappers, rows of HWC tensors are independent for both ops
+template <typename T>
+void upsample_cpu_mt(T *input,
+                     const unsigned int height,
+                     const unsigned int width,
+                     const unsigned int channel,
+                     T        *output){
+    parallel_rows(height, [&](unsigned int row_st, unsigned int row_ed){
+        upsample_cpu(input + (size_t)width * channel * row_st, row_ed - row_st, width, channel, \
+                     output + (size_t)4 * width * channel * row_st);
+    });
+}
+
+template <typename T>
+void concatenate_mt(T *input1,
+                    T *input2,
+                    unsigned int height,
+                    unsigned int width,
+                    unsigned int channel1,
+                    unsigned int channel2,
+                    T *output){
+    parallel_rows(height, [&](unsigned int row_st, unsigned int row_ed){
+        concatenate(input1 + (size_t)width * channel1 * row_st, input2 + (size_t)width * channel2 * row_st, \
+                    row_ed - row_st, width, channel1, channel2, output + (size_t)width * (channel1 + channel2) * row_st);
+    });
+}
+
+#endif
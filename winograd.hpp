@@ -0,0 +1,233 @@
+#ifndef TOMOGAN_WINOGRAD_HPP
+#define TOMOGAN_WINOGRAD_HPP
+
+#include <vector>
+#include <algorithm>
+
+#include "utils.hpp"
+#include "conv_gemm.hpp"
+
+// Winograd F(m x m, 3 x 3) for the 3x3 layers: with alpha = m + 2, the output tile is
+// Y = A^T [ (G g G^T) .* (B^T d B) ] A for an alpha x alpha input tile d and filter g.
+// Filters are transformed once at load time into U[alpha^2][C][NF]; per tile, the products
+// over channels are alpha^2 independent GEMMs [tiles][C] x [C][NF].
+// F(2x2) needs 16 instead of 36 multiplies per output pixel and channel, F(4x4) 36 instead
+// of 144 but with larger transform constants and so larger rounding errors.
+struct winograd_matrices{
+    unsigned int m;
+    unsigned int alpha;
+    float G[6 * 3];   // alpha x 3
+    float BT[6 * 6];  // alpha x alpha
+    float AT[4 * 6];  // m x alpha
+};
+
+winograd_matrices winograd_f2(){
+    winograd_matrices wm = {2, 4,
+        {1.0f,  0.0f, 0.0f,
+         0.5f,  0.5f, 0.5f,
+         0.5f, -0.5f, 0.5f,
+         0.0f,  0.0f, 1.0f},
+        {1.0f,  0.0f, -1.0f,  0.0f,
+         0.0f,  1.0f,  1.0f,  0.0f,
+         0.0f, -1.0f,  1.0f,  0.0f,
+         0.0f,  1.0f,  0.0f, -1.0f},
+        {1.0f, 1.0f,  1.0f,  0.0f,
+         0.0f, 1.0f, -1.0f, -1.0f}};
+    return wm;
+}
+
+winograd_matrices winograd_f4(){
+    winograd_matrices wm = {4, 6,
+        { 1.0f/4,   0.0f,     0.0f,
+         -1.0f/6,  -1.0f/6,  -1.0f/6,
+         -1.0f/6,   1.0f/6,  -1.0f/6,
+          1.0f/24,  1.0f/12,  1.0f/6,
+          1.0f/24, -1.0f/12,  1.0f/6,
+          0.0f,     0.0f,     1.0f},
+        {4.0f,  0.0f, -5.0f,  0.0f, 1.0f, 0.0f,
+         0.0f, -4.0f, -4.0f,  1.0f, 1.0f, 0.0f,
+         0.0f,  4.0f, -4.0f, -1.0f, 1.0f, 0.0f,
+         0.0f, -2.0f, -1.0f,  2.0f, 1.0f, 0.0f,
+         0.0f,  2.0f, -1.0f, -2.0f, 1.0f, 0.0f,
+         0.0f,  4.0f,  0.0f, -5.0f, 0.0f, 1.0f},
+        {1.0f, 1.0f,  1.0f, 1.0f,  1.0f, 0.0f,
+         0.0f, 1.0f, -1.0f, 2.0f, -2.0f, 0.0f,
+         0.0f, 1.0f,  1.0f, 4.0f,  4.0f, 0.0f,
+         0.0f, 1.0f, -1.0f, 8.0f, -8.0f, 1.0f}};
+    return wm;
+}
+
+// filters [num_filter][3][3][channel] -> U[alpha^2][channel][num_filter], U = G g G^T
+std::vector<float> winograd_transform_filters(const float *filter_values, unsigned int channel, unsigned int num_filter,
+                                              const winograd_matrices &wm){
+    const unsigned int alpha = wm.alpha;
+    std::vector<float> U((size_t)alpha * alpha * channel * num_filter);
+    for(unsigned int kf = 0; kf < num_filter; kf++)
+        for(unsigned int c = 0; c < channel; c++){
+            float g[9], Gg[6 * 3];
+            for(int t = 0; t < 9; t++){
+                g[t] = filter_values[((size_t)kf * 9 + t) * channel + c];
+            }
+            for(unsigned int a = 0; a < alpha; a++)
+                for(int j = 0; j < 3; j++){
+                    Gg[a * 3 + j] = wm.G[a * 3] * g[j] + wm.G[a * 3 + 1] * g[3 + j] + wm.G[a * 3 + 2] * g[6 + j];
+            }
+            for(unsigned int a = 0; a < alpha; a++)
+                for(unsigned int b = 0; b < alpha; b++){
+                    float u = Gg[a * 3] * wm.G[b * 3] + Gg[a * 3 + 1] * wm.G[b * 3 + 1] + Gg[a * 3 + 2] * wm.G[b * 3 + 2];
+                    U[((size_t)(a * alpha + b) * channel + c) * num_filter + kf] = u;
+            }
+    }
+    return U;
+}
+
+// transformed filters of one layer, each of the alpha^2 [C][NF] matrices packed into
+// GEMM_NR wide panels for gemm_micro_kernel
+struct winograd_packed_filters{
+    winograd_matrices wm;
+    unsigned int channel;
+    unsigned int num_filter;
+    unsigned int n_panels;
+    std::vector<float> values; // [alpha^2][n_panels][channel][GEMM_NR]
+};
+
+winograd_packed_filters winograd_pack_filters(const float *filter_values, unsigned int channel, unsigned int num_filter,
+                                              const winograd_matrices &wm){
+    winograd_packed_filters packed;
+    packed.wm = wm;
+    packed.channel = channel;
+    packed.num_filter = num_filter;
+    packed.n_panels = (num_filter + GEMM_NR - 1) / GEMM_NR;
+    std::vector<float> U = winograd_transform_filters(filter_values, channel, num_filter, wm);
+    const size_t e_size = (size_t)packed.n_panels * channel * GEMM_NR;
+    packed.values.assign(wm.alpha * wm.alpha * e_size, 0.0f);
+    for(unsigned int e = 0; e < wm.alpha * wm.alpha; e++)
+        for(unsigned int c = 0; c < channel; c++)
+            for(unsigned int kf = 0; kf < num_filter; kf++){
+                packed.values[e * e_size + ((size_t)(kf / GEMM_NR) * channel + c) * GEMM_NR + kf % GEMM_NR] = \
+                    U[((size_t)e * channel + c) * num_filter + kf];
+    }
+    return packed;
+}
+
+#define WINO_TB (GEMM_MR * 4) // tiles per block of work
+
+// HWC; stride = 1; padding = same; 3x3 filters transformed by winograd_pack_filters
+void conv2d_winograd_cpu(const float *input,
+                         const unsigned int height,
+                         const unsigned int width,
+                         const unsigned int channel,
+                         const winograd_packed_filters &filters,
+                         float *output,
+                         const unsigned char relu){
+    const winograd_matrices &wm = filters.wm;
+    const unsigned int m = wm.m, alpha = wm.alpha, n_e = alpha * alpha;
+    const unsigned int num_filter = filters.num_filter;
+    const unsigned int ldc = filters.n_panels * GEMM_NR;
+    const unsigned int tiles_w = (width + m - 1) / m;
+    const size_t n_tiles = (size_t)((height + m - 1) / m) * tiles_w;
+    const unsigned int n_blocks = (n_tiles + WINO_TB - 1) / WINO_TB;
+    const size_t e_size = (size_t)filters.n_panels * channel * GEMM_NR;
+    parallel_rows(n_blocks, [&](unsigned int blk_st, unsigned int blk_ed){
+        // V[e][tile strip][channel][GEMM_MR] and M[e][tile][ldc]
+        std::vector<float> v_buf((size_t)n_e * WINO_TB * channel);
+        std::vector<float> m_buf((size_t)n_e * WINO_TB * ldc);
+        std::vector<float> d((size_t)alpha * alpha * channel);
+        // transform scratch, big enough for alpha^2 channels or filters
+        std::vector<float> tmp((size_t)alpha * alpha * std::max(channel, ldc));
+        std::vector<float> v_px(channel);
+        for(unsigned int blk = blk_st; blk < blk_ed; blk++){
+            size_t tile0 = (size_t)blk * WINO_TB;
+            unsigned int n_blk_tiles = std::min((size_t)WINO_TB, n_tiles - tile0);
+            unsigned int n_strips = (n_blk_tiles + GEMM_MR - 1) / GEMM_MR;
+            // input transform V = B^T d B of every channel, tiles past the image are zero
+            for(unsigned int i = 0; i < n_strips * GEMM_MR; i++){
+                size_t tile = tile0 + i;
+                int row0 = tile / tiles_w * m - 1, col0 = tile % tiles_w * m - 1;
+                for(unsigned int a = 0; a < alpha; a++)
+                    for(unsigned int b = 0; b < alpha; b++){
+                        int in_g_row = row0 + a, in_g_col = col0 + b;
+                        float *d_px = d.data() + (size_t)(a * alpha + b) * channel;
+                        if(i >= n_blk_tiles || in_g_row < 0 || in_g_col < 0 || in_g_row >= (int)height || in_g_col >= (int)width){
+                            std::fill(d_px, d_px + channel, 0.0f);
+                        }else{
+                            memcpy(d_px, input + ((size_t)width * in_g_row + in_g_col) * channel, sizeof(float) * channel);
+                        }
+                }
+                // rows then columns, vectorized over the channels, zero coefficients skipped
+                for(unsigned int a = 0; a < alpha; a++)
+                    for(unsigned int b = 0; b < alpha; b++){
+                        float *t_px = tmp.data() + (size_t)(a * alpha + b) * channel;
+                        std::fill(t_px, t_px + channel, 0.0f);
+                        for(unsigned int k = 0; k < alpha; k++){
+                            float coef = wm.BT[a * alpha + k];
+                            const float *d_px = d.data() + (size_t)(k * alpha + b) * channel;
+                            if(coef != 0.0f){
+                                for(unsigned int c = 0; c < channel; c++) t_px[c] += coef * d_px[c];
+                            }
+                        }
+                }
+                for(unsigned int a = 0; a < alpha; a++)
+                    for(unsigned int b = 0; b < alpha; b++){
+                        std::fill(v_px.begin(), v_px.end(), 0.0f);
+                        for(unsigned int k = 0; k < alpha; k++){
+                            float coef = wm.BT[b * alpha + k];
+                            const float *t_px = tmp.data() + (size_t)(a * alpha + k) * channel;
+                            if(coef != 0.0f){
+                                for(unsigned int c = 0; c < channel; c++) v_px[c] += coef * t_px[c];
+                            }
+                        }
+                        float *v_tile = v_buf.data() + (size_t)(a * alpha + b) * WINO_TB * channel + \
+                                        (size_t)(i / GEMM_MR) * channel * GEMM_MR + i % GEMM_MR;
+                        for(unsigned int c = 0; c < channel; c++){
+                            v_tile[(size_t)c * GEMM_MR] = v_px[c];
+                        }
+                }
+            }
+            // alpha^2 GEMMs M[e] = V[e] x U[e]
+            std::fill(m_buf.begin(), m_buf.end(), 0.0f);
+            for(unsigned int e = 0; e < n_e; e++)
+                for(unsigned int p = 0; p < filters.n_panels; p++){
+                    const float *b = filters.values.data() + e * e_size + (size_t)p * channel * GEMM_NR;
+                    for(unsigned int s = 0; s < n_strips; s++){
+                        gemm_micro_kernel(channel, v_buf.data() + (size_t)e * WINO_TB * channel + (size_t)s * channel * GEMM_MR, b, \
+                                          m_buf.data() + ((size_t)e * WINO_TB + s * GEMM_MR) * ldc + p * GEMM_NR, ldc);
+                    }
+            }
+            // output transform Y = A^T M A vectorized over the filters, cropped at the image border
+            for(unsigned int i = 0; i < n_blk_tiles; i++){
+                size_t tile = tile0 + i;
+                unsigned int row0 = tile / tiles_w * m, col0 = tile % tiles_w * m;
+                for(unsigned int a = 0; a < m; a++)
+                    for(unsigned int b = 0; b < alpha; b++){
+                        float *t_px = tmp.data() + (size_t)(a * alpha + b) * ldc;
+                        std::fill(t_px, t_px + num_filter, 0.0f);
+                        for(unsigned int k = 0; k < alpha; k++){
+                            float coef = wm.AT[a * alpha + k];
+                            const float *m_px = m_buf.data() + ((size_t)(k * alpha + b) * WINO_TB + i) * ldc;
+                            if(coef != 0.0f){
+                                for(unsigned int kf = 0; kf < num_filter; kf++) t_px[kf] += coef * m_px[kf];
+                            }
+                        }
+                }
+                for(unsigned int a = 0; a < m && row0 + a < height; a++)
+                    for(unsigned int b = 0; b < m && col0 + b < width; b++){
+                        float *out_px = output + ((size_t)width * (row0 + a) + col0 + b) * num_filter;
+                        std::fill(out_px, out_px + num_filter, 0.0f);
+                        for(unsigned int k = 0; k < alpha; k++){
+                            float coef = wm.AT[b * alpha + k];
+                            const float *t_px = tmp.data() + (size_t)(a * alpha + k) * ldc;
+                            if(coef != 0.0f){
+                                for(unsigned int kf = 0; kf < num_filter; kf++) out_px[kf] += coef * t_px[kf];
+                            }
+                        }
+                        if(relu != 0){
+                            for(unsigned int kf = 0; kf < num_filter; kf++) out_px[kf] = std::max(0.0f, out_px[kf]);
+                        }
+                }
+            }
+        }
+    });
+}
+
+#endif